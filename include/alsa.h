@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_ALSA_H
+#define VIMDAW_ALSA_H
+/* build/pre/alsa.i */
+uint8_t alsa_device_path(const char *name, char *path, size_t size);
+void alsa_param_init(struct snd_pcm_hw_params *params);
+void alsa_param_mask(struct snd_pcm_hw_params *params, uint32_t param, uint32_t bit);
+void alsa_param_range(struct snd_pcm_hw_params *params, uint32_t param, uint32_t min, uint32_t max);
+uint32_t alsa_param_value(const struct snd_pcm_hw_params *params, uint32_t param);
+uint8_t alsa_hw_params(AlsaDevice *device, uint32_t format, uint32_t period_frames, uint32_t periods);
+uint8_t alsa_sw_params(AlsaDevice *device);
+void alsa_sync(AlsaDevice *device, uint32_t flags);
+void alsa_close(AlsaDevice *device);
+AlsaDevice *alsa_open(const char *name, uint32_t rate, uint32_t period_frames, uint32_t periods);
+AlsaDevice *alsa_open_env(uint32_t rate);
+uint64_t alsa_avail(const AlsaDevice *device);
+void alsa_commit(AlsaDevice *device, uint32_t frames);
+void alsa_write(AlsaDevice *device, const MixKernels *k, const float *in, uint64_t at, uint32_t frames);
+void alsa_fill_silence(AlsaDevice *device);
+void alsa_render_resampled(AudioEngine *engine, AlsaDevice *device, uint64_t at);
+void alsa_render_period(AudioEngine *engine, AlsaDevice *device);
+void alsa_recover(AudioEngine *engine, AlsaDevice *device);
+void alsa_run(AudioEngine *engine);
+void alsa_print_stats(const AudioEngine *engine, double seconds);
+void alsa_measure_run(void);
+#endif /* VIMDAW_ALSA_H */
@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_AUDIO_H
+#define VIMDAW_AUDIO_H
+/* build/pre/audio.i */
+uint8_t spsc_push(SpscQueue *queue, const AudioMessage *message);
+uint8_t spsc_full(SpscQueue *queue);
+uint8_t spsc_drained(SpscQueue *queue);
+uint8_t spsc_pop(SpscQueue *queue, AudioMessage *message);
+AudioEngine *audio_make_engine(uint32_t sample_rate, uint32_t block_frames);
+AudioGraph *audio_build_graph(AudioEngine *engine);
+void audio_load_env_plugin(AudioEngine *engine);
+void audio_free_engine(AudioEngine *engine);
+uint32_t audio_graph_workers(void);
+uint8_t audio_send(AudioEngine *engine, uint32_t type, uint32_t note, float value, uint64_t frame);
+uint8_t audio_send_pointer(AudioEngine *engine, uint32_t type, void *pointer);
+uint8_t audio_audition(AudioEngine *engine, uint32_t type, uint32_t note, float velocity, uint64_t ns);
+TempoMap *audio_tempo_map(AudioEngine *engine);
+void audio_post(AudioEngine *engine, uint32_t type, uint64_t frame, void *pointer);
+void audio_set_track(AudioEngine *engine, const NoteTrack *track);
+void audio_set_automation(AudioEngine *engine, const AutomationLane *lanes, uint32_t lane_count);
+void audio_thaw(AudioEngine *engine);
+void audio_idle(AudioEngine *engine);
+void audio_drain(AudioEngine *engine);
+void audio_retire(const AudioMessage *event);
+void audio_apply(AudioEngine *engine, const AudioMessage *message);
+void audio_render_span(AudioEngine *engine, float *left, float *right, uint32_t frames);
+void audio_graph_instrument(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void audio_graph_clips(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void audio_collect_live(AudioEngine *engine, uint32_t frames);
+void audio_record_auditions(AudioEngine *engine, uint32_t count, uint64_t stamp_min, uint64_t stamp_max, uint64_t stamp_total);
+void audio_process_block(AudioEngine *engine, float *out, uint32_t frames);
+void audio_record_block(AudioEngine *engine, const struct timespec *t0, const struct timespec *t1, uint32_t frames);
+void *audio_thread(void *arg);
+void audio_start(AudioEngine *engine);
+void audio_stop(AudioEngine *engine);
+void audio_finish(AudioEngine *engine);
+void audio_write_wav_header(FILE *file, uint32_t sample_rate, uint32_t channels, uint32_t data_bytes);
+void audio_demo_tempo_map(TempoMap *map, uint32_t sample_rate);
+uint32_t audio_demo_automation(const AudioEngine *engine, AutomationLane *lanes, AutomationPoint *points);
+void audio_load_env_automation(AudioEngine *engine);
+void audio_load_env_freeze(AudioEngine *engine, const NoteTrack *track, const TempoMap *tempo_map);
+void audio_load_env_reverb(AudioEngine *engine, uint8_t offline);
+void audio_offline_run(void);
+#endif /* VIMDAW_AUDIO_H */
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_AUTOMATION_H
+#define VIMDAW_AUTOMATION_H
+/* build/pre/automation.i */
+Automation *automation_make(const AutomationLane *lanes, uint32_t lane_count, uint32_t block_frames);
+void automation_free(Automation *automation);
+uint32_t automation_search(const AutomationLane *lane, uint64_t frame);
+uint8_t automation_straight(float curve);
+float automation_value(const AutomationLane *lane, uint32_t cursor, uint64_t frame);
+void automation_fill(const AutomationLane *lane, const MixKernels *k, uint32_t cursor, uint64_t frame, float *out, uint32_t n);
+uint8_t automation_moves(const AutomationLane *lane, uint64_t end);
+void automation_render(AutomationLane *lane, const MixKernels *k, uint64_t frame, uint32_t frames);
+void automation_run(Automation *automation, const MixKernels *k, uint64_t frame, uint32_t frames, uint8_t playing);
+void automation_apply(const Automation *automation, const MixKernels *k, uint32_t node, float *left, float *right, uint32_t frames);
+void automation_bench_run(void);
+#endif /* VIMDAW_AUTOMATION_H */
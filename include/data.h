@@ -21,13 +21,173 @@
 #ifndef WAR_DATA_H
 #define WAR_DATA_H
 
+#include <clap/clap.h>
+#include <pthread.h>
+#include <sound/asound.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+enum {
+    max_frames_in_flight = 2,
+};
+
+enum {
+    layer_octave_bands = 0,
+    layer_grid = 1,
+    layer_key_sidebar = 2,
+    layer_static_count = 3,
+};
+
+enum {
+    note_ticks_per_beat = 960,
+    note_block_size = 64, // notes per index block, a power of two
+    note_flag_selected = 1 << 0,
+    note_flag_muted = 1 << 1,
+    note_flag_deleted = 1 << 7, // internal, only set during a batch delete
+};
+
+typedef struct {
+    uint32_t start; // ticks
+    uint32_t length;
+    uint8_t pitch;
+    uint8_t velocity;
+    uint8_t flags;
+} Note;
+
+// one track's notes as parallel arrays sorted by start; fixed-size blocks
+// keep the max end and pitch range of their notes, and a max-end segment
+// tree over the blocks skips everything that cannot overlap a query
+typedef struct NoteTrack {
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* start;
+    uint32_t* length;
+    uint8_t* pitch;
+    uint8_t* velocity;
+    uint8_t* flags;
+    uint32_t block_count;
+    uint32_t block_capacity;
+    uint32_t* block_max_end;
+    uint8_t* block_pitch_min;
+    uint8_t* block_pitch_max;
+    uint32_t tree_leaves; // power of two >= block_count
+    uint32_t* tree_max_end; // 2 * tree_leaves, root at 1
+} NoteTrack;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    float scroll_x; // pixels
+    float scroll_y; // pixels
+    float cell_width;  // pixels per grid cell
+    float cell_height; // pixels per semitone
+    uint32_t cells_per_beat;
+    uint32_t beats_per_bar;
+    uint32_t sidebar_width;
+    uint32_t cursor_col;
+    uint32_t cursor_row;
+    float playhead_col;
+    uint32_t selection_col;
+    uint32_t selection_row;
+    uint32_t selection_cols; // 0 when nothing is selected
+    uint32_t selection_rows;
+    float seconds_per_cell; // audio clip scale, from the tempo
+    const NoteTrack* notes; // drawn in the dynamic layer, may be NULL
+} PianoRollView;
+
+typedef struct {
+    uint32_t frame;
+    float scroll_x;
+    float scroll_y;
+    float cell_width;
+    float cell_height;
+} HeadlessKeyframe;
+
+enum {
+    waveform_base_samples = 64, // samples per peak at level 0
+    waveform_level_factor = 4,  // each level merges this many peaks
+    waveform_max_levels = 12,
+    max_waveforms = 64,
+    max_waveform_clips = 256,
+    waveform_buffer_peaks = 1 << 22, // shared storage buffer, 64 MiB
+};
+
+// std430 vec4 in the storage buffer
+typedef struct {
+    float min;
+    float max;
+    float rms;
+    float pad;
+} WaveformPeak;
+
+// min/max/rms pyramid of one audio file, all levels back to back
+typedef struct {
+    uint64_t sample_count; // frames
+    uint32_t sample_rate;
+    uint32_t level_count;
+    uint32_t level_offsets[waveform_max_levels]; // in peaks
+    uint32_t level_counts[waveform_max_levels];
+    uint32_t peak_count;
+    WaveformPeak* peaks;
+    uint32_t gpu_base; // first peak in the storage buffer
+} WaveformPyramid;
+
+// placement on the timeline, drawn under the notes
+typedef struct {
+    uint32_t waveform;
+    float start_col;
+    uint32_t row;
+    uint32_t rows;
+} WaveformClip;
+
+// matches the push constant block in waveform.vert.glsl/waveform.frag.glsl
+typedef struct {
+    float rect[4]; // x, y, w, h in pixels
+    float color[4];
+    float target[2];
+    float first_peak;
+    float peaks_per_pixel;
+    uint32_t level_offset;
+    uint32_t level_count;
+} WaveformPush;
+
+enum {
+    overlay_playhead = 0,
+    overlay_cursor = 1,
+    overlay_selection = 2,
+    overlay_meter_left = 3, // master peak, at the right edge
+    overlay_meter_right = 4,
+    overlay_loudness = 5, // master short-term loudness across both
+    overlay_spectrum = 6, // master spectrum, overlay_spectrum_bands bars
+    overlay_spectrum_bands = 16,
+    overlay_count = overlay_spectrum + overlay_spectrum_bands,
+};
+
+enum {
+    overlay_meter_width = 6, // pixels
+    overlay_band_width = 8,
+    overlay_band_low_hz = 40,
+    overlay_band_high_hz = 16000,
+};
+
+// subsurface showing a 1x1 wl_shm buffer stretched by its wp_viewport
+typedef struct {
+    uint32_t surface_id;
+    uint32_t subsurface_id;
+    uint32_t viewport_id;
+    uint32_t buffer_id;
+    // last committed placement, w == 0 while hidden
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} OverlaySurface;
+
 typedef struct {
     int dmabuf_fd;
     VkInstance instance;
@@ -37,12 +197,1126 @@ typedef struct {
     uint32_t queue_family_index;
     VkImage image;
     VkDeviceMemory memory;
-    VkCommandPool cmd_pool;
-    VkCommandBuffer cmd_buffer;
+    VkImageView image_view;
     VkRenderPass render_pass;
+    VkRenderPass load_render_pass;
     VkFramebuffer frame_buffer;
+    uint32_t width;
+    uint32_t height;
+    VkImageLayout final_layout;
+    // per-frame pools are reset in bulk, never per buffer
+    uint32_t frame_index;
+    VkFence frame_fences[max_frames_in_flight];
+    VkCommandPool frame_cmd_pools[max_frames_in_flight];
+    VkCommandBuffer frame_cmd_buffers[max_frames_in_flight];
+    VkCommandBuffer dynamic_cmd_buffers[max_frames_in_flight];
+    VkQueryPool query_pool; // NULL when the queue has no timestamps
+    float timestamp_period; // ns per tick
+    // headless only
+    VkBuffer readback_buffer;
+    VkDeviceMemory readback_memory;
+    uint8_t* readback_pixels;
+    // static layers, re-recorded only when their view inputs change
+    VkCommandPool static_cmd_pool;
+    VkCommandBuffer static_cmd_buffers[layer_static_count];
+    uint8_t static_layer_valid[layer_static_count];
+    PianoRollView static_view;
     VkPipeline pipeline;
     VkPipelineLayout pipeline_layout;
+    // audio clips; pipeline is NULL when the shaders are missing
+    VkPipeline waveform_pipeline;
+    VkPipelineLayout waveform_pipeline_layout;
+    VkDescriptorSetLayout waveform_set_layout;
+    VkDescriptorPool waveform_descriptor_pool;
+    VkDescriptorSet waveform_set;
+    VkBuffer waveform_buffer;
+    VkDeviceMemory waveform_memory;
+    WaveformPeak* waveform_mapped;
+    uint32_t waveform_peaks_used;
+    WaveformPyramid waveforms[max_waveforms];
+    uint32_t waveform_count;
+    WaveformClip waveform_clips[max_waveform_clips];
+    uint32_t waveform_clip_count;
 } VulkanContext;
 
+enum {
+    audio_sample_rate = 48000,
+    audio_block_frames = 128,
+    audio_channels = 2,
+    audio_max_block_frames = 4096,
+    audio_queue_capacity = 1024, // power of two
+    audio_idle_ms = 50,          // longest the UI leaves the engine's events
+    audio_tempo_map_pool = 8,    // tempo maps in flight to the audio thread
+};
+
+// audio_build_graph adds these first, in this order; lanes and tools can
+// name them until tracks have nodes of their own
+enum {
+    audio_node_instrument = 0,
+    audio_node_clips = 1,
+    audio_node_master = 2,
+    audio_node_inserts = 3, // the plugin, then the sandboxed one
+};
+
+// the generated project's lanes, see audio_demo_automation
+enum {
+    audio_demo_lanes = 4,
+    audio_demo_points = 27,
+};
+
+enum {
+    audio_cmd_play = 0,
+    audio_cmd_stop = 1,
+    audio_cmd_seek = 2,    // frame
+    audio_cmd_tempo = 3,   // value = bpm
+    audio_cmd_note_on = 4, // note, value = velocity 0..1
+    audio_cmd_note_off = 5,
+    audio_cmd_gain = 6, // value = linear gain
+    audio_cmd_set_track = 7,     // pointer = NoteTrack snapshot
+    audio_cmd_set_tempo_map = 8, // pointer = TempoMap, copied
+    audio_cmd_set_graph = 9,     // pointer = AudioGraph
+    audio_cmd_set_automation = 10, // pointer = Automation for the graph
+};
+
+// the position is not an event: see AudioEngine.position
+enum {
+    audio_event_late = 1,     // frame = blocks that missed their deadline
+    audio_event_dropped = 2,  // frame = events lost to a full queue
+    audio_event_retire = 3,   // pointer is no longer read by the audio thread
+    audio_event_xrun = 4,     // frame = device underruns so far
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t note;
+    float value;
+    uint64_t frame;
+    void* pointer;
+} AudioMessage;
+
+// single producer, single consumer; head and tail on separate cache lines
+typedef struct {
+    uint32_t head __attribute__((aligned(64))); // written by the consumer
+    uint32_t tail __attribute__((aligned(64))); // written by the producer
+    AudioMessage slots[audio_queue_capacity] __attribute__((aligned(64)));
+} SpscQueue;
+
+// fixed-size objects from one locked block, for anything a real-time
+// thread hands over or takes back. Lock-free: the free list head is an
+// index (plus one, 0 when empty) tagged with a counter against ABA
+typedef struct {
+    uint8_t* slots;
+    uint32_t* next; // index + 1 of the slot below, 0 at the bottom
+    uint32_t stride;
+    uint32_t capacity;
+    uint64_t head __attribute__((aligned(64)));
+    uint32_t in_use __attribute__((aligned(64)));
+    uint32_t high_water;
+    uint64_t exhausted; // gets that found the pool empty
+} Pool;
+
+enum {
+    synth_lanes = 16, // voices per simd group
+    synth_max_voices = 512,
+    synth_groups = synth_max_voices / synth_lanes,
+    synth_chunk = 32, // frames between envelope stage checks
+};
+
+enum {
+    synth_stage_off = 0,
+    synth_stage_attack = 1,
+    synth_stage_decay = 2,
+    synth_stage_sustain = 3,
+    synth_stage_release = 4,
+};
+
+// voice state as structure of arrays so a lane group loads with one vector
+// move per field; lane l of group g is voice g * synth_lanes + l
+typedef struct {
+    float phase[synth_max_voices] __attribute__((aligned(64)));
+    float step[synth_max_voices] __attribute__((aligned(64)));
+    float inv_step[synth_max_voices] __attribute__((aligned(64)));
+    float level[synth_max_voices] __attribute__((aligned(64))); // envelope
+    float target[synth_max_voices] __attribute__((aligned(64)));
+    float rate[synth_max_voices] __attribute__((aligned(64)));
+    float gain[synth_max_voices] __attribute__((aligned(64)));  // velocity
+    float filter[synth_max_voices] __attribute__((aligned(64))); // lowpass
+    float cutoff[synth_max_voices] __attribute__((aligned(64)));
+    float lanes[synth_chunk * synth_lanes] __attribute__((aligned(64)));
+    uint8_t stage[synth_max_voices];
+    uint8_t pitch[synth_max_voices];
+    uint32_t serial[synth_max_voices]; // note-on order, for stealing
+    uint32_t group_active[synth_groups];
+    uint32_t active;
+    uint32_t next_serial;
+    uint32_t sample_rate;
+    float attack_rate;
+    float decay_rate;
+    float sustain;
+    float release_rate;
+} Synth;
+
+enum {
+    max_tempo_points = 256,
+    max_block_events = 256,
+    max_pending_offs = 512,
+};
+
+typedef struct {
+    uint32_t tick;
+    float bpm;
+} TempoPoint;
+
+// constant tempo from tick on; sample is where the segment starts
+typedef struct {
+    uint32_t tick;
+    double sample;
+    double samples_per_tick;
+} TempoSegment;
+
+// tick <-> sample is one lookup and one multiply-add; lookups remember the
+// last segment since playback walks forward
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t count;
+    uint32_t cached;
+    TempoSegment segments[max_tempo_points];
+} TempoMap;
+
+enum {
+    sequencer_event_off = 0, // offs sort before ons at the same offset
+    sequencer_event_on = 1,
+};
+
+typedef struct {
+    uint32_t offset; // frames into the block
+    uint8_t type;
+    uint8_t pitch;
+    uint8_t velocity;
+} SequencerEvent;
+
+typedef struct {
+    uint64_t sample;
+    uint8_t pitch;
+} PendingOff;
+
+// audio thread only; the track is an immutable snapshot published by the UI
+typedef struct {
+    const NoteTrack* track;
+    uint32_t next_note;
+    uint8_t needs_seek;
+    uint8_t deferred; // notes before next_note's time are owed, not passed
+    PendingOff offs[max_pending_offs]; // min-heap on sample
+    uint32_t off_count;
+    SequencerEvent events[max_block_events];
+    uint32_t event_count;
+    uint64_t late_notes;    // played at a later block start, relaxed atomic
+    uint64_t dropped_notes; // no room for their offs, relaxed atomic
+} Sequencer;
+
+enum {
+    mix_isa_scalar = 0,
+    mix_isa_sse2 = 1,
+    mix_isa_avx2 = 2, // with fma
+    mix_isa_avx512 = 3,
+    mix_isa_count = 4,
+};
+
+enum {
+    mix_biquad_step = 8, // samples per matrix step, see mix_biquad_design
+    mix_biquad_rows = mix_biquad_step + 4,
+};
+
+// one second-order section, a0 normalized away. m is the same filter as a
+// matrix from the next step's inputs and the state (x1, x2, y1, y2) to
+// its outputs, so a step is independent multiply-adds, not a recurrence
+typedef struct {
+    float b0;
+    float b1;
+    float b2;
+    float a1;
+    float a2;
+    float m[mix_biquad_rows][mix_biquad_step] __attribute__((aligned(64)));
+} MixBiquad;
+
+// one table per instruction set, picked at startup from what the cpu has
+typedef struct {
+    uint32_t isa;
+    const char* name;
+    void (*gain)(float* buf, float gain, uint32_t n);
+    void (*add)(float* dst, const float* src, float gain, uint32_t n);
+    void (*pan_add)(const float* src,
+                    float* left,
+                    float* right,
+                    float gain_left,
+                    float gain_right,
+                    uint32_t n);
+    void (*interleave)(const float* left,
+                       const float* right,
+                       float* out,
+                       uint32_t frames);
+    void (*deinterleave)(const float* in,
+                         float* left,
+                         float* right,
+                         uint32_t frames);
+    void (*to_s16)(const float* in, int16_t* out, uint32_t n);
+    void (*from_s16)(const int16_t* in, float* out, uint32_t n);
+    void (*to_s32)(const float* in, int32_t* out, uint32_t n);
+    // automation: out[i] = start + step * i, out[i] = base + first *
+    // ratio^i, buf[i] *= gains[i], and pan -1..1 to square-root law gains
+    void (*ramp)(float* out, float start, float step, uint32_t n);
+    void (*curve)(float* out, float base, float first, float ratio, uint32_t n);
+    void (*mul)(float* buf, const float* gains, uint32_t n);
+    void (*pan_law)(const float* pan, float* left, float* right, uint32_t n);
+    // metering: *peak = max(*peak, |x|), *sum += x^2; and a biquad run in
+    // place over both channels, state is x1, x2, y1, y2 for each
+    void (*meter)(const float* buf, float* peak, float* sum, uint32_t n);
+    void (*biquad)(float* left,
+                   float* right,
+                   const MixBiquad* filter,
+                   float* state,
+                   uint32_t n);
+    // convolution: acc += x * h over split complex spectra
+    void (*cmac)(float* acc_re,
+                 float* acc_im,
+                 const float* x_re,
+                 const float* x_im,
+                 const float* h_re,
+                 const float* h_im,
+                 uint32_t n);
+} MixKernels;
+
+enum {
+    sampler_max_files = 64,
+    sampler_max_clips = 256,
+    sampler_max_streams = 64,
+    sampler_ring_frames = 1 << 15, // power of two, ~0.7 s at 48 kHz
+    sampler_chunk_frames = 4096,   // largest single fill
+    sampler_io_period_ns = 2000000,
+};
+
+enum {
+    sampler_stream_idle = 0, // owned by the io thread
+    sampler_stream_live = 1, // io thread writes, audio thread reads
+    sampler_stream_done = 2, // audio thread finished; io thread recycles
+};
+
+// a mapped PCM16 or float32 WAV; nothing is read until a stream needs it
+typedef struct {
+    const uint8_t* data;
+    void* map;
+    size_t map_size;
+    uint32_t channels;
+    uint32_t bits;
+    uint32_t sample_rate;
+    uint64_t frames;
+} SampleFile;
+
+// frames [offset, offset + length) of a file at timeline frame start
+typedef struct {
+    uint32_t file;
+    uint64_t start;
+    uint64_t offset;
+    uint64_t length;
+    float gain;
+} SamplerClip;
+
+// one clip being played from its ring; start is the timeline frame of
+// ring frame 0, write and read count frames from there
+typedef struct {
+    uint32_t state;
+    uint32_t clip;
+    uint64_t start;
+    size_t released; // map bytes below this are already unmapped
+    uint64_t write __attribute__((aligned(64))); // io thread
+    uint64_t read __attribute__((aligned(64)));  // audio thread
+    float left[sampler_ring_frames] __attribute__((aligned(64)));
+    float right[sampler_ring_frames] __attribute__((aligned(64)));
+} SamplerStream;
+
+// clips are append-only and published by clip_count
+typedef struct {
+    SampleFile files[sampler_max_files];
+    uint32_t file_count;
+    SamplerClip clips[sampler_max_clips];
+    uint32_t clip_count;
+    uint32_t clip_stream[sampler_max_clips]; // io thread only
+    SamplerStream streams[sampler_max_streams];
+    uint64_t transport; // audio thread -> io thread
+    uint64_t expected;  // audio thread only
+    uint64_t underruns; // frames played as silence
+    uint32_t running;
+    pthread_t thread;
+    size_t page_size;
+    MixKernels kernels;
+    float scratch[sampler_chunk_frames * 2]; // io thread only
+} Sampler;
+
+enum {
+    max_graph_nodes = 1024, // power of two, also the deque capacity
+    max_graph_edges = 4096,
+    max_graph_workers = 16, // including the audio thread
+    graph_spin_iterations = 4096,
+    graph_max_tasks = 0xffff, // per graph_exec, the width of its claim index
+};
+
+enum {
+    stats_magic = 0x53524157, // "WARS"
+    stats_version = 1,
+    stats_buckets = 32, // bucket b counts times in [2^b, 2^(b+1)) ns
+    stats_max_name = 48,
+    stats_max_path = 256,
+};
+
+// one graph node; written only by the thread running it that block
+typedef struct {
+    char name[stats_max_name];
+    uint64_t calls;
+    uint64_t ns_total;
+    uint64_t ns_max;
+    uint64_t ns_last;
+    uint64_t histogram[stats_buckets];
+} StatsNode;
+
+// a file anyone can map read-only, see tools/war-top.c. Counters only
+// grow, with relaxed stores from their one writer; node names change
+// with the graph, inside an odd generation
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t sample_rate;
+    uint32_t generation;
+    uint32_t node_count;
+    uint64_t blocks;
+    uint64_t misses; // blocks that took longer than their own length
+    uint64_t block_ns_total;
+    uint64_t block_ns_max;
+    uint64_t block_ns_last;
+    uint64_t budget_ns_total; // the blocks' lengths, summed
+    uint64_t block_histogram[stats_buckets];
+    StatsNode nodes[max_graph_nodes];
+} StatsPage;
+
+enum {
+    automation_volume = 0, // linear gain on a graph node's output
+    automation_pan = 1,    // -1 left to 1 right, square-root law
+    automation_param = 2,  // a parameter of the node's CLAP plugin
+    automation_max_lanes = 1024,
+    automation_param_step = 32, // frames between parameter events, moving
+    automation_curve_run = 32,  // frames a curve's series runs unrestarted
+};
+
+// the shape from this point to the next: 0 is a straight line, positive
+// starts slow and ends fast, negative the other way round
+typedef struct {
+    uint64_t frame;
+    float value;
+    float curve;
+} AutomationPoint;
+
+typedef struct {
+    uint32_t target; // automation_volume, _pan or _param
+    uint32_t node;   // graph node it drives
+    uint32_t param;  // clap param id, automation_param only
+    uint32_t count;
+    AutomationPoint* points; // sorted by frame
+    // audio thread, per block: a lane that is not moving holds value for
+    // the whole block and values is not written
+    uint32_t cursor; // first point after the block start
+    uint8_t moving;
+    float value;         // at the block start
+    float gains[2];      // pan lanes: value through the pan law
+    float* values;       // block_frames, while moving
+    float* pan_gains[2]; // pan lanes: values through the pan law
+    float sent;          // automation_param: what the plugin last got
+} AutomationLane;
+
+// an immutable set of lanes built by the UI for one graph, ordered by
+// node; the audio thread only touches the per-block state. Sent like a track
+// snapshot and retired the same way
+typedef struct {
+    AutomationLane* lanes;
+    uint32_t lane_count;
+    uint32_t block_frames;
+    uint16_t lane_begin[max_graph_nodes + 1]; // node n's lanes start here
+    uint64_t next_frame; // where the cursors are; anything else seeks
+    uint8_t located;
+    AutomationPoint* points;
+    float* values;
+} Automation;
+
+enum {
+    fft_lanes = 8,         // butterflies per vector once a span is this wide
+    fft_max_size = 1 << 16, // real samples
+};
+
+// real transforms of one power-of-two size through a complex one of half
+// that, split re/im. Spectra are half + 1 bins, dc to nyquist
+typedef struct {
+    uint32_t size;
+    uint32_t half;
+    uint32_t* reverse;   // half: bit-reversed index
+    float* twiddle_re;   // half: span h's factors at [h, 2h)
+    float* twiddle_im;
+    float* untangle_re;  // half / 2 + 1: e^(-2 pi i k / size)
+    float* untangle_im;
+} Fft;
+
+enum {
+    meter_sub_ms = 100,   // loudness is summed in 100 ms sub-blocks
+    meter_rms = 3,        // sub-blocks per rms reading, 300 ms
+    meter_momentary = 4,  // 400 ms
+    meter_short_term = 30, // 3 s, also the ring size
+    meter_fresh = 4,      // in a triple buffer's middle: not read yet
+    meter_floor_db = -70,
+    spectrum_size = 2048,
+    spectrum_bins = spectrum_size / 2 + 1,
+    spectrum_hop = spectrum_size / 2,
+};
+
+// what the UI draws for one node: linear sample peak and mean squares per
+// channel, loudness as the K-weighted mean square summed over channels.
+// meter_db and meter_lufs turn them into numbers
+typedef struct {
+    float peak[2];  // over the last one or two sub-blocks
+    float power[2]; // meter_rms sub-blocks
+    float momentary;
+    float short_term;
+} MeterReading;
+
+// triple buffer: the writer fills its back slot and swaps it with middle,
+// the reader swaps front with middle only when middle is fresh. Neither
+// side ever waits and the reader always has the latest whole reading
+typedef struct {
+    MeterReading slots[3];
+    uint32_t middle __attribute__((aligned(64))); // slot | meter_fresh
+    uint32_t front __attribute__((aligned(64)));  // reader only
+} MeterShared;
+
+// one node's running sums, written only by whichever worker runs it
+typedef struct {
+    float filter[2][8];    // per stage: biquad state, both channels
+    float peak[2];         // this sub-block
+    float last_peak[2];    // the one before
+    float sum[2];          // squares, this sub-block
+    float k_sum;           // K-weighted squares, both channels
+    float sums[meter_rms][2];
+    float k_sums[meter_short_term];
+    uint32_t filled; // frames in this sub-block
+    uint32_t subs;   // sub-blocks done
+    uint32_t back;   // triple buffer slot being written
+} MeterNode;
+
+typedef struct {
+    float power[spectrum_bins]; // |X|^2 of the windowed, scaled frame
+} SpectrumReading;
+
+// a Hann-windowed transform of the master every hop, same hand-off
+typedef struct {
+    Fft fft;
+    float window[spectrum_size];
+    float ring[spectrum_size]; // mono, oldest at write
+    uint32_t write;
+    uint32_t filled; // frames since the last transform
+    float frame[spectrum_size];
+    float re[spectrum_bins];
+    float im[spectrum_bins];
+    float scale; // bin power to a sine's mean square times two
+    SpectrumReading slots[3];
+    uint32_t back;
+    uint32_t middle __attribute__((aligned(64)));
+    uint32_t front __attribute__((aligned(64)));
+} Spectrum;
+
+// every graph node is metered on the worker that ran it, right after it
+// ran; readings are indexed by node like the graph's buffers
+typedef struct {
+    MixBiquad k_weighting[2]; // shelf, then high-pass
+    uint32_t sample_rate;
+    uint32_t sub_frames;
+    MeterNode nodes[max_graph_nodes];
+    MeterShared shared[max_graph_nodes];
+    float scratch[max_graph_workers][2][audio_max_block_frames]
+        __attribute__((aligned(64)));
+    Spectrum spectrum;
+} Meters;
+
+enum {
+    reverb_max = 8,           // convolvers at once, see audio_load_env_reverb
+    reverb_head_frames = 128, // partitions run by the graph
+    reverb_tail_ratio = 16,   // a tail partition is this many head ones
+    reverb_tail_frames = reverb_head_frames * reverb_tail_ratio,
+    // the head covers the first two tail partitions' worth of response,
+    // which is the time the tail thread gets for each of its own
+    reverb_head_count = 2 * reverb_tail_ratio,
+    reverb_tail_start = 2 * reverb_tail_frames,
+    reverb_tail_slots = 4, // chunks in flight each way
+    reverb_max_seconds = 20,
+    reverb_max_name = 64,
+    reverb_priority = 60, // under the graph workers
+};
+
+// one uniformly partitioned stretch of an impulse response, overlap-save
+// over windows of two partitions. Spectra are size + 1 bins padded to
+// stride, [channel][partition][stride]. rest is what the partitions
+// before the current one add to its output, summed once the last one
+// completes, so an output needs one product however long the stretch
+typedef struct {
+    Fft fft; // 2 * size
+    uint32_t size;
+    uint32_t count;
+    uint32_t stride;
+    float* filter_re;
+    float* filter_im;
+    float* line_re; // input spectra, a ring; newest is the last whole one
+    float* line_im;
+    uint32_t newest;
+    uint32_t fill;  // frames of the current partition so far
+    float* window;  // [channel][2 * size]: last partition, then current
+    float* rest_re; // [channel][stride]
+    float* rest_im;
+    float* sum_re; // [stride], scratch
+    float* sum_im;
+    float* out; // 2 * size, the inverse's
+} ReverbSegment;
+
+// a stereo convolution reverb as a graph node, with no latency. The head
+// runs in the node; the tail takes the input a chunk of
+// reverb_tail_frames at a time on its own thread and has until the chunk
+// is reverb_tail_start frames old to hand its output back. posted and
+// done are futex words; a side only sleeps after saying so
+typedef struct {
+    char name[reverb_max_name];
+    uint32_t sample_rate;
+    uint64_t ir_frames;
+    uint8_t wait; // offline: wait for a late tail instead of dropping it
+    MixKernels kernels; // the tail thread's
+    ReverbSegment head;
+    ReverbSegment tail; // count 0: a short response, no thread
+    pthread_t thread;
+    uint64_t frame;   // through the node so far, audio side
+    uint8_t playing;  // the tail chunk being played arrived in time
+    uint64_t late_chunks; // played without their tail
+    uint32_t resets;  // tail thread fell behind and started over
+    uint64_t tail_ns; // tail thread, summed
+    uint32_t posted __attribute__((aligned(64))); // chunks, audio side
+    uint32_t tail_sleeping;
+    uint32_t quit;
+    uint32_t done __attribute__((aligned(64))); // chunks, tail thread
+    uint32_t host_sleeping;
+    uint32_t tags[reverb_tail_slots]; // chunk + 1 once its output is in
+    float tail_in[reverb_tail_slots][2][reverb_tail_frames]
+        __attribute__((aligned(64)));
+    float tail_out[reverb_tail_slots][2][reverb_tail_frames]
+        __attribute__((aligned(64)));
+    float in_left[audio_max_block_frames] __attribute__((aligned(64)));
+    float in_right[audio_max_block_frames] __attribute__((aligned(64)));
+} Reverb;
+
+struct AudioGraph;
+// fills the node's own output from its inputs' outputs
+typedef void (*GraphProcess)(void* state,
+                             struct AudioGraph* graph,
+                             uint32_t node,
+                             uint32_t frames);
+
+typedef struct {
+    GraphProcess process; // NULL sums the inputs
+    void* state;
+    float gain;
+    float cost;       // relative, for placement only
+    uint32_t latency; // frames the output lags the inputs, see graph_compile
+    const char* name; // for profiling, may be NULL
+} GraphNodeDesc;
+
+// built on the UI thread, then compiled into an AudioGraph
+typedef struct {
+    GraphNodeDesc nodes[max_graph_nodes];
+    uint32_t node_count;
+    uint32_t edge_from[max_graph_edges];
+    uint32_t edge_to[max_graph_edges];
+    uint32_t edge_count;
+    uint32_t output;
+} GraphDesc;
+
+// compiled and immutable apart from pending and block_start_ns; inputs and
+// successors are
+// index ranges into one array each, and each worker has a list of source
+// nodes it starts from, heaviest critical path first
+typedef struct AudioGraph {
+    uint32_t node_count;
+    uint32_t output;
+    uint32_t block_frames;
+    uint32_t workers;
+    const MixKernels* kernels;
+    GraphNodeDesc* nodes;
+    uint32_t* input_begin; // node_count + 1
+    uint32_t* inputs;
+    uint32_t* successor_begin; // node_count + 1
+    uint32_t* successors;
+    uint32_t* dependencies;
+    uint32_t* pending; // per block, counts down to ready
+    uint32_t* source_begin; // workers + 1
+    uint32_t* sources;
+    float* buffers; // node n: left at 2n, right at 2n + 1, block_frames each
+    // delay compensation: every input i is held back by delay[i] so all of
+    // a node's inputs line up with its latest one. Lines are rings of
+    // delay + block_frames per channel, written by the node's thread only
+    uint32_t latency; // of the output, from the sources
+    uint32_t* delay;  // per input
+    uint32_t* delay_begin; // per input, into delay_lines
+    uint32_t* delay_write; // per input
+    float* delay_lines;
+    StatsNode* stats; // per node when profiling, see stats_attach
+    uint64_t block_start_ns; // set by graph_run, for nodes with a deadline
+} AudioGraph;
+
+// Chase-Lev: the owner pushes and pops at bottom, thieves take from top
+typedef struct {
+    int64_t top __attribute__((aligned(64)));
+    int64_t bottom __attribute__((aligned(64)));
+    uint32_t items[max_graph_nodes] __attribute__((aligned(64)));
+} GraphDeque;
+
+typedef struct {
+    uint32_t cursor __attribute__((aligned(64)));
+} GraphSourceCursor;
+
+// one of a batch run by graph_exec
+typedef void (*GraphTask)(void* context, uint32_t task);
+
+struct GraphPool;
+typedef struct {
+    struct GraphPool* pool;
+    uint32_t index;
+    pthread_t thread;
+} GraphWorker;
+
+// worker 0 is whichever thread calls graph_run; the rest wait on a futex
+typedef struct GraphPool {
+    GraphDeque deques[max_graph_workers];
+    GraphSourceCursor cursors[max_graph_workers];
+    GraphWorker workers[max_graph_workers];
+    uint32_t worker_count;
+    uint32_t generation __attribute__((aligned(64)));
+    uint32_t sleepers;
+    uint32_t open;
+    uint32_t busy;
+    uint32_t remaining __attribute__((aligned(64)));
+    AudioGraph* graph;
+    uint32_t frames;
+    Automation* automation; // this block's lanes, may be NULL
+    Meters* meters;         // may be NULL
+    uint32_t running;
+    uint8_t realtime;
+    // graph_exec: one batch at a time. claim is batch << 32 | count << 16 |
+    // next, so a stale claim from the last batch can never succeed
+    uint64_t task_claim __attribute__((aligned(64)));
+    uint32_t task_done __attribute__((aligned(64)));
+    uint32_t task_busy;
+    GraphTask task;
+    void* task_context;
+} GraphPool;
+
+enum {
+    export_window_frames = 4096, // a multiple of audio_block_frames
+    export_slots = 16,           // windows in flight, each one write
+    export_track_states = 4,     // segments of one track rendered at once
+    export_tail_seconds = 2,     // longest release the synth can ring for
+    export_align = 4096,         // O_DIRECT offsets, sizes and buffers
+    max_export_workers = 64,
+};
+
+// a track with no notes plays the sampler's clips
+typedef struct {
+    const NoteTrack* notes;
+    float gain_left;
+    float gain_right;
+} ExportTrack;
+
+// what to bounce: only the tracks listed, in this order into the master
+typedef struct {
+    const char* path;
+    uint32_t sample_rate;
+    uint64_t frames;
+    const TempoMap* tempo_map;
+    const ExportTrack* tracks;
+    uint32_t track_count;
+    const Sampler* sampler; // clips, may be NULL
+    uint32_t workers;       // 0 is one per core
+} ExportDesc;
+
+// instrument state for one segment of a track
+typedef struct {
+    Synth synth;
+    Sequencer sequencer;
+    TempoMap tempo_map;
+} ExportState;
+
+// a track splits into segments where nothing of it is sounding; each
+// segment starts from fresh state, so segments render in parallel.
+// next[k] is the window state k may render next, a futex word
+typedef struct {
+    uint32_t* segment; // per window
+    uint32_t* segment_start;
+    uint32_t segment_count;
+    ExportState* states; // export_track_states
+    uint32_t next[export_track_states];
+} ExportTrackRun;
+
+struct Export;
+typedef struct {
+    struct Export* export;
+    pthread_t thread;
+    float voice[audio_block_frames] __attribute__((aligned(64)));
+    float left[sampler_chunk_frames] __attribute__((aligned(64)));
+    float right[sampler_chunk_frames] __attribute__((aligned(64)));
+    float scratch[sampler_chunk_frames * 2];
+} ExportWorker;
+
+// tasks are (window, track) pairs handed out window by window, so every
+// wait is on work that was handed out earlier. Window w lives in slot
+// w % export_slots until the writer has it on disk
+typedef struct Export {
+    const ExportDesc* desc;
+    MixKernels kernels;
+    uint32_t window_count;
+    uint64_t task_count;
+    ExportTrackRun* runs;
+    float* track_buffers; // [slot][track][left, right][window]
+    float* ring;          // interleaved, export_slots windows
+    uint32_t pending[export_slots]; // tracks still to render
+    uint32_t ready[export_slots];   // window + 1 once mixed
+    uint64_t next_task __attribute__((aligned(64)));
+    uint32_t written __attribute__((aligned(64))); // windows on disk
+    int fd;
+    uint8_t direct;
+    ExportWorker* workers;
+    uint32_t worker_count;
+    pthread_t writer;
+    uint64_t write_bytes;
+    double write_seconds;
+} Export;
+
+enum {
+    freeze_version = 1, // part of every key: bump when rendering changes
+    freeze_max_path = 4096,
+};
+
+// what a frozen track plays: the instrument's notes over the tempo map,
+// and the lanes on the instrument and its inserts. The plugin comes from
+// the engine
+typedef struct {
+    const NoteTrack* track;
+    const TempoMap* tempo_map;
+    const AutomationLane* lanes; // any node; only the chain's are used
+    uint32_t lane_count;
+} FreezeDesc;
+
+// the instrument and its inserts rendered once, to a file named by a hash
+// of everything the render depends on. The parts the UI can change are
+// kept so a change to any of them thaws the track. UI side, but sampler
+// and latency are read by the frozen node
+typedef struct {
+    uint64_t key;
+    uint64_t notes_key;
+    uint64_t tempo_key;
+    uint64_t lanes_key;
+    float gain; // the instrument's, see audio_cmd_gain
+    uint64_t frames;
+    uint32_t latency; // of the chain, kept by the frozen node
+    uint8_t active;   // the graph plays the file instead of the chain
+    Sampler* sampler;
+    char path[freeze_max_path];
+} Freeze;
+
+enum {
+    resample_quality_fast = 0,
+    resample_quality_good = 1,
+    resample_quality_high = 2,
+    resample_quality_best = 3,
+    resample_quality_count = 4,
+};
+
+enum {
+    resample_lanes = 16, // rows are padded to whole vectors
+    resample_max_phases = 1024,
+    resample_max_taps = 256,
+    // a block on top of up to a block's worth of outputs still unread at
+    // a 2:1 downsample, plus a window
+    resample_buffer_frames = 3 * audio_max_block_frames + resample_max_taps,
+    resample_chunk_frames = 4096, // offline conversion
+    resample_max_path = 4096,
+};
+
+// rational polyphase: output n sits at input n * step / phases, and its
+// row is (n * step) mod phases. Input is buffered with a lead-in of
+// taps / 2 - 1 zeros so output 0 is centred on input 0
+typedef struct {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint32_t quality;
+    uint32_t phases;
+    uint32_t step;
+    uint32_t taps; // per row
+    float* bank;   // phases rows of taps, 64-byte aligned
+    uint32_t phase; // row of the next output
+    uint32_t read;  // first frame of its window
+    uint32_t fill;  // frames buffered
+    float left[resample_buffer_frames] __attribute__((aligned(64)));
+    float right[resample_buffer_frames] __attribute__((aligned(64)));
+} Resampler;
+
+enum {
+    alsa_default_periods = 2,
+    alsa_max_cards = 32,
+    alsa_max_path = 64,
+    alsa_poll_timeout_ms = 1000,
+};
+
+// a kernel PCM in mmap mode. status and control are the driver's own
+// pages when it lets them be mapped, else they live in sync and are
+// exchanged with SNDRV_PCM_IOCTL_SYNC_PTR
+typedef struct {
+    int fd;
+    char path[alsa_max_path];
+    uint32_t rate;
+    uint32_t channels;
+    uint32_t format; // SNDRV_PCM_FORMAT_*
+    uint32_t frame_bytes;
+    uint32_t period_frames;
+    uint32_t buffer_frames;
+    uint64_t boundary; // appl_ptr and hw_ptr wrap here
+    uint8_t* buffer;
+    size_t buffer_bytes;
+    size_t page_size;
+    struct snd_pcm_mmap_status* status;
+    struct snd_pcm_mmap_control* control;
+    struct snd_pcm_sync_ptr* sync; // NULL when the pages are mapped
+    // engine rate to device rate when the card cannot run at the former
+    Resampler* resampler;
+    float resample_left[audio_max_block_frames];
+    float resample_right[audio_max_block_frames];
+} AlsaDevice;
+
+// written by the audio thread with relaxed stores, read by anyone
+typedef struct {
+    uint64_t callbacks;
+    uint64_t xruns;
+    uint64_t dsp_ns_last;
+    uint64_t dsp_ns_max;
+    uint64_t dsp_ns_total;
+    uint64_t period_ns;
+    uint32_t period_frames;
+    uint32_t buffer_frames;
+    uint32_t latency_frames; // queued plus in the hardware, last callback
+    float load;              // dsp time over the period, smoothed
+    float load_max;
+    // key stamp to the block that plays it, see audio_audition
+    uint64_t auditions;
+    uint64_t audition_ns_last;
+    uint64_t audition_ns_max;
+    uint64_t audition_ns_total;
+    uint64_t audition_late; // blocks where one waited over a period
+} AudioStats;
+
+enum {
+    midi_max_raw = 8,
+    midi_read_bytes = 4096,
+    midi_poll_timeout_ms = 100,
+    midi_thread_priority = 75, // above the audio thread: it only stamps
+};
+
+// running status across reads; sysex and realtime bytes are skipped
+typedef struct {
+    uint8_t status;
+    uint8_t count;
+    uint8_t data[2];
+    uint8_t sysex;
+} MidiParser;
+
+// the sequencer port is a virtual port anything can connect to; raw
+// devices are read as bytes. Events go to the engine's midi queue
+struct AudioEngine;
+typedef struct {
+    struct AudioEngine* engine;
+    int seq_fd;
+    int seq_client;
+    int seq_port;
+    int raw_fds[midi_max_raw];
+    MidiParser parsers[midi_max_raw];
+    uint32_t raw_count;
+    pthread_t thread;
+    uint32_t running;
+    uint64_t events;
+    uint64_t dropped;
+} MidiInput;
+
+enum {
+    plugin_channels = 2, // one stereo port each way
+    plugin_max_param_events = 256, // per block, from automation
+};
+
+// a CLAP plugin as a graph node. host is the first member, so host_data
+// and the instance are one pointer. Its process runs on whichever worker
+// takes the node; thread-pool requests fan out over the same workers.
+// Notes come from events, the engine's live input for now, parameters
+// from the automation lanes on its node
+typedef struct {
+    clap_host_t host;
+    clap_host_thread_pool_t host_thread_pool;
+    clap_host_latency_t host_latency;
+    void* library;
+    const clap_plugin_entry_t* entry;
+    const clap_plugin_t* plugin;
+    const clap_plugin_thread_pool_t* thread_pool;
+    const clap_plugin_latency_t* latency_ext;
+    GraphPool* pool; // may be NULL: tasks run on the caller
+    uint32_t sample_rate;
+    uint32_t max_frames;
+    uint32_t latency;
+    uint32_t inputs; // audio ports, 0 for an instrument
+    uint32_t outputs;
+    uint8_t active;
+    uint8_t processing;
+    uint8_t restarting; // UI side: out of the graph until plugin_restart
+    int64_t steady_time;
+    // set from any thread, handled by plugin_idle on the UI thread
+    uint32_t request_restart;
+    uint32_t request_callback;
+    uint32_t latency_changed;
+    const SequencerEvent* events;
+    const uint32_t* event_count;
+    clap_event_note_t notes[max_block_events];
+    uint32_t note_count;
+    clap_event_param_value_t params[plugin_max_param_events];
+    uint32_t param_count;
+    // notes and params merged by time, what the plugin reads
+    const clap_event_header_t* in_order[max_block_events +
+                                        plugin_max_param_events];
+    uint32_t in_count;
+    clap_input_events_t in_events;
+    clap_output_events_t out_events;
+    float* in_channels[plugin_channels];
+    float* out_channels[plugin_channels];
+    float in_left[audio_max_block_frames] __attribute__((aligned(64)));
+    float in_right[audio_max_block_frames] __attribute__((aligned(64)));
+} PluginInstance;
+
+enum {
+    sandbox_max_path = 4096,
+    sandbox_max_id = 256,
+    sandbox_max_name = 128,
+    sandbox_spin_iterations = 4096, // each side, before sleeping, if there
+                                    // is another core to answer on
+    sandbox_setup_timeout_ms = 10000,
+    sandbox_quit_timeout_ms = 1000,
+    sandbox_priority = 70, // the graph workers'
+    sandbox_budget_percent = 50, // of a block, from when the graph started
+                                 // it, that the child's answer may take
+};
+
+// the one page set both processes map. request and done are futex
+// words: the host posts block n by storing it in request, the child
+// answers by storing n in done. A side only sleeps after saying so in
+// its sleeping word, so the other only calls FUTEX_WAKE when needed
+typedef struct {
+    uint32_t request __attribute__((aligned(64)));
+    uint32_t child_sleeping;
+    uint32_t quit;
+    uint32_t done __attribute__((aligned(64)));
+    uint32_t host_sleeping;
+    uint32_t frames __attribute__((aligned(64)));
+    uint32_t event_count;
+    SequencerEvent events[max_block_events];
+    float in[plugin_channels][audio_max_block_frames]
+        __attribute__((aligned(64)));
+    float out[plugin_channels][audio_max_block_frames]
+        __attribute__((aligned(64)));
+} SandboxShared;
+
+// sent with the memfd, and the child's answer
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t max_frames;
+    char path[sandbox_max_path];
+    char id[sandbox_max_id]; // empty for the first plugin
+} SandboxSetup;
+
+typedef struct {
+    uint32_t ok;
+    uint32_t latency;
+    char name[sandbox_max_name];
+} SandboxReply;
+
+// a plugin in a child process, as a graph node. A block the child has not
+// answered within its own length plays silence, and so does every block
+// after until it catches up, or for good once it is dead
+typedef struct {
+    pid_t pid;
+    int socket;
+    SandboxShared* shared;
+    uint32_t sample_rate;
+    uint32_t latency;
+    char name[sandbox_max_name];
+    uint32_t spin; // iterations before sleeping
+    uint32_t budget_percent; // see sandbox_budget_percent
+    uint32_t request; // last block posted
+    uint32_t dead;
+    uint64_t late_blocks;
+    const SequencerEvent* events;
+    const uint32_t* event_count;
+} SandboxPlugin;
+
+// everything the audio thread touches is allocated before it starts
+typedef struct AudioEngine {
+    SpscQueue commands; // ui -> audio
+    SpscQueue events;   // audio -> ui
+    SpscQueue midi;     // midi thread -> audio, frame = CLOCK_MONOTONIC ns
+    SpscQueue audition; // ui keys -> audio, the same
+    pthread_t thread;
+    uint32_t running;
+    uint8_t realtime; // SCHED_FIFO granted
+    uint32_t sample_rate;
+    uint32_t block_frames;
+    uint8_t playing;
+    uint64_t frame;
+    float tempo_bpm;
+    float gain;
+    uint64_t late_blocks;
+    uint64_t dropped_events; // never retires, see audio_process_block
+    uint64_t position; // frame after the last playing block, relaxed atomic
+    uint8_t graph_stale; // UI side, see audio_idle
+    TempoMap tempo_map;
+    Sequencer sequencer;
+    Synth synth;
+    Sampler* sampler;    // optional, set before audio_start
+    AlsaDevice* device;  // optional, set before audio_start
+    PluginInstance* plugin; // optional, after the instrument, see
+                            // audio_build_graph
+    SandboxPlugin* sandbox; // the same, in a child process
+    Automation* automation; // audio thread, see audio_cmd_set_automation
+    Freeze* freeze; // optional, set before audio_start, see freeze_open
+    Meters* meters; // every node and the master's spectrum, see meter_read
+    Reverb* reverbs[reverb_max]; // sends from the instrument and clips
+    uint32_t reverb_count;
+    AudioStats stats;
+    StatsPage* profile; // per node, mapped for tools, see stats_open
+    char profile_path[stats_max_path];
+    // live input lands at the offset in this block that its timestamp had
+    // in the last one
+    uint64_t block_ns;
+    SequencerEvent live_events[max_block_events];
+    uint32_t live_count;
+    MixKernels kernels;
+    AudioGraph* graph;
+    GraphPool pool;
+    Pool tempo_maps; // see audio_tempo_map
+    // the synth renders mono into voice_buffer before it is panned into
+    // its graph node; mix is the graph output interleaved for the device
+    float voice_buffer[audio_max_block_frames] __attribute__((aligned(64)));
+    float mix[audio_max_block_frames * audio_channels];
+} AudioEngine;
+
 #endif // WAR_DATA_H
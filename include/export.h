@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_EXPORT_H
+#define VIMDAW_EXPORT_H
+/* build/pre/export.i */
+void export_wait(uint32_t *word, uint32_t seen);
+void export_wake(uint32_t *word);
+void export_plan_track(Export *export, uint32_t t);
+void export_render_span(ExportWorker *worker, ExportState *state, const ExportTrack *track, float *left, float *right, uint32_t frames);
+void export_render_notes(ExportWorker *worker, uint32_t t, uint32_t w, float *left, float *right);
+void export_render_clips(ExportWorker *worker, uint32_t w, float *left, float *right);
+float *export_track_buffer(Export *export, uint32_t slot, uint32_t t);
+void export_mix_window(Export *export, uint32_t w);
+void *export_worker_thread(void *arg);
+void export_wav_header(uint8_t *h, uint32_t sample_rate, uint32_t channels, uint64_t data_bytes);
+void export_write(Export *export, const void *data, size_t bytes, off_t at);
+void *export_writer_thread(void *arg);
+uint8_t export_run(const ExportDesc *desc);
+uint8_t export_demo_run(void);
+#endif /* VIMDAW_EXPORT_H */
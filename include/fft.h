@@ -0,0 +1,19 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_FFT_H
+#define VIMDAW_FFT_H
+/* build/pre/fft.i */
+float *fft_alloc(uint32_t count);
+void fft_make(Fft *fft, uint32_t size);
+void fft_free(Fft *fft);
+void fft_first_spans(float *re, float *im, uint32_t half);
+void fft_butterflies(const Fft *fft, float *re, float *im);
+void fft_forward(const Fft *fft, const float *in, float *re, float *im);
+void fft_inverse(const Fft *fft, float *re, float *im, float *out);
+void fft_bench_run(void);
+#endif /* VIMDAW_FFT_H */
@@ -0,0 +1,26 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_FREEZE_H
+#define VIMDAW_FREEZE_H
+/* build/pre/freeze.i */
+uint64_t freeze_hash(uint64_t hash, const void *data, size_t size);
+uint64_t freeze_hash_begin(void);
+uint64_t freeze_key_notes(const NoteTrack *track);
+uint64_t freeze_key_tempo(const TempoMap *map);
+uint8_t freeze_chain_node(uint32_t node);
+uint64_t freeze_key_lanes(const AutomationLane *lanes, uint32_t lane_count);
+uint64_t freeze_key_plugin(const AudioEngine *engine);
+uint32_t freeze_chain_latency(const AudioEngine *engine);
+uint64_t freeze_frames(const AudioEngine *engine, const FreezeDesc *desc);
+uint8_t freeze_dir(char *dir, size_t size);
+uint8_t freeze_render(const AudioEngine *engine, const FreezeDesc *desc, uint64_t frames, const char *path);
+uint8_t freeze_load(Freeze *freeze);
+Freeze *freeze_open(const AudioEngine *engine, const FreezeDesc *desc);
+void freeze_free(Freeze *freeze);
+void freeze_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+#endif /* VIMDAW_FREEZE_H */
@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_GRAPH_H
+#define VIMDAW_GRAPH_H
+/* build/pre/graph.i */
+void graph_desc_init(GraphDesc *desc);
+uint32_t graph_add_node(GraphDesc *desc, GraphProcess process, void *state, float gain, float cost);
+void graph_set_latency(GraphDesc *desc, uint32_t node, uint32_t frames);
+void graph_set_name(GraphDesc *desc, uint32_t node, const char *name);
+void graph_connect(GraphDesc *desc, uint32_t from, uint32_t to);
+AudioGraph *graph_compile(const GraphDesc *desc, uint32_t block_frames, uint32_t workers, const MixKernels *kernels);
+void graph_free(AudioGraph *graph);
+float *graph_left(AudioGraph *graph, uint32_t node);
+float *graph_right(AudioGraph *graph, uint32_t node);
+void graph_deque_push(GraphDeque *deque, uint32_t item);
+uint8_t graph_deque_pop(GraphDeque *deque, uint32_t *item);
+uint8_t graph_deque_steal(GraphDeque *deque, uint32_t *item);
+void graph_delay_add(AudioGraph *graph, uint32_t k, float *left, float *right, float gain, uint32_t frames);
+void graph_gather(AudioGraph *graph, uint32_t node, float *left, float *right, float gain, uint32_t frames);
+void graph_sum(AudioGraph *graph, uint32_t node, uint32_t frames);
+void graph_run_node(GraphPool *pool, AudioGraph *graph, uint32_t worker, uint32_t node);
+uint8_t graph_claim_source(GraphPool *pool, AudioGraph *graph, uint32_t list, uint32_t *node);
+uint8_t graph_take(GraphPool *pool, AudioGraph *graph, uint32_t worker, uint32_t *node);
+void graph_work(GraphPool *pool, AudioGraph *graph, uint32_t worker);
+void *graph_worker_thread(void *arg);
+void graph_pool_start(GraphPool *pool, uint32_t workers, uint8_t realtime);
+void graph_pool_stop(GraphPool *pool);
+void graph_run(GraphPool *pool, AudioGraph *graph, uint32_t frames);
+uint8_t graph_help(GraphPool *pool);
+void graph_exec(GraphPool *pool, GraphTask task, void *context, uint32_t count);
+void graph_bench_synth(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void graph_bench_run(void);
+#endif /* VIMDAW_GRAPH_H */
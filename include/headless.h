@@ -0,0 +1,15 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_HEADLESS_H
+#define VIMDAW_HEADLESS_H
+/* build/pre/headless.i */
+void headless_run(void);
+uint32_t headless_load_camera(const char *path, HeadlessKeyframe *keyframes, uint32_t max);
+void headless_camera(const HeadlessKeyframe *keyframes, uint32_t count, uint32_t frame, PianoRollView *view);
+void headless_write_ppm(const char *path, const uint8_t *pixels, uint32_t width, uint32_t height);
+#endif /* VIMDAW_HEADLESS_H */
@@ -51,4 +51,9 @@ static inline void write_le16(uint8_t* p, uint16_t v) {
     p[1] = (uint8_t)(v >> 8);
 }
 
+// wl_fixed_t: signed 24.8
+static inline int32_t float_to_fixed(float v) { return (int32_t)(v * 256.0f); }
+
+static inline float fixed_to_float(int32_t v) { return (float)v / 256.0f; }
+
 #endif
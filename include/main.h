@@ -8,10 +8,390 @@
 #ifndef VIMDAW_MAIN_H
 #define VIMDAW_MAIN_H
 /* build/pre/main.i */
+uint8_t alsa_device_path(const char *name, char *path, size_t size);
+void alsa_param_init(struct snd_pcm_hw_params *params);
+void alsa_param_mask(struct snd_pcm_hw_params *params, uint32_t param, uint32_t bit);
+void alsa_param_range(struct snd_pcm_hw_params *params, uint32_t param, uint32_t min, uint32_t max);
+uint32_t alsa_param_value(const struct snd_pcm_hw_params *params, uint32_t param);
+uint8_t alsa_hw_params(AlsaDevice *device, uint32_t format, uint32_t period_frames, uint32_t periods);
+uint8_t alsa_sw_params(AlsaDevice *device);
+void alsa_sync(AlsaDevice *device, uint32_t flags);
+void alsa_close(AlsaDevice *device);
+AlsaDevice *alsa_open(const char *name, uint32_t rate, uint32_t period_frames, uint32_t periods);
+AlsaDevice *alsa_open_env(uint32_t rate);
+uint64_t alsa_avail(const AlsaDevice *device);
+void alsa_commit(AlsaDevice *device, uint32_t frames);
+void alsa_write(AlsaDevice *device, const MixKernels *k, const float *in, uint64_t at, uint32_t frames);
+void alsa_fill_silence(AlsaDevice *device);
+void alsa_render_resampled(AudioEngine *engine, AlsaDevice *device, uint64_t at);
+void alsa_render_period(AudioEngine *engine, AlsaDevice *device);
+void alsa_recover(AudioEngine *engine, AlsaDevice *device);
+void alsa_run(AudioEngine *engine);
+void alsa_print_stats(const AudioEngine *engine, double seconds);
+void alsa_measure_run(void);
+uint8_t spsc_push(SpscQueue *queue, const AudioMessage *message);
+uint8_t spsc_full(SpscQueue *queue);
+uint8_t spsc_drained(SpscQueue *queue);
+uint8_t spsc_pop(SpscQueue *queue, AudioMessage *message);
+AudioEngine *audio_make_engine(uint32_t sample_rate, uint32_t block_frames);
+AudioGraph *audio_build_graph(AudioEngine *engine);
+void audio_load_env_plugin(AudioEngine *engine);
+void audio_free_engine(AudioEngine *engine);
+uint32_t audio_graph_workers(void);
+uint8_t audio_send(AudioEngine *engine, uint32_t type, uint32_t note, float value, uint64_t frame);
+uint8_t audio_send_pointer(AudioEngine *engine, uint32_t type, void *pointer);
+uint8_t audio_audition(AudioEngine *engine, uint32_t type, uint32_t note, float velocity, uint64_t ns);
+TempoMap *audio_tempo_map(AudioEngine *engine);
+void audio_post(AudioEngine *engine, uint32_t type, uint64_t frame, void *pointer);
+void audio_set_track(AudioEngine *engine, const NoteTrack *track);
+void audio_set_automation(AudioEngine *engine, const AutomationLane *lanes, uint32_t lane_count);
+void audio_thaw(AudioEngine *engine);
+void audio_idle(AudioEngine *engine);
+void audio_drain(AudioEngine *engine);
+void audio_retire(const AudioMessage *event);
+void audio_apply(AudioEngine *engine, const AudioMessage *message);
+void audio_render_span(AudioEngine *engine, float *left, float *right, uint32_t frames);
+void audio_graph_instrument(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void audio_graph_clips(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void audio_collect_live(AudioEngine *engine, uint32_t frames);
+void audio_record_auditions(AudioEngine *engine, uint32_t count, uint64_t stamp_min, uint64_t stamp_max, uint64_t stamp_total);
+void audio_process_block(AudioEngine *engine, float *out, uint32_t frames);
+void audio_record_block(AudioEngine *engine, const struct timespec *t0, const struct timespec *t1, uint32_t frames);
+void *audio_thread(void *arg);
+void audio_start(AudioEngine *engine);
+void audio_stop(AudioEngine *engine);
+void audio_finish(AudioEngine *engine);
+void audio_write_wav_header(FILE *file, uint32_t sample_rate, uint32_t channels, uint32_t data_bytes);
+void audio_demo_tempo_map(TempoMap *map, uint32_t sample_rate);
+uint32_t audio_demo_automation(const AudioEngine *engine, AutomationLane *lanes, AutomationPoint *points);
+void audio_load_env_automation(AudioEngine *engine);
+void audio_load_env_freeze(AudioEngine *engine, const NoteTrack *track, const TempoMap *tempo_map);
+void audio_load_env_reverb(AudioEngine *engine, uint8_t offline);
+void audio_offline_run(void);
+Automation *automation_make(const AutomationLane *lanes, uint32_t lane_count, uint32_t block_frames);
+void automation_free(Automation *automation);
+uint32_t automation_search(const AutomationLane *lane, uint64_t frame);
+uint8_t automation_straight(float curve);
+float automation_value(const AutomationLane *lane, uint32_t cursor, uint64_t frame);
+void automation_fill(const AutomationLane *lane, const MixKernels *k, uint32_t cursor, uint64_t frame, float *out, uint32_t n);
+uint8_t automation_moves(const AutomationLane *lane, uint64_t end);
+void automation_render(AutomationLane *lane, const MixKernels *k, uint64_t frame, uint32_t frames);
+void automation_run(Automation *automation, const MixKernels *k, uint64_t frame, uint32_t frames, uint8_t playing);
+void automation_apply(const Automation *automation, const MixKernels *k, uint32_t node, float *left, float *right, uint32_t frames);
+void automation_bench_run(void);
+void export_wait(uint32_t *word, uint32_t seen);
+void export_wake(uint32_t *word);
+void export_plan_track(Export *export, uint32_t t);
+void export_render_span(ExportWorker *worker, ExportState *state, const ExportTrack *track, float *left, float *right, uint32_t frames);
+void export_render_notes(ExportWorker *worker, uint32_t t, uint32_t w, float *left, float *right);
+void export_render_clips(ExportWorker *worker, uint32_t w, float *left, float *right);
+float *export_track_buffer(Export *export, uint32_t slot, uint32_t t);
+void export_mix_window(Export *export, uint32_t w);
+void *export_worker_thread(void *arg);
+void export_wav_header(uint8_t *h, uint32_t sample_rate, uint32_t channels, uint64_t data_bytes);
+void export_write(Export *export, const void *data, size_t bytes, off_t at);
+void *export_writer_thread(void *arg);
+uint8_t export_run(const ExportDesc *desc);
+uint8_t export_demo_run(void);
+float *fft_alloc(uint32_t count);
+void fft_make(Fft *fft, uint32_t size);
+void fft_free(Fft *fft);
+void fft_first_spans(float *re, float *im, uint32_t half);
+void fft_butterflies(const Fft *fft, float *re, float *im);
+void fft_forward(const Fft *fft, const float *in, float *re, float *im);
+void fft_inverse(const Fft *fft, float *re, float *im, float *out);
+void fft_bench_run(void);
+uint64_t freeze_hash(uint64_t hash, const void *data, size_t size);
+uint64_t freeze_hash_begin(void);
+uint64_t freeze_key_notes(const NoteTrack *track);
+uint64_t freeze_key_tempo(const TempoMap *map);
+uint8_t freeze_chain_node(uint32_t node);
+uint64_t freeze_key_lanes(const AutomationLane *lanes, uint32_t lane_count);
+uint64_t freeze_key_plugin(const AudioEngine *engine);
+uint32_t freeze_chain_latency(const AudioEngine *engine);
+uint64_t freeze_frames(const AudioEngine *engine, const FreezeDesc *desc);
+uint8_t freeze_dir(char *dir, size_t size);
+uint8_t freeze_render(const AudioEngine *engine, const FreezeDesc *desc, uint64_t frames, const char *path);
+uint8_t freeze_load(Freeze *freeze);
+Freeze *freeze_open(const AudioEngine *engine, const FreezeDesc *desc);
+void freeze_free(Freeze *freeze);
+void freeze_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void graph_desc_init(GraphDesc *desc);
+uint32_t graph_add_node(GraphDesc *desc, GraphProcess process, void *state, float gain, float cost);
+void graph_set_latency(GraphDesc *desc, uint32_t node, uint32_t frames);
+void graph_set_name(GraphDesc *desc, uint32_t node, const char *name);
+void graph_connect(GraphDesc *desc, uint32_t from, uint32_t to);
+AudioGraph *graph_compile(const GraphDesc *desc, uint32_t block_frames, uint32_t workers, const MixKernels *kernels);
+void graph_free(AudioGraph *graph);
+float *graph_left(AudioGraph *graph, uint32_t node);
+float *graph_right(AudioGraph *graph, uint32_t node);
+void graph_deque_push(GraphDeque *deque, uint32_t item);
+uint8_t graph_deque_pop(GraphDeque *deque, uint32_t *item);
+uint8_t graph_deque_steal(GraphDeque *deque, uint32_t *item);
+void graph_delay_add(AudioGraph *graph, uint32_t k, float *left, float *right, float gain, uint32_t frames);
+void graph_gather(AudioGraph *graph, uint32_t node, float *left, float *right, float gain, uint32_t frames);
+void graph_sum(AudioGraph *graph, uint32_t node, uint32_t frames);
+void graph_run_node(GraphPool *pool, AudioGraph *graph, uint32_t worker, uint32_t node);
+uint8_t graph_claim_source(GraphPool *pool, AudioGraph *graph, uint32_t list, uint32_t *node);
+uint8_t graph_take(GraphPool *pool, AudioGraph *graph, uint32_t worker, uint32_t *node);
+void graph_work(GraphPool *pool, AudioGraph *graph, uint32_t worker);
+void *graph_worker_thread(void *arg);
+void graph_pool_start(GraphPool *pool, uint32_t workers, uint8_t realtime);
+void graph_pool_stop(GraphPool *pool);
+void graph_run(GraphPool *pool, AudioGraph *graph, uint32_t frames);
+uint8_t graph_help(GraphPool *pool);
+void graph_exec(GraphPool *pool, GraphTask task, void *context, uint32_t count);
+void graph_bench_synth(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void graph_bench_run(void);
+void headless_run(void);
+uint32_t headless_load_camera(const char *path, HeadlessKeyframe *keyframes, uint32_t max);
+void headless_camera(const HeadlessKeyframe *keyframes, uint32_t count, uint32_t frame, PianoRollView *view);
+void headless_write_ppm(const char *path, const uint8_t *pixels, uint32_t width, uint32_t height);
+void meter_k_weighting(MixBiquad *shelf, MixBiquad *highpass, uint32_t sample_rate);
+uint8_t meter_env(void);
+Meters *meter_make(uint32_t sample_rate);
+void meter_free(Meters *meters);
+void meter_flush(float *state, uint32_t n);
+void meter_close_sub(MeterNode *node);
+float meter_window(const float *ring, uint32_t stride, uint32_t size, uint32_t subs, uint32_t count, float partial, uint32_t filled, uint32_t sub_frames);
+void meter_publish(Meters *meters, uint32_t index);
+void meter_run(Meters *meters, const MixKernels *kernels, uint32_t worker, uint32_t index, const float *left, const float *right, uint32_t frames);
+void meter_spectrum(Meters *meters, const float *left, const float *right, uint32_t frames);
+void meter_node(Meters *meters, AudioGraph *graph, uint32_t worker, uint32_t node, uint32_t frames);
+void meter_read(Meters *meters, uint32_t node, MeterReading *reading);
+const SpectrumReading *meter_read_spectrum(Meters *meters);
+float meter_db(float amplitude);
+float meter_power_db(float power);
+float meter_lufs(float power);
+void meter_bands(const SpectrumReading *reading, uint32_t sample_rate, float low, float high, float *bands, uint32_t count);
+void meter_bench_run(void);
+uint64_t midi_now_ns(void);
+void midi_push(MidiInput *input, uint32_t type, uint8_t note, uint8_t velocity, uint64_t ns);
+void midi_parse_byte(MidiInput *input, MidiParser *parser, uint8_t byte, uint64_t ns);
+void midi_parse_seq(MidiInput *input, const uint8_t *buffer, size_t size, uint64_t ns);
+uint8_t midi_open_seq(MidiInput *input);
+uint8_t midi_open_raw(MidiInput *input, const char *name);
+void *midi_thread(void *arg);
+MidiInput *midi_start(AudioEngine *engine);
+void midi_stop(MidiInput *input);
+void mix_gain_scalar(float *buf, float gain, uint32_t n);
+void mix_add_scalar(float *dst, const float *src, float gain, uint32_t n);
+void mix_pan_add_scalar(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+void mix_interleave_scalar(const float *left, const float *right, float *out, uint32_t frames);
+void mix_deinterleave_scalar(const float *in, float *left, float *right, uint32_t frames);
+void mix_to_s16_scalar(const float *in, int16_t *out, uint32_t n);
+void mix_from_s16_scalar(const int16_t *in, float *out, uint32_t n);
+void mix_to_s32_scalar(const float *in, int32_t *out, uint32_t n);
+void mix_ramp_scalar(float *out, float start, float step, uint32_t n);
+void mix_curve_scalar(float *out, float base, float first, float ratio, uint32_t n);
+void mix_mul_scalar(float *buf, const float *gains, uint32_t n);
+void mix_pan_law_scalar(const float *pan, float *left, float *right, uint32_t n);
+void mix_meter_scalar(const float *buf, float *peak, float *sum, uint32_t n);
+void mix_biquad_scalar(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+void mix_biquad_design(MixBiquad *filter, double b0, double b1, double b2, double a1, double a2);
+void mix_cmac_scalar(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+void mix_gain_sse2(float *buf, float gain, uint32_t n);
+void mix_add_sse2(float *dst, const float *src, float gain, uint32_t n);
+void mix_pan_add_sse2(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+void mix_interleave_sse2(const float *left, const float *right, float *out, uint32_t frames);
+void mix_deinterleave_sse2(const float *in, float *left, float *right, uint32_t frames);
+void mix_to_s16_sse2(const float *in, int16_t *out, uint32_t n);
+void mix_from_s16_sse2(const int16_t *in, float *out, uint32_t n);
+void mix_to_s32_sse2(const float *in, int32_t *out, uint32_t n);
+void mix_ramp_sse2(float *out, float start, float step, uint32_t n);
+void mix_curve_sse2(float *out, float base, float first, float ratio, uint32_t n);
+void mix_mul_sse2(float *buf, const float *gains, uint32_t n);
+void mix_pan_law_sse2(const float *pan, float *left, float *right, uint32_t n);
+void mix_meter_sse2(const float *buf, float *peak, float *sum, uint32_t n);
+void mix_biquad_sse2(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+void mix_cmac_sse2(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_gain_avx2(float *buf, float gain, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_add_avx2(float *dst, const float *src, float gain, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_pan_add_avx2(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_interleave_avx2(const float *left, const float *right, float *out, uint32_t frames);
+__attribute__((target("avx2,fma"))) void mix_deinterleave_avx2(const float *in, float *left, float *right, uint32_t frames);
+__attribute__((target("avx2,fma"))) void mix_to_s16_avx2(const float *in, int16_t *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_from_s16_avx2(const int16_t *in, float *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_to_s32_avx2(const float *in, int32_t *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_ramp_avx2(float *out, float start, float step, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_curve_avx2(float *out, float base, float first, float ratio, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_mul_avx2(float *buf, const float *gains, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_pan_law_avx2(const float *pan, float *left, float *right, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_meter_avx2(const float *buf, float *peak, float *sum, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_biquad_avx2(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_cmac_avx2(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+__attribute__((target("avx512f"))) void mix_gain_avx512(float *buf, float gain, uint32_t n);
+__attribute__((target("avx512f"))) void mix_add_avx512(float *dst, const float *src, float gain, uint32_t n);
+__attribute__((target("avx512f"))) void mix_pan_add_avx512(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+__attribute__((target("avx512f"))) void mix_interleave_avx512(const float *left, const float *right, float *out, uint32_t frames);
+__attribute__((target("avx512f"))) void mix_deinterleave_avx512(const float *in, float *left, float *right, uint32_t frames);
+__attribute__((target("avx512f"))) void mix_to_s16_avx512(const float *in, int16_t *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_from_s16_avx512(const int16_t *in, float *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_to_s32_avx512(const float *in, int32_t *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_ramp_avx512(float *out, float start, float step, uint32_t n);
+__attribute__((target("avx512f"))) void mix_curve_avx512(float *out, float base, float first, float ratio, uint32_t n);
+__attribute__((target("avx512f"))) void mix_mul_avx512(float *buf, const float *gains, uint32_t n);
+__attribute__((target("avx512f"))) void mix_pan_law_avx512(const float *pan, float *left, float *right, uint32_t n);
+__attribute__((target("avx512f"))) void mix_meter_avx512(const float *buf, float *peak, float *sum, uint32_t n);
+__attribute__((target("avx512f"))) void mix_cmac_avx512(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+uint32_t mix_best_isa(void);
+uint8_t mix_kernels_for(uint32_t isa, MixKernels *kernels);
+void mix_select(MixKernels *kernels);
+double mix_bench_seconds(void);
+float mix_bench_check(const MixKernels *k, const float *a, const float *b, float *x, float *y, float *z, float *w, int16_t *s16, int32_t *s32, uint32_t n);
+void mix_bench_run(void);
+void notes_make_track(NoteTrack *track, uint32_t capacity);
+void notes_free_track(NoteTrack *track);
+void notes_reserve(NoteTrack *track, uint32_t capacity);
+uint32_t notes_lower_bound(const NoteTrack *track, uint32_t tick);
+int notes_compare(const void *a, const void *b);
+void notes_insert(NoteTrack *track, const Note *notes, uint32_t count);
+void notes_delete(NoteTrack *track, const uint32_t *indices, uint32_t count);
+void notes_update_index(NoteTrack *track, uint32_t first_changed, uint32_t old_blocks);
+uint32_t notes_query(const NoteTrack *track, uint32_t t0, uint32_t t1, uint8_t p0, uint8_t p1, uint32_t *out, uint32_t max, uint32_t *resume);
+void notes_fill_demo(NoteTrack *track, uint32_t count);
+void notes_clone(const NoteTrack *track, NoteTrack *out);
+const void *plugin_host_extension(const clap_host_t *host, const char *id);
+void plugin_host_request_restart(const clap_host_t *host);
+void plugin_host_request_process(const clap_host_t *host);
+void plugin_host_request_callback(const clap_host_t *host);
+void plugin_host_latency_changed(const clap_host_t *host);
+void plugin_exec_task(void *context, uint32_t task);
+bool plugin_host_request_exec(const clap_host_t *host, uint32_t num_tasks);
+uint32_t plugin_events_size(const clap_input_events_t *list);
+const clap_event_header_t *plugin_events_get(const clap_input_events_t *list, uint32_t index);
+bool plugin_events_push(const clap_output_events_t *list, const clap_event_header_t *event);
+uint32_t plugin_port_channels(const PluginInstance *instance, bool input);
+PluginInstance *plugin_load(const char *path, const char *id, uint32_t sample_rate, uint32_t max_frames, GraphPool *pool);
+void plugin_free(PluginInstance *instance);
+uint8_t plugin_idle(PluginInstance *instance);
+void plugin_restart(PluginInstance *instance);
+void plugin_automate(PluginInstance *instance, Automation *automation, uint32_t node, uint32_t frames);
+void plugin_process(PluginInstance *instance, float *left, float *right, float *out_left, float *out_right, uint32_t frames);
+void plugin_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void pool_make(Pool *pool, uint32_t size, uint32_t capacity);
+void pool_free(Pool *pool);
+void *pool_get(Pool *pool);
+void pool_put(Pool *pool, void *object);
+const char *resample_quality_name(uint32_t quality);
+uint32_t resample_quality_env(void);
+double resample_bessel_i0(double x);
+Resampler *resample_make(uint32_t in_rate, uint32_t out_rate, uint32_t quality);
+void resample_reset(Resampler *resampler);
+void resample_free(Resampler *resampler);
+uint32_t resample_ready(const Resampler *resampler);
+uint32_t resample_write(Resampler *resampler, const float *left, const float *right, uint32_t frames);
+__attribute__((target_clones("avx512f", "avx2", "default"))) uint32_t resample_read(Resampler *resampler, float *left, float *right, uint32_t frames);
+uint8_t resample_file(const char *path, const char *out_path, uint32_t rate, uint32_t quality);
+uint8_t resample_cached(const char *path, char *cached, size_t size, uint32_t rate);
+double resample_bench_error(const float *out, uint32_t frames, uint32_t taps, double frequency, uint32_t rate);
+double resample_bench_tone(Resampler *resampler, double frequency, float *in, float *out, uint32_t in_frames, uint32_t *out_frames);
+void resample_bench_run(void);
+void reverb_segment_make(ReverbSegment *seg, const float *left, const float *right, uint64_t frames, uint64_t offset, uint32_t size, uint32_t count);
+void reverb_segment_free(ReverbSegment *seg);
+void reverb_segment_reset(ReverbSegment *seg);
+void reverb_segment_push(ReverbSegment *seg, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t n);
+void reverb_segment_advance(ReverbSegment *seg, const MixKernels *k);
+void *reverb_thread(void *arg);
+void reverb_generate(float *left, float *right, uint64_t frames, uint32_t seed);
+void reverb_normalize(float *left, float *right, uint64_t frames);
+Reverb *reverb_make(const float *left, const float *right, uint64_t frames, uint32_t sample_rate, uint8_t wait, const char *name);
+Reverb *reverb_load(const char *source, uint32_t sample_rate, uint8_t wait);
+void reverb_free(Reverb *reverb);
+uint8_t reverb_tail_ready(Reverb *reverb, uint32_t chunk);
+void reverb_tail(Reverb *reverb, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t n);
+void reverb_process(Reverb *reverb, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t frames);
+void reverb_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void reverb_bench_run(void);
+Sampler *sampler_make(void);
+uint32_t sampler_open_file(Sampler *sampler, const char *path);
+uint8_t sampler_add_clip(Sampler *sampler, uint32_t file, uint64_t start, uint64_t offset, uint64_t length, float gain);
+void sampler_read_frames(const MixKernels *k, const SampleFile *file, uint64_t frame, uint32_t frames, float *scratch, float *left, float *right);
+void sampler_fill(Sampler *sampler, SamplerStream *stream);
+void sampler_service(Sampler *sampler);
+void *sampler_thread(void *arg);
+void sampler_start(Sampler *sampler);
+void sampler_free(Sampler *sampler);
+void sampler_locate(Sampler *sampler, uint64_t frame);
+void sampler_render(Sampler *sampler, const MixKernels *k, uint64_t frame, uint32_t frames, float *left, float *right);
+void sampler_load_env_clip(Sampler *sampler);
+uint32_t sandbox_spin(void);
+SandboxPlugin *sandbox_load(const char *path, const char *id, uint32_t sample_rate, uint32_t max_frames);
+void sandbox_free(SandboxPlugin *sandbox);
+uint8_t sandbox_idle(SandboxPlugin *sandbox);
+uint64_t sandbox_now_ns(void);
+uint8_t sandbox_wait(SandboxShared *shared, uint32_t request, uint32_t spin, uint64_t deadline_ns);
+void sandbox_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void sandbox_child_run(void);
+void sandbox_bench_source(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void sandbox_bench_run(void);
+void tempo_map_build(TempoMap *map, uint32_t sample_rate, const TempoPoint *points, uint32_t count);
+void tempo_map_constant(TempoMap *map, uint32_t sample_rate, float bpm);
+uint32_t tempo_map_find_tick(TempoMap *map, uint32_t tick);
+double tempo_map_tick_to_sample(TempoMap *map, uint32_t tick);
+double tempo_map_sample_to_tick(const TempoMap *map, double sample);
+void sequencer_push_off(Sequencer *seq, uint64_t sample, uint8_t pitch);
+PendingOff sequencer_pop_off(Sequencer *seq);
+void sequencer_emit(Sequencer *seq, uint32_t offset, uint8_t type, uint8_t pitch, uint8_t velocity);
+void sequencer_emit_offs(Sequencer *seq, uint64_t frame, uint64_t limit);
+void sequencer_reset(Sequencer *seq);
+void sequencer_collect(Sequencer *seq, TempoMap *map, uint64_t frame, uint32_t frames);
+uint64_t stats_now_ns(void);
+uint32_t stats_bucket(uint64_t ns);
+void stats_record(StatsNode *node, uint64_t ns);
+void stats_block(StatsPage *page, uint64_t ns, uint64_t budget_ns);
+uint8_t stats_env_path(char *path, size_t size);
+StatsPage *stats_open(const char *path, uint32_t sample_rate);
+void stats_close(StatsPage *page, const char *path);
+void stats_attach(StatsPage *page, AudioGraph *graph);
+float synth_rate(uint32_t sample_rate, float seconds);
+void synth_make(Synth *synth, uint32_t sample_rate);
+uint32_t synth_allocate(const Synth *synth);
+void synth_note_on(Synth *synth, uint32_t pitch, float velocity);
+void synth_release(Synth *synth, uint32_t v);
+void synth_note_off(Synth *synth, uint32_t pitch);
+void synth_release_all(Synth *synth);
+__attribute__((target_clones("avx512f", "avx2", "default"))) void synth_render_group(Synth *synth, uint32_t group, uint32_t frames);
+void synth_update_stages(Synth *synth, uint32_t group);
+void synth_render(Synth *synth, float *out, uint32_t frames);
+void synth_bench_run(void);
 VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height);
+VulkanContext vulkan_make_context(uint32_t width, uint32_t height, uint8_t export_dmabuf);
 uint32_t vulkan_find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties, VkPhysicalDevice physical_device);
+void vulkan_clear_rects(VkCommandBuffer cmd, const float color[4], VkClearRect *rects, uint32_t rect_count);
+uint8_t vulkan_push_rect(VkClearRect *rects, uint32_t *rect_count, int32_t x, int32_t y, int32_t w, int32_t h, const VkRect2D *clip);
+void vulkan_record_layer(VkCommandBuffer cmd, uint32_t layer, const PianoRollView *view, const VkRect2D *clip);
+void vulkan_record_notes(VkCommandBuffer cmd, const PianoRollView *view, const VkRect2D *clip);
+void vulkan_begin_secondary(VulkanContext *ctx, VkCommandBuffer cmd, VkCommandBufferUsageFlags flags);
+void vulkan_record_static_layer(VulkanContext *ctx, uint32_t layer, const PianoRollView *view);
+void vulkan_update_static_layers(VulkanContext *ctx, const PianoRollView *view);
+void vulkan_record_dynamic_layers(VulkanContext *ctx, VkCommandBuffer cmd, const PianoRollView *view);
+VkCommandBuffer vulkan_begin_frame(VulkanContext *ctx);
+void vulkan_end_frame(VulkanContext *ctx);
+void vulkan_render_frame(VulkanContext *ctx, const PianoRollView *view);
+void vulkan_image_barrier(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+void vulkan_scroll_canvas(VulkanContext *ctx, const PianoRollView *view, int32_t shift);
+double vulkan_frame_gpu_ms(VulkanContext *ctx, uint32_t frame);
+void vulkan_make_readback(VulkanContext *ctx);
+void vulkan_read_pixels(VulkanContext *ctx);
+VkShaderModule vulkan_load_shader(VkDevice device, const char *path);
+void vulkan_make_waveform_pipeline(VulkanContext *ctx);
+uint32_t vulkan_upload_waveform(VulkanContext *ctx, const WaveformPyramid *pyramid);
+void vulkan_add_waveform_clip(VulkanContext *ctx, uint32_t waveform, float start_col, uint32_t row, uint32_t rows);
+void vulkan_record_waveforms(VulkanContext *ctx, VkCommandBuffer cmd, const PianoRollView *view, const VkRect2D *clip);
+void waveform_layout(WaveformPyramid *pyramid, uint64_t sample_count, uint32_t sample_rate);
+void waveform_build_base(WaveformPyramid *pyramid, const void *samples, uint32_t channels, uint32_t bits);
+void waveform_build_levels(WaveformPyramid *pyramid);
+const void *waveform_map_wav(const char *path, size_t *map_size, void **map, uint32_t *channels, uint32_t *bits, uint32_t *sample_rate, uint64_t *frames);
+uint8_t waveform_load_cache(const char *cache_path, uint64_t audio_size, int64_t audio_mtime, WaveformPyramid *pyramid);
+void waveform_save_cache(const char *cache_path, uint64_t audio_size, int64_t audio_mtime, const WaveformPyramid *pyramid);
+uint8_t waveform_open(const char *path, WaveformPyramid *pyramid);
+uint32_t waveform_pick_level(const WaveformPyramid *pyramid, float samples_per_pixel);
+void waveform_load_env_clip(VulkanContext *ctx);
 void wayland_init(void);
 void wayland_registry_bind(int fd, uint8_t *buffer, size_t offset, uint16_t size, uint16_t new_id);
+void wayland_overlay_place(int fd, OverlaySurface *overlay, int32_t x, int32_t y, int32_t w, int32_t h, const int32_t clip[4]);
+void wayland_overlay_update(int fd, OverlaySurface *overlay, int32_t x, int32_t y, int32_t w, int32_t h);
 int wayland_make_fd(void);
 int main(void);
 #endif /* VIMDAW_MAIN_H */
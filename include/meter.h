@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_METER_H
+#define VIMDAW_METER_H
+/* build/pre/meter.i */
+void meter_k_weighting(MixBiquad *shelf, MixBiquad *highpass, uint32_t sample_rate);
+uint8_t meter_env(void);
+Meters *meter_make(uint32_t sample_rate);
+void meter_free(Meters *meters);
+void meter_flush(float *state, uint32_t n);
+void meter_close_sub(MeterNode *node);
+float meter_window(const float *ring, uint32_t stride, uint32_t size, uint32_t subs, uint32_t count, float partial, uint32_t filled, uint32_t sub_frames);
+void meter_publish(Meters *meters, uint32_t index);
+void meter_run(Meters *meters, const MixKernels *kernels, uint32_t worker, uint32_t index, const float *left, const float *right, uint32_t frames);
+void meter_spectrum(Meters *meters, const float *left, const float *right, uint32_t frames);
+void meter_node(Meters *meters, AudioGraph *graph, uint32_t worker, uint32_t node, uint32_t frames);
+void meter_read(Meters *meters, uint32_t node, MeterReading *reading);
+const SpectrumReading *meter_read_spectrum(Meters *meters);
+float meter_db(float amplitude);
+float meter_power_db(float power);
+float meter_lufs(float power);
+void meter_bands(const SpectrumReading *reading, uint32_t sample_rate, float low, float high, float *bands, uint32_t count);
+void meter_bench_run(void);
+#endif /* VIMDAW_METER_H */
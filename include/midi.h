@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_MIDI_H
+#define VIMDAW_MIDI_H
+/* build/pre/midi.i */
+uint64_t midi_now_ns(void);
+void midi_push(MidiInput *input, uint32_t type, uint8_t note, uint8_t velocity, uint64_t ns);
+void midi_parse_byte(MidiInput *input, MidiParser *parser, uint8_t byte, uint64_t ns);
+void midi_parse_seq(MidiInput *input, const uint8_t *buffer, size_t size, uint64_t ns);
+uint8_t midi_open_seq(MidiInput *input);
+uint8_t midi_open_raw(MidiInput *input, const char *name);
+void *midi_thread(void *arg);
+MidiInput *midi_start(AudioEngine *engine);
+void midi_stop(MidiInput *input);
+#endif /* VIMDAW_MIDI_H */
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_MIX_H
+#define VIMDAW_MIX_H
+/* build/pre/mix.i */
+void mix_gain_scalar(float *buf, float gain, uint32_t n);
+void mix_add_scalar(float *dst, const float *src, float gain, uint32_t n);
+void mix_pan_add_scalar(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+void mix_interleave_scalar(const float *left, const float *right, float *out, uint32_t frames);
+void mix_deinterleave_scalar(const float *in, float *left, float *right, uint32_t frames);
+void mix_to_s16_scalar(const float *in, int16_t *out, uint32_t n);
+void mix_from_s16_scalar(const int16_t *in, float *out, uint32_t n);
+void mix_to_s32_scalar(const float *in, int32_t *out, uint32_t n);
+void mix_ramp_scalar(float *out, float start, float step, uint32_t n);
+void mix_curve_scalar(float *out, float base, float first, float ratio, uint32_t n);
+void mix_mul_scalar(float *buf, const float *gains, uint32_t n);
+void mix_pan_law_scalar(const float *pan, float *left, float *right, uint32_t n);
+void mix_meter_scalar(const float *buf, float *peak, float *sum, uint32_t n);
+void mix_biquad_scalar(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+void mix_biquad_design(MixBiquad *filter, double b0, double b1, double b2, double a1, double a2);
+void mix_cmac_scalar(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+void mix_gain_sse2(float *buf, float gain, uint32_t n);
+void mix_add_sse2(float *dst, const float *src, float gain, uint32_t n);
+void mix_pan_add_sse2(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+void mix_interleave_sse2(const float *left, const float *right, float *out, uint32_t frames);
+void mix_deinterleave_sse2(const float *in, float *left, float *right, uint32_t frames);
+void mix_to_s16_sse2(const float *in, int16_t *out, uint32_t n);
+void mix_from_s16_sse2(const int16_t *in, float *out, uint32_t n);
+void mix_to_s32_sse2(const float *in, int32_t *out, uint32_t n);
+void mix_ramp_sse2(float *out, float start, float step, uint32_t n);
+void mix_curve_sse2(float *out, float base, float first, float ratio, uint32_t n);
+void mix_mul_sse2(float *buf, const float *gains, uint32_t n);
+void mix_pan_law_sse2(const float *pan, float *left, float *right, uint32_t n);
+void mix_meter_sse2(const float *buf, float *peak, float *sum, uint32_t n);
+void mix_biquad_sse2(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+void mix_cmac_sse2(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_gain_avx2(float *buf, float gain, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_add_avx2(float *dst, const float *src, float gain, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_pan_add_avx2(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_interleave_avx2(const float *left, const float *right, float *out, uint32_t frames);
+__attribute__((target("avx2,fma"))) void mix_deinterleave_avx2(const float *in, float *left, float *right, uint32_t frames);
+__attribute__((target("avx2,fma"))) void mix_to_s16_avx2(const float *in, int16_t *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_from_s16_avx2(const int16_t *in, float *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_to_s32_avx2(const float *in, int32_t *out, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_ramp_avx2(float *out, float start, float step, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_curve_avx2(float *out, float base, float first, float ratio, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_mul_avx2(float *buf, const float *gains, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_pan_law_avx2(const float *pan, float *left, float *right, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_meter_avx2(const float *buf, float *peak, float *sum, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_biquad_avx2(float *left, float *right, const MixBiquad *filter, float *state, uint32_t n);
+__attribute__((target("avx2,fma"))) void mix_cmac_avx2(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+__attribute__((target("avx512f"))) void mix_gain_avx512(float *buf, float gain, uint32_t n);
+__attribute__((target("avx512f"))) void mix_add_avx512(float *dst, const float *src, float gain, uint32_t n);
+__attribute__((target("avx512f"))) void mix_pan_add_avx512(const float *src, float *left, float *right, float gain_left, float gain_right, uint32_t n);
+__attribute__((target("avx512f"))) void mix_interleave_avx512(const float *left, const float *right, float *out, uint32_t frames);
+__attribute__((target("avx512f"))) void mix_deinterleave_avx512(const float *in, float *left, float *right, uint32_t frames);
+__attribute__((target("avx512f"))) void mix_to_s16_avx512(const float *in, int16_t *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_from_s16_avx512(const int16_t *in, float *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_to_s32_avx512(const float *in, int32_t *out, uint32_t n);
+__attribute__((target("avx512f"))) void mix_ramp_avx512(float *out, float start, float step, uint32_t n);
+__attribute__((target("avx512f"))) void mix_curve_avx512(float *out, float base, float first, float ratio, uint32_t n);
+__attribute__((target("avx512f"))) void mix_mul_avx512(float *buf, const float *gains, uint32_t n);
+__attribute__((target("avx512f"))) void mix_pan_law_avx512(const float *pan, float *left, float *right, uint32_t n);
+__attribute__((target("avx512f"))) void mix_meter_avx512(const float *buf, float *peak, float *sum, uint32_t n);
+__attribute__((target("avx512f"))) void mix_cmac_avx512(float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, uint32_t n);
+uint32_t mix_best_isa(void);
+uint8_t mix_kernels_for(uint32_t isa, MixKernels *kernels);
+void mix_select(MixKernels *kernels);
+double mix_bench_seconds(void);
+float mix_bench_check(const MixKernels *k, const float *a, const float *b, float *x, float *y, float *z, float *w, int16_t *s16, int32_t *s32, uint32_t n);
+void mix_bench_run(void);
+#endif /* VIMDAW_MIX_H */
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_NOTES_H
+#define VIMDAW_NOTES_H
+/* build/pre/notes.i */
+void notes_make_track(NoteTrack *track, uint32_t capacity);
+void notes_free_track(NoteTrack *track);
+void notes_reserve(NoteTrack *track, uint32_t capacity);
+uint32_t notes_lower_bound(const NoteTrack *track, uint32_t tick);
+int notes_compare(const void *a, const void *b);
+void notes_insert(NoteTrack *track, const Note *notes, uint32_t count);
+void notes_delete(NoteTrack *track, const uint32_t *indices, uint32_t count);
+void notes_update_index(NoteTrack *track, uint32_t first_changed, uint32_t old_blocks);
+uint32_t notes_query(const NoteTrack *track, uint32_t t0, uint32_t t1, uint8_t p0, uint8_t p1, uint32_t *out, uint32_t max, uint32_t *resume);
+void notes_fill_demo(NoteTrack *track, uint32_t count);
+void notes_clone(const NoteTrack *track, NoteTrack *out);
+#endif /* VIMDAW_NOTES_H */
@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_PLUGIN_H
+#define VIMDAW_PLUGIN_H
+/* build/pre/plugin.i */
+const void *plugin_host_extension(const clap_host_t *host, const char *id);
+void plugin_host_request_restart(const clap_host_t *host);
+void plugin_host_request_process(const clap_host_t *host);
+void plugin_host_request_callback(const clap_host_t *host);
+void plugin_host_latency_changed(const clap_host_t *host);
+void plugin_exec_task(void *context, uint32_t task);
+bool plugin_host_request_exec(const clap_host_t *host, uint32_t num_tasks);
+uint32_t plugin_events_size(const clap_input_events_t *list);
+const clap_event_header_t *plugin_events_get(const clap_input_events_t *list, uint32_t index);
+bool plugin_events_push(const clap_output_events_t *list, const clap_event_header_t *event);
+uint32_t plugin_port_channels(const PluginInstance *instance, bool input);
+PluginInstance *plugin_load(const char *path, const char *id, uint32_t sample_rate, uint32_t max_frames, GraphPool *pool);
+void plugin_free(PluginInstance *instance);
+uint8_t plugin_idle(PluginInstance *instance);
+void plugin_restart(PluginInstance *instance);
+void plugin_automate(PluginInstance *instance, Automation *automation, uint32_t node, uint32_t frames);
+void plugin_process(PluginInstance *instance, float *left, float *right, float *out_left, float *out_right, uint32_t frames);
+void plugin_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+#endif /* VIMDAW_PLUGIN_H */
@@ -0,0 +1,15 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_POOL_H
+#define VIMDAW_POOL_H
+/* build/pre/pool.i */
+void pool_make(Pool *pool, uint32_t size, uint32_t capacity);
+void pool_free(Pool *pool);
+void *pool_get(Pool *pool);
+void pool_put(Pool *pool, void *object);
+#endif /* VIMDAW_POOL_H */
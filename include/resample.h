@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_RESAMPLE_H
+#define VIMDAW_RESAMPLE_H
+/* build/pre/resample.i */
+const char *resample_quality_name(uint32_t quality);
+uint32_t resample_quality_env(void);
+double resample_bessel_i0(double x);
+Resampler *resample_make(uint32_t in_rate, uint32_t out_rate, uint32_t quality);
+void resample_reset(Resampler *resampler);
+void resample_free(Resampler *resampler);
+uint32_t resample_ready(const Resampler *resampler);
+uint32_t resample_write(Resampler *resampler, const float *left, const float *right, uint32_t frames);
+__attribute__((target_clones("avx512f", "avx2", "default"))) uint32_t resample_read(Resampler *resampler, float *left, float *right, uint32_t frames);
+uint8_t resample_file(const char *path, const char *out_path, uint32_t rate, uint32_t quality);
+uint8_t resample_cached(const char *path, char *cached, size_t size, uint32_t rate);
+double resample_bench_error(const float *out, uint32_t frames, uint32_t taps, double frequency, uint32_t rate);
+double resample_bench_tone(Resampler *resampler, double frequency, float *in, float *out, uint32_t in_frames, uint32_t *out_frames);
+void resample_bench_run(void);
+#endif /* VIMDAW_RESAMPLE_H */
@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_REVERB_H
+#define VIMDAW_REVERB_H
+/* build/pre/reverb.i */
+void reverb_segment_make(ReverbSegment *seg, const float *left, const float *right, uint64_t frames, uint64_t offset, uint32_t size, uint32_t count);
+void reverb_segment_free(ReverbSegment *seg);
+void reverb_segment_reset(ReverbSegment *seg);
+void reverb_segment_push(ReverbSegment *seg, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t n);
+void reverb_segment_advance(ReverbSegment *seg, const MixKernels *k);
+void *reverb_thread(void *arg);
+void reverb_generate(float *left, float *right, uint64_t frames, uint32_t seed);
+void reverb_normalize(float *left, float *right, uint64_t frames);
+Reverb *reverb_make(const float *left, const float *right, uint64_t frames, uint32_t sample_rate, uint8_t wait, const char *name);
+Reverb *reverb_load(const char *source, uint32_t sample_rate, uint8_t wait);
+void reverb_free(Reverb *reverb);
+uint8_t reverb_tail_ready(Reverb *reverb, uint32_t chunk);
+void reverb_tail(Reverb *reverb, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t n);
+void reverb_process(Reverb *reverb, const MixKernels *k, const float *left, const float *right, float *out_left, float *out_right, uint32_t frames);
+void reverb_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void reverb_bench_run(void);
+#endif /* VIMDAW_REVERB_H */
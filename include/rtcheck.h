@@ -0,0 +1,12 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_RTCHECK_H
+#define VIMDAW_RTCHECK_H
+/* build/pre/rtcheck.i */
+
+#endif /* VIMDAW_RTCHECK_H */
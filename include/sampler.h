@@ -0,0 +1,23 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_SAMPLER_H
+#define VIMDAW_SAMPLER_H
+/* build/pre/sampler.i */
+Sampler *sampler_make(void);
+uint32_t sampler_open_file(Sampler *sampler, const char *path);
+uint8_t sampler_add_clip(Sampler *sampler, uint32_t file, uint64_t start, uint64_t offset, uint64_t length, float gain);
+void sampler_read_frames(const MixKernels *k, const SampleFile *file, uint64_t frame, uint32_t frames, float *scratch, float *left, float *right);
+void sampler_fill(Sampler *sampler, SamplerStream *stream);
+void sampler_service(Sampler *sampler);
+void *sampler_thread(void *arg);
+void sampler_start(Sampler *sampler);
+void sampler_free(Sampler *sampler);
+void sampler_locate(Sampler *sampler, uint64_t frame);
+void sampler_render(Sampler *sampler, const MixKernels *k, uint64_t frame, uint32_t frames, float *left, float *right);
+void sampler_load_env_clip(Sampler *sampler);
+#endif /* VIMDAW_SAMPLER_H */
@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_SANDBOX_H
+#define VIMDAW_SANDBOX_H
+/* build/pre/sandbox.i */
+uint32_t sandbox_spin(void);
+SandboxPlugin *sandbox_load(const char *path, const char *id, uint32_t sample_rate, uint32_t max_frames);
+void sandbox_free(SandboxPlugin *sandbox);
+uint8_t sandbox_idle(SandboxPlugin *sandbox);
+uint64_t sandbox_now_ns(void);
+uint8_t sandbox_wait(SandboxShared *shared, uint32_t request, uint32_t spin, uint64_t deadline_ns);
+void sandbox_node(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void sandbox_child_run(void);
+void sandbox_bench_source(void *state, AudioGraph *graph, uint32_t node, uint32_t frames);
+void sandbox_bench_run(void);
+#endif /* VIMDAW_SANDBOX_H */
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_SEQUENCER_H
+#define VIMDAW_SEQUENCER_H
+/* build/pre/sequencer.i */
+void tempo_map_build(TempoMap *map, uint32_t sample_rate, const TempoPoint *points, uint32_t count);
+void tempo_map_constant(TempoMap *map, uint32_t sample_rate, float bpm);
+uint32_t tempo_map_find_tick(TempoMap *map, uint32_t tick);
+double tempo_map_tick_to_sample(TempoMap *map, uint32_t tick);
+double tempo_map_sample_to_tick(const TempoMap *map, double sample);
+void sequencer_push_off(Sequencer *seq, uint64_t sample, uint8_t pitch);
+PendingOff sequencer_pop_off(Sequencer *seq);
+void sequencer_emit(Sequencer *seq, uint32_t offset, uint8_t type, uint8_t pitch, uint8_t velocity);
+void sequencer_emit_offs(Sequencer *seq, uint64_t frame, uint64_t limit);
+void sequencer_reset(Sequencer *seq);
+void sequencer_collect(Sequencer *seq, TempoMap *map, uint64_t frame, uint32_t frames);
+#endif /* VIMDAW_SEQUENCER_H */
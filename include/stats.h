@@ -0,0 +1,19 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_STATS_H
+#define VIMDAW_STATS_H
+/* build/pre/stats.i */
+uint64_t stats_now_ns(void);
+uint32_t stats_bucket(uint64_t ns);
+void stats_record(StatsNode *node, uint64_t ns);
+void stats_block(StatsPage *page, uint64_t ns, uint64_t budget_ns);
+uint8_t stats_env_path(char *path, size_t size);
+StatsPage *stats_open(const char *path, uint32_t sample_rate);
+void stats_close(StatsPage *page, const char *path);
+void stats_attach(StatsPage *page, AudioGraph *graph);
+#endif /* VIMDAW_STATS_H */
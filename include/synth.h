@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_SYNTH_H
+#define VIMDAW_SYNTH_H
+/* build/pre/synth.i */
+float synth_rate(uint32_t sample_rate, float seconds);
+void synth_make(Synth *synth, uint32_t sample_rate);
+uint32_t synth_allocate(const Synth *synth);
+void synth_note_on(Synth *synth, uint32_t pitch, float velocity);
+void synth_release(Synth *synth, uint32_t v);
+void synth_note_off(Synth *synth, uint32_t pitch);
+void synth_release_all(Synth *synth);
+__attribute__((target_clones("avx512f", "avx2", "default"))) void synth_render_group(Synth *synth, uint32_t group, uint32_t frames);
+void synth_update_stages(Synth *synth, uint32_t group);
+void synth_render(Synth *synth, float *out, uint32_t frames);
+void synth_bench_run(void);
+#endif /* VIMDAW_SYNTH_H */
@@ -9,5 +9,27 @@
 #define VIMDAW_VULKAN_H
 /* build/pre/vulkan.i */
 VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height);
+VulkanContext vulkan_make_context(uint32_t width, uint32_t height, uint8_t export_dmabuf);
 uint32_t vulkan_find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties, VkPhysicalDevice physical_device);
+void vulkan_clear_rects(VkCommandBuffer cmd, const float color[4], VkClearRect *rects, uint32_t rect_count);
+uint8_t vulkan_push_rect(VkClearRect *rects, uint32_t *rect_count, int32_t x, int32_t y, int32_t w, int32_t h, const VkRect2D *clip);
+void vulkan_record_layer(VkCommandBuffer cmd, uint32_t layer, const PianoRollView *view, const VkRect2D *clip);
+void vulkan_record_notes(VkCommandBuffer cmd, const PianoRollView *view, const VkRect2D *clip);
+void vulkan_begin_secondary(VulkanContext *ctx, VkCommandBuffer cmd, VkCommandBufferUsageFlags flags);
+void vulkan_record_static_layer(VulkanContext *ctx, uint32_t layer, const PianoRollView *view);
+void vulkan_update_static_layers(VulkanContext *ctx, const PianoRollView *view);
+void vulkan_record_dynamic_layers(VulkanContext *ctx, VkCommandBuffer cmd, const PianoRollView *view);
+VkCommandBuffer vulkan_begin_frame(VulkanContext *ctx);
+void vulkan_end_frame(VulkanContext *ctx);
+void vulkan_render_frame(VulkanContext *ctx, const PianoRollView *view);
+void vulkan_image_barrier(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+void vulkan_scroll_canvas(VulkanContext *ctx, const PianoRollView *view, int32_t shift);
+double vulkan_frame_gpu_ms(VulkanContext *ctx, uint32_t frame);
+void vulkan_make_readback(VulkanContext *ctx);
+void vulkan_read_pixels(VulkanContext *ctx);
+VkShaderModule vulkan_load_shader(VkDevice device, const char *path);
+void vulkan_make_waveform_pipeline(VulkanContext *ctx);
+uint32_t vulkan_upload_waveform(VulkanContext *ctx, const WaveformPyramid *pyramid);
+void vulkan_add_waveform_clip(VulkanContext *ctx, uint32_t waveform, float start_col, uint32_t row, uint32_t rows);
+void vulkan_record_waveforms(VulkanContext *ctx, VkCommandBuffer cmd, const PianoRollView *view, const VkRect2D *clip);
 #endif /* VIMDAW_VULKAN_H */
@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+#include <vulkan/vulkan_core.h>
+#include "data.h"
+#ifndef VIMDAW_WAVEFORM_H
+#define VIMDAW_WAVEFORM_H
+/* build/pre/waveform.i */
+void waveform_layout(WaveformPyramid *pyramid, uint64_t sample_count, uint32_t sample_rate);
+void waveform_build_base(WaveformPyramid *pyramid, const void *samples, uint32_t channels, uint32_t bits);
+void waveform_build_levels(WaveformPyramid *pyramid);
+const void *waveform_map_wav(const char *path, size_t *map_size, void **map, uint32_t *channels, uint32_t *bits, uint32_t *sample_rate, uint64_t *frames);
+uint8_t waveform_load_cache(const char *cache_path, uint64_t audio_size, int64_t audio_mtime, WaveformPyramid *pyramid);
+void waveform_save_cache(const char *cache_path, uint64_t audio_size, int64_t audio_mtime, const WaveformPyramid *pyramid);
+uint8_t waveform_open(const char *path, WaveformPyramid *pyramid);
+uint32_t waveform_pick_level(const WaveformPyramid *pyramid, float samples_per_pixel);
+void waveform_load_env_clip(VulkanContext *ctx);
+#endif /* VIMDAW_WAVEFORM_H */
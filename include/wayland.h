@@ -10,5 +10,7 @@
 /* build/pre/wayland.i */
 void wayland_init(void);
 void wayland_registry_bind(int fd, uint8_t *buffer, size_t offset, uint16_t size, uint16_t new_id);
+void wayland_overlay_place(int fd, OverlaySurface *overlay, int32_t x, int32_t y, int32_t w, int32_t h, const int32_t clip[4]);
+void wayland_overlay_update(int fd, OverlaySurface *overlay, int32_t x, int32_t y, int32_t w, int32_t h);
 int wayland_make_fd(void);
 #endif /* VIMDAW_WAYLAND_H */
@@ -0,0 +1,389 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// plugins/war_test.c
+//=============================================================================
+
+// the host's test plugin: a stereo delay of exactly war_test_latency
+// frames, reported as its latency, with each channel run as a thread-pool
+// task when the host has one. Through a compensating host the output is
+// the input, late by the reported latency and nothing else. One
+// parameter, a gain at 1 by default, takes effect at its event's frame.
+// Not part of the unity build; the Makefile builds it as a .clap
+
+#include <clap/clap.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    war_test_latency = 64,
+    war_test_channels = 2,
+    war_test_param_gain = 0,
+    war_test_max_changes = 512, // gain events used per block
+};
+
+typedef struct {
+    clap_plugin_t plugin;
+    const clap_host_t* host;
+    const clap_host_thread_pool_t* thread_pool;
+    const clap_process_t* process; // during process only
+    float* lines[war_test_channels]; // war_test_latency frames each
+    uint32_t write[war_test_channels];
+    double gain;
+    // this block's gain changes, read by both channels
+    uint32_t change_time[war_test_max_changes];
+    float change_gain[war_test_max_changes];
+    uint32_t change_count;
+    float block_gain; // in effect at the block start
+} WarTest;
+
+static const char* const war_test_features[] = {
+    CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+    CLAP_PLUGIN_FEATURE_UTILITY,
+    CLAP_PLUGIN_FEATURE_STEREO,
+    NULL,
+};
+
+static const clap_plugin_descriptor_t war_test_descriptor = {
+    .clap_version = CLAP_VERSION_INIT,
+    .id = "war.test",
+    .name = "WAR test delay",
+    .vendor = "WAR",
+    .url = "https://github.com/thenickmonaco/vimDAW",
+    .manual_url = "",
+    .support_url = "",
+    .version = "0.1",
+    .description = "fixed delay with reported latency, for host tests",
+    .features = war_test_features,
+};
+
+//-----------------------------------------------------------------------------
+// extensions
+//-----------------------------------------------------------------------------
+
+static uint32_t war_test_params_count(const clap_plugin_t* plugin) {
+    (void)plugin;
+    return 1;
+}
+
+static bool war_test_params_info(const clap_plugin_t* plugin,
+                                 uint32_t index,
+                                 clap_param_info_t* info) {
+    (void)plugin;
+    if (index) return false;
+    memset(info, 0, sizeof(*info));
+    info->id = war_test_param_gain;
+    info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+    strcpy(info->name, "gain");
+    info->min_value = 0.0;
+    info->max_value = 2.0;
+    info->default_value = 1.0;
+    return true;
+}
+
+static bool war_test_params_value(const clap_plugin_t* plugin,
+                                  clap_id id,
+                                  double* value) {
+    WarTest* test = plugin->plugin_data;
+    if (id != war_test_param_gain) return false;
+    *value = test->gain;
+    return true;
+}
+
+static bool war_test_params_to_text(const clap_plugin_t* plugin,
+                                    clap_id id,
+                                    double value,
+                                    char* text,
+                                    uint32_t size) {
+    (void)plugin;
+    if (id != war_test_param_gain) return false;
+    snprintf(text, size, "%.3f", value);
+    return true;
+}
+
+static bool war_test_params_from_text(const clap_plugin_t* plugin,
+                                      clap_id id,
+                                      const char* text,
+                                      double* value) {
+    (void)plugin;
+    if (id != war_test_param_gain) return false;
+    *value = strtod(text, NULL);
+    return true;
+}
+
+// events outside process: only the latest value matters
+static void war_test_params_flush(const clap_plugin_t* plugin,
+                                  const clap_input_events_t* in,
+                                  const clap_output_events_t* out) {
+    WarTest* test = plugin->plugin_data;
+    (void)out;
+    for (uint32_t i = 0; i < in->size(in); i++) {
+        const clap_event_header_t* event = in->get(in, i);
+        if (event->space_id != CLAP_CORE_EVENT_SPACE_ID ||
+            event->type != CLAP_EVENT_PARAM_VALUE)
+            continue;
+        const clap_event_param_value_t* param = (const void*)event;
+        if (param->param_id == war_test_param_gain) test->gain = param->value;
+    }
+}
+
+static const clap_plugin_params_t war_test_params = {
+    .count = war_test_params_count,
+    .get_info = war_test_params_info,
+    .get_value = war_test_params_value,
+    .value_to_text = war_test_params_to_text,
+    .text_to_value = war_test_params_from_text,
+    .flush = war_test_params_flush,
+};
+
+static uint32_t war_test_latency_get(const clap_plugin_t* plugin) {
+    (void)plugin;
+    return war_test_latency;
+}
+
+static const clap_plugin_latency_t war_test_latency_ext = {
+    .get = war_test_latency_get,
+};
+
+static uint32_t war_test_ports_count(const clap_plugin_t* plugin,
+                                     bool is_input) {
+    (void)plugin;
+    (void)is_input;
+    return 1;
+}
+
+static bool war_test_ports_get(const clap_plugin_t* plugin,
+                               uint32_t index,
+                               bool is_input,
+                               clap_audio_port_info_t* info) {
+    (void)plugin;
+    if (index) return false;
+    memset(info, 0, sizeof(*info));
+    info->id = 0;
+    strcpy(info->name, is_input ? "in" : "out");
+    info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+    info->channel_count = war_test_channels;
+    info->port_type = CLAP_PORT_STEREO;
+    info->in_place_pair = CLAP_INVALID_ID;
+    return true;
+}
+
+static const clap_plugin_audio_ports_t war_test_ports = {
+    .count = war_test_ports_count,
+    .get = war_test_ports_get,
+};
+
+// one channel: output is the line's oldest frames, then the input, at
+// the gain in effect on each frame
+static void war_test_channel(WarTest* test, uint32_t channel) {
+    const clap_process_t* process = test->process;
+    const float* in = process->audio_inputs[0].data32[channel];
+    float* out = process->audio_outputs[0].data32[channel];
+    float* line = test->lines[channel];
+    uint32_t write = test->write[channel];
+    float gain = test->block_gain;
+    uint32_t change = 0;
+    for (uint32_t i = 0; i < process->frames_count; i++) {
+        while (change < test->change_count && test->change_time[change] <= i)
+            gain = test->change_gain[change++];
+        float sample = in[i];
+        out[i] = line[write] * gain;
+        line[write] = sample;
+        write = write + 1 == war_test_latency ? 0 : write + 1;
+    }
+    test->write[channel] = write;
+}
+
+static void war_test_exec(const clap_plugin_t* plugin, uint32_t task) {
+    war_test_channel(plugin->plugin_data, task);
+}
+
+static const clap_plugin_thread_pool_t war_test_thread_pool = {
+    .exec = war_test_exec,
+};
+
+//-----------------------------------------------------------------------------
+// plugin
+//-----------------------------------------------------------------------------
+
+static bool war_test_init(const clap_plugin_t* plugin) {
+    WarTest* test = plugin->plugin_data;
+    test->thread_pool =
+        test->host->get_extension(test->host, CLAP_EXT_THREAD_POOL);
+    return true;
+}
+
+static void war_test_destroy(const clap_plugin_t* plugin) {
+    WarTest* test = plugin->plugin_data;
+    for (uint32_t c = 0; c < war_test_channels; c++) free(test->lines[c]);
+    free(test);
+}
+
+static bool war_test_activate(const clap_plugin_t* plugin,
+                              double sample_rate,
+                              uint32_t min_frames,
+                              uint32_t max_frames) {
+    WarTest* test = plugin->plugin_data;
+    (void)sample_rate;
+    (void)min_frames;
+    (void)max_frames;
+    for (uint32_t c = 0; c < war_test_channels; c++) {
+        test->lines[c] = calloc(war_test_latency, sizeof(float));
+        if (!test->lines[c]) return false;
+        test->write[c] = 0;
+    }
+    return true;
+}
+
+static void war_test_deactivate(const clap_plugin_t* plugin) {
+    WarTest* test = plugin->plugin_data;
+    for (uint32_t c = 0; c < war_test_channels; c++) {
+        free(test->lines[c]);
+        test->lines[c] = NULL;
+    }
+}
+
+static bool war_test_start_processing(const clap_plugin_t* plugin) {
+    (void)plugin;
+    return true;
+}
+
+static void war_test_stop_processing(const clap_plugin_t* plugin) {
+    (void)plugin;
+}
+
+static void war_test_reset(const clap_plugin_t* plugin) {
+    WarTest* test = plugin->plugin_data;
+    for (uint32_t c = 0; c < war_test_channels; c++) {
+        memset(test->lines[c], 0, sizeof(float) * war_test_latency);
+        test->write[c] = 0;
+    }
+}
+
+static clap_process_status war_test_process(const clap_plugin_t* plugin,
+                                            const clap_process_t* process) {
+    WarTest* test = plugin->plugin_data;
+    if (process->audio_inputs_count < 1 || process->audio_outputs_count < 1)
+        return CLAP_PROCESS_ERROR;
+    test->block_gain = (float)test->gain;
+    test->change_count = 0;
+    const clap_input_events_t* events = process->in_events;
+    for (uint32_t i = 0; i < events->size(events); i++) {
+        const clap_event_header_t* event = events->get(events, i);
+        if (event->space_id != CLAP_CORE_EVENT_SPACE_ID ||
+            event->type != CLAP_EVENT_PARAM_VALUE)
+            continue;
+        const clap_event_param_value_t* param = (const void*)event;
+        if (param->param_id != war_test_param_gain) continue;
+        test->gain = param->value;
+        if (test->change_count == war_test_max_changes) continue;
+        test->change_time[test->change_count] = event->time;
+        test->change_gain[test->change_count++] = (float)param->value;
+    }
+    test->process = process;
+    if (!test->thread_pool ||
+        !test->thread_pool->request_exec(test->host, war_test_channels)) {
+        for (uint32_t c = 0; c < war_test_channels; c++)
+            war_test_channel(test, c);
+    }
+    test->process = NULL;
+    return CLAP_PROCESS_CONTINUE;
+}
+
+static const void* war_test_get_extension(const clap_plugin_t* plugin,
+                                          const char* id) {
+    (void)plugin;
+    if (!strcmp(id, CLAP_EXT_LATENCY)) return &war_test_latency_ext;
+    if (!strcmp(id, CLAP_EXT_AUDIO_PORTS)) return &war_test_ports;
+    if (!strcmp(id, CLAP_EXT_THREAD_POOL)) return &war_test_thread_pool;
+    if (!strcmp(id, CLAP_EXT_PARAMS)) return &war_test_params;
+    return NULL;
+}
+
+static void war_test_on_main_thread(const clap_plugin_t* plugin) {
+    (void)plugin;
+}
+
+//-----------------------------------------------------------------------------
+// factory and entry
+//-----------------------------------------------------------------------------
+
+static uint32_t war_test_count(const clap_plugin_factory_t* factory) {
+    (void)factory;
+    return 1;
+}
+
+static const clap_plugin_descriptor_t*
+war_test_describe(const clap_plugin_factory_t* factory, uint32_t index) {
+    (void)factory;
+    return index == 0 ? &war_test_descriptor : NULL;
+}
+
+static const clap_plugin_t*
+war_test_create(const clap_plugin_factory_t* factory,
+                const clap_host_t* host,
+                const char* id) {
+    (void)factory;
+    if (strcmp(id, war_test_descriptor.id)) return NULL;
+    WarTest* test = calloc(1, sizeof(WarTest));
+    if (!test) return NULL;
+    test->host = host;
+    test->gain = 1.0;
+    test->plugin = (clap_plugin_t){
+        .desc = &war_test_descriptor,
+        .plugin_data = test,
+        .init = war_test_init,
+        .destroy = war_test_destroy,
+        .activate = war_test_activate,
+        .deactivate = war_test_deactivate,
+        .start_processing = war_test_start_processing,
+        .stop_processing = war_test_stop_processing,
+        .reset = war_test_reset,
+        .process = war_test_process,
+        .get_extension = war_test_get_extension,
+        .on_main_thread = war_test_on_main_thread,
+    };
+    return &test->plugin;
+}
+
+static const clap_plugin_factory_t war_test_factory = {
+    .get_plugin_count = war_test_count,
+    .get_plugin_descriptor = war_test_describe,
+    .create_plugin = war_test_create,
+};
+
+static bool war_test_entry_init(const char* path) {
+    (void)path;
+    return true;
+}
+
+static void war_test_entry_deinit(void) {
+}
+
+static const void* war_test_get_factory(const char* id) {
+    return strcmp(id, CLAP_PLUGIN_FACTORY_ID) ? NULL : &war_test_factory;
+}
+
+CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+    .clap_version = CLAP_VERSION_INIT,
+    .init = war_test_entry_init,
+    .deinit = war_test_entry_deinit,
+    .get_factory = war_test_get_factory,
+};
@@ -0,0 +1,664 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/alsa.c
+//=============================================================================
+
+#include "alsa.h"
+#include "audio.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "graph.h"
+#include "macros.h"
+#include "meter.h"
+#include "reverb.h"
+#include "midi.h"
+#include "notes.h"
+#include "resample.h"
+#include "sampler.h"
+#include "sequencer.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <sound/asound.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// playback straight through the kernel's PCM interface, the way wayland.c
+// speaks the wire protocol: no libasound. The period is the engine block,
+// and the audio thread renders each one into the mapped dma buffer
+
+//-----------------------------------------------------------------------------
+// setup
+//-----------------------------------------------------------------------------
+
+// "hw:CARD,DEVICE" or "hw:CARD", CARD an index or an id such as "Dummy"
+// (snd-dummy); the id is looked up through each card's control device
+uint8_t alsa_device_path(const char* name, char* path, size_t size) {
+    if (strncmp(name, "hw:", 3) == 0) name += 3;
+    char card_name[32];
+    size_t n = strcspn(name, ",");
+    if (n == 0 || n >= sizeof(card_name)) return 0;
+    memcpy(card_name, name, n);
+    card_name[n] = '\0';
+    uint32_t device = name[n] == ',' ? (uint32_t)strtoul(name + n + 1, NULL, 10)
+                                     : 0;
+
+    char* end;
+    long card = strtol(card_name, &end, 10);
+    if (*end != '\0') {
+        card = -1;
+        for (int c = 0; c < alsa_max_cards && card < 0; c++) {
+            char control[alsa_max_path];
+            snprintf(control, sizeof(control), "/dev/snd/controlC%d", c);
+            int fd = open(control, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+            struct snd_ctl_card_info info;
+            memset(&info, 0, sizeof(info));
+            if (ioctl(fd, SNDRV_CTL_IOCTL_CARD_INFO, &info) == 0 &&
+                strncmp((const char*)info.id, card_name, sizeof(info.id)) == 0)
+                card = c;
+            close(fd);
+        }
+        if (card < 0) return 0;
+    }
+    snprintf(path, size, "/dev/snd/pcmC%ldD%up", card, device);
+    return 1;
+}
+
+void alsa_param_init(struct snd_pcm_hw_params* params) {
+    memset(params, 0, sizeof(*params));
+    for (uint32_t i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_MASK -
+                                 SNDRV_PCM_HW_PARAM_FIRST_MASK;
+         i++)
+        memset(params->masks[i].bits, 0xff, sizeof(params->masks[i].bits));
+    for (uint32_t i = 0; i <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL -
+                                 SNDRV_PCM_HW_PARAM_FIRST_INTERVAL;
+         i++)
+        params->intervals[i].max = UINT_MAX;
+    params->rmask = ~0u;
+    params->info = ~0u;
+}
+
+void alsa_param_mask(struct snd_pcm_hw_params* params,
+                     uint32_t param,
+                     uint32_t bit) {
+    struct snd_mask* mask =
+        &params->masks[param - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+    memset(mask->bits, 0, sizeof(mask->bits));
+    mask->bits[bit / 32] = 1u << (bit % 32);
+}
+
+void alsa_param_range(struct snd_pcm_hw_params* params,
+                      uint32_t param,
+                      uint32_t min,
+                      uint32_t max) {
+    struct snd_interval* interval =
+        &params->intervals[param - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+    interval->min = min;
+    interval->max = max;
+    interval->integer = 1;
+}
+
+uint32_t alsa_param_value(const struct snd_pcm_hw_params* params,
+                          uint32_t param) {
+    return params->intervals[param - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL].min;
+}
+
+// exactly period x periods when the driver can, else the nearest it can
+// at or above, never beyond what an engine block can hold
+uint8_t alsa_hw_params(AlsaDevice* device,
+                       uint32_t format,
+                       uint32_t period_frames,
+                       uint32_t periods) {
+    struct snd_pcm_hw_params params;
+    for (uint32_t exact = 1;; exact = 0) {
+        alsa_param_init(&params);
+        alsa_param_mask(&params,
+                        SNDRV_PCM_HW_PARAM_ACCESS,
+                        SNDRV_PCM_ACCESS_MMAP_INTERLEAVED);
+        alsa_param_mask(&params, SNDRV_PCM_HW_PARAM_FORMAT, format);
+        alsa_param_mask(
+            &params, SNDRV_PCM_HW_PARAM_SUBFORMAT, SNDRV_PCM_SUBFORMAT_STD);
+        alsa_param_range(&params,
+                         SNDRV_PCM_HW_PARAM_CHANNELS,
+                         device->channels,
+                         device->channels);
+        alsa_param_range(
+            &params, SNDRV_PCM_HW_PARAM_RATE, device->rate, device->rate);
+        alsa_param_range(&params,
+                         SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+                         period_frames,
+                         exact ? period_frames : audio_max_block_frames);
+        alsa_param_range(&params,
+                         SNDRV_PCM_HW_PARAM_PERIODS,
+                         periods,
+                         exact ? periods : 32);
+        if (ioctl(device->fd, SNDRV_PCM_IOCTL_HW_PARAMS, &params) == 0) break;
+        if (!exact) return 0;
+    }
+    device->format = format;
+    device->period_frames =
+        alsa_param_value(&params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
+    device->buffer_frames =
+        alsa_param_value(&params, SNDRV_PCM_HW_PARAM_BUFFER_SIZE);
+    device->frame_bytes =
+        alsa_param_value(&params, SNDRV_PCM_HW_PARAM_FRAME_BITS) / 8;
+    return 1;
+}
+
+// the audio thread starts the stream itself and an empty buffer stops it
+uint8_t alsa_sw_params(AlsaDevice* device) {
+    struct snd_pcm_sw_params params;
+    memset(&params, 0, sizeof(params));
+    uint64_t boundary = device->buffer_frames;
+    while (boundary * 2 <= (uint64_t)LONG_MAX - device->buffer_frames)
+        boundary *= 2;
+    device->boundary = boundary;
+    params.tstamp_mode = SNDRV_PCM_TSTAMP_ENABLE;
+    params.tstamp_type = SNDRV_PCM_TSTAMP_TYPE_MONOTONIC;
+    params.proto = SNDRV_PCM_VERSION;
+    params.period_step = 1;
+    params.avail_min = device->period_frames;
+    params.start_threshold = boundary;
+    params.stop_threshold = device->buffer_frames;
+    params.boundary = boundary;
+    return ioctl(device->fd, SNDRV_PCM_IOCTL_SW_PARAMS, &params) == 0;
+}
+
+// refreshes status (and pushes control) when the pages are not shared
+void alsa_sync(AlsaDevice* device, uint32_t flags) {
+    if (device->sync) {
+        device->sync->flags = flags;
+        ioctl(device->fd, SNDRV_PCM_IOCTL_SYNC_PTR, device->sync);
+    } else if (flags & SNDRV_PCM_SYNC_PTR_HWSYNC) {
+        ioctl(device->fd, SNDRV_PCM_IOCTL_HWSYNC);
+    }
+}
+
+void alsa_close(AlsaDevice* device) {
+    if (device->buffer) munmap(device->buffer, device->buffer_bytes);
+    if (device->sync) {
+        free(device->sync);
+    } else {
+        if (device->status) munmap(device->status, device->page_size);
+        if (device->control) munmap(device->control, device->page_size);
+    }
+    resample_free(device->resampler);
+    close(device->fd);
+    free(device);
+}
+
+// NULL when the device cannot be opened as asked; the engine then paces
+// itself on the clock, which is the null device
+AlsaDevice* alsa_open(const char* name,
+                      uint32_t rate,
+                      uint32_t period_frames,
+                      uint32_t periods) {
+    header("alsa_open");
+
+    AlsaDevice* device = calloc(1, sizeof(AlsaDevice));
+    assert(device);
+    if (!alsa_device_path(name, device->path, sizeof(device->path))) {
+        fprintf(stderr, "alsa: no device %s\n", name);
+        free(device);
+        end("alsa_open");
+        return NULL;
+    }
+    device->fd = open(device->path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (device->fd < 0) {
+        // EBUSY is a sound server holding the card
+        fprintf(stderr,
+                "alsa: cannot open %s (%s)%s\n",
+                device->path,
+                strerror(errno),
+                errno == EBUSY ? "; free it from PipeWire with pw-reserve "
+                                 "or pick another card"
+                               : "");
+        free(device);
+        end("alsa_open");
+        return NULL;
+    }
+    device->rate = rate;
+    device->channels = audio_channels;
+    device->page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    // float straight from the mixer when the hardware takes it, and the
+    // engine's rate when it has it; otherwise the card's nearest common
+    // rate, and the engine is resampled to it a period at a time
+    const uint32_t formats[] = {SNDRV_PCM_FORMAT_FLOAT_LE,
+                                SNDRV_PCM_FORMAT_S32_LE,
+                                SNDRV_PCM_FORMAT_S16_LE};
+    const uint32_t rates[] = {rate, 48000, 44100, 96000, 88200, 192000};
+    uint8_t configured = 0;
+    for (uint32_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        device->rate = rates[r];
+        for (uint32_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            configured =
+                alsa_hw_params(device, formats[i], period_frames, periods);
+            if (configured) break;
+        }
+        if (configured) break;
+    }
+    if (configured && device->rate != rate) {
+        device->resampler =
+            resample_make(rate, device->rate, resample_quality_env());
+        configured = device->resampler != NULL;
+    }
+    if (!configured || !alsa_sw_params(device)) {
+        fprintf(stderr, "alsa: %s has no stereo mmap setup\n", device->path);
+        alsa_close(device);
+        end("alsa_open");
+        return NULL;
+    }
+
+    device->status = mmap(NULL,
+                          device->page_size,
+                          PROT_READ,
+                          MAP_SHARED,
+                          device->fd,
+                          SNDRV_PCM_MMAP_OFFSET_STATUS);
+    device->control = mmap(NULL,
+                           device->page_size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED,
+                           device->fd,
+                           SNDRV_PCM_MMAP_OFFSET_CONTROL);
+    if (device->status == MAP_FAILED || device->control == MAP_FAILED) {
+        if (device->status != MAP_FAILED)
+            munmap(device->status, device->page_size);
+        if (device->control != MAP_FAILED)
+            munmap(device->control, device->page_size);
+        device->sync = calloc(1, sizeof(struct snd_pcm_sync_ptr));
+        assert(device->sync);
+        device->status = (struct snd_pcm_mmap_status*)&device->sync->s.status;
+        device->control =
+            (struct snd_pcm_mmap_control*)&device->sync->c.control;
+    }
+    device->control->avail_min = device->period_frames;
+
+    device->buffer_bytes = (size_t)device->buffer_frames * device->frame_bytes;
+    device->buffer = mmap(NULL,
+                          device->buffer_bytes,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          device->fd,
+                          SNDRV_PCM_MMAP_OFFSET_DATA);
+    if (device->buffer == MAP_FAILED ||
+        ioctl(device->fd, SNDRV_PCM_IOCTL_PREPARE) != 0) {
+        if (device->buffer == MAP_FAILED) device->buffer = NULL;
+        fprintf(stderr, "alsa: cannot map %s\n", device->path);
+        alsa_close(device);
+        end("alsa_open");
+        return NULL;
+    }
+
+    call_carmack("alsa: %s %u Hz format %u, %u x %u frames%s",
+                 device->path,
+                 device->rate,
+                 device->format,
+                 device->period_frames,
+                 device->buffer_frames / device->period_frames,
+                 device->sync ? ", sync_ptr" : "");
+    end("alsa_open");
+    return device;
+}
+
+// WAR_ALSA_DEVICE   hw:CARD,DEVICE (default hw:0,0)
+// WAR_ALSA_PERIOD   frames per period and engine block (default
+//                   audio_block_frames)
+// WAR_ALSA_PERIODS  periods in the buffer (default 2)
+AlsaDevice* alsa_open_env(uint32_t rate) {
+    const char* name = getenv("WAR_ALSA_DEVICE");
+    const char* period_env = getenv("WAR_ALSA_PERIOD");
+    const char* periods_env = getenv("WAR_ALSA_PERIODS");
+    uint32_t period =
+        period_env ? (uint32_t)strtoul(period_env, NULL, 10) : 0;
+    uint32_t periods =
+        periods_env ? (uint32_t)strtoul(periods_env, NULL, 10) : 0;
+    if (period == 0 || period > audio_max_block_frames)
+        period = audio_block_frames;
+    if (periods < 2) periods = alsa_default_periods;
+    return alsa_open(name ? name : "hw:0,0", rate, period, periods);
+}
+
+//-----------------------------------------------------------------------------
+// audio thread
+//-----------------------------------------------------------------------------
+
+uint64_t alsa_avail(const AlsaDevice* device) {
+    int64_t avail = (int64_t)device->status->hw_ptr + device->buffer_frames -
+                    (int64_t)device->control->appl_ptr;
+    if (avail < 0) avail += (int64_t)device->boundary;
+    if ((uint64_t)avail >= device->boundary) avail -= (int64_t)device->boundary;
+    return (uint64_t)avail;
+}
+
+void alsa_commit(AlsaDevice* device, uint32_t frames) {
+    uint64_t appl = device->control->appl_ptr + frames;
+    if (appl >= device->boundary) appl -= device->boundary;
+    device->control->appl_ptr = appl;
+    alsa_sync(device, 0);
+}
+
+// frames from the mixer into the ring at frame at, wrapping at its end
+void alsa_write(AlsaDevice* device,
+                const MixKernels* k,
+                const float* in,
+                uint64_t at,
+                uint32_t frames) {
+    while (frames) {
+        uint32_t n = device->buffer_frames - at < frames
+                         ? (uint32_t)(device->buffer_frames - at)
+                         : frames;
+        uint8_t* out = device->buffer + at * device->frame_bytes;
+        uint32_t samples = n * audio_channels;
+        if (!in) {
+            memset(out, 0, (size_t)n * device->frame_bytes);
+        } else if (device->format == SNDRV_PCM_FORMAT_FLOAT_LE) {
+            memcpy(out, in, sizeof(float) * samples);
+        } else if (device->format == SNDRV_PCM_FORMAT_S32_LE) {
+            k->to_s32(in, (int32_t*)out, samples);
+        } else {
+            k->to_s16(in, (int16_t*)out, samples);
+        }
+        if (in) in += samples;
+        frames -= n;
+        at = 0;
+    }
+}
+
+// a prepare after an underrun leaves appl_ptr wherever hw_ptr stopped, so
+// periods are not assumed to line up with the end of the buffer
+void alsa_fill_silence(AlsaDevice* device) {
+    alsa_sync(device, SNDRV_PCM_SYNC_PTR_HWSYNC);
+    uint64_t avail = alsa_avail(device);
+    while (avail >= device->period_frames) {
+        uint64_t at = device->control->appl_ptr % device->buffer_frames;
+        alsa_write(device, NULL, NULL, at, device->period_frames);
+        alsa_commit(device, device->period_frames);
+        avail -= device->period_frames;
+    }
+}
+
+// engine blocks go through the resampler until it holds a period at the
+// device's rate, none, one or two of them, since a period is not a whole
+// number of blocks. The master output is read planar, before interleaving
+void alsa_render_resampled(AudioEngine* engine,
+                           AlsaDevice* device,
+                           uint64_t at) {
+    Resampler* resampler = device->resampler;
+    uint32_t frames = device->period_frames;
+    while (resample_ready(resampler) < frames) {
+        audio_process_block(engine, engine->mix, engine->block_frames);
+        AudioGraph* graph = engine->graph;
+        uint32_t written = resample_write(resampler,
+                                          graph_left(graph, graph->output),
+                                          graph_right(graph, graph->output),
+                                          engine->block_frames);
+        assert(written == engine->block_frames);
+        (void)written;
+    }
+    resample_read(
+        resampler, device->resample_left, device->resample_right, frames);
+    engine->kernels.interleave(
+        device->resample_left, device->resample_right, engine->mix, frames);
+    alsa_write(device, &engine->kernels, engine->mix, at, frames);
+}
+
+
+// the engine renders straight into the dma buffer when it takes float and
+// the period does not wrap, else through the mix buffer
+void alsa_render_period(AudioEngine* engine, AlsaDevice* device) {
+    uint32_t frames = device->period_frames;
+    uint64_t at = device->control->appl_ptr % device->buffer_frames;
+    if (device->resampler) {
+        alsa_render_resampled(engine, device, at);
+    } else if (device->format == SNDRV_PCM_FORMAT_FLOAT_LE &&
+        at + frames <= device->buffer_frames) {
+        float* out = (float*)(device->buffer + at * device->frame_bytes);
+        audio_process_block(engine, out, frames);
+    } else {
+        audio_process_block(engine, engine->mix, frames);
+        alsa_write(device, &engine->kernels, engine->mix, at, frames);
+    }
+    alsa_commit(device, frames);
+}
+
+void alsa_recover(AudioEngine* engine, AlsaDevice* device) {
+    uint64_t xruns =
+        __atomic_add_fetch(&engine->stats.xruns, 1, __ATOMIC_RELAXED);
+    audio_post(engine, audio_event_xrun, xruns, NULL);
+    ioctl(device->fd, SNDRV_PCM_IOCTL_PREPARE);
+    alsa_fill_silence(device);
+    ioctl(device->fd, SNDRV_PCM_IOCTL_START);
+}
+
+// sleeps in poll until a period is free, renders every free period, and
+// restarts from silence after an underrun
+void alsa_run(AudioEngine* engine) {
+    AlsaDevice* device = engine->device;
+    __atomic_store_n(
+        &engine->stats.period_frames, device->period_frames, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &engine->stats.buffer_frames, device->buffer_frames, __ATOMIC_RELAXED);
+
+    alsa_fill_silence(device);
+    ioctl(device->fd, SNDRV_PCM_IOCTL_START);
+    struct pollfd fds = {.fd = device->fd, .events = POLLOUT};
+    while (__atomic_load_n(&engine->running, __ATOMIC_ACQUIRE)) {
+        int ready = poll(&fds, 1, alsa_poll_timeout_ms);
+        if (ready < 0 && errno != EINTR) break;
+        alsa_sync(device, SNDRV_PCM_SYNC_PTR_HWSYNC);
+        int state = device->status->state;
+        if (state == SNDRV_PCM_STATE_XRUN || (fds.revents & POLLERR)) {
+            alsa_recover(engine, device);
+            continue;
+        }
+        if (state == SNDRV_PCM_STATE_DISCONNECTED) break;
+
+        while (alsa_avail(device) >= device->period_frames) {
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            alsa_render_period(engine, device);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            audio_record_block(engine, &t0, &t1, device->period_frames);
+        }
+        snd_pcm_sframes_t delay = 0;
+        if (ioctl(device->fd, SNDRV_PCM_IOCTL_DELAY, &delay) == 0) {
+            __atomic_store_n(&engine->stats.latency_frames,
+                             (uint32_t)(delay > 0 ? delay : 0),
+                             __ATOMIC_RELAXED);
+        }
+    }
+    ioctl(device->fd, SNDRV_PCM_IOCTL_DROP);
+}
+
+//-----------------------------------------------------------------------------
+// measurement
+//-----------------------------------------------------------------------------
+
+void alsa_print_stats(const AudioEngine* engine, double seconds) {
+    const AudioStats* stats = &engine->stats;
+    float load, load_max;
+    __atomic_load(&stats->load, &load, __ATOMIC_RELAXED);
+    __atomic_load(&stats->load_max, &load_max, __ATOMIC_RELAXED);
+    uint64_t callbacks = __atomic_load_n(&stats->callbacks, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_load_n(&stats->dsp_ns_total, __ATOMIC_RELAXED);
+    uint32_t period = __atomic_load_n(&stats->period_frames, __ATOMIC_RELAXED);
+    uint32_t buffer = __atomic_load_n(&stats->buffer_frames, __ATOMIC_RELAXED);
+    uint32_t latency =
+        __atomic_load_n(&stats->latency_frames, __ATOMIC_RELAXED);
+    printf("%6.1f s: %" PRIu64 " callbacks, dsp avg %.1f us max %.1f us, "
+           "load %.1f%% max %.1f%%, %" PRIu64 " xruns, %" PRIu64
+           " late, period %u buffer %u, latency %.2f ms\n",
+           seconds,
+           callbacks,
+           callbacks ? total / 1e3 / callbacks : 0.0,
+           __atomic_load_n(&stats->dsp_ns_max, __ATOMIC_RELAXED) / 1e3,
+           100.0f * load,
+           100.0f * load_max,
+           __atomic_load_n(&stats->xruns, __ATOMIC_RELAXED),
+           __atomic_load_n(&engine->late_blocks, __ATOMIC_RELAXED),
+           period,
+           buffer,
+           1e3 * latency /
+               (engine->device ? engine->device->rate : engine->sample_rate));
+    // what the UI would draw this frame
+    if (engine->meters) {
+        MeterReading master;
+        meter_read(engine->meters, engine->graph->output, &master);
+        printf("          master peak %.1f/%.1f dBFS, rms %.1f/%.1f dB, "
+               "momentary %.1f LUFS, short-term %.1f LUFS\n",
+               meter_db(master.peak[0]),
+               meter_db(master.peak[1]),
+               meter_power_db(master.power[0]),
+               meter_power_db(master.power[1]),
+               meter_lufs(master.momentary),
+               meter_lufs(master.short_term));
+    }
+    for (uint32_t i = 0; i < engine->reverb_count; i++) {
+        const Reverb* reverb = engine->reverbs[i];
+        printf("          reverb %s: tail thread %.1f%%, %" PRIu64
+               " chunks played dry, %u restarts\n",
+               reverb->name,
+               100.0 * __atomic_load_n(&reverb->tail_ns, __ATOMIC_RELAXED) /
+                   1e9 / seconds,
+               __atomic_load_n(&reverb->late_chunks, __ATOMIC_RELAXED),
+               __atomic_load_n(&reverb->resets, __ATOMIC_RELAXED));
+    }
+    const Sequencer* seq = &engine->sequencer;
+    uint64_t late_notes = __atomic_load_n(&seq->late_notes, __ATOMIC_RELAXED);
+    uint64_t dropped_notes =
+        __atomic_load_n(&seq->dropped_notes, __ATOMIC_RELAXED);
+    if (late_notes || dropped_notes)
+        printf("          sequencer: %" PRIu64 " notes late past the event "
+               "cap, %" PRIu64 " dropped with the off heap full\n",
+               late_notes,
+               dropped_notes);
+    uint64_t auditions = __atomic_load_n(&stats->auditions, __ATOMIC_RELAXED);
+    if (!auditions) return;
+    printf("          %" PRIu64 " auditions, key to block avg %.1f us max "
+           "%.1f us, %" PRIu64 " blocks over a period\n",
+           auditions,
+           __atomic_load_n(&stats->audition_ns_total, __ATOMIC_RELAXED) /
+               1e3 / auditions,
+           __atomic_load_n(&stats->audition_ns_max, __ATOMIC_RELAXED) / 1e3,
+           __atomic_load_n(&stats->audition_late, __ATOMIC_RELAXED));
+}
+
+// plays the generated project through the device and reports once a
+// second; without a device the clock-paced thread stands in for it
+//
+// WAR_DEVICE_SECONDS  how long to play (default 10)
+// WAR_DEVICE_NOTES    notes in the generated project (default 100000)
+// WAR_AUDIO           WAV streamed from the timeline origin
+// WAR_AUTOMATION      1 for the demo lanes, see audio_load_env_automation
+// WAR_FREEZE          1 to play the instrument from its cached render
+// WAR_REVERB          reverb sends, see audio_load_env_reverb
+// WAR_MIDI_*          live input played over it, see midi_start
+// WAR_AUDITION        key presses a second, sent the way the UI sends
+//                     them, see audio_audition (default 0)
+void alsa_measure_run(void) {
+    header("alsa_measure_run");
+
+    const char* seconds_env = getenv("WAR_DEVICE_SECONDS");
+    const char* notes_env = getenv("WAR_DEVICE_NOTES");
+    const char* audition_env = getenv("WAR_AUDITION");
+    uint32_t auditions =
+        audition_env ? (uint32_t)strtoul(audition_env, NULL, 10) : 0;
+    if (auditions > 50) auditions = 50;
+    uint32_t seconds =
+        seconds_env ? (uint32_t)strtoul(seconds_env, NULL, 10) : 10;
+    uint32_t note_count =
+        notes_env ? (uint32_t)strtoul(notes_env, NULL, 10) : 100000;
+
+    AlsaDevice* device = alsa_open_env(audio_sample_rate);
+    AudioEngine* engine = audio_make_engine(
+        audio_sample_rate,
+        device ? device->period_frames : audio_block_frames);
+    engine->device = device;
+    printf("device: %s\n", device ? device->path : "none, clock paced");
+
+    NoteTrack track;
+    notes_make_track(&track, note_count);
+    notes_fill_demo(&track, note_count);
+    audio_set_track(engine, &track);
+    TempoMap* tempo_map = audio_tempo_map(engine);
+    assert(tempo_map);
+    audio_demo_tempo_map(tempo_map, engine->sample_rate);
+    Sampler* sampler = sampler_make();
+    sampler_load_env_clip(sampler);
+    sampler_start(sampler);
+    engine->sampler = sampler;
+    audio_load_env_plugin(engine);
+    audio_load_env_freeze(engine, &track, tempo_map);
+    if (engine->freeze) sampler_start(engine->freeze->sampler);
+    audio_load_env_reverb(engine, 0);
+    audio_send_pointer(engine, audio_cmd_set_tempo_map, tempo_map);
+    notes_free_track(&track);
+    audio_load_env_automation(engine);
+
+    audio_start(engine);
+    MidiInput* midi = midi_start(engine);
+    printf("realtime: %s\n", engine->realtime ? "SCHED_FIFO" : "no");
+    audio_send(engine, audio_cmd_play, 0, 0.0f, 0);
+    AudioMessage event;
+    for (uint32_t s = 1; s <= seconds; s++) {
+        for (uint32_t i = 0; i < 100; i++) {
+            while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+            audio_idle(engine);
+            // pressed on one tick, released on the next; the ticks fall
+            // anywhere in a block
+            uint32_t every = auditions ? 100 / auditions : 0;
+            if (every && i % every < 2) {
+                uint32_t note = 48 + (s * 7 + i / every) % 24;
+                audio_audition(engine,
+                               i % every ? audio_cmd_note_off
+                                         : audio_cmd_note_on,
+                               note,
+                               0.8f,
+                               midi_now_ns());
+            }
+            struct timespec wait = {.tv_sec = 0, .tv_nsec = 10000000};
+            nanosleep(&wait, NULL);
+        }
+        alsa_print_stats(engine, s);
+    }
+    audio_finish(engine);
+    if (midi) {
+        printf("midi: %" PRIu64 " events, %" PRIu64 " dropped\n",
+               midi->events,
+               midi->dropped);
+        midi_stop(midi);
+    }
+    sampler_free(sampler);
+    if (device) alsa_close(device);
+    audio_free_engine(engine);
+
+    end("alsa_measure_run");
+}
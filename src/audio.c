@@ -0,0 +1,1123 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/audio.c
+//=============================================================================
+
+#include "audio.h"
+#include "alsa.h"
+#include "automation.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "freeze.h"
+#include "graph.h"
+#include "macros.h"
+#include "meter.h"
+#include "mix.h"
+#include "notes.h"
+#include "plugin.h"
+#include "pool.h"
+#include "reverb.h"
+#include "sampler.h"
+#include "sandbox.h"
+#include "sequencer.h"
+#include "stats.h"
+#include "synth.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------------
+// wait-free spsc queue: one load of the other side, one release store
+//-----------------------------------------------------------------------------
+
+uint8_t spsc_push(SpscQueue* queue, const AudioMessage* message) {
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (tail - head == audio_queue_capacity) return 0;
+    queue->slots[tail & (audio_queue_capacity - 1)] = *message;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// producer side: 1 when a push would fail
+uint8_t spsc_full(SpscQueue* queue) {
+    return __atomic_load_n(&queue->tail, __ATOMIC_RELAXED) -
+               __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) ==
+           audio_queue_capacity;
+}
+
+// producer side: 1 once the consumer has taken everything pushed
+uint8_t spsc_drained(SpscQueue* queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+}
+
+uint8_t spsc_pop(SpscQueue* queue, AudioMessage* message) {
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head == tail) return 0;
+    *message = queue->slots[head & (audio_queue_capacity - 1)];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// engine
+//-----------------------------------------------------------------------------
+
+AudioEngine* audio_make_engine(uint32_t sample_rate, uint32_t block_frames) {
+    header("audio_make_engine");
+
+    assert(block_frames > 0 && block_frames <= audio_max_block_frames);
+    AudioEngine* engine = aligned_alloc(64, sizeof(AudioEngine));
+    assert(engine);
+    memset(engine, 0, sizeof(AudioEngine));
+    engine->sample_rate = sample_rate;
+    engine->block_frames = block_frames;
+    engine->tempo_bpm = 120.0f;
+    engine->gain = 0.15f;
+    tempo_map_constant(&engine->tempo_map, sample_rate, engine->tempo_bpm);
+    mix_select(&engine->kernels);
+    synth_make(&engine->synth, sample_rate);
+    pool_make(&engine->tempo_maps, sizeof(TempoMap), audio_tempo_map_pool);
+    if (meter_env()) engine->meters = meter_make(sample_rate);
+
+    engine->graph = audio_build_graph(engine);
+    assert(engine->graph);
+
+    end("audio_make_engine");
+    return engine;
+}
+
+// instrument and clips into the master, with the plugin and then the
+// sandboxed one, if there are any, between the instrument and the master,
+// and each reverb fed from both as a send into the master; tracks and
+// effects add nodes. UI side: a running engine takes it
+// through audio_cmd_set_graph.
+//
+// Frozen, the render plays into the master instead. The chain's nodes stay,
+// empty and unconnected, so lanes keep their nodes and nothing baked into
+// the render is applied twice; live input has nothing to play
+AudioGraph* audio_build_graph(AudioEngine* engine) {
+    GraphDesc* desc = malloc(sizeof(GraphDesc));
+    assert(desc);
+    graph_desc_init(desc);
+    uint8_t frozen = engine->freeze && engine->freeze->active;
+    uint32_t instrument = graph_add_node(
+        desc, frozen ? NULL : audio_graph_instrument, engine, 1.0f, 1.0f);
+    graph_set_name(desc, instrument, "instrument");
+    uint32_t clips =
+        graph_add_node(desc, audio_graph_clips, engine, 1.0f, 1.0f);
+    graph_set_name(desc, clips, "clips");
+    desc->output = graph_add_node(desc, NULL, NULL, 1.0f, 1.0f);
+    graph_set_name(desc, desc->output, "master");
+    assert(instrument == audio_node_instrument && clips == audio_node_clips &&
+           desc->output == audio_node_master);
+    if (engine->plugin) {
+        PluginInstance* plugin = engine->plugin;
+        plugin->events = engine->live_events;
+        plugin->event_count = &engine->live_count;
+        // restarting, its node passes the instrument through as it is
+        uint8_t out = frozen || plugin->restarting || !plugin->active;
+        uint32_t node = graph_add_node(
+            desc, out ? NULL : plugin_node, plugin, 1.0f, 1.0f);
+        graph_set_latency(desc, node, out ? 0 : plugin->latency);
+        graph_set_name(desc, node, plugin->plugin->desc->name);
+        graph_connect(desc, instrument, node);
+        instrument = node;
+    }
+    if (engine->sandbox) {
+        SandboxPlugin* sandbox = engine->sandbox;
+        sandbox->events = engine->live_events;
+        sandbox->event_count = &engine->live_count;
+        uint32_t node = graph_add_node(
+            desc, frozen ? NULL : sandbox_node, sandbox, 1.0f, 1.0f);
+        graph_set_latency(desc, node, sandbox->latency);
+        graph_set_name(desc, node, sandbox->name);
+        graph_connect(desc, instrument, node);
+        instrument = node;
+    }
+    if (frozen) {
+        instrument = graph_add_node(desc, freeze_node, engine, 1.0f, 1.0f);
+        graph_set_latency(desc, instrument, engine->freeze->latency);
+        graph_set_name(desc, instrument, "frozen");
+    }
+    graph_connect(desc, instrument, desc->output);
+    graph_connect(desc, clips, desc->output);
+    for (uint32_t i = 0; i < engine->reverb_count; i++) {
+        // about -12 dB of wet each, under the dry
+        uint32_t node = graph_add_node(
+            desc, reverb_node, engine->reverbs[i], 0.25f, 4.0f);
+        graph_set_name(desc, node, engine->reverbs[i]->name);
+        graph_connect(desc, instrument, node);
+        graph_connect(desc, clips, node);
+        graph_connect(desc, node, desc->output);
+    }
+    AudioGraph* graph = graph_compile(desc,
+                                      engine->block_frames,
+                                      audio_graph_workers(),
+                                      &engine->kernels);
+    if (graph && engine->profile) stats_attach(engine->profile, graph);
+    free(desc);
+    return graph;
+}
+
+// WAR_PLUGIN: a CLAP plugin after the instrument, WAR_PLUGIN_ID picks
+// one out of a library with several, WAR_SANDBOX=1 runs it in a child
+// and WAR_SANDBOX_BUDGET is the percent of a block the child may take.
+// Before the engine starts
+void audio_load_env_plugin(AudioEngine* engine) {
+    const char* path = getenv("WAR_PLUGIN");
+    const char* sandbox = getenv("WAR_SANDBOX");
+    if (!path) return;
+    if (sandbox && !strcmp(sandbox, "1")) {
+        engine->sandbox = sandbox_load(path,
+                                       getenv("WAR_PLUGIN_ID"),
+                                       engine->sample_rate,
+                                       engine->block_frames);
+    } else {
+        engine->plugin = plugin_load(path,
+                                     getenv("WAR_PLUGIN_ID"),
+                                     engine->sample_rate,
+                                     engine->block_frames,
+                                     &engine->pool);
+    }
+    if (!engine->plugin && !engine->sandbox) return;
+    AudioGraph* graph = audio_build_graph(engine);
+    assert(graph);
+    graph_free(engine->graph);
+    engine->graph = graph;
+}
+
+// after audio_stop, with every retire event handled
+void audio_free_engine(AudioEngine* engine) {
+    graph_free(engine->graph);
+    if (engine->plugin) plugin_free(engine->plugin);
+    if (engine->sandbox) sandbox_free(engine->sandbox);
+    if (engine->profile) stats_close(engine->profile, engine->profile_path);
+    if (engine->automation) automation_free(engine->automation);
+    if (engine->freeze) freeze_free(engine->freeze);
+    if (engine->meters) meter_free(engine->meters);
+    for (uint32_t i = 0; i < engine->reverb_count; i++)
+        reverb_free(engine->reverbs[i]);
+    pool_free(&engine->tempo_maps);
+    free(engine);
+}
+
+// WAR_GRAPH_WORKERS, else one per core
+uint32_t audio_graph_workers(void) {
+    const char* env = getenv("WAR_GRAPH_WORKERS");
+    long workers = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > max_graph_workers) workers = max_graph_workers;
+    return (uint32_t)workers;
+}
+
+// UI side; a full queue drops the command rather than blocking
+uint8_t audio_send(AudioEngine* engine,
+                   uint32_t type,
+                   uint32_t note,
+                   float value,
+                   uint64_t frame) {
+    if (engine->freeze && engine->freeze->active) {
+        if (type == audio_cmd_gain && value != engine->freeze->gain)
+            audio_thaw(engine);
+        if (type == audio_cmd_tempo) {
+            TempoMap* map = malloc(sizeof(TempoMap));
+            assert(map);
+            tempo_map_constant(map, engine->sample_rate, value);
+            if (freeze_key_tempo(map) != engine->freeze->tempo_key)
+                audio_thaw(engine);
+            free(map);
+        }
+    }
+    AudioMessage message = {
+        .type = type,
+        .note = note,
+        .value = value,
+        .frame = frame,
+    };
+    return spsc_push(&engine->commands, &message);
+}
+
+// ownership of pointer passes to the engine until it comes back as an
+// audio_event_retire
+uint8_t audio_send_pointer(AudioEngine* engine, uint32_t type, void* pointer) {
+    if (type == audio_cmd_set_tempo_map && engine->freeze &&
+        engine->freeze->active &&
+        freeze_key_tempo(pointer) != engine->freeze->tempo_key)
+        audio_thaw(engine);
+    AudioMessage message = {.type = type, .pointer = pointer};
+    return spsc_push(&engine->commands, &message);
+}
+
+// UI side, straight from a key event, before the model is updated or a
+// frame drawn: the note plays from the start of the next block, on the
+// instrument and the plugin like any live input. ns is when the key came
+// in; the wait from there to the block is kept in the stats
+uint8_t audio_audition(AudioEngine* engine,
+                       uint32_t type,
+                       uint32_t note,
+                       float velocity,
+                       uint64_t ns) {
+    AudioMessage message = {
+        .type = type,
+        .note = note & 0x7f,
+        .value = velocity,
+        .frame = ns,
+    };
+    return spsc_push(&engine->audition, &message);
+}
+
+// UI side: a tempo map to fill in and send with audio_cmd_set_tempo_map.
+// The audio thread copies it and puts it straight back, so there is no
+// retire round trip; NULL when every one is still in flight
+TempoMap* audio_tempo_map(AudioEngine* engine) {
+    return pool_get(&engine->tempo_maps);
+}
+
+void audio_post(AudioEngine* engine,
+                uint32_t type,
+                uint64_t frame,
+                void* pointer) {
+    AudioMessage message = {.type = type, .frame = frame, .pointer = pointer};
+    if (!spsc_push(&engine->events, &message)) engine->dropped_events++;
+}
+
+// UI side: publishes a copy of the track; the previous copy is retired
+void audio_set_track(AudioEngine* engine, const NoteTrack* track) {
+    if (engine->freeze && engine->freeze->active &&
+        freeze_key_notes(track) != engine->freeze->notes_key)
+        audio_thaw(engine);
+    NoteTrack* snapshot = malloc(sizeof(NoteTrack));
+    assert(snapshot);
+    notes_clone(track, snapshot);
+    if (!audio_send_pointer(engine, audio_cmd_set_track, snapshot)) {
+        notes_free_track(snapshot);
+        free(snapshot);
+    }
+}
+
+// UI side: publishes a copy of the lanes, against the nodes of the graph
+// now playing; the previous set is retired
+void audio_set_automation(AudioEngine* engine,
+                          const AutomationLane* lanes,
+                          uint32_t lane_count) {
+    if (engine->freeze && engine->freeze->active &&
+        freeze_key_lanes(lanes, lane_count) != engine->freeze->lanes_key)
+        audio_thaw(engine);
+    Automation* automation =
+        automation_make(lanes, lane_count, engine->block_frames);
+    if (!audio_send_pointer(engine, audio_cmd_set_automation, automation))
+        automation_free(automation);
+}
+
+// UI side: the chain plays live again once something its render was made
+// from changes. The render stays cached for when it changes back
+void audio_thaw(AudioEngine* engine) {
+    engine->freeze->active = 0;
+    AudioGraph* graph = audio_build_graph(engine);
+    assert(graph);
+    if (!audio_send_pointer(engine, audio_cmd_set_graph, graph)) {
+        graph_free(graph);
+        engine->freeze->active = 1;
+        return;
+    }
+    call_carmack("freeze: thawed, %s", engine->freeze->path);
+}
+
+// UI side, every frame or tick: the plugin's main thread work, and the
+// sandboxed child reaped if it died. A latency change rebuilds the graph
+// around it. A restart sends a graph without it, then restarts it once
+// the audio thread has taken that graph and every command before it, and
+// sends one with it again. A full queue leaves the graph for the next call
+void audio_idle(AudioEngine* engine) {
+    if (engine->sandbox) sandbox_idle(engine->sandbox);
+    PluginInstance* plugin = engine->plugin;
+    if (plugin && plugin->restarting && !engine->graph_stale &&
+        spsc_drained(&engine->commands)) {
+        plugin_restart(plugin);
+        engine->graph_stale = 1;
+    }
+    if (plugin && plugin_idle(plugin)) engine->graph_stale = 1;
+    if (!engine->graph_stale) return;
+    AudioGraph* graph = audio_build_graph(engine);
+    assert(graph);
+    if (!audio_send_pointer(engine, audio_cmd_set_graph, graph)) {
+        graph_free(graph);
+        return;
+    }
+    engine->graph_stale = 0;
+    call_carmack("audio: graph rebuilt, %u frames latency", graph->latency);
+}
+
+// UI side: frees everything the audio thread has handed back so far
+void audio_drain(AudioEngine* engine) {
+    AudioMessage event;
+    while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+}
+
+// UI side: frees what the audio thread handed back
+void audio_retire(const AudioMessage* event) {
+    if (event->type != audio_event_retire || !event->pointer) return;
+    if (event->frame == audio_cmd_set_graph) {
+        graph_free(event->pointer);
+        return;
+    }
+    if (event->frame == audio_cmd_set_automation) {
+        automation_free(event->pointer);
+        return;
+    }
+    if (event->frame == audio_cmd_set_track) {
+        notes_free_track(event->pointer);
+    }
+    free(event->pointer);
+}
+
+void audio_apply(AudioEngine* engine, const AudioMessage* message) {
+    switch (message->type) {
+    case audio_cmd_play:
+        engine->playing = 1;
+        sequencer_reset(&engine->sequencer);
+        break;
+    case audio_cmd_stop:
+        engine->playing = 0;
+        synth_release_all(&engine->synth);
+        break;
+    case audio_cmd_seek:
+        engine->frame = message->frame;
+        synth_release_all(&engine->synth);
+        sequencer_reset(&engine->sequencer);
+        break;
+    case audio_cmd_tempo:
+        engine->tempo_bpm = message->value;
+        tempo_map_constant(
+            &engine->tempo_map, engine->sample_rate, engine->tempo_bpm);
+        sequencer_reset(&engine->sequencer);
+        break;
+    case audio_cmd_note_on:
+        synth_note_on(&engine->synth, message->note, message->value);
+        break;
+    case audio_cmd_note_off:
+        synth_note_off(&engine->synth, message->note);
+        break;
+    case audio_cmd_gain:
+        engine->gain = message->value;
+        break;
+    case audio_cmd_set_track: {
+        const NoteTrack* old = engine->sequencer.track;
+        engine->sequencer.track = message->pointer;
+        synth_release_all(&engine->synth);
+        sequencer_reset(&engine->sequencer);
+        // frame carries the command so the UI knows how to free it
+        if (old) {
+            audio_post(
+                engine, audio_event_retire, audio_cmd_set_track, (void*)old);
+        }
+        break;
+    }
+    case audio_cmd_set_tempo_map:
+        memcpy(&engine->tempo_map, message->pointer, sizeof(TempoMap));
+        engine->tempo_map.cached = 0;
+        sequencer_reset(&engine->sequencer);
+        pool_put(&engine->tempo_maps, message->pointer);
+        break;
+    case audio_cmd_set_graph: {
+        // compiled by the UI for this engine's block size and kernels
+        AudioGraph* old = engine->graph;
+        engine->graph = message->pointer;
+        audio_post(engine, audio_event_retire, audio_cmd_set_graph, old);
+        // an instrument that was not in the old graph has not been
+        // following the transport
+        synth_release_all(&engine->synth);
+        sequencer_reset(&engine->sequencer);
+        break;
+    }
+    case audio_cmd_set_automation: {
+        Automation* old = engine->automation;
+        engine->automation = message->pointer;
+        if (old) {
+            audio_post(
+                engine, audio_event_retire, audio_cmd_set_automation, old);
+        }
+        break;
+    }
+    }
+}
+
+void audio_render_span(AudioEngine* engine,
+                       float* left,
+                       float* right,
+                       uint32_t frames) {
+    synth_render(&engine->synth, engine->voice_buffer, frames);
+    engine->kernels.pan_add(engine->voice_buffer,
+                            left,
+                            right,
+                            engine->gain,
+                            engine->gain,
+                            frames);
+}
+
+// graph node: the note store through the sequencer, and live input, into
+// the synth
+void audio_graph_instrument(void* state,
+                            AudioGraph* graph,
+                            uint32_t node,
+                            uint32_t frames) {
+    AudioEngine* engine = state;
+    float* left = graph_left(graph, node);
+    float* right = graph_right(graph, node);
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+
+    // the block is split at every event so notes start on their sample;
+    // live input plays whether or not the transport runs
+    Sequencer* seq = &engine->sequencer;
+    uint32_t scheduled = 0;
+    if (engine->playing) {
+        sequencer_collect(seq, &engine->tempo_map, engine->frame, frames);
+        scheduled = seq->event_count;
+    }
+    uint32_t done = 0;
+    uint32_t s = 0;
+    uint32_t l = 0;
+    while (s < scheduled || l < engine->live_count) {
+        // sequenced events first on a tie
+        const SequencerEvent* event =
+            l == engine->live_count ||
+                    (s < scheduled && seq->events[s].offset <=
+                                          engine->live_events[l].offset)
+                ? &seq->events[s++]
+                : &engine->live_events[l++];
+        if (event->offset > done) {
+            audio_render_span(
+                engine, left + done, right + done, event->offset - done);
+            done = event->offset;
+        }
+        if (event->type == sequencer_event_on) {
+            synth_note_on(
+                &engine->synth, event->pitch, event->velocity / 127.0f);
+        } else {
+            synth_note_off(&engine->synth, event->pitch);
+        }
+    }
+    audio_render_span(engine, left + done, right + done, frames - done);
+}
+
+// graph node: streamed audio clips
+void audio_graph_clips(void* state,
+                       AudioGraph* graph,
+                       uint32_t node,
+                       uint32_t frames) {
+    AudioEngine* engine = state;
+    float* left = graph_left(graph, node);
+    float* right = graph_right(graph, node);
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+    if (!engine->playing || !engine->sampler) return;
+    sampler_render(engine->sampler,
+                   &engine->kernels,
+                   engine->frame,
+                   frames,
+                   left,
+                   right);
+}
+
+// live input is played one block late, at the offset its timestamp had in
+// the block before: the latency is a constant period instead of a jitter of
+// up to one. An event stamped before the last drain but queued after it
+// lands at offset 0. Auditions skip the wait and all land at offset 0:
+// one note at a time needs no timing, only to be heard
+void audio_collect_live(AudioEngine* engine, uint32_t frames) {
+    uint64_t since = engine->block_ns;
+    uint32_t last = 0;
+    AudioMessage message;
+    engine->live_count = 0;
+    uint32_t auditions = 0;
+    uint64_t stamp_min = UINT64_MAX;
+    uint64_t stamp_max = 0;
+    uint64_t stamp_total = 0;
+    while (engine->live_count < max_block_events &&
+           spsc_pop(&engine->audition, &message)) {
+        engine->live_events[engine->live_count++] = (SequencerEvent){
+            .offset = 0,
+            .type = message.type == audio_cmd_note_on ? sequencer_event_on
+                                                      : sequencer_event_off,
+            .pitch = (uint8_t)message.note,
+            .velocity = (uint8_t)lroundf(message.value * 127.0f),
+        };
+        if (message.type != audio_cmd_note_on) continue;
+        auditions++;
+        stamp_min = message.frame < stamp_min ? message.frame : stamp_min;
+        stamp_max = message.frame > stamp_max ? message.frame : stamp_max;
+        stamp_total += message.frame;
+    }
+    while (engine->live_count < max_block_events &&
+           spsc_pop(&engine->midi, &message)) {
+        uint64_t offset = 0;
+        if (since && message.frame > since) {
+            offset = (message.frame - since) * engine->sample_rate /
+                     1000000000ull;
+        }
+        if (offset >= frames) offset = frames - 1;
+        if (offset < last) offset = last;
+        last = (uint32_t)offset;
+        engine->live_events[engine->live_count++] = (SequencerEvent){
+            .offset = last,
+            .type = message.type == audio_cmd_note_on ? sequencer_event_on
+                                                      : sequencer_event_off,
+            .pitch = (uint8_t)message.note,
+            .velocity = (uint8_t)lroundf(message.value * 127.0f),
+        };
+    }
+    // after the drain, so every event popped was stamped before it
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    engine->block_ns =
+        (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    if (auditions) {
+        audio_record_auditions(
+            engine, auditions, stamp_min, stamp_max, stamp_total);
+    }
+}
+
+// every stamp was taken before block_ns, so none of the waits is negative
+void audio_record_auditions(AudioEngine* engine,
+                            uint32_t count,
+                            uint64_t stamp_min,
+                            uint64_t stamp_max,
+                            uint64_t stamp_total) {
+    AudioStats* stats = &engine->stats;
+    uint64_t now = engine->block_ns;
+    uint64_t period_ns = (uint64_t)engine->block_frames * 1000000000ull /
+                         engine->sample_rate;
+    uint64_t longest = now - stamp_min;
+    __atomic_store_n(
+        &stats->audition_ns_last, now - stamp_max, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->audition_ns_total,
+                     stats->audition_ns_total + count * now - stamp_total,
+                     __ATOMIC_RELAXED);
+    if (longest > stats->audition_ns_max)
+        __atomic_store_n(&stats->audition_ns_max, longest, __ATOMIC_RELAXED);
+    if (longest > period_ns) {
+        __atomic_store_n(&stats->audition_late,
+                         stats->audition_late + 1,
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(
+        &stats->auditions, stats->auditions + count, __ATOMIC_RELAXED);
+}
+
+// audio thread only: no locks, no allocation, bounded work per block
+void audio_process_block(AudioEngine* engine, float* out, uint32_t frames) {
+    AudioMessage message;
+    for (uint32_t i = 0; i < audio_queue_capacity; i++) {
+        // a command retires at most one pointer, which must not be lost:
+        // with no room to post it the command waits for the UI to drain
+        if (spsc_full(&engine->events)) break;
+        if (!spsc_pop(&engine->commands, &message)) break;
+        audio_apply(engine, &message);
+    }
+    audio_collect_live(engine, frames);
+    if (engine->sampler) sampler_locate(engine->sampler, engine->frame);
+    // lanes before the graph, so every node reads this block's values
+    if (engine->automation) {
+        automation_run(engine->automation,
+                       &engine->kernels,
+                       engine->frame,
+                       frames,
+                       engine->playing);
+    }
+    engine->pool.automation = engine->automation;
+    engine->pool.meters = engine->meters;
+
+    AudioGraph* graph = engine->graph;
+    graph_run(&engine->pool, graph, frames);
+    engine->kernels.interleave(graph_left(graph, graph->output),
+                               graph_right(graph, graph->output),
+                               out,
+                               frames);
+    if (!engine->playing) return;
+
+    engine->frame += frames;
+    __atomic_store_n(&engine->position, engine->frame, __ATOMIC_RELAXED);
+}
+
+// per-callback timing; load is the share of the period spent rendering
+void audio_record_block(AudioEngine* engine,
+                        const struct timespec* t0,
+                        const struct timespec* t1,
+                        uint32_t frames) {
+    AudioStats* stats = &engine->stats;
+    uint64_t ns = (uint64_t)(t1->tv_sec - t0->tv_sec) * 1000000000ull +
+                  (uint64_t)(t1->tv_nsec - t0->tv_nsec);
+    uint64_t period_ns = (uint64_t)frames * 1000000000ull / engine->sample_rate;
+    float load = (float)ns / (float)period_ns;
+    float smoothed = stats->load + (load - stats->load) * 0.05f;
+    __atomic_store_n(&stats->dsp_ns_last, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->dsp_ns_total,
+                     stats->dsp_ns_total + ns,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->period_ns, period_ns, __ATOMIC_RELAXED);
+    if (ns > stats->dsp_ns_max)
+        __atomic_store_n(&stats->dsp_ns_max, ns, __ATOMIC_RELAXED);
+    __atomic_store(&stats->load, &smoothed, __ATOMIC_RELAXED);
+    if (load > stats->load_max)
+        __atomic_store(&stats->load_max, &load, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &stats->callbacks, stats->callbacks + 1, __ATOMIC_RELAXED);
+    if (engine->profile) stats_block(engine->profile, ns, period_ns);
+}
+
+// the device drives the thread when there is one; otherwise blocks are
+// paced on CLOCK_MONOTONIC
+void* audio_thread(void* arg) {
+    AudioEngine* engine = arg;
+    // war-rt-* is what an RT_CHECK build watches
+    pthread_setname_np(pthread_self(), "war-rt-audio");
+    // fault in the stack the callbacks will use
+    volatile uint8_t stack_prefault[64 * 1024];
+    memset((uint8_t*)stack_prefault, 0, sizeof(stack_prefault));
+    if (engine->device) {
+        alsa_run(engine);
+        return NULL;
+    }
+
+    __atomic_store_n(
+        &engine->stats.period_frames, engine->block_frames, __ATOMIC_RELAXED);
+    uint64_t period_ns =
+        (uint64_t)engine->block_frames * 1000000000ull / engine->sample_rate;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (__atomic_load_n(&engine->running, __ATOMIC_ACQUIRE)) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        audio_process_block(engine, engine->mix, engine->block_frames);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        audio_record_block(engine, &t0, &t1, engine->block_frames);
+
+        deadline.tv_nsec += period_ns;
+        while (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            deadline.tv_sec++;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec ||
+            (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec)) {
+            engine->late_blocks++;
+            audio_post(engine, audio_event_late, engine->late_blocks, NULL);
+            deadline = now;
+            continue;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+    return NULL;
+}
+
+void audio_start(AudioEngine* engine) {
+    header("audio_start");
+
+    // page faults on the audio thread are as bad as a lock. On fault, so
+    // mapped sample files are not read in whole
+    if (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) != 0 &&
+        mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        call_carmack("audio: mlockall failed (%d), continuing", errno);
+    }
+    // per node timings for war-top, from the first block
+    if (stats_env_path(engine->profile_path, sizeof(engine->profile_path))) {
+        engine->profile = stats_open(engine->profile_path, engine->sample_rate);
+        if (engine->profile) stats_attach(engine->profile, engine->graph);
+    }
+    __atomic_store_n(&engine->running, 1, __ATOMIC_RELEASE);
+    graph_pool_start(&engine->pool, engine->graph->workers, 1);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    struct sched_param param = {.sched_priority = 70};
+    pthread_attr_setschedparam(&attr, &param);
+    int res = pthread_create(&engine->thread, &attr, audio_thread, engine);
+    engine->realtime = res == 0;
+    if (res == EPERM) {
+        // no rtprio limit for this user: run at normal priority
+        call_carmack("audio: SCHED_FIFO denied, using SCHED_OTHER");
+        res = pthread_create(&engine->thread, NULL, audio_thread, engine);
+    }
+    assert(res == 0);
+    pthread_attr_destroy(&attr);
+
+    end("audio_start");
+}
+
+void audio_stop(AudioEngine* engine) {
+    __atomic_store_n(&engine->running, 0, __ATOMIC_RELEASE);
+    pthread_join(engine->thread, NULL);
+    graph_pool_stop(&engine->pool);
+}
+
+// hands the snapshot back the way a new one would, stops the engine and
+// frees everything it retired. A running engine takes the command on its
+// own thread before it stops, while its pool still has workers; one that
+// was never started runs a block for it here. Before audio_free_engine
+void audio_finish(AudioEngine* engine) {
+    AudioMessage event;
+    uint8_t running = __atomic_load_n(&engine->running, __ATOMIC_ACQUIRE);
+    while (!audio_send_pointer(engine, audio_cmd_set_track, NULL)) {
+        assert(running);
+        while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+        struct timespec wait = {.tv_sec = 0, .tv_nsec = 1000000};
+        nanosleep(&wait, NULL);
+    }
+    if (running) {
+        // whatever the thread has taken is applied once it is joined
+        while (!spsc_drained(&engine->commands)) {
+            while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+            struct timespec wait = {.tv_sec = 0, .tv_nsec = 1000000};
+            nanosleep(&wait, NULL);
+        }
+        audio_stop(engine);
+    } else {
+        audio_process_block(engine, engine->mix, 1);
+        graph_pool_stop(&engine->pool);
+    }
+    while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+}
+
+//-----------------------------------------------------------------------------
+// offline render
+//-----------------------------------------------------------------------------
+
+void audio_write_wav_header(FILE* file,
+                            uint32_t sample_rate,
+                            uint32_t channels,
+                            uint32_t data_bytes) {
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    write_le32(h + 4, 36 + data_bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    write_le32(h + 16, 16);
+    write_le16(h + 20, 3); // IEEE float
+    write_le16(h + 22, (uint16_t)channels);
+    write_le32(h + 24, sample_rate);
+    write_le32(h + 28, sample_rate * channels * 4);
+    write_le16(h + 32, (uint16_t)(channels * 4));
+    write_le16(h + 34, 32);
+    memcpy(h + 36, "data", 4);
+    write_le32(h + 40, data_bytes);
+    fwrite(h, 1, sizeof(h), file);
+}
+
+// the generated project's tempo changes, shared with the export demo
+void audio_demo_tempo_map(TempoMap* map, uint32_t sample_rate) {
+    TempoPoint points[4] = {
+        {.tick = 0, .bpm = 120.0f},
+        {.tick = 32 * note_ticks_per_beat, .bpm = 140.0f},
+        {.tick = 64 * note_ticks_per_beat, .bpm = 90.0f},
+        {.tick = 96 * note_ticks_per_beat, .bpm = 174.0f},
+    };
+    tempo_map_build(map, sample_rate, points, 4);
+}
+
+// the generated project's lanes: a fade in and a later dip on the master,
+// the instrument swept across the stereo field, the clips ducked on a
+// curve and, with a plugin, its first parameter pulled down and back.
+// points holds audio_demo_points; returns the lane count
+uint32_t audio_demo_automation(const AudioEngine* engine,
+                               AutomationLane* lanes,
+                               AutomationPoint* points) {
+    uint64_t s = engine->sample_rate;
+    AutomationPoint* master = points;
+    AutomationPoint* pan = master + 4;
+    AutomationPoint* clips = pan + 16;
+    AutomationPoint* param = clips + 4;
+    master[0] = (AutomationPoint){.frame = 0, .value = 0.0f, .curve = -4.0f};
+    master[1] = (AutomationPoint){.frame = 2 * s, .value = 1.0f};
+    master[2] = (AutomationPoint){.frame = 20 * s, .value = 1.0f};
+    master[3] = (AutomationPoint){.frame = 24 * s, .value = 0.5f};
+    for (uint32_t i = 0; i < 16; i++) {
+        pan[i] = (AutomationPoint){
+            .frame = i * 4 * s,
+            .value = i & 1 ? 0.8f : -0.8f,
+        };
+    }
+    clips[0] = (AutomationPoint){.frame = 8 * s, .value = 1.0f, .curve = 4.0f};
+    clips[1] = (AutomationPoint){.frame = 12 * s, .value = 0.3f};
+    clips[2] =
+        (AutomationPoint){.frame = 14 * s, .value = 0.3f, .curve = -4.0f};
+    clips[3] = (AutomationPoint){.frame = 16 * s, .value = 1.0f};
+    param[0] = (AutomationPoint){.frame = 10 * s, .value = 1.0f};
+    param[1] =
+        (AutomationPoint){.frame = 14 * s, .value = 0.25f, .curve = 2.0f};
+    param[2] = (AutomationPoint){.frame = 18 * s, .value = 1.0f};
+    assert(param + 3 == points + audio_demo_points);
+    lanes[0] = (AutomationLane){
+        .target = automation_volume,
+        .node = audio_node_master,
+        .count = 4,
+        .points = master,
+    };
+    lanes[1] = (AutomationLane){
+        .target = automation_pan,
+        .node = audio_node_instrument,
+        .count = 16,
+        .points = pan,
+    };
+    lanes[2] = (AutomationLane){
+        .target = automation_volume,
+        .node = audio_node_clips,
+        .count = 4,
+        .points = clips,
+    };
+    lanes[3] = (AutomationLane){
+        .target = automation_param,
+        .node = audio_node_inserts,
+        .param = 0,
+        .count = 3,
+        .points = param,
+    };
+    return engine->plugin ? 4 : 3;
+}
+
+// WAR_AUTOMATION=1: the demo lanes, see audio_demo_automation
+void audio_load_env_automation(AudioEngine* engine) {
+    const char* env = getenv("WAR_AUTOMATION");
+    if (!env || strcmp(env, "1")) return;
+    AutomationLane lanes[audio_demo_lanes];
+    AutomationPoint points[audio_demo_points];
+    uint32_t lane_count = audio_demo_automation(engine, lanes, points);
+    audio_set_automation(engine, lanes, lane_count);
+}
+
+// WAR_FREEZE=1: the instrument and its inserts play from a render cached
+// by content, see freeze_open; with WAR_AUTOMATION=1 the demo lanes on
+// them are part of it. After the plugin, before audio_start
+void audio_load_env_freeze(AudioEngine* engine,
+                           const NoteTrack* track,
+                           const TempoMap* tempo_map) {
+    const char* env = getenv("WAR_FREEZE");
+    if (!env || strcmp(env, "1")) return;
+    const char* automation = getenv("WAR_AUTOMATION");
+    AutomationLane lanes[audio_demo_lanes];
+    AutomationPoint points[audio_demo_points];
+    FreezeDesc desc = {
+        .track = track,
+        .tempo_map = tempo_map,
+        .lanes = lanes,
+    };
+    if (automation && !strcmp(automation, "1"))
+        desc.lane_count = audio_demo_automation(engine, lanes, points);
+    engine->freeze = freeze_open(engine, &desc);
+    if (!engine->freeze) return;
+    AudioGraph* graph = audio_build_graph(engine);
+    assert(graph);
+    graph_free(engine->graph);
+    engine->graph = graph;
+}
+
+// WAR_REVERB: convolution reverbs, colon separated, each a WAV impulse
+// response or a length in seconds for a generated one; see reverb_load.
+// An offline render waits for a late tail rather than play without it.
+// Before audio_start
+void audio_load_env_reverb(AudioEngine* engine, uint8_t offline) {
+    const char* env = getenv("WAR_REVERB");
+    if (!env) return;
+    char* list = strdup(env);
+    assert(list);
+    char* save = NULL;
+    for (char* source = strtok_r(list, ":", &save);
+         source && engine->reverb_count < reverb_max;
+         source = strtok_r(NULL, ":", &save)) {
+        Reverb* reverb = reverb_load(source, engine->sample_rate, offline);
+        if (!reverb) {
+            fprintf(stderr, "reverb: cannot load %s\n", source);
+            continue;
+        }
+        engine->reverbs[engine->reverb_count++] = reverb;
+    }
+    free(list);
+    if (!engine->reverb_count) return;
+    AudioGraph* graph = audio_build_graph(engine);
+    assert(graph);
+    graph_free(engine->graph);
+    engine->graph = graph;
+}
+
+// renders as fast as the cpu allows; no device, no real-time thread
+//
+// WAR_OFFLINE_OUT      output path (default war.wav)
+// WAR_OFFLINE_SECONDS  length (default 60)
+// WAR_OFFLINE_BLOCK    block size in frames (default audio_block_frames)
+// WAR_OFFLINE_NOTES    notes in the generated project (default 100000)
+// WAR_AUDIO            WAV streamed from the timeline origin
+// WAR_AUTOMATION       1 for the demo lanes, see audio_load_env_automation
+// WAR_FREEZE           1 to play the instrument from its cached render
+// WAR_REVERB           reverb sends, see audio_load_env_reverb
+void audio_offline_run(void) {
+    header("audio_offline_run");
+
+    const char* path = getenv("WAR_OFFLINE_OUT");
+    if (!path) path = "war.wav";
+    const char* seconds_env = getenv("WAR_OFFLINE_SECONDS");
+    double seconds = seconds_env ? strtod(seconds_env, NULL) : 60.0;
+    const char* block_env = getenv("WAR_OFFLINE_BLOCK");
+    uint32_t block_frames =
+        block_env ? (uint32_t)strtoul(block_env, NULL, 10) : audio_block_frames;
+    if (block_frames == 0 || block_frames > audio_max_block_frames)
+        block_frames = audio_block_frames;
+
+    const char* notes_env = getenv("WAR_OFFLINE_NOTES");
+    uint32_t note_count =
+        notes_env ? (uint32_t)strtoul(notes_env, NULL, 10) : 100000;
+
+    AudioEngine* engine = audio_make_engine(audio_sample_rate, block_frames);
+    // no project files yet: dense generated notes over a changing tempo
+    NoteTrack track;
+    notes_make_track(&track, note_count);
+    notes_fill_demo(&track, note_count);
+    audio_set_track(engine, &track);
+    TempoMap* tempo_map = audio_tempo_map(engine);
+    assert(tempo_map);
+    audio_demo_tempo_map(tempo_map, engine->sample_rate);
+    // no io thread: the rings are topped up before every block instead, so
+    // the render never underruns however fast it goes
+    Sampler* sampler = sampler_make();
+    sampler_load_env_clip(sampler);
+    engine->sampler = sampler;
+    audio_load_env_plugin(engine);
+    audio_load_env_freeze(engine, &track, tempo_map);
+    audio_load_env_reverb(engine, 1);
+    audio_send_pointer(engine, audio_cmd_set_tempo_map, tempo_map);
+    notes_free_track(&track);
+    audio_load_env_automation(engine);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "offline: cannot write %s\n", path);
+        sampler_free(sampler);
+        audio_free_engine(engine);
+        end("audio_offline_run");
+        return;
+    }
+    uint64_t total_frames = (uint64_t)(seconds * engine->sample_rate);
+    audio_write_wav_header(file, engine->sample_rate, audio_channels, 0);
+    audio_send(engine, audio_cmd_play, 0, 0.0f, 0);
+    // workers at normal priority: offline never has a deadline to keep
+    graph_pool_start(&engine->pool, engine->graph->workers, 0);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t done = 0;
+    uint64_t events = 0;
+    AudioMessage event;
+    while (done < total_frames) {
+        uint32_t frames = total_frames - done < block_frames
+                              ? (uint32_t)(total_frames - done)
+                              : block_frames;
+        sampler_service(sampler);
+        if (engine->freeze) sampler_service(engine->freeze->sampler);
+        audio_process_block(engine, engine->mix, frames);
+        events += engine->sequencer.event_count;
+        fwrite(engine->mix, sizeof(float) * audio_channels, frames, file);
+        while (spsc_pop(&engine->events, &event)) audio_retire(&event);
+        audio_idle(engine);
+        done += frames;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // the sequencer alone, over the same span and block size
+    struct timespec s0, s1;
+    sequencer_reset(&engine->sequencer);
+    clock_gettime(CLOCK_MONOTONIC, &s0);
+    for (uint64_t frame = 0; frame < total_frames; frame += block_frames) {
+        sequencer_collect(
+            &engine->sequencer, &engine->tempo_map, frame, block_frames);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &s1);
+
+    uint32_t data_bytes = (uint32_t)(done * audio_channels * sizeof(float));
+    fseek(file, 0, SEEK_SET);
+    audio_write_wav_header(file, engine->sample_rate, audio_channels, data_bytes);
+    fclose(file);
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double audio_seconds = (double)done / engine->sample_rate;
+    double seq_wall =
+        (s1.tv_sec - s0.tv_sec) + (s1.tv_nsec - s0.tv_nsec) / 1e9;
+    printf("offline: %.1f s of audio in %.3f s (%.1fx real time) -> %s\n",
+           audio_seconds,
+           wall,
+           wall > 0 ? audio_seconds / wall : 0.0,
+           path);
+    printf("sequencer: %" PRIu64 " events, %u-frame blocks, %.4f%% of a core\n",
+           events,
+           block_frames,
+           100.0 * seq_wall / audio_seconds);
+    if (sampler->clip_count) {
+        printf("sampler: %u clips, %" PRIu64 " underrun frames\n",
+               sampler->clip_count,
+               sampler->underruns);
+    }
+    if (engine->plugin) {
+        printf("plugin: %s, %u frames latency through the graph\n",
+               engine->plugin->plugin->desc->name,
+               engine->graph->latency);
+    }
+    if (engine->sandbox) {
+        printf("sandbox: %s, %u frames latency through the graph, %" PRIu64
+               " late blocks\n",
+               engine->sandbox->name,
+               engine->graph->latency,
+               engine->sandbox->late_blocks);
+    }
+    for (uint32_t i = 0; i < engine->reverb_count; i++) {
+        const Reverb* reverb = engine->reverbs[i];
+        printf("reverb: %s, %.2f s in %u + %u partitions, tail thread %.2f%% "
+               "of a core\n",
+               reverb->name,
+               (double)reverb->ir_frames / reverb->sample_rate,
+               reverb->head.count,
+               reverb->tail.count,
+               100.0 * reverb->tail_ns / 1e9 / audio_seconds);
+    }
+    if (engine->meters) {
+        MeterReading master;
+        meter_read(engine->meters, engine->graph->output, &master);
+        printf("meter: master at the end peak %.1f dBFS, short-term %.1f "
+               "LUFS\n",
+               meter_db(fmaxf(master.peak[0], master.peak[1])),
+               meter_lufs(master.short_term));
+    }
+
+    audio_finish(engine);
+    sampler_free(sampler);
+    audio_free_engine(engine);
+
+    end("audio_offline_run");
+}
@@ -0,0 +1,415 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/automation.c
+//=============================================================================
+
+#include "automation.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "mix.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// breakpoint lanes, evaluated once per block on the audio thread before
+// the graph runs. A lane that holds still for the block costs a compare
+// or two and is applied as a constant; a moving one is filled a block at
+// a time by the ramp and curve kernels, and nodes read it from whichever
+// worker runs them
+
+//-----------------------------------------------------------------------------
+// building, UI thread
+//-----------------------------------------------------------------------------
+
+// lanes are copied, points and all, and grouped by node; the caller's
+// arrays can go once this returns. For a graph compiled at block_frames
+Automation* automation_make(const AutomationLane* lanes,
+                            uint32_t lane_count,
+                            uint32_t block_frames) {
+    assert(lane_count <= automation_max_lanes);
+    assert(block_frames > 0 && block_frames <= audio_max_block_frames);
+    Automation* automation = malloc(sizeof(Automation));
+    assert(automation);
+    memset(automation, 0, sizeof(Automation));
+    automation->lane_count = lane_count;
+    automation->block_frames = block_frames;
+
+    uint32_t point_count = 0;
+    for (uint32_t l = 0; l < lane_count; l++) {
+        assert(lanes[l].count > 0 && lanes[l].node < max_graph_nodes);
+        for (uint32_t p = 1; p < lanes[l].count; p++)
+            assert(lanes[l].points[p].frame >= lanes[l].points[p - 1].frame);
+        point_count += lanes[l].count;
+        automation->lane_begin[lanes[l].node + 1]++;
+    }
+    for (uint32_t n = 0; n < max_graph_nodes; n++)
+        automation->lane_begin[n + 1] += automation->lane_begin[n];
+
+    // three buffers a lane: values and the two pan gains, each a whole
+    // number of cache lines
+    uint32_t stride = (block_frames + 15) & ~15u;
+    automation->lanes = calloc(lane_count ? lane_count : 1,
+                               sizeof(AutomationLane));
+    automation->points =
+        malloc(sizeof(AutomationPoint) * (point_count ? point_count : 1));
+    automation->values = aligned_alloc(
+        64, sizeof(float) * stride * 3 * (lane_count ? lane_count : 1));
+    assert(automation->lanes && automation->points && automation->values);
+
+    uint16_t next[max_graph_nodes];
+    memcpy(next, automation->lane_begin, sizeof(next));
+    AutomationPoint* points = automation->points;
+    for (uint32_t l = 0; l < lane_count; l++) {
+        uint32_t index = next[lanes[l].node]++;
+        AutomationLane* lane = &automation->lanes[index];
+        *lane = lanes[l];
+        memcpy(points, lanes[l].points, sizeof(AutomationPoint) * lane->count);
+        lane->points = points;
+        points += lane->count;
+        lane->cursor = 0;
+        lane->moving = 0;
+        // nothing to compare the first block's value with
+        lane->value = NAN;
+        lane->values = automation->values + (size_t)index * stride * 3;
+        lane->pan_gains[0] = lane->values + stride;
+        lane->pan_gains[1] = lane->values + stride * 2;
+        lane->sent = NAN;
+    }
+    return automation;
+}
+
+void automation_free(Automation* automation) {
+    free(automation->lanes);
+    free(automation->points);
+    free(automation->values);
+    free(automation);
+}
+
+//-----------------------------------------------------------------------------
+// evaluation, audio thread
+//-----------------------------------------------------------------------------
+
+// the first point after frame
+uint32_t automation_search(const AutomationLane* lane, uint64_t frame) {
+    uint32_t low = 0;
+    uint32_t high = lane->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (lane->points[mid].frame <= frame) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// a curve this close to 0 is drawn straight: the exponential form would
+// cancel a large base against a large first term
+uint8_t automation_straight(float curve) {
+    return fabsf(curve) < 1e-2f;
+}
+
+// at frame, with cursor the first point after it. Before the first point
+// and after the last the lane holds their value
+float automation_value(const AutomationLane* lane,
+                       uint32_t cursor,
+                       uint64_t frame) {
+    if (cursor == 0) return lane->points[0].value;
+    if (cursor == lane->count) return lane->points[cursor - 1].value;
+    const AutomationPoint* a = &lane->points[cursor - 1];
+    const AutomationPoint* b = &lane->points[cursor];
+    if (a->value == b->value) return a->value;
+    double t = (double)(frame - a->frame) / (double)(b->frame - a->frame);
+    double delta = (double)b->value - a->value;
+    if (automation_straight(a->curve)) return (float)(a->value + delta * t);
+    return (float)(a->value + delta * expm1(a->curve * t) / expm1(a->curve));
+}
+
+// n frames from frame, all inside the segment ending at cursor. On a curve
+// value = base + scale * e^(curve * t), which steps by a constant ratio;
+// the series starts again from the exact value every automation_curve_run
+// frames, so its error does not grow with the block size
+void automation_fill(const AutomationLane* lane,
+                     const MixKernels* k,
+                     uint32_t cursor,
+                     uint64_t frame,
+                     float* out,
+                     uint32_t n) {
+    if (cursor == 0 || cursor == lane->count) {
+        k->ramp(out, automation_value(lane, cursor, frame), 0.0f, n);
+        return;
+    }
+    const AutomationPoint* a = &lane->points[cursor - 1];
+    const AutomationPoint* b = &lane->points[cursor];
+    double length = (double)(b->frame - a->frame);
+    double delta = (double)b->value - a->value;
+    if (automation_straight(a->curve)) {
+        double t = (double)(frame - a->frame) / length;
+        k->ramp(out, (float)(a->value + delta * t), (float)(delta / length), n);
+        return;
+    }
+    double scale = delta / expm1(a->curve);
+    float base = (float)(a->value - scale);
+    float ratio = (float)exp(a->curve / length);
+    for (uint32_t done = 0; done < n; done += automation_curve_run) {
+        uint32_t run = n - done < automation_curve_run ? n - done
+                                                       : automation_curve_run;
+        double t = (double)(frame + done - a->frame) / length;
+        k->curve(
+            out + done, base, (float)(scale * exp(a->curve * t)), ratio, run);
+    }
+}
+
+// 0 when the lane holds value up to end: every point the block reaches,
+// and the one it is heading for, has that value
+uint8_t automation_moves(const AutomationLane* lane, uint64_t end) {
+    for (uint32_t p = lane->cursor; p < lane->count; p++) {
+        if (lane->points[p].value != lane->value) return 1;
+        if (lane->points[p].frame >= end) break;
+    }
+    return 0;
+}
+
+// a moving lane's block, segment by segment
+void automation_render(AutomationLane* lane,
+                       const MixKernels* k,
+                       uint64_t frame,
+                       uint32_t frames) {
+    uint32_t cursor = lane->cursor;
+    uint32_t done = 0;
+    while (done < frames) {
+        uint64_t at = frame + done;
+        while (cursor < lane->count && lane->points[cursor].frame <= at)
+            cursor++;
+        uint32_t n = frames - done;
+        if (cursor < lane->count && lane->points[cursor].frame - at < n)
+            n = (uint32_t)(lane->points[cursor].frame - at);
+        automation_fill(lane, k, cursor, at, lane->values + done, n);
+        done += n;
+    }
+    if (lane->target == automation_pan) {
+        k->pan_law(
+            lane->values, lane->pan_gains[0], lane->pan_gains[1], frames);
+    }
+}
+
+// every lane at [frame, frame + frames). Stopped, the lanes hold their
+// value at frame. Cursors step forward while the blocks follow on;
+// anything else, a seek or a new set, searches again
+void automation_run(Automation* automation,
+                    const MixKernels* k,
+                    uint64_t frame,
+                    uint32_t frames,
+                    uint8_t playing) {
+    assert(frames <= automation->block_frames);
+    uint8_t search = !automation->located || frame != automation->next_frame;
+    uint64_t end = frame + frames;
+    for (uint32_t l = 0; l < automation->lane_count; l++) {
+        AutomationLane* lane = &automation->lanes[l];
+        if (search) {
+            lane->cursor = automation_search(lane, frame);
+        } else {
+            while (lane->cursor < lane->count &&
+                   lane->points[lane->cursor].frame <= frame)
+                lane->cursor++;
+        }
+        float previous = lane->value;
+        uint8_t was_moving = lane->moving;
+        lane->value = automation_value(lane, lane->cursor, frame);
+        lane->moving = playing && automation_moves(lane, end);
+        if (lane->moving) {
+            automation_render(lane, k, frame, frames);
+        } else if (lane->target == automation_pan &&
+                   (lane->value != previous || was_moving)) {
+            // a moving block may end where it started, with gains that
+            // were never written for the value it holds
+            k->pan_law(&lane->value, &lane->gains[0], &lane->gains[1], 1);
+        }
+    }
+    automation->next_frame = playing ? end : frame;
+    automation->located = 1;
+}
+
+// graph node: the node's volume and pan lanes on its output. Parameter
+// lanes are the plugin's, see plugin_automate
+void automation_apply(const Automation* automation,
+                      const MixKernels* k,
+                      uint32_t node,
+                      float* left,
+                      float* right,
+                      uint32_t frames) {
+    for (uint32_t l = automation->lane_begin[node];
+         l < automation->lane_begin[node + 1];
+         l++) {
+        const AutomationLane* lane = &automation->lanes[l];
+        if (lane->target == automation_volume) {
+            if (lane->moving) {
+                k->mul(left, lane->values, frames);
+                k->mul(right, lane->values, frames);
+            } else if (lane->value != 1.0f) {
+                k->gain(left, lane->value, frames);
+                k->gain(right, lane->value, frames);
+            }
+        } else if (lane->target == automation_pan) {
+            if (lane->moving) {
+                k->mul(left, lane->pan_gains[0], frames);
+                k->mul(right, lane->pan_gains[1], frames);
+            } else {
+                k->gain(left, lane->gains[0], frames);
+                k->gain(right, lane->gains[1], frames);
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+// lanes on a bench's worth of nodes, run and applied block after block;
+// flat first, then all of them moving, with each instruction set
+void automation_bench_run(void) {
+    header("automation_bench_run");
+
+    enum {
+        bench_lanes = 512,
+        bench_nodes = 64,
+        bench_blocks = 20000,
+        bench_points = 4,
+    };
+    float* left = aligned_alloc(64, sizeof(float) * audio_block_frames);
+    float* right = aligned_alloc(64, sizeof(float) * audio_block_frames);
+    AutomationLane* lanes = calloc(bench_lanes, sizeof(AutomationLane));
+    AutomationPoint* points =
+        malloc(sizeof(AutomationPoint) * bench_lanes * bench_points);
+    assert(left && right && lanes && points);
+    for (uint32_t i = 0; i < audio_block_frames; i++) {
+        left[i] = 0.5f;
+        right[i] = 0.5f;
+    }
+    uint64_t span = (uint64_t)bench_blocks * audio_block_frames;
+
+    for (uint32_t isa = 0; isa < mix_isa_count; isa++) {
+        MixKernels k;
+        if (!mix_kernels_for(isa, &k)) continue;
+        for (uint32_t moving = 0; moving < 2; moving++) {
+            // moving: straight lines and curves end to end over the run
+            for (uint32_t l = 0; l < bench_lanes; l++) {
+                AutomationPoint* p = points + l * bench_points;
+                for (uint32_t i = 0; i < bench_points; i++) {
+                    p[i] = (AutomationPoint){
+                        .frame = span * i / (bench_points - 1),
+                        .value = moving ? (i & 1 ? 0.25f : 0.75f) : 0.5f,
+                        .curve = (l & 1) ? 3.0f : 0.0f,
+                    };
+                }
+                lanes[l] = (AutomationLane){
+                    .target = l & 2 ? automation_pan : automation_volume,
+                    .node = l % bench_nodes,
+                    .count = bench_points,
+                    .points = p,
+                };
+            }
+            Automation* automation =
+                automation_make(lanes, bench_lanes, audio_block_frames);
+            // the lanes alone, then applied to every node as well
+            double ns[2];
+            for (uint32_t apply = 0; apply < 2; apply++) {
+                struct timespec t0, t1;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                for (uint32_t b = 0; b < bench_blocks; b++) {
+                    automation_run(automation,
+                                   &k,
+                                   (uint64_t)b * audio_block_frames,
+                                   audio_block_frames,
+                                   1);
+                    for (uint32_t n = 0; apply && n < bench_nodes; n++) {
+                        automation_apply(automation,
+                                         &k,
+                                         n,
+                                         left,
+                                         right,
+                                         audio_block_frames);
+                    }
+                }
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                ns[apply] = ((t1.tv_sec - t0.tv_sec) * 1e9 +
+                             (double)(t1.tv_nsec - t0.tv_nsec)) /
+                            bench_blocks;
+            }
+            double block_ns = 1e9 * audio_block_frames / audio_sample_rate;
+            printf("automation %-7s %-6s %u lanes: %6.2f ns/lane evaluated "
+                   "(%.3f%% of a block), %6.2f ns/lane applied (%.3f%%)\n",
+                   k.name,
+                   moving ? "moving" : "flat",
+                   bench_lanes,
+                   ns[0] / bench_lanes,
+                   100.0 * ns[0] / block_ns,
+                   ns[1] / bench_lanes,
+                   100.0 * ns[1] / block_ns);
+            automation_free(automation);
+        }
+    }
+
+    // a pan lane that moves for a block and comes back to where it was
+    // holds the pan law of that value, not the gains it had before
+    MixKernels k;
+    mix_select(&k);
+    float held = 0.5f;
+    AutomationPoint back[3] = {
+        {.frame = 0, .value = held},
+        {.frame = 64, .value = -1.0f},
+        {.frame = audio_block_frames - 1, .value = held},
+    };
+    AutomationLane pan = {
+        .target = automation_pan,
+        .count = 3,
+        .points = back,
+    };
+    Automation* automation = automation_make(&pan, 1, audio_block_frames);
+    automation_run(automation, &k, 0, audio_block_frames, 1);
+    automation_run(
+        automation, &k, audio_block_frames, audio_block_frames, 1);
+    float expect[2];
+    k.pan_law(&held, &expect[0], &expect[1], 1);
+    for (uint32_t i = 0; i < audio_block_frames; i++) {
+        left[i] = 1.0f;
+        right[i] = 1.0f;
+    }
+    automation_apply(automation, &k, 0, left, right, audio_block_frames);
+    assert(!automation->lanes[0].moving);
+    assert(fabsf(left[0] - expect[0]) < 1e-6f &&
+           fabsf(right[0] - expect[1]) < 1e-6f);
+    printf("automation pan held after a moving block: %.3f/%.3f\n",
+           left[0],
+           right[0]);
+    automation_free(automation);
+
+    free(left);
+    free(right);
+    free(lanes);
+    free(points);
+    end("automation_bench_run");
+}
@@ -0,0 +1,599 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/export.c
+//=============================================================================
+
+#include "export.h"
+#include "audio.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "mix.h"
+#include "notes.h"
+#include "sampler.h"
+#include "sequencer.h"
+#include "synth.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// bouncing to disk, apart from the live engine: as many threads as there
+// are cores render (window, track) tasks while one thread writes finished
+// windows. Nothing here has a deadline, so waits sleep on futexes
+
+void export_wait(uint32_t* word, uint32_t seen) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+}
+
+void export_wake(uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+//-----------------------------------------------------------------------------
+// planning
+//-----------------------------------------------------------------------------
+
+// a window boundary splits the track when every note before it ended a
+// release tail earlier: the synth is silent with all voices off and the
+// sequencer has no pending offs, which is what fresh state looks like
+void export_plan_track(Export* export, uint32_t t) {
+    const ExportDesc* desc = export->desc;
+    const NoteTrack* notes = desc->tracks[t].notes;
+    ExportTrackRun* run = &export->runs[t];
+    uint32_t windows = export->window_count;
+    run->segment = malloc(sizeof(uint32_t) * windows);
+    run->segment_start = malloc(sizeof(uint32_t) * windows);
+    assert(run->segment && run->segment_start);
+    run->segment_count = 0;
+
+    TempoMap* map = malloc(sizeof(TempoMap));
+    assert(map);
+    memcpy(map, desc->tempo_map, sizeof(TempoMap));
+    uint64_t tail = (uint64_t)export_tail_seconds * desc->sample_rate;
+    uint64_t last_off = 0;
+    uint32_t next = 0;
+    for (uint32_t w = 0; w < windows; w++) {
+        uint64_t boundary = (uint64_t)w * export_window_frames;
+        // clips carry no state, every window stands alone
+        uint8_t cold = notes == NULL || w == 0;
+        if (notes) {
+            for (; next < notes->count; next++) {
+                uint64_t on = (uint64_t)tempo_map_tick_to_sample(
+                    map, notes->start[next]);
+                if (on >= boundary) break;
+                if (notes->flags[next] & note_flag_muted) continue;
+                uint64_t off = (uint64_t)tempo_map_tick_to_sample(
+                    map, notes->start[next] + notes->length[next]);
+                last_off = off > last_off ? off : last_off;
+            }
+            if (last_off + tail <= boundary) cold = 1;
+        }
+        if (cold) run->segment_start[run->segment_count++] = w;
+        run->segment[w] = run->segment_count - 1;
+    }
+    free(map);
+
+    for (uint32_t k = 0; k < export_track_states; k++) {
+        run->next[k] =
+            k < run->segment_count ? run->segment_start[k] : UINT32_MAX;
+    }
+    run->states = NULL;
+    if (notes) {
+        run->states =
+            aligned_alloc(64, sizeof(ExportState) * export_track_states);
+        assert(run->states);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// rendering, worker threads
+//-----------------------------------------------------------------------------
+
+void export_render_span(ExportWorker* worker,
+                        ExportState* state,
+                        const ExportTrack* track,
+                        float* left,
+                        float* right,
+                        uint32_t frames) {
+    synth_render(&state->synth, worker->voice, frames);
+    worker->export->kernels.pan_add(worker->voice,
+                                    left,
+                                    right,
+                                    track->gain_left,
+                                    track->gain_right,
+                                    frames);
+}
+
+// the engine's instrument node, a block at a time so events land where
+// they would live
+void export_render_notes(ExportWorker* worker,
+                         uint32_t t,
+                         uint32_t w,
+                         float* left,
+                         float* right) {
+    Export* export = worker->export;
+    const ExportDesc* desc = export->desc;
+    const ExportTrack* track = &desc->tracks[t];
+    ExportTrackRun* run = &export->runs[t];
+    uint32_t s = run->segment[w];
+    uint32_t k = s % export_track_states;
+    ExportState* state = &run->states[k];
+    // wait for the window before this one, or for the segment this state
+    // was rendering before to finish
+    for (;;) {
+        uint32_t next = __atomic_load_n(&run->next[k], __ATOMIC_ACQUIRE);
+        if (next == w) break;
+        export_wait(&run->next[k], next);
+    }
+    if (w == run->segment_start[s]) {
+        synth_make(&state->synth, desc->sample_rate);
+        memset(&state->sequencer, 0, sizeof(Sequencer));
+        state->sequencer.track = track->notes;
+        sequencer_reset(&state->sequencer);
+        memcpy(&state->tempo_map, desc->tempo_map, sizeof(TempoMap));
+    }
+
+    Sequencer* seq = &state->sequencer;
+    uint64_t frame = (uint64_t)w * export_window_frames;
+    for (uint32_t block = 0; block < export_window_frames;
+         block += audio_block_frames) {
+        float* l = left + block;
+        float* r = right + block;
+        sequencer_collect(
+            seq, &state->tempo_map, frame + block, audio_block_frames);
+        uint32_t done = 0;
+        for (uint32_t i = 0; i < seq->event_count; i++) {
+            const SequencerEvent* event = &seq->events[i];
+            if (event->offset > done) {
+                export_render_span(worker,
+                                   state,
+                                   track,
+                                   l + done,
+                                   r + done,
+                                   event->offset - done);
+                done = event->offset;
+            }
+            if (event->type == sequencer_event_on) {
+                synth_note_on(
+                    &state->synth, event->pitch, event->velocity / 127.0f);
+            } else {
+                synth_note_off(&state->synth, event->pitch);
+            }
+        }
+        export_render_span(worker,
+                           state,
+                           track,
+                           l + done,
+                           r + done,
+                           audio_block_frames - done);
+    }
+
+    uint32_t next;
+    if (w + 1 < export->window_count && run->segment[w + 1] == s) {
+        next = w + 1;
+    } else if (s + export_track_states < run->segment_count) {
+        next = run->segment_start[s + export_track_states];
+    } else {
+        next = UINT32_MAX;
+    }
+    __atomic_store_n(&run->next[k], next, __ATOMIC_RELEASE);
+    export_wake(&run->next[k]);
+}
+
+// straight from the mapping, no rings: nothing here is real time
+void export_render_clips(ExportWorker* worker,
+                         uint32_t w,
+                         float* left,
+                         float* right) {
+    const Sampler* sampler = worker->export->desc->sampler;
+    const MixKernels* k = &worker->export->kernels;
+    if (!sampler) return;
+    uint64_t frame = (uint64_t)w * export_window_frames;
+    uint64_t end = frame + export_window_frames;
+    for (uint32_t c = 0; c < sampler->clip_count; c++) {
+        const SamplerClip* clip = &sampler->clips[c];
+        uint64_t clip_end = clip->start + clip->length;
+        uint64_t from = frame > clip->start ? frame : clip->start;
+        uint64_t to = end < clip_end ? end : clip_end;
+        while (from < to) {
+            uint32_t n = to - from < sampler_chunk_frames
+                             ? (uint32_t)(to - from)
+                             : sampler_chunk_frames;
+            sampler_read_frames(k,
+                                &sampler->files[clip->file],
+                                clip->offset + (from - clip->start),
+                                n,
+                                worker->scratch,
+                                worker->left,
+                                worker->right);
+            k->add(left + (from - frame), worker->left, clip->gain, n);
+            k->add(right + (from - frame), worker->right, clip->gain, n);
+            from += n;
+        }
+    }
+}
+
+float* export_track_buffer(Export* export, uint32_t slot, uint32_t t) {
+    uint64_t track = (uint64_t)slot * export->desc->track_count + t;
+    return export->track_buffers + track * 2 * export_window_frames;
+}
+
+// the last track of a window mixes it, in track order whichever thread
+// that is, so every bounce of a project is bit for bit the same
+void export_mix_window(Export* export, uint32_t w) {
+    const MixKernels* k = &export->kernels;
+    uint32_t slot = w % export_slots;
+    float* left = export_track_buffer(export, slot, 0);
+    float* right = left + export_window_frames;
+    for (uint32_t t = 1; t < export->desc->track_count; t++) {
+        float* track = export_track_buffer(export, slot, t);
+        k->add(left, track, 1.0f, export_window_frames);
+        k->add(right, track + export_window_frames, 1.0f, export_window_frames);
+    }
+    k->interleave(left,
+                  right,
+                  export->ring + (uint64_t)slot * export_window_frames *
+                                     audio_channels,
+                  export_window_frames);
+    __atomic_store_n(&export->pending[slot],
+                     export->desc->track_count,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&export->ready[slot], w + 1, __ATOMIC_RELEASE);
+    export_wake(&export->ready[slot]);
+}
+
+void* export_worker_thread(void* arg) {
+    ExportWorker* worker = arg;
+    Export* export = worker->export;
+    uint32_t tracks = export->desc->track_count;
+    for (;;) {
+        uint64_t task =
+            __atomic_fetch_add(&export->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= export->task_count) break;
+        uint32_t w = (uint32_t)(task / tracks);
+        uint32_t t = (uint32_t)(task % tracks);
+        // the slot is free once the writer is export_slots windows behind
+        for (;;) {
+            uint32_t written =
+                __atomic_load_n(&export->written, __ATOMIC_ACQUIRE);
+            if (w < written + export_slots) break;
+            export_wait(&export->written, written);
+        }
+
+        uint32_t slot = w % export_slots;
+        float* left = export_track_buffer(export, slot, t);
+        float* right = left + export_window_frames;
+        memset(left, 0, sizeof(float) * 2 * export_window_frames);
+        if (export->desc->tracks[t].notes) {
+            export_render_notes(worker, t, w, left, right);
+        } else {
+            const ExportTrack* track = &export->desc->tracks[t];
+            export_render_clips(worker, w, left, right);
+            if (track->gain_left != 1.0f || track->gain_right != 1.0f) {
+                export->kernels.gain(
+                    left, track->gain_left, export_window_frames);
+                export->kernels.gain(
+                    right, track->gain_right, export_window_frames);
+            }
+        }
+        if (__atomic_sub_fetch(&export->pending[slot], 1, __ATOMIC_ACQ_REL) ==
+            0)
+            export_mix_window(export, w);
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// writing
+//-----------------------------------------------------------------------------
+
+// float WAV whose data starts at export_align, padded with a JUNK chunk,
+// so every window goes straight from the ring to the disk
+void export_wav_header(uint8_t* h,
+                       uint32_t sample_rate,
+                       uint32_t channels,
+                       uint64_t data_bytes) {
+    memset(h, 0, export_align);
+    uint32_t data = data_bytes > UINT32_MAX - export_align
+                        ? UINT32_MAX - export_align
+                        : (uint32_t)data_bytes;
+    memcpy(h, "RIFF", 4);
+    write_le32(h + 4, export_align - 8 + data);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    write_le32(h + 16, 16);
+    write_le16(h + 20, 3); // IEEE float
+    write_le16(h + 22, (uint16_t)channels);
+    write_le32(h + 24, sample_rate);
+    write_le32(h + 28, sample_rate * channels * 4);
+    write_le16(h + 32, (uint16_t)(channels * 4));
+    write_le16(h + 34, 32);
+    memcpy(h + 36, "JUNK", 4);
+    write_le32(h + 40, export_align - 44 - 8);
+    memcpy(h + export_align - 8, "data", 4);
+    write_le32(h + export_align - 4, data);
+}
+
+void export_write(Export* export, const void* data, size_t bytes, off_t at) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const uint8_t* p = data;
+    while (bytes) {
+        ssize_t n = pwrite(export->fd, p, bytes, at);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "export: write failed: %s\n", strerror(errno));
+            break;
+        }
+        p += n;
+        at += n;
+        bytes -= (size_t)n;
+        export->write_bytes += (uint64_t)n;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    export->write_seconds +=
+        (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+// takes every mixed window in a row at once, up to the end of the ring
+void* export_writer_thread(void* arg) {
+    Export* export = arg;
+    size_t window_bytes = sizeof(float) * audio_channels * export_window_frames;
+    uint32_t w = 0;
+    while (w < export->window_count) {
+        uint32_t slot = w % export_slots;
+        for (;;) {
+            uint32_t ready =
+                __atomic_load_n(&export->ready[slot], __ATOMIC_ACQUIRE);
+            if (ready == w + 1) break;
+            export_wait(&export->ready[slot], ready);
+        }
+        uint32_t count = 1;
+        while (slot + count < export_slots &&
+               w + count < export->window_count &&
+               __atomic_load_n(&export->ready[slot + count],
+                               __ATOMIC_ACQUIRE) == w + count + 1)
+            count++;
+        export_write(export,
+                     export->ring + (uint64_t)slot * export_window_frames *
+                                        audio_channels,
+                     window_bytes * count,
+                     (off_t)export_align + (off_t)w * window_bytes);
+        w += count;
+        __atomic_store_n(&export->written, w, __ATOMIC_RELEASE);
+        export_wake(&export->written);
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// entry points
+//-----------------------------------------------------------------------------
+
+// blocks until the file is complete; returns 0 if it could not be written
+uint8_t export_run(const ExportDesc* desc) {
+    header("export_run");
+
+    assert(desc->track_count > 0 && desc->frames > 0);
+    Export* export = aligned_alloc(64, sizeof(Export));
+    assert(export);
+    memset(export, 0, sizeof(Export));
+    export->desc = desc;
+    mix_select(&export->kernels);
+
+    // O_DIRECT keeps a long bounce out of the page cache; not every
+    // filesystem has it
+    export->direct = 1;
+    export->fd =
+        open(desc->path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (export->fd < 0 && errno == EINVAL) {
+        export->direct = 0;
+        export->fd = open(desc->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (export->fd < 0) {
+        fprintf(stderr, "export: cannot write %s\n", desc->path);
+        free(export);
+        end("export_run");
+        return 0;
+    }
+
+    uint64_t windows =
+        (desc->frames + export_window_frames - 1) / export_window_frames;
+    assert(windows < UINT32_MAX - export_slots);
+    export->window_count = (uint32_t)windows;
+    export->task_count = windows * desc->track_count;
+    size_t window_bytes = sizeof(float) * audio_channels * export_window_frames;
+    export->track_buffers = aligned_alloc(
+        64, window_bytes * export_slots * desc->track_count);
+    export->ring = aligned_alloc(export_align, window_bytes * export_slots);
+    uint8_t* head = aligned_alloc(export_align, export_align);
+    export->runs = malloc(sizeof(ExportTrackRun) * desc->track_count);
+    assert(export->track_buffers && export->ring && head && export->runs);
+    for (uint32_t s = 0; s < export_slots; s++)
+        export->pending[s] = desc->track_count;
+
+    uint32_t segments = 0;
+    for (uint32_t t = 0; t < desc->track_count; t++) {
+        export_plan_track(export, t);
+        segments += export->runs[t].segment_count;
+    }
+
+    // the header goes first so the data never has to move; sizes are
+    // filled in at the end
+    export_wav_header(head, desc->sample_rate, audio_channels, 0);
+    export_write(export, head, export_align, 0);
+
+    uint32_t workers = desc->workers;
+    if (workers == 0) workers = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > max_export_workers) workers = max_export_workers;
+    export->worker_count = workers;
+    export->workers = aligned_alloc(64, sizeof(ExportWorker) * workers);
+    assert(export->workers);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int err = pthread_create(
+        &export->writer, NULL, export_writer_thread, export);
+    assert(err == 0);
+    for (uint32_t i = 0; i < workers; i++) {
+        export->workers[i].export = export;
+        err = pthread_create(&export->workers[i].thread,
+                             NULL,
+                             export_worker_thread,
+                             &export->workers[i]);
+        assert(err == 0);
+    }
+    for (uint32_t i = 0; i < workers; i++)
+        pthread_join(export->workers[i].thread, NULL);
+    pthread_join(export->writer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    (void)err;
+
+    uint64_t data_bytes = desc->frames * audio_channels * sizeof(float);
+    export_wav_header(head, desc->sample_rate, audio_channels, data_bytes);
+    export_write(export, head, export_align, 0);
+    // the last window was written whole
+    uint8_t ok = ftruncate(export->fd, (off_t)(export_align + data_bytes)) ==
+                     0 &&
+                 export->write_bytes ==
+                     export_align * 2 + windows * window_bytes;
+    close(export->fd);
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double seconds = (double)desc->frames / desc->sample_rate;
+    printf("export: %u tracks, %.1f s of audio in %.3f s (%.1fx real time) "
+           "-> %s\n",
+           desc->track_count,
+           seconds,
+           wall,
+           wall > 0 ? seconds / wall : 0.0,
+           desc->path);
+    printf("export: %u workers, %u windows, %u segments, %.1f MB written "
+           "in %.3f s%s\n",
+           workers,
+           export->window_count,
+           segments,
+           export->write_bytes / 1e6,
+           export->write_seconds,
+           export->direct ? " (direct)" : "");
+
+    for (uint32_t t = 0; t < desc->track_count; t++) {
+        free(export->runs[t].segment);
+        free(export->runs[t].segment_start);
+        free(export->runs[t].states);
+    }
+    free(export->runs);
+    free(export->workers);
+    free(head);
+    free(export->ring);
+    free(export->track_buffers);
+    free(export);
+
+    end("export_run");
+    return ok;
+}
+
+// bounces the generated project; no project files yet
+//
+// WAR_EXPORT_OUT      output path (default war-export.wav)
+// WAR_EXPORT_SECONDS  length (default 600)
+// WAR_EXPORT_TRACKS   instrument tracks, spread across the stereo field
+//                     (default 100)
+// WAR_EXPORT_NOTES    notes per track (default 30000, ten minutes' worth)
+// WAR_EXPORT_WORKERS  render threads (default one per core)
+// WAR_AUDIO           WAV on its own track from the timeline origin
+// returns 0 if the file could not be written
+uint8_t export_demo_run(void) {
+    header("export_demo_run");
+
+    const char* path = getenv("WAR_EXPORT_OUT");
+    const char* seconds_env = getenv("WAR_EXPORT_SECONDS");
+    const char* tracks_env = getenv("WAR_EXPORT_TRACKS");
+    const char* notes_env = getenv("WAR_EXPORT_NOTES");
+    const char* workers_env = getenv("WAR_EXPORT_WORKERS");
+    double seconds = seconds_env ? strtod(seconds_env, NULL) : 600.0;
+    uint32_t track_count =
+        tracks_env ? (uint32_t)strtoul(tracks_env, NULL, 10) : 100;
+    uint32_t note_count =
+        notes_env ? (uint32_t)strtoul(notes_env, NULL, 10) : 30000;
+    if (track_count == 0) track_count = 1;
+
+    NoteTrack* notes = malloc(sizeof(NoteTrack));
+    TempoMap* tempo_map = malloc(sizeof(TempoMap));
+    ExportTrack* tracks = malloc(sizeof(ExportTrack) * (track_count + 1));
+    assert(notes && tempo_map && tracks);
+    notes_make_track(notes, note_count);
+    notes_fill_demo(notes, note_count);
+    audio_demo_tempo_map(tempo_map, audio_sample_rate);
+    // each track is the bare synth at the engine's gain split across the
+    // tracks; nothing of the graph (effects, plugins, reverb sends) is in it
+    float gain = 0.15f / track_count;
+    for (uint32_t t = 0; t < track_count; t++) {
+        float pan = track_count > 1 ? (float)t / (track_count - 1) - 0.5f
+                                    : 0.0f;
+        tracks[t] = (ExportTrack){
+            .notes = notes,
+            .gain_left = gain * (1.0f - pan),
+            .gain_right = gain * (1.0f + pan),
+        };
+    }
+    Sampler* sampler = sampler_make();
+    sampler_load_env_clip(sampler);
+    uint32_t total = track_count;
+    if (sampler->clip_count) {
+        tracks[total++] = (ExportTrack){
+            .notes = NULL,
+            .gain_left = 1.0f,
+            .gain_right = 1.0f,
+        };
+    }
+
+    ExportDesc desc = {
+        .path = path ? path : "war-export.wav",
+        .sample_rate = audio_sample_rate,
+        .frames = (uint64_t)(seconds * audio_sample_rate),
+        .tempo_map = tempo_map,
+        .tracks = tracks,
+        .track_count = total,
+        .sampler = sampler,
+        .workers =
+            workers_env ? (uint32_t)strtoul(workers_env, NULL, 10) : 0,
+    };
+    uint8_t ok = desc.frames ? export_run(&desc) : 1;
+
+    sampler_free(sampler);
+    notes_free_track(notes);
+    free(notes);
+    free(tempo_map);
+    free(tracks);
+
+    end("export_demo_run");
+    return ok;
+}
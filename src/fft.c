@@ -0,0 +1,337 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/fft.c
+//=============================================================================
+
+#include "fft.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "mix.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a real transform of size n is a complex one of n / 2 over the even
+// samples as real parts and the odd ones as imaginary, then untangled.
+// The complex one is radix-2 in time on split arrays, so a butterfly
+// span of fft_lanes or more is whole vectors of independent work; the
+// first few spans are scalar. No allocation and no locks after fft_make
+
+// a run of butterflies as a gcc vector, like the synth's lane groups
+typedef float FftLanes __attribute__((vector_size(sizeof(float) * fft_lanes)));
+
+//-----------------------------------------------------------------------------
+// tables, UI thread
+//-----------------------------------------------------------------------------
+
+float* fft_alloc(uint32_t count) {
+    size_t bytes = ((size_t)count * sizeof(float) + 63) & ~(size_t)63;
+    float* p = aligned_alloc(64, bytes);
+    assert(p);
+    memset(p, 0, bytes);
+    return p;
+}
+
+void fft_make(Fft* fft, uint32_t size) {
+    assert(size >= 4 && size <= fft_max_size && !(size & (size - 1)));
+    memset(fft, 0, sizeof(Fft));
+    fft->size = size;
+    fft->half = size / 2;
+    uint32_t half = fft->half;
+    uint32_t bits = (uint32_t)__builtin_ctz(half);
+    fft->reverse = malloc(sizeof(uint32_t) * half);
+    assert(fft->reverse);
+    for (uint32_t k = 0; k < half; k++) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        fft->reverse[k] = r;
+    }
+    fft->twiddle_re = fft_alloc(half);
+    fft->twiddle_im = fft_alloc(half);
+    for (uint32_t h = 1; h < half; h *= 2) {
+        for (uint32_t j = 0; j < h; j++) {
+            double angle = -M_PI * j / h;
+            fft->twiddle_re[h + j] = (float)cos(angle);
+            fft->twiddle_im[h + j] = (float)sin(angle);
+        }
+    }
+    fft->untangle_re = fft_alloc(half / 2 + 1);
+    fft->untangle_im = fft_alloc(half / 2 + 1);
+    for (uint32_t k = 0; k <= half / 2; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        fft->untangle_re[k] = (float)cos(angle);
+        fft->untangle_im[k] = (float)sin(angle);
+    }
+}
+
+void fft_free(Fft* fft) {
+    free(fft->reverse);
+    free(fft->twiddle_re);
+    free(fft->twiddle_im);
+    free(fft->untangle_re);
+    free(fft->untangle_im);
+    memset(fft, 0, sizeof(Fft));
+}
+
+//-----------------------------------------------------------------------------
+// transforms, any thread
+//-----------------------------------------------------------------------------
+
+// the first three spans of every run of eight points in registers, with
+// their twiddles as constants: one pass over memory instead of three
+void fft_first_spans(float* re, float* im, uint32_t half) {
+    const float c = 0.70710678118654752f;
+    const float wr[4] = {1.0f, c, 0.0f, -c};
+    const float wi[4] = {0.0f, -c, -1.0f, -c};
+    for (uint32_t g = 0; g < half; g += 8) {
+        float r[8], i[8];
+        memcpy(r, re + g, sizeof(r));
+        memcpy(i, im + g, sizeof(i));
+        for (uint32_t h = 1; h < 8; h *= 2) {
+            for (uint32_t b = 0; b < 8; b += 2 * h) {
+                for (uint32_t j = 0; j < h; j++) {
+                    uint32_t w = j * (4 / h);
+                    float tr = r[b + j + h] * wr[w] - i[b + j + h] * wi[w];
+                    float ti = r[b + j + h] * wi[w] + i[b + j + h] * wr[w];
+                    r[b + j + h] = r[b + j] - tr;
+                    i[b + j + h] = i[b + j] - ti;
+                    r[b + j] += tr;
+                    i[b + j] += ti;
+                }
+            }
+        }
+        memcpy(re + g, r, sizeof(r));
+        memcpy(im + g, i, sizeof(i));
+    }
+}
+
+// in place over half points already in bit-reversed order
+void fft_butterflies(const Fft* fft, float* re, float* im) {
+    uint32_t half = fft->half;
+    uint32_t h = 1;
+    if (half >= 8) {
+        fft_first_spans(re, im, half);
+        h = 8;
+    }
+    for (; h < half; h *= 2) {
+        const float* wr = fft->twiddle_re + h;
+        const float* wi = fft->twiddle_im + h;
+        for (uint32_t g = 0; g < half; g += 2 * h) {
+            float* ar = re + g;
+            float* ai = im + g;
+            float* br = re + g + h;
+            float* bi = im + g + h;
+            uint32_t j = 0;
+            if (h >= fft_lanes) {
+                for (; j < h; j += fft_lanes) {
+                    FftLanes xr, xi, yr, yi, cr, ci;
+                    memcpy(&xr, ar + j, sizeof(FftLanes));
+                    memcpy(&xi, ai + j, sizeof(FftLanes));
+                    memcpy(&yr, br + j, sizeof(FftLanes));
+                    memcpy(&yi, bi + j, sizeof(FftLanes));
+                    memcpy(&cr, wr + j, sizeof(FftLanes));
+                    memcpy(&ci, wi + j, sizeof(FftLanes));
+                    FftLanes tr = yr * cr - yi * ci;
+                    FftLanes ti = yr * ci + yi * cr;
+                    FftLanes sr = xr + tr;
+                    FftLanes si = xi + ti;
+                    FftLanes dr = xr - tr;
+                    FftLanes di = xi - ti;
+                    memcpy(ar + j, &sr, sizeof(FftLanes));
+                    memcpy(ai + j, &si, sizeof(FftLanes));
+                    memcpy(br + j, &dr, sizeof(FftLanes));
+                    memcpy(bi + j, &di, sizeof(FftLanes));
+                }
+            }
+            for (; j < h; j++) {
+                float tr = br[j] * wr[j] - bi[j] * wi[j];
+                float ti = br[j] * wi[j] + bi[j] * wr[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
+
+// size real samples to half + 1 bins, unscaled: a full-scale sine on a
+// bin reads size / 2
+void fft_forward(const Fft* fft, const float* in, float* re, float* im) {
+    uint32_t half = fft->half;
+    for (uint32_t k = 0; k < half; k++) {
+        uint32_t r = fft->reverse[k];
+        re[r] = in[2 * k];
+        im[r] = in[2 * k + 1];
+    }
+    fft_butterflies(fft, re, im);
+    // bins k and half - k come from the same two points; the middle one
+    // is written twice with the same value
+    float r0 = re[0];
+    float i0 = im[0];
+    re[0] = r0 + i0;
+    im[0] = 0.0f;
+    re[half] = r0 - i0;
+    im[half] = 0.0f;
+    for (uint32_t k = 1; k <= half / 2; k++) {
+        float ar = re[k], ai = im[k];
+        float br = re[half - k], bi = im[half - k];
+        float er = 0.5f * (ar + br);
+        float ei = 0.5f * (ai - bi);
+        float odd_re = 0.5f * (ai + bi);
+        float odd_im = -0.5f * (ar - br);
+        float wr = fft->untangle_re[k];
+        float wi = fft->untangle_im[k];
+        float tr = wr * odd_re - wi * odd_im;
+        float ti = wr * odd_im + wi * odd_re;
+        re[k] = er + tr;
+        im[k] = ei + ti;
+        re[half - k] = er - tr;
+        im[half - k] = ti - ei;
+    }
+}
+
+// half + 1 bins back to size real samples, scaled so that the inverse of
+// the forward is the input. re and im are left as scratch, and out holds
+// the untangled points on their way back into bit-reversed order
+void fft_inverse(const Fft* fft, float* re, float* im, float* out) {
+    uint32_t half = fft->half;
+    float* zr = out;
+    float* zi = out + half;
+    // the complex inverse as a forward transform of the conjugate; the
+    // 1 / half it needs is folded into the untangling
+    float scale = 0.5f / (float)half;
+    zr[0] = scale * (re[0] + re[half]);
+    zi[0] = -scale * (re[0] - re[half]);
+    for (uint32_t k = 1; k <= half / 2; k++) {
+        float ar = re[k], ai = im[k];
+        float br = re[half - k], bi = -im[half - k];
+        float er = scale * (ar + br);
+        float ei = scale * (ai + bi);
+        float dr = scale * (ar - br);
+        float di = scale * (ai - bi);
+        float wr = fft->untangle_re[k];
+        float wi = fft->untangle_im[k];
+        float odd_re = dr * wr + di * wi;
+        float odd_im = di * wr - dr * wi;
+        zr[k] = er - odd_im;
+        zi[k] = -(ei + odd_re);
+        zr[half - k] = er + odd_im;
+        zi[half - k] = ei - odd_re;
+    }
+    for (uint32_t k = 0; k < half; k++) {
+        uint32_t r = fft->reverse[k];
+        re[r] = zr[k];
+        im[r] = zi[k];
+    }
+    fft_butterflies(fft, re, im);
+    for (uint32_t k = 0; k < half; k++) {
+        out[2 * k] = re[k];
+        out[2 * k + 1] = -im[k];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+// against a direct transform in double, the round trip, and ns per
+// forward and inverse at the sizes the meters and convolution use
+void fft_bench_run(void) {
+    header("fft_bench_run");
+
+    enum {
+        bench_sizes = 4,
+        check_size = 2048,
+    };
+    const uint32_t sizes[bench_sizes] = {256, 1024, 2048, 16384};
+    float* in = fft_alloc(fft_max_size);
+    float* out = fft_alloc(fft_max_size);
+    float* re = fft_alloc(fft_max_size / 2 + 1);
+    float* im = fft_alloc(fft_max_size / 2 + 1);
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < fft_max_size; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        in[i] = (seed >> 8) / 8388608.0f - 1.0f;
+    }
+
+    Fft fft;
+    fft_make(&fft, check_size);
+    fft_forward(&fft, in, re, im);
+    double worst = 0.0;
+    for (uint32_t k = 0; k <= check_size / 2; k++) {
+        double sr = 0.0, si = 0.0;
+        for (uint32_t i = 0; i < check_size; i++) {
+            double angle = -2.0 * M_PI * (double)((uint64_t)k * i %
+                                                  check_size) /
+                           check_size;
+            sr += in[i] * cos(angle);
+            si += in[i] * sin(angle);
+        }
+        double d = hypot(re[k] - sr, im[k] - si);
+        worst = d > worst ? d : worst;
+    }
+    fft_inverse(&fft, re, im, out);
+    double trip = 0.0;
+    for (uint32_t i = 0; i < check_size; i++) {
+        double d = fabs((double)out[i] - in[i]);
+        trip = d > trip ? d : trip;
+    }
+    printf("fft %u: max bin error %g (of %g rms), round trip %g\n",
+           check_size,
+           worst,
+           sqrt(check_size / 3.0),
+           trip);
+    fft_free(&fft);
+
+    for (uint32_t s = 0; s < bench_sizes; s++) {
+        uint32_t n = sizes[s];
+        fft_make(&fft, n);
+        // about 64M samples each way
+        uint32_t reps = (1u << 26) / n;
+        double t0 = mix_bench_seconds();
+        for (uint32_t r = 0; r < reps; r++) fft_forward(&fft, in, re, im);
+        double t1 = mix_bench_seconds();
+        for (uint32_t r = 0; r < reps; r++) {
+            fft_forward(&fft, in, re, im);
+            fft_inverse(&fft, re, im, out);
+        }
+        double t2 = mix_bench_seconds();
+        double forward = (t1 - t0) * 1e9 / reps;
+        double inverse = (t2 - t1) * 1e9 / reps - forward;
+        printf("fft n=%-6u forward %8.0f ns (%5.2f ns/sample) inverse %8.0f "
+               "ns\n",
+               n,
+               forward,
+               forward / n,
+               inverse);
+        fft_free(&fft);
+    }
+
+    free(in);
+    free(out);
+    free(re);
+    free(im);
+    end("fft_bench_run");
+}
@@ -0,0 +1,402 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/freeze.c
+//=============================================================================
+
+#include "freeze.h"
+#include "audio.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "graph.h"
+#include "macros.h"
+#include "sampler.h"
+#include "sequencer.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// a frozen track is its instrument and inserts rendered once and streamed
+// back like a clip. The file is named by a hash of everything the render
+// depends on, so an unchanged track finds its render from any session and
+// a changed one never plays a stale one. Nothing is ever overwritten in
+// place: renders land under a temporary name and are renamed
+
+//-----------------------------------------------------------------------------
+// keys
+//-----------------------------------------------------------------------------
+
+// fnv-1a, 64 bit
+uint64_t freeze_hash(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t freeze_hash_begin(void) {
+    return 0xcbf29ce484222325ull;
+}
+
+// selection is not something the instrument hears
+uint64_t freeze_key_notes(const NoteTrack* track) {
+    uint64_t hash = freeze_hash_begin();
+    uint32_t count = track ? track->count : 0;
+    hash = freeze_hash(hash, &count, sizeof(count));
+    if (!count) return hash;
+    hash = freeze_hash(hash, track->start, sizeof(uint32_t) * count);
+    hash = freeze_hash(hash, track->length, sizeof(uint32_t) * count);
+    hash = freeze_hash(hash, track->pitch, count);
+    hash = freeze_hash(hash, track->velocity, count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t muted = track->flags[i] & note_flag_muted;
+        hash = freeze_hash(hash, &muted, 1);
+    }
+    return hash;
+}
+
+// field by field: segments have padding
+uint64_t freeze_key_tempo(const TempoMap* map) {
+    uint64_t hash = freeze_hash_begin();
+    hash = freeze_hash(hash, &map->sample_rate, sizeof(map->sample_rate));
+    hash = freeze_hash(hash, &map->count, sizeof(map->count));
+    for (uint32_t i = 0; i < map->count; i++) {
+        const TempoSegment* segment = &map->segments[i];
+        hash = freeze_hash(hash, &segment->tick, sizeof(segment->tick));
+        hash = freeze_hash(hash,
+                           &segment->samples_per_tick,
+                           sizeof(segment->samples_per_tick));
+    }
+    return hash;
+}
+
+// the nodes a render replaces
+uint8_t freeze_chain_node(uint32_t node) {
+    return node == audio_node_instrument || node >= audio_node_inserts;
+}
+
+uint64_t freeze_key_lanes(const AutomationLane* lanes, uint32_t lane_count) {
+    uint64_t hash = freeze_hash_begin();
+    for (uint32_t l = 0; l < lane_count; l++) {
+        const AutomationLane* lane = &lanes[l];
+        if (!freeze_chain_node(lane->node)) continue;
+        hash = freeze_hash(hash, &lane->target, sizeof(lane->target));
+        hash = freeze_hash(hash, &lane->node, sizeof(lane->node));
+        hash = freeze_hash(hash, &lane->param, sizeof(lane->param));
+        hash = freeze_hash(hash, &lane->count, sizeof(lane->count));
+        for (uint32_t p = 0; p < lane->count; p++) {
+            const AutomationPoint* point = &lane->points[p];
+            hash = freeze_hash(hash, &point->frame, sizeof(point->frame));
+            hash = freeze_hash(hash, &point->value, sizeof(point->value));
+            hash = freeze_hash(hash, &point->curve, sizeof(point->curve));
+        }
+    }
+    return hash;
+}
+
+// which plugin, and its parameters as they stand. A sandboxed plugin is
+// known by name only: its parameters live in the child
+uint64_t freeze_key_plugin(const AudioEngine* engine) {
+    uint64_t hash = freeze_hash_begin();
+    const PluginInstance* instance = engine->plugin;
+    if (instance) {
+        const clap_plugin_descriptor_t* desc = instance->plugin->desc;
+        hash = freeze_hash(hash, desc->id, strlen(desc->id) + 1);
+        if (desc->version)
+            hash = freeze_hash(hash, desc->version, strlen(desc->version) + 1);
+        const clap_plugin_params_t* params =
+            instance->plugin->get_extension(instance->plugin, CLAP_EXT_PARAMS);
+        uint32_t count = params ? params->count(instance->plugin) : 0;
+        for (uint32_t i = 0; i < count; i++) {
+            clap_param_info_t info;
+            double value = 0.0;
+            if (!params->get_info(instance->plugin, i, &info)) continue;
+            params->get_value(instance->plugin, info.id, &value);
+            hash = freeze_hash(hash, &info.id, sizeof(info.id));
+            hash = freeze_hash(hash, &value, sizeof(value));
+        }
+    }
+    if (engine->sandbox) {
+        hash = freeze_hash(
+            hash, engine->sandbox->name, strlen(engine->sandbox->name) + 1);
+    }
+    return hash;
+}
+
+uint32_t freeze_chain_latency(const AudioEngine* engine) {
+    uint32_t latency = 0;
+    if (engine->plugin) latency += engine->plugin->latency;
+    if (engine->sandbox) latency += engine->sandbox->latency;
+    return latency;
+}
+
+// the last note's end through the tempo map, the synth's release and the
+// chain's latency
+uint64_t freeze_frames(const AudioEngine* engine, const FreezeDesc* desc) {
+    uint32_t end = 0;
+    const NoteTrack* track = desc->track;
+    for (uint32_t i = 0; track && i < track->count; i++) {
+        uint32_t note_end = track->start[i] + track->length[i];
+        end = note_end > end ? note_end : end;
+    }
+    TempoMap* map = malloc(sizeof(TempoMap));
+    assert(map);
+    memcpy(map, desc->tempo_map, sizeof(TempoMap));
+    map->cached = 0;
+    uint64_t frames = (uint64_t)ceil(tempo_map_tick_to_sample(map, end));
+    free(map);
+    return frames + (uint64_t)export_tail_seconds * engine->sample_rate +
+           freeze_chain_latency(engine);
+}
+
+//-----------------------------------------------------------------------------
+// cache
+//-----------------------------------------------------------------------------
+
+// WAR_FREEZE_DIR, else $XDG_CACHE_HOME/war/freeze, else
+// ~/.cache/war/freeze; made if missing. 0 when there is nowhere to put it
+uint8_t freeze_dir(char* dir, size_t size) {
+    const char* env = getenv("WAR_FREEZE_DIR");
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (env && env[0]) {
+        snprintf(dir, size, "%s", env);
+    } else if (cache && cache[0]) {
+        snprintf(dir, size, "%s/war/freeze", cache);
+    } else if (home && home[0]) {
+        snprintf(dir, size, "%s/.cache/war/freeze", home);
+    } else {
+        return 0;
+    }
+    // every parent first
+    for (char* slash = strchr(dir + 1, '/'); slash;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST) return 0;
+        *slash = '/';
+    }
+    return mkdir(dir, 0755) == 0 || errno == EEXIST;
+}
+
+// the chain alone on an engine of its own, offline, a block at a time the
+// way it plays: same block size, same events, same parameter steps. The
+// plugin is a fresh instance of the engine's, loaded the way it was
+uint8_t freeze_render(const AudioEngine* engine,
+                      const FreezeDesc* desc,
+                      uint64_t frames,
+                      const char* path) {
+    header("freeze_render");
+
+    if (frames * audio_channels * sizeof(float) > UINT32_MAX - 36) {
+        call_carmack("freeze: %" PRIu64 " frames do not fit a WAV", frames);
+        end("freeze_render");
+        return 0;
+    }
+    char temp[freeze_max_path + 32];
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+    FILE* file = fopen(temp, "wb");
+    if (!file) {
+        call_carmack("freeze: cannot write %s", temp);
+        end("freeze_render");
+        return 0;
+    }
+
+    AudioEngine* render =
+        audio_make_engine(engine->sample_rate, engine->block_frames);
+    render->gain = engine->gain;
+    audio_set_track(render, desc->track);
+    TempoMap* tempo_map = audio_tempo_map(render);
+    assert(tempo_map);
+    memcpy(tempo_map, desc->tempo_map, sizeof(TempoMap));
+    audio_send_pointer(render, audio_cmd_set_tempo_map, tempo_map);
+    audio_load_env_plugin(render);
+    uint8_t ok = !engine->plugin == !render->plugin &&
+                 !engine->sandbox == !render->sandbox &&
+                 render->graph->latency == freeze_chain_latency(engine);
+    // master and clips lanes are the engine's to play
+    uint32_t lane_count = 0;
+    AutomationLane* lanes =
+        malloc(sizeof(AutomationLane) * (desc->lane_count + 1));
+    assert(lanes);
+    for (uint32_t l = 0; l < desc->lane_count; l++) {
+        if (freeze_chain_node(desc->lanes[l].node))
+            lanes[lane_count++] = desc->lanes[l];
+    }
+    if (lane_count) audio_set_automation(render, lanes, lane_count);
+    free(lanes);
+
+    audio_write_wav_header(file, render->sample_rate, audio_channels, 0);
+    audio_send(render, audio_cmd_play, 0, 0.0f, 0);
+    graph_pool_start(&render->pool, render->graph->workers, 0);
+    uint64_t done = 0;
+    AudioMessage event;
+    while (ok && done < frames) {
+        uint32_t n = frames - done < render->block_frames
+                         ? (uint32_t)(frames - done)
+                         : render->block_frames;
+        audio_process_block(render, render->mix, n);
+        fwrite(render->mix, sizeof(float) * audio_channels, n, file);
+        while (spsc_pop(&render->events, &event)) audio_retire(&event);
+        done += n;
+    }
+    uint32_t data_bytes = (uint32_t)(done * audio_channels * sizeof(float));
+    fseek(file, 0, SEEK_SET);
+    audio_write_wav_header(
+        file, render->sample_rate, audio_channels, data_bytes);
+    ok = ok && !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) {
+        call_carmack("freeze: render to %s failed", path);
+        unlink(temp);
+    }
+
+    audio_finish(render);
+    audio_free_engine(render);
+
+    end("freeze_render");
+    return ok;
+}
+
+// a render of the right length and layout, streamed by a new sampler
+uint8_t freeze_load(Freeze* freeze) {
+    freeze->sampler = sampler_make();
+    uint32_t file = sampler_open_file(freeze->sampler, freeze->path);
+    if (file != UINT32_MAX) {
+        const SampleFile* sample = &freeze->sampler->files[file];
+        if (sample->frames == freeze->frames &&
+            sample->channels == audio_channels && sample->bits == 32 &&
+            sample->sample_rate == audio_sample_rate) {
+            sampler_add_clip(freeze->sampler, file, 0, 0, freeze->frames, 1.0f);
+            return 1;
+        }
+    }
+    sampler_free(freeze->sampler);
+    freeze->sampler = NULL;
+    return 0;
+}
+
+// UI side, after the plugin is loaded and before audio_start: the cached
+// render when there is one, a new one otherwise. NULL when neither can
+// be had; the track then plays live
+Freeze* freeze_open(const AudioEngine* engine, const FreezeDesc* desc) {
+    header("freeze_open");
+
+    Freeze* freeze = malloc(sizeof(Freeze));
+    assert(freeze);
+    memset(freeze, 0, sizeof(Freeze));
+    freeze->notes_key = freeze_key_notes(desc->track);
+    freeze->tempo_key = freeze_key_tempo(desc->tempo_map);
+    freeze->lanes_key = freeze_key_lanes(desc->lanes, desc->lane_count);
+    freeze->gain = engine->gain;
+    freeze->latency = freeze_chain_latency(engine);
+    freeze->frames = freeze_frames(engine, desc);
+    uint64_t parts[] = {
+        freeze_version,
+        engine->sample_rate,
+        engine->block_frames,
+        freeze->notes_key,
+        freeze->tempo_key,
+        freeze->lanes_key,
+        freeze_key_plugin(engine),
+        freeze->frames,
+    };
+    uint64_t key = freeze_hash(freeze_hash_begin(), parts, sizeof(parts));
+    freeze->key = freeze_hash(key, &freeze->gain, sizeof(freeze->gain));
+
+    char dir[freeze_max_path];
+    if (!freeze_dir(dir, sizeof(dir))) {
+        call_carmack("freeze: no cache directory");
+        free(freeze);
+        end("freeze_open");
+        return NULL;
+    }
+    int length = snprintf(freeze->path,
+                          sizeof(freeze->path),
+                          "%s/%016" PRIx64 ".wav",
+                          dir,
+                          freeze->key);
+    if (length < 0 || (size_t)length >= sizeof(freeze->path)) {
+        call_carmack("freeze: cache path too long under %s", dir);
+        free(freeze);
+        end("freeze_open");
+        return NULL;
+    }
+    double seconds = (double)freeze->frames / engine->sample_rate;
+    if (freeze_load(freeze)) {
+        printf("freeze: %.1f s cached -> %s\n", seconds, freeze->path);
+    } else {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        uint8_t ok = freeze_render(engine, desc, freeze->frames, freeze->path);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (!ok || !freeze_load(freeze)) {
+            free(freeze);
+            end("freeze_open");
+            return NULL;
+        }
+        double wall =
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("freeze: %.1f s rendered in %.3f s (%.1fx real time) -> %s\n",
+               seconds,
+               wall,
+               wall > 0 ? seconds / wall : 0.0,
+               freeze->path);
+    }
+    freeze->active = 1;
+
+    end("freeze_open");
+    return freeze;
+}
+
+// after the engine is done with it
+void freeze_free(Freeze* freeze) {
+    sampler_free(freeze->sampler);
+    free(freeze);
+}
+
+//-----------------------------------------------------------------------------
+// audio thread
+//-----------------------------------------------------------------------------
+
+// graph node: the render in place of the chain, latency and all
+void freeze_node(void* state,
+                 AudioGraph* graph,
+                 uint32_t node,
+                 uint32_t frames) {
+    AudioEngine* engine = state;
+    Sampler* sampler = engine->freeze->sampler;
+    float* left = graph_left(graph, node);
+    float* right = graph_right(graph, node);
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+    sampler_locate(sampler, engine->frame);
+    if (!engine->playing) return;
+    sampler_render(
+        sampler, &engine->kernels, engine->frame, frames, left, right);
+}
@@ -0,0 +1,802 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/graph.c
+//=============================================================================
+
+#include "graph.h"
+#include "automation.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "meter.h"
+#include "mix.h"
+#include "stats.h"
+#include "synth.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// the mixer as a dag. Compiling does everything that depends only on the
+// shape (order, counts, placement) so a block is: reset the counters, wake
+// the workers, and let every thread run nodes whose inputs are done
+
+//-----------------------------------------------------------------------------
+// description, UI thread
+//-----------------------------------------------------------------------------
+
+void graph_desc_init(GraphDesc* desc) {
+    memset(desc, 0, sizeof(GraphDesc));
+}
+
+uint32_t graph_add_node(GraphDesc* desc,
+                        GraphProcess process,
+                        void* state,
+                        float gain,
+                        float cost) {
+    assert(desc->node_count < max_graph_nodes);
+    desc->nodes[desc->node_count] = (GraphNodeDesc){
+        .process = process,
+        .state = state,
+        .gain = gain,
+        .cost = cost,
+    };
+    return desc->node_count++;
+}
+
+// frames the node's output lags its inputs, e.g. a plugin's lookahead
+void graph_set_latency(GraphDesc* desc, uint32_t node, uint32_t frames) {
+    assert(node < desc->node_count);
+    desc->nodes[node].latency = frames;
+}
+
+// what profiling calls the node; kept by pointer until graph_compile
+void graph_set_name(GraphDesc* desc, uint32_t node, const char* name) {
+    assert(node < desc->node_count);
+    desc->nodes[node].name = name;
+}
+
+void graph_connect(GraphDesc* desc, uint32_t from, uint32_t to) {
+    assert(desc->edge_count < max_graph_edges);
+    assert(from < desc->node_count && to < desc->node_count);
+    desc->edge_from[desc->edge_count] = from;
+    desc->edge_to[desc->edge_count] = to;
+    desc->edge_count++;
+}
+
+// NULL on a cycle. Placement: sources are ranked by their longest cost
+// path to a sink and dealt, heaviest first, to the least loaded worker.
+// Latency: a node's inputs are delayed up to the latest of them, so the
+// paths into every sum stay sample aligned
+AudioGraph* graph_compile(const GraphDesc* desc,
+                          uint32_t block_frames,
+                          uint32_t workers,
+                          const MixKernels* kernels) {
+    header("graph_compile");
+
+    uint32_t n = desc->node_count;
+    uint32_t e = desc->edge_count;
+    assert(n > 0 && desc->output < n);
+    if (workers < 1) workers = 1;
+    if (workers > max_graph_workers) workers = max_graph_workers;
+
+    AudioGraph* graph = malloc(sizeof(AudioGraph));
+    assert(graph);
+    *graph = (AudioGraph){
+        .node_count = n,
+        .output = desc->output,
+        .block_frames = block_frames,
+        .workers = workers,
+        .kernels = kernels,
+    };
+    graph->nodes = malloc(sizeof(GraphNodeDesc) * n);
+    graph->input_begin = calloc(n + 1, sizeof(uint32_t));
+    graph->inputs = malloc(sizeof(uint32_t) * (e ? e : 1));
+    graph->successor_begin = calloc(n + 1, sizeof(uint32_t));
+    graph->successors = malloc(sizeof(uint32_t) * (e ? e : 1));
+    graph->dependencies = calloc(n, sizeof(uint32_t));
+    graph->pending = calloc(n, sizeof(uint32_t));
+    graph->source_begin = calloc(workers + 1, sizeof(uint32_t));
+    graph->sources = malloc(sizeof(uint32_t) * n);
+    size_t buffer_bytes = sizeof(float) * 2 * block_frames * n;
+    buffer_bytes = (buffer_bytes + 63) & ~(size_t)63;
+    graph->buffers = aligned_alloc(64, buffer_bytes);
+    assert(graph->nodes && graph->input_begin && graph->inputs &&
+           graph->successor_begin && graph->successors &&
+           graph->dependencies && graph->pending && graph->source_begin &&
+           graph->sources && graph->buffers);
+    memcpy(graph->nodes, desc->nodes, sizeof(GraphNodeDesc) * n);
+    memset(graph->buffers, 0, buffer_bytes);
+
+    // both adjacency lists by counting sort on the edge endpoints
+    for (uint32_t i = 0; i < e; i++) {
+        graph->input_begin[desc->edge_to[i] + 1]++;
+        graph->successor_begin[desc->edge_from[i] + 1]++;
+        graph->dependencies[desc->edge_to[i]]++;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        graph->input_begin[i + 1] += graph->input_begin[i];
+        graph->successor_begin[i + 1] += graph->successor_begin[i];
+    }
+    uint32_t* fill = calloc(n * 2, sizeof(uint32_t));
+    assert(fill);
+    for (uint32_t i = 0; i < e; i++) {
+        uint32_t from = desc->edge_from[i], to = desc->edge_to[i];
+        graph->inputs[graph->input_begin[to] + fill[to]++] = from;
+        graph->successors[graph->successor_begin[from] + fill[n + from]++] =
+            to;
+    }
+
+    // kahn's order; anything left over sits on a cycle
+    uint32_t* order = fill;
+    uint32_t* degree = fill + n;
+    memcpy(degree, graph->dependencies, sizeof(uint32_t) * n);
+    uint32_t head = 0, tail = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (!degree[i]) order[tail++] = i;
+    while (head < tail) {
+        uint32_t node = order[head++];
+        for (uint32_t s = graph->successor_begin[node];
+             s < graph->successor_begin[node + 1];
+             s++) {
+            if (--degree[graph->successors[s]] == 0)
+                order[tail++] = graph->successors[s];
+        }
+    }
+    if (tail != n) {
+        call_carmack("graph: cycle, %u of %u nodes ordered", tail, n);
+        free(fill);
+        graph_free(graph);
+        end("graph_compile");
+        return NULL;
+    }
+
+    // in order, so every input's latency is final before it is read
+    uint32_t* latency = calloc(n, sizeof(uint32_t));
+    graph->delay = calloc(e ? e : 1, sizeof(uint32_t));
+    graph->delay_begin = calloc(e ? e : 1, sizeof(uint32_t));
+    graph->delay_write = calloc(e ? e : 1, sizeof(uint32_t));
+    assert(latency && graph->delay && graph->delay_begin &&
+           graph->delay_write);
+    size_t delay_floats = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t node = order[i];
+        uint32_t arrival = 0;
+        for (uint32_t k = graph->input_begin[node];
+             k < graph->input_begin[node + 1];
+             k++) {
+            uint32_t input = latency[graph->inputs[k]];
+            arrival = input > arrival ? input : arrival;
+        }
+        for (uint32_t k = graph->input_begin[node];
+             k < graph->input_begin[node + 1];
+             k++) {
+            graph->delay[k] = arrival - latency[graph->inputs[k]];
+            if (!graph->delay[k]) continue;
+            graph->delay_begin[k] = (uint32_t)delay_floats;
+            delay_floats += 2 * ((size_t)graph->delay[k] + block_frames);
+        }
+        latency[node] = arrival + desc->nodes[node].latency;
+    }
+    graph->latency = latency[desc->output];
+    free(latency);
+    graph->delay_lines = calloc(delay_floats ? delay_floats : 1, sizeof(float));
+    assert(graph->delay_lines);
+
+    float* rank = malloc(sizeof(float) * n);
+    assert(rank);
+    for (uint32_t i = n; i-- > 0;) {
+        uint32_t node = order[i];
+        float longest = 0.0f;
+        for (uint32_t s = graph->successor_begin[node];
+             s < graph->successor_begin[node + 1];
+             s++) {
+            float r = rank[graph->successors[s]];
+            longest = r > longest ? r : longest;
+        }
+        rank[node] = desc->nodes[node].cost + longest;
+    }
+
+    // sources sorted by rank, descending (insertion sort, compile time only)
+    uint32_t source_count = 0;
+    uint32_t* sources = degree;
+    for (uint32_t i = 0; i < n; i++) {
+        if (graph->dependencies[i]) continue;
+        uint32_t j = source_count++;
+        while (j > 0 && rank[sources[j - 1]] < rank[i]) {
+            sources[j] = sources[j - 1];
+            j--;
+        }
+        sources[j] = i;
+    }
+    float load[max_graph_workers] = {0};
+    uint32_t* owner = order;
+    uint32_t per_worker[max_graph_workers] = {0};
+    for (uint32_t i = 0; i < source_count; i++) {
+        uint32_t best = 0;
+        for (uint32_t w = 1; w < workers; w++)
+            if (load[w] < load[best]) best = w;
+        load[best] += rank[sources[i]];
+        owner[i] = best;
+        per_worker[best]++;
+    }
+    for (uint32_t w = 0; w < workers; w++)
+        graph->source_begin[w + 1] = graph->source_begin[w] + per_worker[w];
+    memset(per_worker, 0, sizeof(per_worker));
+    for (uint32_t i = 0; i < source_count; i++) {
+        uint32_t w = owner[i];
+        graph->sources[graph->source_begin[w] + per_worker[w]++] = sources[i];
+    }
+
+    free(rank);
+    free(fill);
+    call_carmack("graph: %u nodes, %u edges, %u sources over %u workers, "
+                 "%u frames latency",
+                 n,
+                 e,
+                 source_count,
+                 workers,
+                 graph->latency);
+    end("graph_compile");
+    return graph;
+}
+
+void graph_free(AudioGraph* graph) {
+    free(graph->nodes);
+    free(graph->input_begin);
+    free(graph->inputs);
+    free(graph->successor_begin);
+    free(graph->successors);
+    free(graph->dependencies);
+    free(graph->pending);
+    free(graph->source_begin);
+    free(graph->sources);
+    free(graph->buffers);
+    free(graph->delay);
+    free(graph->delay_begin);
+    free(graph->delay_write);
+    free(graph->delay_lines);
+    free(graph);
+}
+
+float* graph_left(AudioGraph* graph, uint32_t node) {
+    return graph->buffers + (size_t)node * 2 * graph->block_frames;
+}
+
+float* graph_right(AudioGraph* graph, uint32_t node) {
+    return graph->buffers + ((size_t)node * 2 + 1) * graph->block_frames;
+}
+
+//-----------------------------------------------------------------------------
+// chase-lev deque
+//-----------------------------------------------------------------------------
+
+// owner only; a block never holds more than max_graph_nodes items
+void graph_deque_push(GraphDeque* deque, uint32_t item) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->items[bottom & (max_graph_nodes - 1)],
+                     item,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+// owner only
+uint8_t graph_deque_pop(GraphDeque* deque, uint32_t* item) {
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *item = __atomic_load_n(&deque->items[bottom & (max_graph_nodes - 1)],
+                            __ATOMIC_RELAXED);
+    if (top < bottom) return 1;
+    // last item: race the thieves for it
+    uint8_t won = __atomic_compare_exchange_n(&deque->top,
+                                              &top,
+                                              top + 1,
+                                              0,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+// any thread
+uint8_t graph_deque_steal(GraphDeque* deque, uint32_t* item) {
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) return 0;
+    *item = __atomic_load_n(&deque->items[top & (max_graph_nodes - 1)],
+                            __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(&deque->top,
+                                       &top,
+                                       top + 1,
+                                       0,
+                                       __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+// execution, audio thread and workers
+//-----------------------------------------------------------------------------
+
+// input k pushed through its delay line and added at gain: the block is
+// written at the head, then read back delay frames behind it
+void graph_delay_add(AudioGraph* graph,
+                     uint32_t k,
+                     float* left,
+                     float* right,
+                     float gain,
+                     uint32_t frames) {
+    const MixKernels* mix = graph->kernels;
+    uint32_t input = graph->inputs[k];
+    uint32_t length = graph->delay[k] + graph->block_frames;
+    float* lines[2] = {
+        graph->delay_lines + graph->delay_begin[k],
+        graph->delay_lines + graph->delay_begin[k] + length,
+    };
+    const float* sources[2] = {
+        graph_left(graph, input),
+        graph_right(graph, input),
+    };
+    float* outputs[2] = {left, right};
+    uint32_t write = graph->delay_write[k];
+    uint32_t read = (write + length - graph->delay[k]) % length;
+    uint32_t first = length - write < frames ? length - write : frames;
+    uint32_t first_read = length - read < frames ? length - read : frames;
+    for (uint32_t c = 0; c < 2; c++) {
+        memcpy(lines[c] + write, sources[c], sizeof(float) * first);
+        memcpy(lines[c], sources[c] + first, sizeof(float) * (frames - first));
+        mix->add(outputs[c], lines[c] + read, gain, first_read);
+        mix->add(outputs[c] + first_read,
+                 lines[c],
+                 gain,
+                 frames - first_read);
+    }
+    graph->delay_write[k] = (write + frames) % length;
+}
+
+// the node's inputs, lined up and summed at gain into left and right
+void graph_gather(AudioGraph* graph,
+                  uint32_t node,
+                  float* left,
+                  float* right,
+                  float gain,
+                  uint32_t frames) {
+    const MixKernels* k = graph->kernels;
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+    for (uint32_t i = graph->input_begin[node];
+         i < graph->input_begin[node + 1];
+         i++) {
+        if (graph->delay[i]) {
+            graph_delay_add(graph, i, left, right, gain, frames);
+            continue;
+        }
+        uint32_t input = graph->inputs[i];
+        k->add(left, graph_left(graph, input), gain, frames);
+        k->add(right, graph_right(graph, input), gain, frames);
+    }
+}
+
+void graph_sum(AudioGraph* graph, uint32_t node, uint32_t frames) {
+    graph_gather(graph,
+                 node,
+                 graph_left(graph, node),
+                 graph_right(graph, node),
+                 graph->nodes[node].gain,
+                 frames);
+}
+
+// successors that become ready stay on this thread, where their inputs
+// are still in cache
+void graph_run_node(GraphPool* pool,
+                    AudioGraph* graph,
+                    uint32_t worker,
+                    uint32_t node) {
+    const GraphNodeDesc* desc = &graph->nodes[node];
+    uint32_t frames = pool->frames;
+    uint64_t start = graph->stats ? stats_now_ns() : 0;
+    if (desc->process) {
+        desc->process(desc->state, graph, node, frames);
+        if (desc->gain != 1.0f) {
+            graph->kernels->gain(graph_left(graph, node), desc->gain, frames);
+            graph->kernels->gain(graph_right(graph, node), desc->gain, frames);
+        }
+    } else {
+        graph_sum(graph, node, frames);
+    }
+    if (pool->automation) {
+        automation_apply(pool->automation,
+                         graph->kernels,
+                         node,
+                         graph_left(graph, node),
+                         graph_right(graph, node),
+                         frames);
+    }
+    if (pool->meters) meter_node(pool->meters, graph, worker, node, frames);
+    if (graph->stats)
+        stats_record(&graph->stats[node], stats_now_ns() - start);
+    for (uint32_t s = graph->successor_begin[node];
+         s < graph->successor_begin[node + 1];
+         s++) {
+        uint32_t next = graph->successors[s];
+        if (__atomic_sub_fetch(&graph->pending[next], 1, __ATOMIC_ACQ_REL) ==
+            0)
+            graph_deque_push(&pool->deques[worker], next);
+    }
+    __atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL);
+}
+
+uint8_t graph_claim_source(GraphPool* pool,
+                           AudioGraph* graph,
+                           uint32_t list,
+                           uint32_t* node) {
+    uint32_t count = graph->source_begin[list + 1] - graph->source_begin[list];
+    if (__atomic_load_n(&pool->cursors[list].cursor, __ATOMIC_RELAXED) >=
+        count)
+        return 0;
+    uint32_t i =
+        __atomic_fetch_add(&pool->cursors[list].cursor, 1, __ATOMIC_RELAXED);
+    if (i >= count) return 0;
+    *node = graph->sources[graph->source_begin[list] + i];
+    return 1;
+}
+
+// own deque, own sources, then everyone else's sources and deques. A
+// stopped or never started pool has fewer workers than the graph has
+// lists, so the lists are walked whichever count is larger
+uint8_t graph_take(GraphPool* pool,
+                   AudioGraph* graph,
+                   uint32_t worker,
+                   uint32_t* node) {
+    if (graph_deque_pop(&pool->deques[worker], node)) return 1;
+    if (worker < graph->workers && graph_claim_source(pool, graph, worker, node))
+        return 1;
+    uint32_t lists = pool->worker_count > graph->workers ? pool->worker_count
+                                                         : graph->workers;
+    for (uint32_t i = 1; i < lists; i++) {
+        uint32_t victim = (worker + i) % lists;
+        if (victim < graph->workers &&
+            graph_claim_source(pool, graph, victim, node))
+            return 1;
+        if (graph_deque_steal(&pool->deques[victim], node)) return 1;
+    }
+    return 0;
+}
+
+void graph_work(GraphPool* pool, AudioGraph* graph, uint32_t worker) {
+    for (;;) {
+        uint32_t node;
+        // a node is waiting on these
+        if (graph_help(pool)) continue;
+        if (graph_take(pool, graph, worker, &node)) {
+            graph_run_node(pool, graph, worker, node);
+            continue;
+        }
+        if (!__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE)) return;
+        __builtin_ia32_pause();
+    }
+}
+
+// open and busy close the gap between a block ending and the next one
+// starting: a worker only touches a block it saw open after announcing
+// itself, and graph_run does not return while anyone is announced
+void* graph_worker_thread(void* arg) {
+    GraphWorker* self = arg;
+    GraphPool* pool = self->pool;
+    uint32_t seen = 0;
+    for (;;) {
+        uint32_t generation = seen;
+        for (uint32_t i = 0; i < graph_spin_iterations; i++) {
+            generation = __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE);
+            if (generation != seen) break;
+            __builtin_ia32_pause();
+        }
+        if (generation == seen) {
+            // sleepers and generation are a dekker pair with graph_run
+            __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&pool->generation, __ATOMIC_SEQ_CST) == seen) {
+                syscall(SYS_futex,
+                        &pool->generation,
+                        FUTEX_WAIT_PRIVATE,
+                        seen,
+                        NULL,
+                        NULL,
+                        0);
+            }
+            __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        seen = generation;
+        if (!__atomic_load_n(&pool->running, __ATOMIC_ACQUIRE)) break;
+        __atomic_add_fetch(&pool->busy, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pool->open, __ATOMIC_SEQ_CST))
+            graph_work(pool, pool->graph, self->index);
+        __atomic_sub_fetch(&pool->busy, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+// workers counts the calling thread; realtime asks for SCHED_FIFO at the
+// audio thread's priority and falls back like it does
+void graph_pool_start(GraphPool* pool, uint32_t workers, uint8_t realtime) {
+    header("graph_pool_start");
+
+    if (workers < 1) workers = 1;
+    if (workers > max_graph_workers) workers = max_graph_workers;
+    memset(pool, 0, sizeof(GraphPool));
+    pool->worker_count = workers;
+    pool->running = 1;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (realtime) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        struct sched_param param = {.sched_priority = 70};
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    pool->realtime = realtime;
+    for (uint32_t w = 1; w < workers; w++) {
+        GraphWorker* worker = &pool->workers[w];
+        worker->pool = pool;
+        worker->index = w;
+        int res = pthread_create(
+            &worker->thread, &attr, graph_worker_thread, worker);
+        if (res == EPERM) {
+            pool->realtime = 0;
+            res = pthread_create(
+                &worker->thread, NULL, graph_worker_thread, worker);
+        }
+        assert(res == 0);
+        (void)res;
+        // on the audio path whether or not SCHED_FIFO was granted
+        pthread_setname_np(worker->thread,
+                           realtime ? "war-rt-graph" : "war-graph");
+    }
+    pthread_attr_destroy(&attr);
+    call_carmack("graph: %u workers%s", workers, pool->realtime ? " rt" : "");
+
+    end("graph_pool_start");
+}
+
+void graph_pool_stop(GraphPool* pool) {
+    __atomic_store_n(&pool->running, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex,
+            &pool->generation,
+            FUTEX_WAKE_PRIVATE,
+            INT32_MAX,
+            NULL,
+            NULL,
+            0);
+    for (uint32_t w = 1; w < pool->worker_count; w++)
+        pthread_join(pool->workers[w].thread, NULL);
+    pool->worker_count = 0;
+}
+
+// one block of the whole graph; returns with every node done and no
+// worker still looking at it. A pool that was never started, or was
+// stopped, runs it all on the calling thread
+void graph_run(GraphPool* pool, AudioGraph* graph, uint32_t frames) {
+    assert(frames <= graph->block_frames);
+    graph->block_start_ns = stats_now_ns();
+    for (uint32_t i = 0; i < graph->node_count; i++) {
+        __atomic_store_n(
+            &graph->pending[i], graph->dependencies[i], __ATOMIC_RELAXED);
+    }
+    for (uint32_t w = 0; w < graph->workers; w++)
+        __atomic_store_n(&pool->cursors[w].cursor, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->remaining, graph->node_count, __ATOMIC_RELAXED);
+    pool->graph = graph;
+    pool->frames = frames;
+    if (pool->worker_count < 2) {
+        graph_work(pool, graph, 0);
+        return;
+    }
+
+    __atomic_store_n(&pool->open, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST)) {
+        // FUTEX_WAKE never blocks
+        syscall(SYS_futex,
+                &pool->generation,
+                FUTEX_WAKE_PRIVATE,
+                INT32_MAX,
+                NULL,
+                NULL,
+                0);
+    }
+    graph_work(pool, graph, 0);
+    __atomic_store_n(&pool->open, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool->busy, __ATOMIC_SEQ_CST))
+        __builtin_ia32_pause();
+}
+
+//-----------------------------------------------------------------------------
+// task batches, from inside a node
+//-----------------------------------------------------------------------------
+
+// one task of the current batch, if any is left unclaimed
+uint8_t graph_help(GraphPool* pool) {
+    uint64_t claim = __atomic_load_n(&pool->task_claim, __ATOMIC_ACQUIRE);
+    uint32_t count = (uint32_t)(claim >> 16) & 0xffff;
+    uint32_t task = (uint32_t)claim & 0xffff;
+    if (task >= count) return 0;
+    if (!__atomic_compare_exchange_n(&pool->task_claim,
+                                     &claim,
+                                     claim + 1,
+                                     0,
+                                     __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED))
+        return 1;
+    pool->task(pool->task_context, task);
+    __atomic_add_fetch(&pool->task_done, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// runs task 0 .. count - 1 and returns when all are done. Called by a node
+// mid-block: the other workers are spinning in graph_work, and take tasks
+// before nodes. A second batch while one is out, or a pool with no
+// workers, runs on the calling thread
+void graph_exec(GraphPool* pool,
+                GraphTask task,
+                void* context,
+                uint32_t count) {
+    uint32_t idle = 0;
+    if (!pool || pool->worker_count < 2 || count < 2 ||
+        count > graph_max_tasks ||
+        !__atomic_compare_exchange_n(&pool->task_busy,
+                                     &idle,
+                                     1,
+                                     0,
+                                     __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) {
+        for (uint32_t i = 0; i < count; i++) task(context, i);
+        return;
+    }
+    pool->task = task;
+    pool->task_context = context;
+    __atomic_store_n(&pool->task_done, 0, __ATOMIC_RELAXED);
+    uint64_t batch =
+        (__atomic_load_n(&pool->task_claim, __ATOMIC_RELAXED) >> 32) + 1;
+    __atomic_store_n(&pool->task_claim,
+                     batch << 32 | (uint64_t)count << 16,
+                     __ATOMIC_RELEASE);
+    while (__atomic_load_n(&pool->task_done, __ATOMIC_ACQUIRE) < count) {
+        if (!graph_help(pool)) __builtin_ia32_pause();
+    }
+    __atomic_store_n(&pool->task_busy, 0, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+void graph_bench_synth(void* state,
+                       AudioGraph* graph,
+                       uint32_t node,
+                       uint32_t frames) {
+    float* left = graph_left(graph, node);
+    synth_render(state, left, frames);
+    memcpy(graph_right(graph, node), left, sizeof(float) * frames);
+}
+
+// tracks -> buses -> master, timed per block at each worker count up to
+// the cores this machine has
+void graph_bench_run(void) {
+    header("graph_bench_run");
+
+    enum {
+        bench_tracks = 256,
+        bench_buses = 16,
+        bench_voices = 48,
+        bench_blocks = 2000,
+        bench_block = audio_block_frames,
+    };
+    MixKernels kernels;
+    mix_select(&kernels);
+    Synth* synths = aligned_alloc(64, sizeof(Synth) * bench_tracks);
+    GraphDesc* desc = malloc(sizeof(GraphDesc));
+    assert(synths && desc);
+    graph_desc_init(desc);
+    uint32_t master = graph_add_node(desc, NULL, NULL, 1.0f / bench_buses, 1);
+    desc->output = master;
+    for (uint32_t b = 0; b < bench_buses; b++) {
+        uint32_t bus = graph_add_node(desc, NULL, NULL, 0.05f, 1);
+        graph_connect(desc, bus, master);
+        for (uint32_t t = 0; t < bench_tracks / bench_buses; t++) {
+            Synth* synth = &synths[b * (bench_tracks / bench_buses) + t];
+            synth_make(synth, audio_sample_rate);
+            for (uint32_t v = 0; v < bench_voices; v++)
+                synth_note_on(synth, 36 + (v * 7 + t) % 60, 0.7f);
+            uint32_t track = graph_add_node(
+                desc, graph_bench_synth, synth, 1.0f, bench_voices);
+            graph_connect(desc, track, bus);
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > max_graph_workers) cores = max_graph_workers;
+    double deadline_us = 1e6 * bench_block / audio_sample_rate;
+    double single_us = 0.0;
+    GraphPool* pool = aligned_alloc(64, sizeof(GraphPool));
+    assert(pool);
+    // 1, 2, 4, ... and every core
+    uint32_t counts[max_graph_workers];
+    uint32_t count_total = 0;
+    for (uint32_t w = 1; w < (uint32_t)cores; w *= 2) counts[count_total++] = w;
+    counts[count_total++] = (uint32_t)cores;
+    for (uint32_t c = 0; c < count_total; c++) {
+        uint32_t workers = counts[c];
+        AudioGraph* graph = graph_compile(desc, bench_block, workers, &kernels);
+        assert(graph);
+        graph_pool_start(pool, workers, 0);
+        double total = 0.0, worst = 0.0;
+        for (uint32_t i = 0; i < bench_blocks; i++) {
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            graph_run(pool, graph, bench_block);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double us = (t1.tv_sec - t0.tv_sec) * 1e6 +
+                        (t1.tv_nsec - t0.tv_nsec) / 1e3;
+            total += us;
+            worst = us > worst ? us : worst;
+        }
+        graph_pool_stop(pool);
+        double avg = total / bench_blocks;
+        if (workers == 1) single_us = avg;
+        printf("graph %u tracks x %u voices, %2u workers: avg %7.1f us max "
+               "%7.1f us of %.0f us, %.2fx\n",
+               bench_tracks,
+               bench_voices,
+               workers,
+               avg,
+               worst,
+               deadline_us,
+               single_us / avg);
+        graph_free(graph);
+    }
+    // a stopped pool runs a graph built for several workers on the caller
+    AudioGraph* lists = graph_compile(desc, bench_block, 4, &kernels);
+    assert(lists && lists->workers == 4);
+    graph_pool_start(pool, 1, 0);
+    graph_pool_stop(pool);
+    graph_run(pool, lists, bench_block);
+    assert(!__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE));
+    printf("graph %u lists on a stopped pool: ran on the caller\n",
+           lists->workers);
+    graph_free(lists);
+    free(pool);
+    free(desc);
+    free(synths);
+
+    end("graph_bench_run");
+}
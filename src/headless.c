@@ -0,0 +1,225 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/headless.c
+//=============================================================================
+
+#include "headless.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "notes.h"
+#include "vulkan.h"
+#include "waveform.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// renders the piano roll without a compositor; same renderer, offscreen image
+//
+// WAR_HEADLESS_FRAMES  frame count (default 240)
+// WAR_HEADLESS_DUMP    directory to write frame_NNNNN.ppm into (optional)
+// WAR_CAMERA_PATH      keyframe file, one "frame scroll_x scroll_y cell_width
+//                      cell_height" per line, linearly interpolated; without
+//                      it the camera sweeps right and down
+// WAR_AUDIO            WAV drawn as a clip at the timeline origin
+// WAR_HEADLESS_NOTES   random notes to fill the track with (default 0)
+void headless_run(void) {
+    header("headless_run");
+
+    enum {
+        width = 1920,
+        height = 1080,
+        default_frames = 240,
+        max_keyframes = 256,
+        max_path = 4096,
+    };
+
+    uint32_t frames = default_frames;
+    const char* frames_env = getenv("WAR_HEADLESS_FRAMES");
+    if (frames_env) frames = (uint32_t)strtoul(frames_env, NULL, 10);
+    const char* dump_dir = getenv("WAR_HEADLESS_DUMP");
+
+    HeadlessKeyframe keyframes[max_keyframes];
+    uint32_t keyframe_count = 0;
+    const char* camera_path = getenv("WAR_CAMERA_PATH");
+    if (camera_path) {
+        keyframe_count =
+            headless_load_camera(camera_path, keyframes, max_keyframes);
+    }
+    if (!keyframe_count) {
+        keyframes[0] = (HeadlessKeyframe){0, 0, 48 * 20, 24, 20};
+        keyframes[1] = (HeadlessKeyframe){frames, 24 * 256, 24 * 20, 24, 20};
+        keyframe_count = 2;
+    }
+
+    PianoRollView view = {
+        .width = width,
+        .height = height,
+        .scroll_x = 0,
+        .scroll_y = 48 * 20,
+        .cell_width = 24,
+        .cell_height = 20,
+        .cells_per_beat = 4,
+        .beats_per_bar = 4,
+        .sidebar_width = 96,
+        .cursor_col = 0,
+        .cursor_row = 48 + 12,
+        .playhead_col = 0,
+        .selection_cols = 0,
+        .seconds_per_cell = 60.0f / 120.0f / 4,
+    };
+
+    NoteTrack track;
+    notes_make_track(&track, 0);
+    const char* notes_env = getenv("WAR_HEADLESS_NOTES");
+    if (notes_env) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        notes_fill_demo(&track, (uint32_t)strtoul(notes_env, NULL, 10));
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        printf("notes %u inserted in %.3f ms\n",
+               track.count,
+               (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    }
+    view.notes = &track;
+
+    VulkanContext ctx = vulkan_make_context(width, height, 0);
+    if (dump_dir) vulkan_make_readback(&ctx);
+    waveform_load_env_clip(&ctx);
+
+    double cpu_total = 0, cpu_max = 0;
+    double gpu_total = 0, gpu_max = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        headless_camera(keyframes, keyframe_count, i, &view);
+
+        uint32_t slot = ctx.frame_index;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        vulkan_render_frame(&ctx, &view);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double cpu_ms = (t1.tv_sec - t0.tv_sec) * 1e3 +
+                        (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+        VkResult res = vkWaitForFences(
+            ctx.device, 1, &ctx.frame_fences[slot], VK_TRUE, UINT64_MAX);
+        assert(res == VK_SUCCESS);
+        double gpu_ms = vulkan_frame_gpu_ms(&ctx, slot);
+
+        cpu_total += cpu_ms;
+        gpu_total += gpu_ms;
+        if (cpu_ms > cpu_max) cpu_max = cpu_ms;
+        if (gpu_ms > gpu_max) gpu_max = gpu_ms;
+        printf("frame %u cpu %.3f ms gpu %.3f ms\n", i, cpu_ms, gpu_ms);
+
+        if (dump_dir) {
+            vulkan_read_pixels(&ctx);
+            char path[max_path];
+            snprintf(path, sizeof(path), "%s/frame_%05u.ppm", dump_dir, i);
+            headless_write_ppm(path, ctx.readback_pixels, width, height);
+        }
+    }
+    if (frames) {
+        printf("frames %u cpu avg %.3f max %.3f ms gpu avg %.3f max %.3f ms\n",
+               frames,
+               cpu_total / frames,
+               cpu_max,
+               gpu_total / frames,
+               gpu_max);
+    }
+
+    notes_free_track(&track);
+    end("headless_run");
+}
+
+uint32_t headless_load_camera(const char* path,
+                              HeadlessKeyframe* keyframes,
+                              uint32_t max) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "headless: cannot open camera path %s\n", path);
+        return 0;
+    }
+    uint32_t count = 0;
+    HeadlessKeyframe k;
+    while (count < max && fscanf(file,
+                                 "%u %f %f %f %f",
+                                 &k.frame,
+                                 &k.scroll_x,
+                                 &k.scroll_y,
+                                 &k.cell_width,
+                                 &k.cell_height) == 5) {
+        keyframes[count++] = k;
+    }
+    fclose(file);
+    return count;
+}
+
+// keyframes sorted by frame; holds the ends outside the path
+void headless_camera(const HeadlessKeyframe* keyframes,
+                     uint32_t count,
+                     uint32_t frame,
+                     PianoRollView* view) {
+    const HeadlessKeyframe* a = &keyframes[0];
+    const HeadlessKeyframe* b = &keyframes[0];
+    for (uint32_t i = 0; i < count; i++) {
+        b = &keyframes[i];
+        if (b->frame >= frame) break;
+        a = b;
+    }
+    float t = 0.0f;
+    if (b->frame > a->frame && frame > a->frame) {
+        t = (float)(frame - a->frame) / (float)(b->frame - a->frame);
+        if (t > 1.0f) t = 1.0f;
+    }
+    view->scroll_x = a->scroll_x + t * (b->scroll_x - a->scroll_x);
+    view->scroll_y = a->scroll_y + t * (b->scroll_y - a->scroll_y);
+    view->cell_width = a->cell_width + t * (b->cell_width - a->cell_width);
+    view->cell_height = a->cell_height + t * (b->cell_height - a->cell_height);
+}
+
+// binary P6; the image is A8B8G8R8 so bytes are already R, G, B, A
+void headless_write_ppm(const char* path,
+                        const uint8_t* pixels,
+                        uint32_t width,
+                        uint32_t height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "headless: cannot write %s\n", path);
+        return;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    enum {
+        max_row_bytes = 3 * 8192,
+    };
+    uint8_t row[max_row_bytes];
+    assert(width * 3 <= max_row_bytes);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* src = pixels + (size_t)y * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(row, 1, width * 3, file);
+    }
+    fclose(file);
+}
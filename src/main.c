@@ -18,18 +18,68 @@
 // src/main.c
 //=============================================================================
 
+#include "alsa.c"
+#include "audio.c"
+#include "automation.c"
 #include "data.h"
 #include "debug_macros.h"
+#include "export.c"
+#include "fft.c"
+#include "freeze.c"
+#include "graph.c"
+#include "headless.c"
 #include "macros.h"
+#include "meter.c"
+#include "midi.c"
+#include "mix.c"
+#include "notes.c"
+#include "plugin.c"
+#include "pool.c"
+#include "resample.c"
+#include "reverb.c"
+#include "rtcheck.c"
+#include "sampler.c"
+#include "sandbox.c"
+#include "sequencer.c"
+#include "stats.c"
+#include "synth.c"
 #include "vulkan.c"
+#include "waveform.c"
 #include "wayland.c"
 
 #include <stdint.h>
+#include <stdlib.h>
 
 int main() {
     CALL_CARMACK("WAR");
+    int status = 0;
+    // a plugin sandbox is this binary again, see sandbox_load
+    if (getenv("WAR_SANDBOX_FD")) {
+        sandbox_child_run();
+        return 0;
+    }
+#if BENCH
+    mix_bench_run();
+    automation_bench_run();
+    fft_bench_run();
+    meter_bench_run();
+    reverb_bench_run();
+    synth_bench_run();
+    graph_bench_run();
+    resample_bench_run();
+    sandbox_bench_run();
+#elif OFFLINE
+    audio_offline_run();
+#elif EXPORT
+    status = export_demo_run() ? 0 : 1;
+#elif DEVICE
+    alsa_measure_run();
+#elif HEADLESS
+    headless_run();
+#else
     wayland_init();
+#endif
 
     END("WAR");
-    return 0;
+    return status;
 }
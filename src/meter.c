@@ -0,0 +1,450 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/meter.c
+//=============================================================================
+
+#include "meter.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "fft.h"
+#include "graph.h"
+#include "macros.h"
+#include "mix.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// peak, rms and BS.1770 loudness for every graph node, and a spectrum of
+// the master. A node is metered by the worker that just ran it, while
+// its buffers are still in cache: two mix kernels per channel and a
+// K-weighting filter, no logarithms, no locks. Each node's reading goes
+// out through its own triple buffer every block; the UI takes the latest
+// at frame time and does the dB math. Integrated (gated) loudness over a
+// whole programme is not kept, only momentary and short-term
+
+//-----------------------------------------------------------------------------
+// setup, UI thread
+//-----------------------------------------------------------------------------
+
+// K-weighting from BS.1770: the head's high shelf, then a high-pass,
+// designed for any rate from their analog prototypes as libebur128 does
+void meter_k_weighting(MixBiquad* shelf,
+                       MixBiquad* highpass,
+                       uint32_t sample_rate) {
+    double f0 = 1681.974450955533;
+    double gain_db = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / sample_rate);
+    double vh = pow(10.0, gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    mix_biquad_design(shelf,
+                      (vh + vb * k / q + k * k) / a0,
+                      2.0 * (k * k - vh) / a0,
+                      (vh - vb * k / q + k * k) / a0,
+                      2.0 * (k * k - 1.0) / a0,
+                      (1.0 - k / q + k * k) / a0);
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sample_rate);
+    a0 = 1.0 + k / q + k * k;
+    mix_biquad_design(highpass,
+                      1.0,
+                      -2.0,
+                      1.0,
+                      2.0 * (k * k - 1.0) / a0,
+                      (1.0 - k / q + k * k) / a0);
+}
+
+// WAR_METERS=0 turns metering off, for measuring what it costs
+uint8_t meter_env(void) {
+    const char* env = getenv("WAR_METERS");
+    return !(env && !strcmp(env, "0"));
+}
+
+Meters* meter_make(uint32_t sample_rate) {
+    header("meter_make");
+
+    Meters* meters = aligned_alloc(64, sizeof(Meters));
+    assert(meters);
+    // written from the audio thread and the workers: no faults there
+    memset(meters, 0, sizeof(Meters));
+    meter_k_weighting(
+        &meters->k_weighting[0], &meters->k_weighting[1], sample_rate);
+    meters->sample_rate = sample_rate;
+    meters->sub_frames = sample_rate * meter_sub_ms / 1000;
+    for (uint32_t i = 0; i < max_graph_nodes; i++) {
+        meters->nodes[i].back = 0;
+        meters->shared[i].middle = 1;
+        meters->shared[i].front = 2;
+    }
+    Spectrum* spectrum = &meters->spectrum;
+    fft_make(&spectrum->fft, spectrum_size);
+    double window_sum = 0.0;
+    for (uint32_t i = 0; i < spectrum_size; i++) {
+        double w = 0.5 - 0.5 * cos(2.0 * M_PI * i / spectrum_size);
+        spectrum->window[i] = (float)w;
+        window_sum += w;
+    }
+    // a full-scale sine on a bin reads 1
+    spectrum->scale = (float)(4.0 / (window_sum * window_sum));
+    spectrum->back = 0;
+    spectrum->middle = 1;
+    spectrum->front = 2;
+    call_carmack("meter: %u nodes, %u frame sub-blocks, %u point spectrum",
+                 (uint32_t)max_graph_nodes,
+                 meters->sub_frames,
+                 (uint32_t)spectrum_size);
+
+    end("meter_make");
+    return meters;
+}
+
+void meter_free(Meters* meters) {
+    fft_free(&meters->spectrum.fft);
+    free(meters);
+}
+
+//-----------------------------------------------------------------------------
+// metering, audio thread and workers
+//-----------------------------------------------------------------------------
+
+// filter state left to decay in silence ends up denormal, and slow
+void meter_flush(float* state, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++)
+        if (fabsf(state[i]) < 1e-15f) state[i] = 0.0f;
+}
+
+void meter_close_sub(MeterNode* node) {
+    node->sums[node->subs % meter_rms][0] = node->sum[0];
+    node->sums[node->subs % meter_rms][1] = node->sum[1];
+    node->k_sums[node->subs % meter_short_term] = node->k_sum;
+    node->last_peak[0] = node->peak[0];
+    node->last_peak[1] = node->peak[1];
+    node->peak[0] = 0.0f;
+    node->peak[1] = 0.0f;
+    node->sum[0] = 0.0f;
+    node->sum[1] = 0.0f;
+    node->k_sum = 0.0f;
+    node->filled = 0;
+    node->subs++;
+}
+
+// mean of the last count whole sub-blocks in a ring, or of the one being
+// filled before there are any
+float meter_window(const float* ring,
+                   uint32_t stride,
+                   uint32_t size,
+                   uint32_t subs,
+                   uint32_t count,
+                   float partial,
+                   uint32_t filled,
+                   uint32_t sub_frames) {
+    if (!subs) return filled ? partial / (float)filled : 0.0f;
+    count = subs < count ? subs : count;
+    float sum = 0.0f;
+    for (uint32_t i = 1; i <= count; i++)
+        sum += ring[((subs - i) % size) * stride];
+    return sum / (float)(count * sub_frames);
+}
+
+// the reading goes into the writer's slot, which then becomes the middle
+void meter_publish(Meters* meters, uint32_t index) {
+    MeterNode* node = &meters->nodes[index];
+    MeterShared* shared = &meters->shared[index];
+    MeterReading* reading = &shared->slots[node->back];
+    uint32_t sub_frames = meters->sub_frames;
+    for (uint32_t c = 0; c < 2; c++) {
+        reading->peak[c] = node->peak[c] > node->last_peak[c]
+                               ? node->peak[c]
+                               : node->last_peak[c];
+        reading->power[c] = meter_window(&node->sums[0][c],
+                                         2,
+                                         meter_rms,
+                                         node->subs,
+                                         meter_rms,
+                                         node->sum[c],
+                                         node->filled,
+                                         sub_frames);
+    }
+    reading->momentary = meter_window(node->k_sums,
+                                      1,
+                                      meter_short_term,
+                                      node->subs,
+                                      meter_momentary,
+                                      node->k_sum,
+                                      node->filled,
+                                      sub_frames);
+    reading->short_term = meter_window(node->k_sums,
+                                       1,
+                                       meter_short_term,
+                                       node->subs,
+                                       meter_short_term,
+                                       node->k_sum,
+                                       node->filled,
+                                       sub_frames);
+    node->back = __atomic_exchange_n(&shared->middle,
+                                     node->back | meter_fresh,
+                                     __ATOMIC_ACQ_REL) &
+                 (meter_fresh - 1);
+}
+
+// one node's block: sums over the raw channels, K-weighted copies in the
+// worker's scratch, sub-blocks closed where they end inside the block
+void meter_run(Meters* meters,
+               const MixKernels* kernels,
+               uint32_t worker,
+               uint32_t index,
+               const float* left,
+               const float* right,
+               uint32_t frames) {
+    MeterNode* node = &meters->nodes[index];
+    const float* in[2] = {left, right};
+    float* k_left = meters->scratch[worker][0];
+    float* k_right = meters->scratch[worker][1];
+    memcpy(k_left, left, sizeof(float) * frames);
+    memcpy(k_right, right, sizeof(float) * frames);
+    for (uint32_t s = 0; s < 2; s++) {
+        kernels->biquad(
+            k_left, k_right, &meters->k_weighting[s], node->filter[s], frames);
+    }
+    meter_flush(&node->filter[0][0], 16);
+    float k_peak = 0.0f;
+    uint32_t done = 0;
+    while (done < frames) {
+        uint32_t n = meters->sub_frames - node->filled;
+        n = n < frames - done ? n : frames - done;
+        for (uint32_t c = 0; c < 2; c++) {
+            kernels->meter(in[c] + done, &node->peak[c], &node->sum[c], n);
+            kernels->meter(
+                meters->scratch[worker][c] + done, &k_peak, &node->k_sum, n);
+        }
+        node->filled += n;
+        done += n;
+        if (node->filled == meters->sub_frames) meter_close_sub(node);
+    }
+    meter_publish(meters, index);
+}
+
+// the master, mono, into a ring; every hop the last spectrum_size frames
+// are windowed and transformed. A block longer than a hop still makes one
+void meter_spectrum(Meters* meters,
+                    const float* left,
+                    const float* right,
+                    uint32_t frames) {
+    Spectrum* spectrum = &meters->spectrum;
+    for (uint32_t i = 0; i < frames; i++) {
+        spectrum->ring[spectrum->write] = 0.5f * (left[i] + right[i]);
+        spectrum->write = (spectrum->write + 1) & (spectrum_size - 1);
+    }
+    spectrum->filled += frames;
+    if (spectrum->filled < spectrum_hop) return;
+    spectrum->filled = 0;
+
+    uint32_t first = spectrum_size - spectrum->write;
+    for (uint32_t i = 0; i < first; i++)
+        spectrum->frame[i] =
+            spectrum->ring[spectrum->write + i] * spectrum->window[i];
+    for (uint32_t i = first; i < spectrum_size; i++)
+        spectrum->frame[i] = spectrum->ring[i - first] * spectrum->window[i];
+    fft_forward(&spectrum->fft, spectrum->frame, spectrum->re, spectrum->im);
+    SpectrumReading* reading = &spectrum->slots[spectrum->back];
+    for (uint32_t k = 0; k < spectrum_bins; k++) {
+        reading->power[k] = (spectrum->re[k] * spectrum->re[k] +
+                             spectrum->im[k] * spectrum->im[k]) *
+                            spectrum->scale;
+    }
+    spectrum->back = __atomic_exchange_n(&spectrum->middle,
+                                         spectrum->back | meter_fresh,
+                                         __ATOMIC_ACQ_REL) &
+                     (meter_fresh - 1);
+}
+
+// from graph_run_node, after the node's output is final
+void meter_node(Meters* meters,
+                AudioGraph* graph,
+                uint32_t worker,
+                uint32_t node,
+                uint32_t frames) {
+    const float* left = graph_left(graph, node);
+    const float* right = graph_right(graph, node);
+    meter_run(meters, graph->kernels, worker, node, left, right, frames);
+    if (node == graph->output) meter_spectrum(meters, left, right, frames);
+}
+
+//-----------------------------------------------------------------------------
+// readings, one UI thread
+//-----------------------------------------------------------------------------
+
+// the latest reading of a node; the same one again until a newer arrives
+void meter_read(Meters* meters, uint32_t node, MeterReading* reading) {
+    MeterShared* shared = &meters->shared[node];
+    if (__atomic_load_n(&shared->middle, __ATOMIC_RELAXED) & meter_fresh) {
+        shared->front = __atomic_exchange_n(&shared->middle,
+                                            shared->front,
+                                            __ATOMIC_ACQ_REL) &
+                        (meter_fresh - 1);
+    }
+    *reading = shared->slots[shared->front];
+}
+
+// valid until the next call
+const SpectrumReading* meter_read_spectrum(Meters* meters) {
+    Spectrum* spectrum = &meters->spectrum;
+    if (__atomic_load_n(&spectrum->middle, __ATOMIC_RELAXED) & meter_fresh) {
+        spectrum->front = __atomic_exchange_n(&spectrum->middle,
+                                              spectrum->front,
+                                              __ATOMIC_ACQ_REL) &
+                          (meter_fresh - 1);
+    }
+    return &spectrum->slots[spectrum->front];
+}
+
+// linear amplitude and mean square to dB, floored at meter_floor_db
+float meter_db(float amplitude) {
+    float db = amplitude > 0.0f ? 20.0f * log10f(amplitude) : meter_floor_db;
+    return db > meter_floor_db ? db : meter_floor_db;
+}
+
+float meter_power_db(float power) {
+    float db = power > 0.0f ? 10.0f * log10f(power) : meter_floor_db;
+    return db > meter_floor_db ? db : meter_floor_db;
+}
+
+float meter_lufs(float power) {
+    return power > 0.0f ? meter_power_db(power) - 0.691f : meter_floor_db;
+}
+
+// the spectrum in count bands spaced evenly in pitch from low to high
+// Hz, each the loudest bin in it, in dB
+void meter_bands(const SpectrumReading* reading,
+                 uint32_t sample_rate,
+                 float low,
+                 float high,
+                 float* bands,
+                 uint32_t count) {
+    float hz_per_bin = (float)sample_rate / spectrum_size;
+    float ratio = powf(high / low, 1.0f / count);
+    float edge = low;
+    for (uint32_t b = 0; b < count; b++) {
+        uint32_t from = (uint32_t)(edge / hz_per_bin);
+        edge *= ratio;
+        uint32_t to = (uint32_t)(edge / hz_per_bin);
+        to = to > from ? to : from + 1;
+        to = to < spectrum_bins ? to : spectrum_bins;
+        float loudest = 0.0f;
+        for (uint32_t k = from; k < to; k++)
+            loudest = reading->power[k] > loudest ? reading->power[k] : loudest;
+        bands[b] = meter_power_db(loudest);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+// a 1 kHz sine at -23 dBFS in both channels reads -23 LUFS (BS.1770's
+// own check), then the cost of metering many nodes in one block
+void meter_bench_run(void) {
+    header("meter_bench_run");
+
+    enum {
+        bench_nodes = 128,
+        bench_seconds = 10,
+    };
+    MixKernels kernels;
+    mix_select(&kernels);
+    Meters* meters = meter_make(audio_sample_rate);
+
+    float left[audio_block_frames];
+    float right[audio_block_frames];
+    float amplitude = powf(10.0f, -23.0f / 20.0f);
+    uint64_t frame = 0;
+    uint32_t blocks = 4 * audio_sample_rate / audio_block_frames;
+    for (uint32_t b = 0; b < blocks; b++) {
+        for (uint32_t i = 0; i < audio_block_frames; i++, frame++) {
+            left[i] = amplitude * sinf(2.0f * (float)M_PI * 1000.0f *
+                                       (float)(frame % audio_sample_rate) /
+                                       audio_sample_rate);
+            right[i] = left[i];
+        }
+        meter_run(meters, &kernels, 0, 0, left, right, audio_block_frames);
+        meter_spectrum(meters, left, right, audio_block_frames);
+    }
+    MeterReading reading;
+    meter_read(meters, 0, &reading);
+    const SpectrumReading* spectrum = meter_read_spectrum(meters);
+    uint32_t loudest = 0;
+    for (uint32_t k = 0; k < spectrum_bins; k++)
+        if (spectrum->power[k] > spectrum->power[loudest]) loudest = k;
+    printf("meter 1 kHz at -23 dBFS: peak %.2f dBFS, rms %.2f dB, momentary "
+           "%.2f LUFS, short-term %.2f LUFS\n",
+           meter_db(reading.peak[0]),
+           meter_power_db(reading.power[0]),
+           meter_lufs(reading.momentary),
+           meter_lufs(reading.short_term));
+    printf("meter spectrum: loudest bin %u (%.0f Hz) at %.2f dB\n",
+           loudest,
+           (double)loudest * audio_sample_rate / spectrum_size,
+           meter_power_db(spectrum->power[loudest]));
+
+    // every node a different buffer, as in the graph
+    float* buffers =
+        aligned_alloc(64, sizeof(float) * 2 * audio_block_frames * bench_nodes);
+    assert(buffers);
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < 2 * audio_block_frames * bench_nodes; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        buffers[i] = ((seed >> 8) / 8388608.0f - 1.0f) * 0.5f;
+    }
+    blocks = bench_seconds * audio_sample_rate / audio_block_frames;
+    double t0 = mix_bench_seconds();
+    for (uint32_t b = 0; b < blocks; b++) {
+        for (uint32_t n = 0; n < bench_nodes; n++) {
+            const float* l = buffers + (size_t)2 * n * audio_block_frames;
+            meter_run(meters,
+                      &kernels,
+                      0,
+                      n,
+                      l,
+                      l + audio_block_frames,
+                      audio_block_frames);
+        }
+        meter_spectrum(
+            meters, buffers, buffers + audio_block_frames, audio_block_frames);
+    }
+    double block_ns = (mix_bench_seconds() - t0) * 1e9 / blocks;
+    double period_ns = 1e9 * audio_block_frames / audio_sample_rate;
+    printf("meter %u nodes + spectrum (%s): %.1f us per %u frame block, "
+           "%.2f%% of one core, %.0f ns per node\n",
+           (uint32_t)bench_nodes,
+           kernels.name,
+           block_ns / 1e3,
+           (uint32_t)audio_block_frames,
+           100.0 * block_ns / period_ns,
+           block_ns / bench_nodes);
+
+    free(buffers);
+    meter_free(meters);
+    end("meter_bench_run");
+}
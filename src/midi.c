@@ -0,0 +1,332 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/midi.c
+//=============================================================================
+
+#include "midi.h"
+#include "audio.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sound/asound.h>
+#include <sound/asequencer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// input straight from the kernel's sequencer and rawmidi devices, like
+// alsa.c. The thread does nothing but wait, stamp and queue: each event
+// carries the CLOCK_MONOTONIC time it was read, and the audio thread turns
+// that into a sample offset in the next block (audio_collect_live)
+
+//-----------------------------------------------------------------------------
+// parsing
+//-----------------------------------------------------------------------------
+
+uint64_t midi_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void midi_push(MidiInput* input,
+               uint32_t type,
+               uint8_t note,
+               uint8_t velocity,
+               uint64_t ns) {
+    AudioMessage message = {
+        .type = type,
+        .note = note & 0x7f,
+        .value = velocity / 127.0f,
+        .frame = ns,
+    };
+    if (spsc_push(&input->engine->midi, &message)) {
+        __atomic_store_n(&input->events, input->events + 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(
+            &input->dropped, input->dropped + 1, __ATOMIC_RELAXED);
+    }
+}
+
+// one byte of a raw stream, running status kept. Realtime bytes can land
+// anywhere and are skipped; system messages cancel running status
+void midi_parse_byte(MidiInput* input,
+                     MidiParser* parser,
+                     uint8_t byte,
+                     uint64_t ns) {
+    if (byte >= 0xf8) return;
+    if (byte & 0x80) {
+        parser->sysex = byte == 0xf0;
+        parser->status = byte < 0xf0 ? byte : 0;
+        parser->count = 0;
+        return;
+    }
+    if (parser->sysex || !parser->status) return;
+
+    parser->data[parser->count++] = byte;
+    uint8_t kind = parser->status & 0xf0;
+    uint8_t length = kind == 0xc0 || kind == 0xd0 ? 1 : 2;
+    if (parser->count < length) return;
+    parser->count = 0;
+    if (kind == 0x90 && parser->data[1] > 0) {
+        midi_push(
+            input, audio_cmd_note_on, parser->data[0], parser->data[1], ns);
+    } else if (kind == 0x80 || kind == 0x90) {
+        midi_push(input, audio_cmd_note_off, parser->data[0], 0, ns);
+    }
+}
+
+// a read returns whole events; variable length data follows its event,
+// with the length flags cleared by the kernel
+void midi_parse_seq(MidiInput* input,
+                    const uint8_t* buffer,
+                    size_t size,
+                    uint64_t ns) {
+    size_t at = 0;
+    while (at + sizeof(struct snd_seq_event) <= size) {
+        struct snd_seq_event event;
+        memcpy(&event, buffer + at, sizeof(event));
+        at += sizeof(event);
+        if ((event.flags & SNDRV_SEQ_EVENT_LENGTH_MASK) ==
+            SNDRV_SEQ_EVENT_LENGTH_VARIABLE) {
+            at += event.data.ext.len;
+        }
+        const struct snd_seq_ev_note* note = &event.data.note;
+        if (event.type == SNDRV_SEQ_EVENT_NOTEON && note->velocity > 0) {
+            midi_push(
+                input, audio_cmd_note_on, note->note, note->velocity, ns);
+        } else if (event.type == SNDRV_SEQ_EVENT_NOTEON ||
+                   event.type == SNDRV_SEQ_EVENT_NOTEOFF) {
+            midi_push(input, audio_cmd_note_off, note->note, 0, ns);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// devices
+//-----------------------------------------------------------------------------
+
+// a client named WAR with one writable port, "WAR in". Anything can be
+// connected to it (aconnect, a DAW, a virtual keyboard); WAR_MIDI_CONNECT
+// "CLIENT:PORT" subscribes one source at startup
+uint8_t midi_open_seq(MidiInput* input) {
+    header("midi_open_seq");
+
+    int fd = open("/dev/snd/seq", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        call_carmack("midi: no sequencer (%d)", errno);
+        end("midi_open_seq");
+        return 0;
+    }
+    int client = -1;
+    struct snd_seq_client_info info;
+    memset(&info, 0, sizeof(info));
+    struct snd_seq_port_info port;
+    memset(&port, 0, sizeof(port));
+    if (ioctl(fd, SNDRV_SEQ_IOCTL_CLIENT_ID, &client) < 0) goto fail;
+    info.client = client;
+    if (ioctl(fd, SNDRV_SEQ_IOCTL_GET_CLIENT_INFO, &info) < 0) goto fail;
+    snprintf(info.name, sizeof(info.name), "WAR");
+    if (ioctl(fd, SNDRV_SEQ_IOCTL_SET_CLIENT_INFO, &info) < 0) goto fail;
+
+    port.addr.client = (uint8_t)client;
+    snprintf(port.name, sizeof(port.name), "WAR in");
+    port.capability = SNDRV_SEQ_PORT_CAP_WRITE | SNDRV_SEQ_PORT_CAP_SUBS_WRITE;
+    port.type =
+        SNDRV_SEQ_PORT_TYPE_MIDI_GENERIC | SNDRV_SEQ_PORT_TYPE_APPLICATION;
+    port.midi_channels = 16;
+    if (ioctl(fd, SNDRV_SEQ_IOCTL_CREATE_PORT, &port) < 0) goto fail;
+
+    const char* connect = getenv("WAR_MIDI_CONNECT");
+    if (connect) {
+        char* end;
+        struct snd_seq_port_subscribe subscribe;
+        memset(&subscribe, 0, sizeof(subscribe));
+        subscribe.sender.client = (uint8_t)strtoul(connect, &end, 10);
+        subscribe.sender.port =
+            *end == ':' ? (uint8_t)strtoul(end + 1, NULL, 10) : 0;
+        subscribe.dest = port.addr;
+        if (ioctl(fd, SNDRV_SEQ_IOCTL_SUBSCRIBE_PORT, &subscribe) < 0) {
+            call_carmack("midi: connect %s failed (%d)", connect, errno);
+        }
+    }
+
+    input->seq_fd = fd;
+    input->seq_client = client;
+    input->seq_port = port.addr.port;
+    call_carmack("midi: sequencer port %d:%d", client, port.addr.port);
+    end("midi_open_seq");
+    return 1;
+
+fail:
+    call_carmack("midi: sequencer setup failed (%d)", errno);
+    close(fd);
+    end("midi_open_seq");
+    return 0;
+}
+
+// "hw:CARD,DEVICE" is a rawmidi device; anything else is a path. A fifo is
+// opened read-write so it stays open between writers, which makes it a
+// loopback port for testing
+uint8_t midi_open_raw(MidiInput* input, const char* name) {
+    if (input->raw_count == midi_max_raw) return 0;
+    char path[alsa_max_path];
+    int flags = O_RDONLY;
+    if (strncmp(name, "hw:", 3) == 0) {
+        char* end;
+        unsigned long card = strtoul(name + 3, &end, 10);
+        unsigned long device = *end == ',' ? strtoul(end + 1, NULL, 10) : 0;
+        snprintf(path, sizeof(path), "/dev/snd/midiC%luD%lu", card, device);
+    } else {
+        snprintf(path, sizeof(path), "%s", name);
+        flags = O_RDWR;
+    }
+    int fd = open(path, flags | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        call_carmack("midi: cannot open %s (%d)", path, errno);
+        return 0;
+    }
+    memset(&input->parsers[input->raw_count], 0, sizeof(MidiParser));
+    input->raw_fds[input->raw_count++] = fd;
+    call_carmack("midi: raw input %s", path);
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// thread
+//-----------------------------------------------------------------------------
+
+// the stamp is taken as poll returns, before the read, so it is the
+// arrival time to within a wakeup
+void* midi_thread(void* arg) {
+    MidiInput* input = arg;
+    struct pollfd fds[midi_max_raw + 1];
+    uint32_t count = 0;
+    uint32_t first_raw = input->seq_fd >= 0;
+    if (input->seq_fd >= 0) {
+        fds[count++] = (struct pollfd){.fd = input->seq_fd, .events = POLLIN};
+    }
+    for (uint32_t i = 0; i < input->raw_count; i++) {
+        fds[count++] =
+            (struct pollfd){.fd = input->raw_fds[i], .events = POLLIN};
+    }
+    uint8_t buffer[midi_read_bytes] __attribute__((aligned(8)));
+
+    while (__atomic_load_n(&input->running, __ATOMIC_ACQUIRE)) {
+        if (poll(fds, count, midi_poll_timeout_ms) <= 0) continue;
+        uint64_t ns = midi_now_ns();
+        for (uint32_t i = 0; i < count; i++) {
+            if (!(fds[i].revents & POLLIN)) {
+                if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    // unplugged: stop polling it rather than spin
+                    call_carmack("midi: input %u gone", i);
+                    fds[i].fd = -1;
+                }
+                continue;
+            }
+            ssize_t size = read(fds[i].fd, buffer, sizeof(buffer));
+            if (size <= 0) continue;
+            if (i < first_raw) {
+                midi_parse_seq(input, buffer, (size_t)size, ns);
+                continue;
+            }
+            MidiParser* parser = &input->parsers[i - first_raw];
+            for (ssize_t b = 0; b < size; b++) {
+                midi_parse_byte(input, parser, buffer[b], ns);
+            }
+        }
+    }
+    return NULL;
+}
+
+// WAR_MIDI_SEQ      0 to skip the sequencer port (default 1)
+// WAR_MIDI_CONNECT  CLIENT:PORT subscribed to the sequencer port
+// WAR_MIDI_RAW      comma separated hw:CARD,DEVICE or paths
+//
+// returns NULL when there is nothing to read from
+MidiInput* midi_start(AudioEngine* engine) {
+    header("midi_start");
+
+    MidiInput* input = malloc(sizeof(MidiInput));
+    assert(input);
+    memset(input, 0, sizeof(MidiInput));
+    input->engine = engine;
+    input->seq_fd = -1;
+    input->seq_client = -1;
+    input->seq_port = -1;
+    const char* seq = getenv("WAR_MIDI_SEQ");
+    if (!seq || strcmp(seq, "0") != 0) midi_open_seq(input);
+    const char* raw = getenv("WAR_MIDI_RAW");
+    while (raw && *raw) {
+        char name[alsa_max_path];
+        size_t n = strcspn(raw, ",");
+        if (n > 0 && n < sizeof(name)) {
+            memcpy(name, raw, n);
+            name[n] = '\0';
+            midi_open_raw(input, name);
+        }
+        raw += n;
+        if (*raw == ',') raw++;
+    }
+    if (input->seq_fd < 0 && input->raw_count == 0) {
+        free(input);
+        end("midi_start");
+        return NULL;
+    }
+
+    // above the audio thread: it is never runnable for long, and a late
+    // stamp is a late note
+    __atomic_store_n(&input->running, 1, __ATOMIC_RELEASE);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    struct sched_param param = {.sched_priority = midi_thread_priority};
+    pthread_attr_setschedparam(&attr, &param);
+    int res = pthread_create(&input->thread, &attr, midi_thread, input);
+    if (res == EPERM) {
+        call_carmack("midi: SCHED_FIFO denied, using SCHED_OTHER");
+        res = pthread_create(&input->thread, NULL, midi_thread, input);
+    }
+    assert(res == 0);
+    pthread_attr_destroy(&attr);
+
+    end("midi_start");
+    return input;
+}
+
+// closing the sequencer fd removes the client and its port
+void midi_stop(MidiInput* input) {
+    if (!input) return;
+    __atomic_store_n(&input->running, 0, __ATOMIC_RELEASE);
+    pthread_join(input->thread, NULL);
+    if (input->seq_fd >= 0) close(input->seq_fd);
+    for (uint32_t i = 0; i < input->raw_count; i++) close(input->raw_fds[i]);
+    free(input);
+}
@@ -0,0 +1,1426 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/mix.c
+//=============================================================================
+
+#include "mix.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// buffers are planar float unless the name says otherwise. Every kernel
+// takes unaligned pointers and any count; the wide loops leave the tail to
+// the scalar reference. Results match it exactly except that the fma
+// variants round once per multiply-add, curve, whose series is advanced
+// a vector of terms at a time, meter, whose sums are split over lanes,
+// and biquad, whose wide form is a matrix over a step of samples
+
+//-----------------------------------------------------------------------------
+// scalar reference
+//-----------------------------------------------------------------------------
+
+void mix_gain_scalar(float* buf, float gain, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) buf[i] *= gain;
+}
+
+// bus summing: dst += src * gain
+void mix_add_scalar(float* dst, const float* src, float gain, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] += src[i] * gain;
+}
+
+// mono source onto a stereo bus with per-side gains (pan law applied by
+// the caller)
+void mix_pan_add_scalar(const float* src,
+                        float* left,
+                        float* right,
+                        float gain_left,
+                        float gain_right,
+                        uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        left[i] += src[i] * gain_left;
+        right[i] += src[i] * gain_right;
+    }
+}
+
+void mix_interleave_scalar(const float* left,
+                           const float* right,
+                           float* out,
+                           uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        out[i * 2 + 0] = left[i];
+        out[i * 2 + 1] = right[i];
+    }
+}
+
+void mix_deinterleave_scalar(const float* in,
+                             float* left,
+                             float* right,
+                             uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        left[i] = in[i * 2 + 0];
+        right[i] = in[i * 2 + 1];
+    }
+}
+
+void mix_to_s16_scalar(const float* in, int16_t* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        float v = in[i] * 32768.0f;
+        v = v > 32767.0f ? 32767.0f : v;
+        v = v < -32768.0f ? -32768.0f : v;
+        out[i] = (int16_t)lrintf(v);
+    }
+}
+
+void mix_from_s16_scalar(const int16_t* in, float* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) out[i] = in[i] * (1.0f / 32768.0f);
+}
+
+// 2147483520 is the largest float below 2^31
+void mix_to_s32_scalar(const float* in, int32_t* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        float v = in[i] * 2147483648.0f;
+        v = v > 2147483520.0f ? 2147483520.0f : v;
+        v = v < -2147483648.0f ? -2147483648.0f : v;
+        out[i] = (int32_t)lrintf(v);
+    }
+}
+
+// automation ramps are computed from i, not accumulated, so a long block
+// lands exactly where it should
+void mix_ramp_scalar(float* out, float start, float step, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) out[i] = start + step * (float)i;
+}
+
+// exponential segments as a geometric series; drifts by an ulp or so per
+// step, which the caller bounds by restarting it every block
+void mix_curve_scalar(float* out,
+                      float base,
+                      float first,
+                      float ratio,
+                      uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = base + first;
+        first *= ratio;
+    }
+}
+
+void mix_mul_scalar(float* buf, const float* gains, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) buf[i] *= gains[i];
+}
+
+// square-root law: left^2 + right^2 == 1 everywhere, -3 dB in the middle,
+// and only a sqrt per side where sin/cos would need a polynomial
+void mix_pan_law_scalar(const float* pan,
+                        float* left,
+                        float* right,
+                        uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        float p = pan[i];
+        p = p > 1.0f ? 1.0f : p;
+        p = p < -1.0f ? -1.0f : p;
+        left[i] = sqrtf(0.5f - 0.5f * p);
+        right[i] = sqrtf(0.5f + 0.5f * p);
+    }
+}
+
+// sample peak and sum of squares, added to what the caller has so far
+void mix_meter_scalar(const float* buf, float* peak, float* sum, uint32_t n) {
+    float p = *peak;
+    float s = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        float a = fabsf(buf[i]);
+        p = a > p ? a : p;
+        s += buf[i] * buf[i];
+    }
+    *peak = p;
+    *sum += s;
+}
+
+// direct form I, one sample at a time: the reference the matrix form of
+// the wide kernels is checked against. Both channels, state is x1, x2,
+// y1, y2 for the left then the right
+void mix_biquad_scalar(float* left,
+                       float* right,
+                       const MixBiquad* filter,
+                       float* state,
+                       uint32_t n) {
+    float* bufs[2] = {left, right};
+    for (uint32_t c = 0; c < 2; c++) {
+        float* buf = bufs[c];
+        float* s = state + 4 * c;
+        float x1 = s[0];
+        float x2 = s[1];
+        float y1 = s[2];
+        float y2 = s[3];
+        for (uint32_t i = 0; i < n; i++) {
+            float x = buf[i];
+            float y = filter->b0 * x + filter->b1 * x1 + filter->b2 * x2 -
+                      filter->a1 * y1 - filter->a2 * y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            buf[i] = y;
+        }
+        s[0] = x1;
+        s[1] = x2;
+        s[2] = y1;
+        s[3] = y2;
+    }
+}
+
+// row r of m is what each of the next mix_biquad_step outputs gets from
+// input r of the step, the state after the step's samples; found by
+// running the filter in double on one unit input at a time
+void mix_biquad_design(MixBiquad* filter,
+                       double b0,
+                       double b1,
+                       double b2,
+                       double a1,
+                       double a2) {
+    filter->b0 = (float)b0;
+    filter->b1 = (float)b1;
+    filter->b2 = (float)b2;
+    filter->a1 = (float)a1;
+    filter->a2 = (float)a2;
+    for (uint32_t r = 0; r < mix_biquad_rows; r++) {
+        double x[mix_biquad_step] = {0};
+        double state[4] = {0};
+        if (r < mix_biquad_step) {
+            x[r] = 1.0;
+        } else {
+            state[r - mix_biquad_step] = 1.0;
+        }
+        double x1 = state[0], x2 = state[1], y1 = state[2], y2 = state[3];
+        for (uint32_t j = 0; j < mix_biquad_step; j++) {
+            double y = b0 * x[j] + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+            x2 = x1;
+            x1 = x[j];
+            y2 = y1;
+            y1 = y;
+            filter->m[r][j] = (float)y;
+        }
+    }
+}
+
+// complex multiply-accumulate over split spectra, one bin at a time
+void mix_cmac_scalar(float* acc_re,
+                     float* acc_im,
+                     const float* x_re,
+                     const float* x_im,
+                     const float* h_re,
+                     const float* h_im,
+                     uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        float xr = x_re[i], xi = x_im[i];
+        float hr = h_re[i], hi = h_im[i];
+        acc_re[i] += xr * hr - xi * hi;
+        acc_im[i] += xr * hi + xi * hr;
+    }
+}
+
+#if defined(__x86_64__)
+
+//-----------------------------------------------------------------------------
+// sse2, the x86-64 baseline
+//-----------------------------------------------------------------------------
+
+void mix_gain_sse2(float* buf, float gain, uint32_t n) {
+    __m128 g = _mm_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+    mix_gain_scalar(buf + i, gain, n - i);
+}
+
+void mix_add_sse2(float* dst, const float* src, float gain, uint32_t n) {
+    __m128 g = _mm_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+    }
+    mix_add_scalar(dst + i, src + i, gain, n - i);
+}
+
+void mix_pan_add_sse2(const float* src,
+                      float* left,
+                      float* right,
+                      float gain_left,
+                      float gain_right,
+                      uint32_t n) {
+    __m128 gl = _mm_set1_ps(gain_left);
+    __m128 gr = _mm_set1_ps(gain_right);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 s = _mm_loadu_ps(src + i);
+        __m128 l = _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(s, gl));
+        __m128 r = _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(s, gr));
+        _mm_storeu_ps(left + i, l);
+        _mm_storeu_ps(right + i, r);
+    }
+    mix_pan_add_scalar(
+        src + i, left + i, right + i, gain_left, gain_right, n - i);
+}
+
+void mix_interleave_sse2(const float* left,
+                         const float* right,
+                         float* out,
+                         uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    mix_interleave_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+void mix_deinterleave_sse2(const float* in,
+                           float* left,
+                           float* right,
+                           uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(in + i * 2);
+        __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    mix_deinterleave_scalar(in + i * 2, left + i, right + i, frames - i);
+}
+
+// packs saturates, so no clamp before it
+void mix_to_s16_sse2(const float* in, int16_t* out, uint32_t n) {
+    __m128 scale = _mm_set1_ps(32768.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        __m128i b =
+            _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+    mix_to_s16_scalar(in + i, out + i, n - i);
+}
+
+// sign extension without sse4.1: unpack into the high half, shift down
+void mix_from_s16_sse2(const int16_t* in, float* out, uint32_t n) {
+    __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    mix_from_s16_scalar(in + i, out + i, n - i);
+}
+
+void mix_to_s32_sse2(const float* in, int32_t* out, uint32_t n) {
+    __m128 scale = _mm_set1_ps(2147483648.0f);
+    __m128 hi = _mm_set1_ps(2147483520.0f);
+    __m128 lo = _mm_set1_ps(-2147483648.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        v = _mm_max_ps(_mm_min_ps(v, hi), lo);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_cvtps_epi32(v));
+    }
+    mix_to_s32_scalar(in + i, out + i, n - i);
+}
+
+void mix_ramp_sse2(float* out, float start, float step, uint32_t n) {
+    __m128 s = _mm_set1_ps(start);
+    __m128 d = _mm_set1_ps(step);
+    __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 width = _mm_set1_ps(4.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(s, _mm_mul_ps(d, index)));
+        index = _mm_add_ps(index, width);
+    }
+    for (; i < n; i++) out[i] = start + step * (float)i;
+}
+
+// four terms of the series at once, each advanced by ratio^4
+void mix_curve_sse2(float* out,
+                    float base,
+                    float first,
+                    float ratio,
+                    uint32_t n) {
+    float r2 = ratio * ratio;
+    __m128 p =
+        _mm_setr_ps(first, first * ratio, first * r2, first * r2 * ratio);
+    __m128 r4 = _mm_set1_ps(r2 * r2);
+    __m128 b = _mm_set1_ps(base);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(b, p));
+        p = _mm_mul_ps(p, r4);
+    }
+    mix_curve_scalar(out + i, base, _mm_cvtss_f32(p), ratio, n - i);
+}
+
+void mix_mul_sse2(float* buf, const float* gains, uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 g = _mm_loadu_ps(gains + i);
+        _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+    }
+    mix_mul_scalar(buf + i, gains + i, n - i);
+}
+
+void mix_pan_law_sse2(const float* pan, float* left, float* right, uint32_t n) {
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 minus_one = _mm_set1_ps(-1.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 p = _mm_loadu_ps(pan + i);
+        p = _mm_mul_ps(_mm_max_ps(_mm_min_ps(p, one), minus_one), half);
+        _mm_storeu_ps(left + i, _mm_sqrt_ps(_mm_sub_ps(half, p)));
+        _mm_storeu_ps(right + i, _mm_sqrt_ps(_mm_add_ps(half, p)));
+    }
+    mix_pan_law_scalar(pan + i, left + i, right + i, n - i);
+}
+
+// |x| by clearing the sign bit; the lanes are folded before the tail
+void mix_meter_sse2(const float* buf, float* peak, float* sum, uint32_t n) {
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 p = _mm_set1_ps(*peak);
+    __m128 s = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(buf + i);
+        p = _mm_max_ps(p, _mm_andnot_ps(sign, x));
+        s = _mm_add_ps(s, _mm_mul_ps(x, x));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, p);
+    for (uint32_t k = 0; k < 4; k++)
+        *peak = lanes[k] > *peak ? lanes[k] : *peak;
+    _mm_storeu_ps(lanes, s);
+    *sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    mix_meter_scalar(buf + i, peak, sum, n - i);
+}
+
+// a step in two halves per channel; y1 and y2 for the next one are
+// broadcast out of the upper half without a trip through memory
+void mix_biquad_sse2(float* left,
+                     float* right,
+                     const MixBiquad* filter,
+                     float* state,
+                     uint32_t n) {
+    float* bufs[2] = {left, right};
+    __m128 x1[2], x2[2], y1[2], y2[2];
+    for (uint32_t c = 0; c < 2; c++) {
+        x1[c] = _mm_set1_ps(state[4 * c + 0]);
+        x2[c] = _mm_set1_ps(state[4 * c + 1]);
+        y1[c] = _mm_set1_ps(state[4 * c + 2]);
+        y2[c] = _mm_set1_ps(state[4 * c + 3]);
+    }
+    uint32_t i = 0;
+    for (; i + mix_biquad_step <= n; i += mix_biquad_step) {
+        for (uint32_t c = 0; c < 2; c++) {
+            const float* buf = bufs[c] + i;
+            __m128 lo = _mm_mul_ps(_mm_load_ps(filter->m[8]), x1[c]);
+            __m128 hi = _mm_mul_ps(_mm_load_ps(filter->m[8] + 4), x1[c]);
+            __m128 lo2 = _mm_mul_ps(_mm_load_ps(filter->m[9]), x2[c]);
+            __m128 hi2 = _mm_mul_ps(_mm_load_ps(filter->m[9] + 4), x2[c]);
+            for (uint32_t k = 0; k < mix_biquad_step; k += 2) {
+                __m128 x = _mm_set1_ps(buf[k]);
+                __m128 z = _mm_set1_ps(buf[k + 1]);
+                lo = _mm_add_ps(lo, _mm_mul_ps(_mm_load_ps(filter->m[k]), x));
+                hi = _mm_add_ps(hi,
+                                _mm_mul_ps(_mm_load_ps(filter->m[k] + 4), x));
+                lo2 = _mm_add_ps(
+                    lo2, _mm_mul_ps(_mm_load_ps(filter->m[k + 1]), z));
+                hi2 = _mm_add_ps(
+                    hi2, _mm_mul_ps(_mm_load_ps(filter->m[k + 1] + 4), z));
+            }
+            x1[c] = _mm_set1_ps(buf[7]);
+            x2[c] = _mm_set1_ps(buf[6]);
+            lo = _mm_add_ps(lo, lo2);
+            hi = _mm_add_ps(hi, hi2);
+            lo = _mm_add_ps(lo, _mm_mul_ps(_mm_load_ps(filter->m[10]), y1[c]));
+            hi = _mm_add_ps(hi,
+                            _mm_mul_ps(_mm_load_ps(filter->m[10] + 4), y1[c]));
+            lo = _mm_add_ps(lo, _mm_mul_ps(_mm_load_ps(filter->m[11]), y2[c]));
+            hi = _mm_add_ps(hi,
+                            _mm_mul_ps(_mm_load_ps(filter->m[11] + 4), y2[c]));
+            _mm_storeu_ps(bufs[c] + i, lo);
+            _mm_storeu_ps(bufs[c] + i + 4, hi);
+            y1[c] = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 3, 3));
+            y2[c] = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 2, 2));
+        }
+    }
+    for (uint32_t c = 0; c < 2; c++) {
+        state[4 * c + 0] = _mm_cvtss_f32(x1[c]);
+        state[4 * c + 1] = _mm_cvtss_f32(x2[c]);
+        state[4 * c + 2] = _mm_cvtss_f32(y1[c]);
+        state[4 * c + 3] = _mm_cvtss_f32(y2[c]);
+    }
+    mix_biquad_scalar(left + i, right + i, filter, state, n - i);
+}
+
+void mix_cmac_sse2(float* acc_re,
+                   float* acc_im,
+                   const float* x_re,
+                   const float* x_im,
+                   const float* h_re,
+                   const float* h_im,
+                   uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 xr = _mm_loadu_ps(x_re + i);
+        __m128 xi = _mm_loadu_ps(x_im + i);
+        __m128 hr = _mm_loadu_ps(h_re + i);
+        __m128 hi = _mm_loadu_ps(h_im + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(acc_re + i, _mm_add_ps(_mm_loadu_ps(acc_re + i), re));
+        _mm_storeu_ps(acc_im + i, _mm_add_ps(_mm_loadu_ps(acc_im + i), im));
+    }
+    mix_cmac_scalar(
+        acc_re + i, acc_im + i, x_re + i, x_im + i, h_re + i, h_im + i, n - i);
+}
+
+//-----------------------------------------------------------------------------
+// avx2 + fma
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma"))) void
+mix_gain_avx2(float* buf, float gain, uint32_t n) {
+    __m256 g = _mm256_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), g));
+    mix_gain_scalar(buf + i, gain, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_add_avx2(float* dst, const float* src, float gain, uint32_t n) {
+    __m256 g = _mm256_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_loadu_ps(dst + i);
+        _mm256_storeu_ps(dst + i,
+                         _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, d));
+    }
+    mix_add_scalar(dst + i, src + i, gain, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_pan_add_avx2(const float* src,
+                 float* left,
+                 float* right,
+                 float gain_left,
+                 float gain_right,
+                 uint32_t n) {
+    __m256 gl = _mm256_set1_ps(gain_left);
+    __m256 gr = _mm256_set1_ps(gain_right);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s = _mm256_loadu_ps(src + i);
+        __m256 l = _mm256_fmadd_ps(s, gl, _mm256_loadu_ps(left + i));
+        __m256 r = _mm256_fmadd_ps(s, gr, _mm256_loadu_ps(right + i));
+        _mm256_storeu_ps(left + i, l);
+        _mm256_storeu_ps(right + i, r);
+    }
+    mix_pan_add_scalar(
+        src + i, left + i, right + i, gain_left, gain_right, n - i);
+}
+
+// unpack works per 128-bit lane; the lane swap puts frames back in order
+__attribute__((target("avx2,fma"))) void
+mix_interleave_avx2(const float* left,
+                    const float* right,
+                    float* out,
+                    uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 l = _mm256_loadu_ps(left + i);
+        __m256 r = _mm256_loadu_ps(right + i);
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + i * 2 + 8,
+                         _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    mix_interleave_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_deinterleave_avx2(const float* in,
+                      float* left,
+                      float* right,
+                      uint32_t frames) {
+    uint32_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 a = _mm256_loadu_ps(in + i * 2);
+        __m256 b = _mm256_loadu_ps(in + i * 2 + 8);
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l),
+                                                   _MM_SHUFFLE(3, 1, 2, 0)));
+        r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r),
+                                                   _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(left + i, l);
+        _mm256_storeu_ps(right + i, r);
+    }
+    mix_deinterleave_scalar(in + i * 2, left + i, right + i, frames - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_to_s16_avx2(const float* in, int16_t* out, uint32_t n) {
+    __m256 scale = _mm256_set1_ps(32768.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_cvtps_epi32(
+            _mm256_mul_ps(_mm256_loadu_ps(in + i), scale));
+        __m256i b = _mm256_cvtps_epi32(
+            _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+                                                  _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+    mix_to_s16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_from_s16_avx2(const int16_t* in, float* out, uint32_t n) {
+    __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*)(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+    mix_from_s16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_to_s32_avx2(const float* in, int32_t* out, uint32_t n) {
+    __m256 scale = _mm256_set1_ps(2147483648.0f);
+    __m256 hi = _mm256_set1_ps(2147483520.0f);
+    __m256 lo = _mm256_set1_ps(-2147483648.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        v = _mm256_max_ps(_mm256_min_ps(v, hi), lo);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_cvtps_epi32(v));
+    }
+    mix_to_s32_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_ramp_avx2(float* out, float start, float step, uint32_t n) {
+    __m256 s = _mm256_set1_ps(start);
+    __m256 d = _mm256_set1_ps(step);
+    __m256 index =
+        _mm256_cvtepi32_ps(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 width = _mm256_set1_ps(8.0f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_fmadd_ps(d, index, s));
+        index = _mm256_add_ps(index, width);
+    }
+    for (; i < n; i++) out[i] = start + step * (float)i;
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_curve_avx2(float* out, float base, float first, float ratio, uint32_t n) {
+    float terms[8];
+    terms[0] = first;
+    for (uint32_t k = 1; k < 8; k++) terms[k] = terms[k - 1] * ratio;
+    float r2 = ratio * ratio;
+    float r4 = r2 * r2;
+    __m256 p = _mm256_loadu_ps(terms);
+    __m256 r8 = _mm256_set1_ps(r4 * r4);
+    __m256 b = _mm256_set1_ps(base);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(b, p));
+        p = _mm256_mul_ps(p, r8);
+    }
+    mix_curve_scalar(
+        out + i, base, _mm_cvtss_f32(_mm256_castps256_ps128(p)), ratio, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_mul_avx2(float* buf, const float* gains, uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_loadu_ps(gains + i);
+        _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), g));
+    }
+    mix_mul_scalar(buf + i, gains + i, n - i);
+}
+
+// halving is exact, so every instruction set matches the scalar law
+__attribute__((target("avx2,fma"))) void
+mix_pan_law_avx2(const float* pan, float* left, float* right, uint32_t n) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 minus_one = _mm256_set1_ps(-1.0f);
+    __m256 half = _mm256_set1_ps(0.5f);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 p = _mm256_loadu_ps(pan + i);
+        p = _mm256_max_ps(_mm256_min_ps(p, one), minus_one);
+        p = _mm256_mul_ps(p, half);
+        _mm256_storeu_ps(left + i, _mm256_sqrt_ps(_mm256_sub_ps(half, p)));
+        _mm256_storeu_ps(right + i, _mm256_sqrt_ps(_mm256_add_ps(half, p)));
+    }
+    mix_pan_law_scalar(pan + i, left + i, right + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_meter_avx2(const float* buf, float* peak, float* sum, uint32_t n) {
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 p = _mm256_set1_ps(*peak);
+    __m256 s = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(buf + i);
+        p = _mm256_max_ps(p, _mm256_andnot_ps(sign, x));
+        s = _mm256_fmadd_ps(x, x, s);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, p);
+    for (uint32_t k = 0; k < 8; k++)
+        *peak = lanes[k] > *peak ? lanes[k] : *peak;
+    _mm256_storeu_ps(lanes, s);
+    *sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+            ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    mix_meter_scalar(buf + i, peak, sum, n - i);
+}
+
+// the inputs first, into two sums, the previous step's outputs last: only
+// two multiply-adds and a permute are on the recurrence, and the two
+// channels' recurrences overlap
+__attribute__((target("avx2,fma"))) void
+mix_biquad_avx2(float* left,
+                float* right,
+                const MixBiquad* filter,
+                float* state,
+                uint32_t n) {
+    __m256i last = _mm256_set1_epi32(7);
+    __m256i before = _mm256_set1_epi32(6);
+    float* bufs[2] = {left, right};
+    __m256 x1[2], x2[2], y1[2], y2[2];
+    for (uint32_t c = 0; c < 2; c++) {
+        x1[c] = _mm256_set1_ps(state[4 * c + 0]);
+        x2[c] = _mm256_set1_ps(state[4 * c + 1]);
+        y1[c] = _mm256_set1_ps(state[4 * c + 2]);
+        y2[c] = _mm256_set1_ps(state[4 * c + 3]);
+    }
+    uint32_t i = 0;
+    for (; i + mix_biquad_step <= n; i += mix_biquad_step) {
+        for (uint32_t c = 0; c < 2; c++) {
+            float* buf = bufs[c] + i;
+            __m256 a = _mm256_mul_ps(_mm256_load_ps(filter->m[8]), x1[c]);
+            __m256 b = _mm256_mul_ps(_mm256_load_ps(filter->m[9]), x2[c]);
+            for (uint32_t k = 0; k < mix_biquad_step; k += 2) {
+                a = _mm256_fmadd_ps(_mm256_load_ps(filter->m[k]),
+                                    _mm256_broadcast_ss(buf + k),
+                                    a);
+                b = _mm256_fmadd_ps(_mm256_load_ps(filter->m[k + 1]),
+                                    _mm256_broadcast_ss(buf + k + 1),
+                                    b);
+            }
+            x1[c] = _mm256_broadcast_ss(buf + 7);
+            x2[c] = _mm256_broadcast_ss(buf + 6);
+            __m256 y = _mm256_add_ps(a, b);
+            y = _mm256_fmadd_ps(_mm256_load_ps(filter->m[10]), y1[c], y);
+            y = _mm256_fmadd_ps(_mm256_load_ps(filter->m[11]), y2[c], y);
+            _mm256_storeu_ps(buf, y);
+            y1[c] = _mm256_permutevar8x32_ps(y, last);
+            y2[c] = _mm256_permutevar8x32_ps(y, before);
+        }
+    }
+    for (uint32_t c = 0; c < 2; c++) {
+        state[4 * c + 0] = _mm256_cvtss_f32(x1[c]);
+        state[4 * c + 1] = _mm256_cvtss_f32(x2[c]);
+        state[4 * c + 2] = _mm256_cvtss_f32(y1[c]);
+        state[4 * c + 3] = _mm256_cvtss_f32(y2[c]);
+    }
+    mix_biquad_scalar(left + i, right + i, filter, state, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void
+mix_cmac_avx2(float* acc_re,
+              float* acc_im,
+              const float* x_re,
+              const float* x_im,
+              const float* h_re,
+              const float* h_im,
+              uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 xr = _mm256_loadu_ps(x_re + i);
+        __m256 xi = _mm256_loadu_ps(x_im + i);
+        __m256 hr = _mm256_loadu_ps(h_re + i);
+        __m256 hi = _mm256_loadu_ps(h_im + i);
+        __m256 re = _mm256_loadu_ps(acc_re + i);
+        __m256 im = _mm256_loadu_ps(acc_im + i);
+        re = _mm256_fmadd_ps(xr, hr, _mm256_fnmadd_ps(xi, hi, re));
+        im = _mm256_fmadd_ps(xr, hi, _mm256_fmadd_ps(xi, hr, im));
+        _mm256_storeu_ps(acc_re + i, re);
+        _mm256_storeu_ps(acc_im + i, im);
+    }
+    mix_cmac_scalar(
+        acc_re + i, acc_im + i, x_re + i, x_im + i, h_re + i, h_im + i, n - i);
+}
+
+//-----------------------------------------------------------------------------
+// avx-512f
+//-----------------------------------------------------------------------------
+
+__attribute__((target("avx512f"))) void
+mix_gain_avx512(float* buf, float gain, uint32_t n) {
+    __m512 g = _mm512_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(buf + i, _mm512_mul_ps(_mm512_loadu_ps(buf + i), g));
+    mix_gain_scalar(buf + i, gain, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_add_avx512(float* dst, const float* src, float gain, uint32_t n) {
+    __m512 g = _mm512_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_loadu_ps(dst + i);
+        _mm512_storeu_ps(dst + i,
+                         _mm512_fmadd_ps(_mm512_loadu_ps(src + i), g, d));
+    }
+    mix_add_scalar(dst + i, src + i, gain, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_pan_add_avx512(const float* src,
+                   float* left,
+                   float* right,
+                   float gain_left,
+                   float gain_right,
+                   uint32_t n) {
+    __m512 gl = _mm512_set1_ps(gain_left);
+    __m512 gr = _mm512_set1_ps(gain_right);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 s = _mm512_loadu_ps(src + i);
+        __m512 l = _mm512_fmadd_ps(s, gl, _mm512_loadu_ps(left + i));
+        __m512 r = _mm512_fmadd_ps(s, gr, _mm512_loadu_ps(right + i));
+        _mm512_storeu_ps(left + i, l);
+        _mm512_storeu_ps(right + i, r);
+    }
+    mix_pan_add_scalar(
+        src + i, left + i, right + i, gain_left, gain_right, n - i);
+}
+
+// one two-source permute per output vector; indices >= 16 pick from right
+__attribute__((target("avx512f"))) void
+mix_interleave_avx512(const float* left,
+                      const float* right,
+                      float* out,
+                      uint32_t frames) {
+    __m512i lo_index = _mm512_setr_epi32(
+        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    __m512i hi_index = _mm512_setr_epi32(
+        8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    uint32_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        __m512 l = _mm512_loadu_ps(left + i);
+        __m512 r = _mm512_loadu_ps(right + i);
+        _mm512_storeu_ps(out + i * 2, _mm512_permutex2var_ps(l, lo_index, r));
+        _mm512_storeu_ps(out + i * 2 + 16,
+                         _mm512_permutex2var_ps(l, hi_index, r));
+    }
+    mix_interleave_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_deinterleave_avx512(const float* in,
+                        float* left,
+                        float* right,
+                        uint32_t frames) {
+    __m512i even = _mm512_setr_epi32(
+        0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    __m512i odd = _mm512_setr_epi32(
+        1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    uint32_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        __m512 a = _mm512_loadu_ps(in + i * 2);
+        __m512 b = _mm512_loadu_ps(in + i * 2 + 16);
+        _mm512_storeu_ps(left + i, _mm512_permutex2var_ps(a, even, b));
+        _mm512_storeu_ps(right + i, _mm512_permutex2var_ps(a, odd, b));
+    }
+    mix_deinterleave_scalar(in + i * 2, left + i, right + i, frames - i);
+}
+
+// vpmovsdw narrows with saturation, so this needs no avx-512bw
+__attribute__((target("avx512f"))) void
+mix_to_s16_avx512(const float* in, int16_t* out, uint32_t n) {
+    __m512 scale = _mm512_set1_ps(32768.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_cvtps_epi32(
+            _mm512_mul_ps(_mm512_loadu_ps(in + i), scale));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtsepi32_epi16(x));
+    }
+    mix_to_s16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_from_s16_avx512(const int16_t* in, float* out, uint32_t n) {
+    __m512 scale = _mm512_set1_ps(1.0f / 32768.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_cvtepi16_epi32(
+            _mm256_loadu_si256((const __m256i*)(in + i)));
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(x), scale));
+    }
+    mix_from_s16_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_to_s32_avx512(const float* in, int32_t* out, uint32_t n) {
+    __m512 scale = _mm512_set1_ps(2147483648.0f);
+    __m512 hi = _mm512_set1_ps(2147483520.0f);
+    __m512 lo = _mm512_set1_ps(-2147483648.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(in + i), scale);
+        v = _mm512_max_ps(_mm512_min_ps(v, hi), lo);
+        _mm512_storeu_si512((void*)(out + i), _mm512_cvtps_epi32(v));
+    }
+    mix_to_s32_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_ramp_avx512(float* out, float start, float step, uint32_t n) {
+    __m512 s = _mm512_set1_ps(start);
+    __m512 d = _mm512_set1_ps(step);
+    __m512 index = _mm512_cvtepi32_ps(_mm512_setr_epi32(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    __m512 width = _mm512_set1_ps(16.0f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_fmadd_ps(d, index, s));
+        index = _mm512_add_ps(index, width);
+    }
+    for (; i < n; i++) out[i] = start + step * (float)i;
+}
+
+__attribute__((target("avx512f"))) void
+mix_curve_avx512(float* out, float base, float first, float ratio, uint32_t n) {
+    float terms[16];
+    terms[0] = first;
+    for (uint32_t k = 1; k < 16; k++) terms[k] = terms[k - 1] * ratio;
+    float r2 = ratio * ratio;
+    float r4 = r2 * r2;
+    float r8 = r4 * r4;
+    __m512 p = _mm512_loadu_ps(terms);
+    __m512 r16 = _mm512_set1_ps(r8 * r8);
+    __m512 b = _mm512_set1_ps(base);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_add_ps(b, p));
+        p = _mm512_mul_ps(p, r16);
+    }
+    mix_curve_scalar(out + i, base, _mm512_cvtss_f32(p), ratio, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_mul_avx512(float* buf, const float* gains, uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 g = _mm512_loadu_ps(gains + i);
+        _mm512_storeu_ps(buf + i, _mm512_mul_ps(_mm512_loadu_ps(buf + i), g));
+    }
+    mix_mul_scalar(buf + i, gains + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_pan_law_avx512(const float* pan, float* left, float* right, uint32_t n) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 minus_one = _mm512_set1_ps(-1.0f);
+    __m512 half = _mm512_set1_ps(0.5f);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 p = _mm512_loadu_ps(pan + i);
+        p = _mm512_max_ps(_mm512_min_ps(p, one), minus_one);
+        p = _mm512_mul_ps(p, half);
+        _mm512_storeu_ps(left + i, _mm512_sqrt_ps(_mm512_sub_ps(half, p)));
+        _mm512_storeu_ps(right + i, _mm512_sqrt_ps(_mm512_add_ps(half, p)));
+    }
+    mix_pan_law_scalar(pan + i, left + i, right + i, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_meter_avx512(const float* buf, float* peak, float* sum, uint32_t n) {
+    __m512 p = _mm512_set1_ps(*peak);
+    __m512 s = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 x = _mm512_loadu_ps(buf + i);
+        p = _mm512_max_ps(p, _mm512_abs_ps(x));
+        s = _mm512_fmadd_ps(x, x, s);
+    }
+    *peak = _mm512_reduce_max_ps(p);
+    *sum += _mm512_reduce_add_ps(s);
+    mix_meter_scalar(buf + i, peak, sum, n - i);
+}
+
+__attribute__((target("avx512f"))) void
+mix_cmac_avx512(float* acc_re,
+                float* acc_im,
+                const float* x_re,
+                const float* x_im,
+                const float* h_re,
+                const float* h_im,
+                uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 xr = _mm512_loadu_ps(x_re + i);
+        __m512 xi = _mm512_loadu_ps(x_im + i);
+        __m512 hr = _mm512_loadu_ps(h_re + i);
+        __m512 hi = _mm512_loadu_ps(h_im + i);
+        __m512 re = _mm512_loadu_ps(acc_re + i);
+        __m512 im = _mm512_loadu_ps(acc_im + i);
+        re = _mm512_fmadd_ps(xr, hr, _mm512_fnmadd_ps(xi, hi, re));
+        im = _mm512_fmadd_ps(xr, hi, _mm512_fmadd_ps(xi, hr, im));
+        _mm512_storeu_ps(acc_re + i, re);
+        _mm512_storeu_ps(acc_im + i, im);
+    }
+    mix_cmac_scalar(
+        acc_re + i, acc_im + i, x_re + i, x_im + i, h_re + i, h_im + i, n - i);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// dispatch
+//-----------------------------------------------------------------------------
+
+// widest instruction set this cpu runs, regardless of -march
+uint32_t mix_best_isa(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return mix_isa_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return mix_isa_avx2;
+    return mix_isa_sse2;
+#else
+    return mix_isa_scalar;
+#endif
+}
+
+// fills a table for one instruction set; returns 0 if this build or this
+// cpu cannot run it
+uint8_t mix_kernels_for(uint32_t isa, MixKernels* kernels) {
+    *kernels = (MixKernels){
+        .isa = mix_isa_scalar,
+        .name = "scalar",
+        .gain = mix_gain_scalar,
+        .add = mix_add_scalar,
+        .pan_add = mix_pan_add_scalar,
+        .interleave = mix_interleave_scalar,
+        .deinterleave = mix_deinterleave_scalar,
+        .to_s16 = mix_to_s16_scalar,
+        .from_s16 = mix_from_s16_scalar,
+        .to_s32 = mix_to_s32_scalar,
+        .ramp = mix_ramp_scalar,
+        .curve = mix_curve_scalar,
+        .mul = mix_mul_scalar,
+        .pan_law = mix_pan_law_scalar,
+        .meter = mix_meter_scalar,
+        .biquad = mix_biquad_scalar,
+        .cmac = mix_cmac_scalar,
+    };
+    if (isa == mix_isa_scalar) return 1;
+    if (isa > mix_best_isa()) return 0;
+#if defined(__x86_64__)
+    switch (isa) {
+    case mix_isa_sse2:
+        *kernels = (MixKernels){
+            .isa = mix_isa_sse2,
+            .name = "sse2",
+            .gain = mix_gain_sse2,
+            .add = mix_add_sse2,
+            .pan_add = mix_pan_add_sse2,
+            .interleave = mix_interleave_sse2,
+            .deinterleave = mix_deinterleave_sse2,
+            .to_s16 = mix_to_s16_sse2,
+            .from_s16 = mix_from_s16_sse2,
+            .to_s32 = mix_to_s32_sse2,
+            .ramp = mix_ramp_sse2,
+            .curve = mix_curve_sse2,
+            .mul = mix_mul_sse2,
+            .pan_law = mix_pan_law_sse2,
+            .meter = mix_meter_sse2,
+            .biquad = mix_biquad_sse2,
+            .cmac = mix_cmac_sse2,
+        };
+        return 1;
+    case mix_isa_avx2:
+        *kernels = (MixKernels){
+            .isa = mix_isa_avx2,
+            .name = "avx2",
+            .gain = mix_gain_avx2,
+            .add = mix_add_avx2,
+            .pan_add = mix_pan_add_avx2,
+            .interleave = mix_interleave_avx2,
+            .deinterleave = mix_deinterleave_avx2,
+            .to_s16 = mix_to_s16_avx2,
+            .from_s16 = mix_from_s16_avx2,
+            .to_s32 = mix_to_s32_avx2,
+            .ramp = mix_ramp_avx2,
+            .curve = mix_curve_avx2,
+            .mul = mix_mul_avx2,
+            .pan_law = mix_pan_law_avx2,
+            .meter = mix_meter_avx2,
+            .biquad = mix_biquad_avx2,
+            .cmac = mix_cmac_avx2,
+        };
+        return 1;
+    case mix_isa_avx512:
+        *kernels = (MixKernels){
+            .isa = mix_isa_avx512,
+            .name = "avx512",
+            .gain = mix_gain_avx512,
+            .add = mix_add_avx512,
+            .pan_add = mix_pan_add_avx512,
+            .interleave = mix_interleave_avx512,
+            .deinterleave = mix_deinterleave_avx512,
+            .to_s16 = mix_to_s16_avx512,
+            .from_s16 = mix_from_s16_avx512,
+            .to_s32 = mix_to_s32_avx512,
+            .ramp = mix_ramp_avx512,
+            .curve = mix_curve_avx512,
+            .mul = mix_mul_avx512,
+            .pan_law = mix_pan_law_avx512,
+            .meter = mix_meter_avx512,
+            // a step is eight wide; any avx-512 cpu has avx2 and fma
+            .biquad = mix_biquad_avx2,
+            .cmac = mix_cmac_avx512,
+        };
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+// WAR_MIX=scalar|sse2|avx2|avx512 caps the choice, for A/B listening and
+// for reproducing a report from an older machine
+void mix_select(MixKernels* kernels) {
+    uint32_t isa = mix_best_isa();
+    const char* env = getenv("WAR_MIX");
+    if (env) {
+        const char* names[mix_isa_count] = {"scalar", "sse2", "avx2", "avx512"};
+        for (uint32_t i = 0; i < mix_isa_count; i++) {
+            if (!strcmp(env, names[i]) && i < isa) isa = i;
+        }
+    }
+    uint8_t ok = mix_kernels_for(isa, kernels);
+    assert(ok);
+    (void)ok;
+    call_carmack("mix: %s kernels", kernels->name);
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+double mix_bench_seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// largest difference from the scalar kernels over the bench buffers; the
+// fma variants round once where scalar rounds twice
+float mix_bench_check(const MixKernels* k,
+                      const float* a,
+                      const float* b,
+                      float* x,
+                      float* y,
+                      float* z,
+                      float* w,
+                      int16_t* s16,
+                      int32_t* s32,
+                      uint32_t n) {
+    MixKernels ref;
+    mix_kernels_for(mix_isa_scalar, &ref);
+    float worst = 0.0f;
+#define MIX_BENCH_DIFF(p, q, count)                                           \
+    for (uint32_t i = 0; i < (count); i++) {                                  \
+        float d = fabsf((float)(p)[i] - (float)(q)[i]);                       \
+        worst = d > worst ? d : worst;                                        \
+    }
+
+    memcpy(x, a, sizeof(float) * n);
+    memcpy(y, a, sizeof(float) * n);
+    ref.add(x, b, 0.7f, n);
+    k->add(y, b, 0.7f, n);
+    MIX_BENCH_DIFF(x, y, n);
+
+    memcpy(x, a, sizeof(float) * n);
+    memcpy(y, b, sizeof(float) * n);
+    memcpy(z, a, sizeof(float) * n);
+    memcpy(w, b, sizeof(float) * n);
+    ref.pan_add(a, x, y, 0.6f, 0.8f, n);
+    k->pan_add(a, z, w, 0.6f, 0.8f, n);
+    MIX_BENCH_DIFF(x, z, n);
+    MIX_BENCH_DIFF(y, w, n);
+
+    // n / 2 frames so the interleaved buffer fits in n floats
+    ref.interleave(a, b, x, n / 2);
+    k->interleave(a, b, y, n / 2);
+    MIX_BENCH_DIFF(x, y, n);
+    ref.deinterleave(a, x, y, n / 2);
+    k->deinterleave(a, z, w, n / 2);
+    MIX_BENCH_DIFF(x, z, n / 2);
+    MIX_BENCH_DIFF(y, w, n / 2);
+
+    // integers compared in their own units: any difference is a bug
+    ref.to_s16(a, s16, n);
+    for (uint32_t i = 0; i < n; i++) x[i] = s16[i];
+    k->to_s16(a, s16, n);
+    MIX_BENCH_DIFF(x, s16, n);
+    ref.from_s16(s16, x, n);
+    k->from_s16(s16, y, n);
+    MIX_BENCH_DIFF(x, y, n);
+    ref.to_s32(a, s32, n);
+    for (uint32_t i = 0; i < n; i++) x[i] = (float)s32[i];
+    k->to_s32(a, s32, n);
+    MIX_BENCH_DIFF(x, s32, n);
+
+    ref.ramp(x, -0.5f, 1.0f / n, n);
+    k->ramp(y, -0.5f, 1.0f / n, n);
+    MIX_BENCH_DIFF(x, y, n);
+    // one block: callers restart the series every block
+    ref.curve(x, 0.25f, -0.25f, 1.0001f, audio_block_frames);
+    k->curve(y, 0.25f, -0.25f, 1.0001f, audio_block_frames);
+    MIX_BENCH_DIFF(x, y, audio_block_frames);
+    memcpy(x, a, sizeof(float) * n);
+    memcpy(y, a, sizeof(float) * n);
+    ref.mul(x, b, n);
+    k->mul(y, b, n);
+    MIX_BENCH_DIFF(x, y, n);
+    ref.pan_law(a, x, y, n);
+    k->pan_law(a, z, w, n);
+    MIX_BENCH_DIFF(x, z, n);
+    MIX_BENCH_DIFF(y, w, n);
+
+    // one block each, as the meters call them; sums as mean squares
+    float peaks[2] = {0.0f, 0.0f};
+    float sums[2] = {0.0f, 0.0f};
+    ref.meter(a, &peaks[0], &sums[0], audio_block_frames);
+    k->meter(a, &peaks[1], &sums[1], audio_block_frames);
+    sums[0] /= audio_block_frames;
+    sums[1] /= audio_block_frames;
+    MIX_BENCH_DIFF(peaks, peaks + 1, 1);
+    MIX_BENCH_DIFF(sums, sums + 1, 1);
+    // the bs.1770 high-pass at 48 kHz, poles close to 1, over a few blocks
+    MixBiquad filter;
+    mix_biquad_design(
+        &filter, 1.0, -2.0, 1.0, -1.99004745483398, 0.99007225036621);
+    float states[2][8] = {{0}};
+    uint32_t span = audio_block_frames * 8;
+    memcpy(x, a, sizeof(float) * span);
+    memcpy(x + span, b, sizeof(float) * span);
+    memcpy(y, x, sizeof(float) * span * 2);
+    for (uint32_t i = 0; i < span; i += audio_block_frames) {
+        ref.biquad(
+            x + i, x + span + i, &filter, states[0], audio_block_frames);
+        k->biquad(y + i, y + span + i, &filter, states[1], audio_block_frames);
+    }
+    MIX_BENCH_DIFF(x, y, span * 2);
+    // one spectrum of a 2048-point transform, onto what was there
+    uint32_t bins = 1025;
+    memcpy(x, a, sizeof(float) * bins);
+    memcpy(y, b, sizeof(float) * bins);
+    memcpy(z, a, sizeof(float) * bins);
+    memcpy(w, b, sizeof(float) * bins);
+    ref.cmac(x, y, a, b, b + bins, a + bins, bins);
+    k->cmac(z, w, a, b, b + bins, a + bins, bins);
+    MIX_BENCH_DIFF(x, z, bins);
+    MIX_BENCH_DIFF(y, w, bins);
+#undef MIX_BENCH_DIFF
+    return worst;
+}
+
+// each kernel at a block size and at a cache-busting size, every
+// instruction set this cpu has, in ns per sample and speedup over scalar
+void mix_bench_run(void) {
+    header("mix_bench_run");
+
+    enum {
+        big_samples = 1 << 22,
+        bench_sizes = 2,
+        bench_kernels = 15,
+    };
+    const uint32_t sizes[bench_sizes] = {audio_block_frames, big_samples};
+    const char* kernel_names[bench_kernels] = {
+        "gain",
+        "add",
+        "pan_add",
+        "interleave",
+        "deinterleave",
+        "to_s16",
+        "from_s16",
+        "to_s32",
+        "ramp",
+        "curve",
+        "mul",
+        "pan_law",
+        "meter",
+        "biquad",
+        "cmac",
+    };
+    MixBiquad filter;
+    mix_biquad_design(
+        &filter, 1.0, -2.0, 1.0, -1.99004745483398, 0.99007225036621);
+    float state[8] = {0};
+    float peak = 0.0f;
+    float sum = 0.0f;
+
+    float* a = aligned_alloc(64, sizeof(float) * big_samples);
+    float* b = aligned_alloc(64, sizeof(float) * big_samples);
+    float* x = aligned_alloc(64, sizeof(float) * big_samples);
+    float* y = aligned_alloc(64, sizeof(float) * big_samples);
+    float* z = aligned_alloc(64, sizeof(float) * big_samples);
+    float* w = aligned_alloc(64, sizeof(float) * big_samples);
+    // 2 then 0.5, for mul to alternate between
+    float* gains = aligned_alloc(64, sizeof(float) * big_samples * 2);
+    int16_t* s16 = aligned_alloc(64, sizeof(int16_t) * big_samples);
+    int32_t* s32 = aligned_alloc(64, sizeof(int32_t) * big_samples);
+    assert(a && b && x && y && z && w && gains && s16 && s32);
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < big_samples; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        // a little past full scale so the clamps are exercised
+        a[i] = ((seed >> 8) / 8388608.0f - 1.0f) * 1.1f;
+        b[i] = sinf(i * 0.01f);
+        gains[i] = 2.0f;
+        gains[big_samples + i] = 0.5f;
+    }
+
+    double scalar_ns[bench_sizes][bench_kernels] = {{0}};
+    for (uint32_t isa = 0; isa < mix_isa_count; isa++) {
+        MixKernels k;
+        if (!mix_kernels_for(isa, &k)) continue;
+        float worst =
+            mix_bench_check(&k, a, b, x, y, z, w, s16, s32, big_samples);
+        printf("%-7s max diff vs scalar %g\n", k.name, worst);
+        for (uint32_t s = 0; s < bench_sizes; s++) {
+            uint32_t n = sizes[s];
+            // about 256M samples of work per kernel
+            uint32_t reps = (1u << 28) / n;
+            for (uint32_t kernel = 0; kernel < bench_kernels; kernel++) {
+                double t0 = mix_bench_seconds();
+                for (uint32_t r = 0; r < reps; r++) {
+                    switch (kernel) {
+                    case 0:
+                        // alternating keeps x out of the denormals
+                        k.gain(x, r & 1 ? 2.0f : 0.5f, n);
+                        break;
+                    case 1:
+                        k.add(x, a, 0.5f, n);
+                        break;
+                    case 2:
+                        k.pan_add(a, x, y, 0.6f, 0.8f, n);
+                        break;
+                    case 3:
+                        k.interleave(a, b, z, n / 2);
+                        break;
+                    case 4:
+                        k.deinterleave(a, z, w, n / 2);
+                        break;
+                    case 5:
+                        k.to_s16(a, s16, n);
+                        break;
+                    case 6:
+                        k.from_s16(s16, x, n);
+                        break;
+                    case 7:
+                        k.to_s32(a, s32, n);
+                        break;
+                    case 8:
+                        k.ramp(x, -0.5f, 1.0f / n, n);
+                        break;
+                    case 9:
+                        k.curve(x, 0.25f, -0.25f, 1.0f, n);
+                        break;
+                    case 10:
+                        k.mul(x, gains + (r & 1 ? big_samples : 0), n);
+                        break;
+                    case 11:
+                        k.pan_law(b, z, w, n);
+                        break;
+                    case 12:
+                        k.meter(a, &peak, &sum, n);
+                        break;
+                    case 13:
+                        k.biquad(x, y, &filter, state, n / 2);
+                        break;
+                    case 14:
+                        // ns per bin
+                        k.cmac(x, y, a, b, z, w, n);
+                        break;
+                    }
+                }
+                double ns = (mix_bench_seconds() - t0) * 1e9 /
+                            ((double)reps * n);
+                if (isa == mix_isa_scalar) scalar_ns[s][kernel] = ns;
+                printf("%-7s %-12s n=%-8u %7.3f ns/sample %6.2fx\n",
+                       k.name,
+                       kernel_names[kernel],
+                       n,
+                       ns,
+                       ns > 0 ? scalar_ns[s][kernel] / ns : 0.0);
+            }
+        }
+    }
+
+    free(a);
+    free(b);
+    free(x);
+    free(y);
+    free(z);
+    free(w);
+    free(gains);
+    free(s16);
+    free(s32);
+    end("mix_bench_run");
+}
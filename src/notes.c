@@ -0,0 +1,328 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/notes.c
+//=============================================================================
+
+#include "notes.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+void notes_make_track(NoteTrack* track, uint32_t capacity) {
+    memset(track, 0, sizeof(NoteTrack));
+    notes_reserve(track, capacity ? capacity : note_block_size);
+}
+
+void notes_free_track(NoteTrack* track) {
+    free(track->start);
+    free(track->length);
+    free(track->pitch);
+    free(track->velocity);
+    free(track->flags);
+    free(track->block_max_end);
+    free(track->block_pitch_min);
+    free(track->block_pitch_max);
+    free(track->tree_max_end);
+    memset(track, 0, sizeof(NoteTrack));
+}
+
+void notes_reserve(NoteTrack* track, uint32_t capacity) {
+    if (capacity <= track->capacity) return;
+    uint32_t new_capacity = track->capacity ? track->capacity : capacity;
+    while (new_capacity < capacity) new_capacity *= 2;
+    track->start = realloc(track->start, sizeof(uint32_t) * new_capacity);
+    track->length = realloc(track->length, sizeof(uint32_t) * new_capacity);
+    track->pitch = realloc(track->pitch, new_capacity);
+    track->velocity = realloc(track->velocity, new_capacity);
+    track->flags = realloc(track->flags, new_capacity);
+    assert(track->start && track->length && track->pitch &&
+           track->velocity && track->flags);
+    track->capacity = new_capacity;
+}
+
+// first note whose start is >= tick
+uint32_t notes_lower_bound(const NoteTrack* track, uint32_t tick) {
+    uint32_t lo = 0, hi = track->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (track->start[mid] < tick) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int notes_compare(const void* a, const void* b) {
+    const Note* x = a;
+    const Note* y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return (int)x->pitch - (int)y->pitch;
+}
+
+// sorts only the batch, then merges it in from the back; notes before the
+// first insertion point are never moved
+void notes_insert(NoteTrack* track, const Note* notes, uint32_t count) {
+    if (!count) return;
+    Note* batch = malloc(sizeof(Note) * count);
+    assert(batch);
+    memcpy(batch, notes, sizeof(Note) * count);
+    qsort(batch, count, sizeof(Note), notes_compare);
+
+    notes_reserve(track, track->count + count);
+    int64_t i = (int64_t)track->count - 1;
+    int64_t j = (int64_t)count - 1;
+    int64_t w = (int64_t)track->count + count - 1;
+    while (j >= 0) {
+        if (i >= 0 && track->start[i] > batch[j].start) {
+            track->start[w] = track->start[i];
+            track->length[w] = track->length[i];
+            track->pitch[w] = track->pitch[i];
+            track->velocity[w] = track->velocity[i];
+            track->flags[w] = track->flags[i];
+            i--;
+        } else {
+            track->start[w] = batch[j].start;
+            track->length[w] = batch[j].length;
+            track->pitch[w] = batch[j].pitch;
+            track->velocity[w] = batch[j].velocity;
+            track->flags[w] = batch[j].flags & ~note_flag_deleted;
+            j--;
+        }
+        w--;
+    }
+    free(batch);
+    uint32_t old_blocks = track->block_count;
+    track->count += count;
+    notes_update_index(track, (uint32_t)(w + 1), old_blocks);
+}
+
+// indices in any order; one compaction pass from the lowest of them
+void notes_delete(NoteTrack* track, const uint32_t* indices, uint32_t count) {
+    if (!count) return;
+    uint32_t first = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        assert(indices[i] < track->count);
+        track->flags[indices[i]] |= note_flag_deleted;
+        if (indices[i] < first) first = indices[i];
+    }
+    uint32_t w = first;
+    for (uint32_t r = first; r < track->count; r++) {
+        if (track->flags[r] & note_flag_deleted) continue;
+        track->start[w] = track->start[r];
+        track->length[w] = track->length[r];
+        track->pitch[w] = track->pitch[r];
+        track->velocity[w] = track->velocity[r];
+        track->flags[w] = track->flags[r];
+        w++;
+    }
+    uint32_t old_blocks = track->block_count;
+    track->count = w;
+    notes_update_index(track, first, old_blocks);
+}
+
+// refreshes block summaries from the block holding first_changed, and the
+// tree nodes above them
+void notes_update_index(NoteTrack* track,
+                        uint32_t first_changed,
+                        uint32_t old_blocks) {
+    uint32_t blocks = (track->count + note_block_size - 1) / note_block_size;
+    if (blocks > track->block_capacity) {
+        uint32_t capacity = track->block_capacity ? track->block_capacity : 1;
+        while (capacity < blocks) capacity *= 2;
+        track->block_max_end =
+            realloc(track->block_max_end, sizeof(uint32_t) * capacity);
+        track->block_pitch_min = realloc(track->block_pitch_min, capacity);
+        track->block_pitch_max = realloc(track->block_pitch_max, capacity);
+        assert(track->block_max_end && track->block_pitch_min &&
+               track->block_pitch_max);
+        track->block_capacity = capacity;
+    }
+    track->block_count = blocks;
+
+    uint32_t first_block = first_changed / note_block_size;
+    for (uint32_t b = first_block; b < blocks; b++) {
+        uint32_t lo = b * note_block_size;
+        uint32_t hi = lo + note_block_size;
+        if (hi > track->count) hi = track->count;
+        uint32_t max_end = 0;
+        uint8_t pitch_min = 127, pitch_max = 0;
+        for (uint32_t i = lo; i < hi; i++) {
+            uint32_t end = track->start[i] + track->length[i];
+            max_end = end > max_end ? end : max_end;
+            uint8_t pitch = track->pitch[i];
+            pitch_min = pitch < pitch_min ? pitch : pitch_min;
+            pitch_max = pitch > pitch_max ? pitch : pitch_max;
+        }
+        track->block_max_end[b] = max_end;
+        track->block_pitch_min[b] = pitch_min;
+        track->block_pitch_max[b] = pitch_max;
+    }
+
+    uint32_t leaves = track->tree_leaves;
+    if (blocks > leaves) {
+        leaves = leaves ? leaves : 1;
+        while (leaves < blocks) leaves *= 2;
+        track->tree_max_end =
+            realloc(track->tree_max_end, sizeof(uint32_t) * 2 * leaves);
+        assert(track->tree_max_end);
+        track->tree_leaves = leaves;
+        first_block = 0;
+        old_blocks = leaves;
+    }
+    uint32_t last_block = blocks > old_blocks ? blocks : old_blocks;
+    if (last_block > leaves) last_block = leaves;
+    if (first_block >= last_block) return;
+    for (uint32_t b = first_block; b < last_block; b++) {
+        track->tree_max_end[leaves + b] =
+            b < blocks ? track->block_max_end[b] : 0;
+    }
+    uint32_t lo = (leaves + first_block) / 2;
+    uint32_t hi = (leaves + last_block - 1) / 2;
+    while (lo >= 1) {
+        for (uint32_t n = lo; n <= hi; n++) {
+            uint32_t l = track->tree_max_end[2 * n];
+            uint32_t r = track->tree_max_end[2 * n + 1];
+            track->tree_max_end[n] = l > r ? l : r;
+        }
+        if (lo == 1) break;
+        lo /= 2;
+        hi /= 2;
+    }
+}
+
+// indices of notes overlapping [t0, t1) with pitch in [p0, p1], ascending;
+// *resume is the first index to consider and is advanced past the last one
+// written, so a full out buffer can be drained in several calls
+uint32_t notes_query(const NoteTrack* track,
+                     uint32_t t0,
+                     uint32_t t1,
+                     uint8_t p0,
+                     uint8_t p1,
+                     uint32_t* out,
+                     uint32_t max,
+                     uint32_t* resume) {
+    uint32_t written = 0;
+    uint32_t end = notes_lower_bound(track, t1);
+    uint32_t begin = resume ? *resume : 0;
+    if (begin >= end || !max) {
+        if (resume) *resume = end;
+        return 0;
+    }
+    uint32_t first_block = begin / note_block_size;
+    uint32_t last_block = (end - 1) / note_block_size;
+    uint32_t leaves = track->tree_leaves;
+
+    // depth-first over subtrees that intersect the block range and hold an
+    // end past t0; right children are pushed first to visit in order
+    enum {
+        max_depth = 64,
+    };
+    uint32_t stack[max_depth];
+    uint32_t stack_lo[max_depth];
+    uint32_t stack_span[max_depth];
+    uint32_t top = 0;
+    stack[top] = 1;
+    stack_lo[top] = 0;
+    stack_span[top] = leaves;
+    top++;
+    while (top) {
+        top--;
+        uint32_t node = stack[top];
+        uint32_t lo = stack_lo[top];
+        uint32_t span = stack_span[top];
+        if (lo > last_block || lo + span <= first_block) continue;
+        if (track->tree_max_end[node] <= t0) continue;
+        if (span > 1) {
+            uint32_t half = span / 2;
+            stack[top] = 2 * node + 1;
+            stack_lo[top] = lo + half;
+            stack_span[top] = half;
+            top++;
+            stack[top] = 2 * node;
+            stack_lo[top] = lo;
+            stack_span[top] = half;
+            top++;
+            continue;
+        }
+        uint32_t b = lo;
+        if (track->block_pitch_max[b] < p0 || track->block_pitch_min[b] > p1)
+            continue;
+        uint32_t i = b * note_block_size;
+        uint32_t stop = i + note_block_size;
+        if (i < begin) i = begin;
+        if (stop > end) stop = end;
+        for (; i < stop; i++) {
+            if (track->start[i] + track->length[i] <= t0) continue;
+            if (track->pitch[i] < p0 || track->pitch[i] > p1) continue;
+            out[written++] = i;
+            if (written == max) {
+                if (resume) *resume = i + 1;
+                return written;
+            }
+        }
+    }
+    if (resume) *resume = end;
+    return written;
+}
+
+// deterministic so frame dumps can be diffed; inserted in batches the way
+// paste and MIDI import would
+void notes_fill_demo(NoteTrack* track, uint32_t count) {
+    enum {
+        batch_size = 4096,
+    };
+    Note batch[batch_size];
+    uint32_t seed = 12345;
+    for (uint32_t done = 0; done < count;) {
+        uint32_t n = count - done < batch_size ? count - done : batch_size;
+        for (uint32_t i = 0; i < n; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t r = seed >> 8;
+            // 16 notes per beat on sixteenth positions
+            batch[i] = (Note){
+                .start = (done + i) / 16 * note_ticks_per_beat +
+                         (r % 4) * (note_ticks_per_beat / 4),
+                .length = (1 + (r >> 4) % 8) * (note_ticks_per_beat / 4),
+                .pitch = (uint8_t)(36 + (r >> 8) % 60),
+                .velocity = (uint8_t)(40 + (r >> 16) % 88),
+                .flags = (r >> 20) % 16 == 0 ? note_flag_selected : 0,
+            };
+        }
+        notes_insert(track, batch, n);
+        done += n;
+    }
+}
+
+// immutable copy for another thread; the copy owns its arrays
+void notes_clone(const NoteTrack* track, NoteTrack* out) {
+    notes_make_track(out, track->count);
+    out->count = track->count;
+    memcpy(out->start, track->start, sizeof(uint32_t) * track->count);
+    memcpy(out->length, track->length, sizeof(uint32_t) * track->count);
+    memcpy(out->pitch, track->pitch, track->count);
+    memcpy(out->velocity, track->velocity, track->count);
+    memcpy(out->flags, track->flags, track->count);
+    notes_update_index(out, 0, 0);
+}
@@ -0,0 +1,426 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/plugin.c
+//=============================================================================
+
+#include "plugin.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "graph.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <clap/clap.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CLAP plugins in process, one instance per graph node. Loading,
+// activation and teardown are UI thread; plugin_node is the audio side.
+// The host supports the thread-pool extension (tasks go to the graph
+// workers through graph_exec) and latency, which the graph compensates
+
+//-----------------------------------------------------------------------------
+// host callbacks, any thread
+//-----------------------------------------------------------------------------
+
+const void* plugin_host_extension(const clap_host_t* host, const char* id) {
+    PluginInstance* instance = host->host_data;
+    if (!strcmp(id, CLAP_EXT_THREAD_POOL)) return &instance->host_thread_pool;
+    if (!strcmp(id, CLAP_EXT_LATENCY)) return &instance->host_latency;
+    return NULL;
+}
+
+void plugin_host_request_restart(const clap_host_t* host) {
+    PluginInstance* instance = host->host_data;
+    __atomic_store_n(&instance->request_restart, 1, __ATOMIC_RELEASE);
+}
+
+// the node runs every block whether or not the plugin asked
+void plugin_host_request_process(const clap_host_t* host) {
+    (void)host;
+}
+
+void plugin_host_request_callback(const clap_host_t* host) {
+    PluginInstance* instance = host->host_data;
+    __atomic_store_n(&instance->request_callback, 1, __ATOMIC_RELEASE);
+}
+
+void plugin_host_latency_changed(const clap_host_t* host) {
+    PluginInstance* instance = host->host_data;
+    __atomic_store_n(&instance->latency_changed, 1, __ATOMIC_RELEASE);
+}
+
+void plugin_exec_task(void* context, uint32_t task) {
+    PluginInstance* instance = context;
+    instance->thread_pool->exec(instance->plugin, task);
+}
+
+// from inside the plugin's process
+bool plugin_host_request_exec(const clap_host_t* host, uint32_t num_tasks) {
+    PluginInstance* instance = host->host_data;
+    if (!instance->thread_pool) return false;
+    graph_exec(instance->pool, plugin_exec_task, instance, num_tasks);
+    return true;
+}
+
+uint32_t plugin_events_size(const clap_input_events_t* list) {
+    const PluginInstance* instance = list->ctx;
+    return instance->in_count;
+}
+
+const clap_event_header_t* plugin_events_get(const clap_input_events_t* list,
+                                             uint32_t index) {
+    const PluginInstance* instance = list->ctx;
+    if (index >= instance->in_count) return NULL;
+    return instance->in_order[index];
+}
+
+// nothing reads what plugins send back yet
+bool plugin_events_push(const clap_output_events_t* list,
+                        const clap_event_header_t* event) {
+    (void)list;
+    (void)event;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// lifetime, UI thread
+//-----------------------------------------------------------------------------
+
+// channels on the main port, or 0 without one; no audio-ports extension
+// is read as one stereo port each way
+uint32_t plugin_port_channels(const PluginInstance* instance, bool input) {
+    const clap_plugin_audio_ports_t* ports =
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS);
+    if (!ports) return plugin_channels;
+    if (!ports->count(instance->plugin, input)) return 0;
+    clap_audio_port_info_t info;
+    if (!ports->get(instance->plugin, 0, input, &info)) return 0;
+    return info.channel_count;
+}
+
+// id NULL takes the library's first plugin. NULL on any failure; pool is
+// where thread-pool tasks run and may be NULL
+PluginInstance* plugin_load(const char* path,
+                            const char* id,
+                            uint32_t sample_rate,
+                            uint32_t max_frames,
+                            GraphPool* pool) {
+    header("plugin_load");
+
+    assert(max_frames <= audio_max_block_frames);
+    PluginInstance* instance = aligned_alloc(64, sizeof(PluginInstance));
+    assert(instance);
+    memset(instance, 0, sizeof(PluginInstance));
+    instance->host = (clap_host_t){
+        .clap_version = CLAP_VERSION,
+        .host_data = instance,
+        .name = "WAR",
+        .vendor = "WAR",
+        .url = "https://github.com/thenickmonaco/vimDAW",
+        .version = "0.1",
+        .get_extension = plugin_host_extension,
+        .request_restart = plugin_host_request_restart,
+        .request_process = plugin_host_request_process,
+        .request_callback = plugin_host_request_callback,
+    };
+    instance->host_thread_pool.request_exec = plugin_host_request_exec;
+    instance->host_latency.changed = plugin_host_latency_changed;
+    instance->in_events = (clap_input_events_t){
+        .ctx = instance,
+        .size = plugin_events_size,
+        .get = plugin_events_get,
+    };
+    instance->out_events = (clap_output_events_t){
+        .ctx = instance,
+        .try_push = plugin_events_push,
+    };
+    instance->pool = pool;
+    instance->sample_rate = sample_rate;
+    instance->max_frames = max_frames;
+
+    instance->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!instance->library) {
+        fprintf(stderr, "plugin: %s\n", dlerror());
+        goto fail;
+    }
+    const clap_plugin_entry_t* entry = dlsym(instance->library, "clap_entry");
+    if (!entry || !clap_version_is_compatible(entry->clap_version)) {
+        fprintf(stderr, "plugin: %s has no compatible clap_entry\n", path);
+        goto fail;
+    }
+    if (!entry->init(path)) {
+        fprintf(stderr, "plugin: %s failed to initialise\n", path);
+        goto fail;
+    }
+    instance->entry = entry;
+    const clap_plugin_factory_t* factory =
+        instance->entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    if (!factory || !factory->get_plugin_count(factory)) {
+        fprintf(stderr, "plugin: %s has no plugins\n", path);
+        goto fail;
+    }
+    if (!id) id = factory->get_plugin_descriptor(factory, 0)->id;
+    instance->plugin = factory->create_plugin(factory, &instance->host, id);
+    if (!instance->plugin) {
+        fprintf(stderr, "plugin: %s has no %s\n", path, id);
+        goto fail;
+    }
+    if (!instance->plugin->init(instance->plugin)) {
+        fprintf(stderr, "plugin: %s failed to initialise\n", id);
+        goto fail;
+    }
+    instance->inputs = plugin_port_channels(instance, true);
+    instance->outputs = plugin_port_channels(instance, false);
+    if ((instance->inputs && instance->inputs != plugin_channels) ||
+        instance->outputs != plugin_channels) {
+        fprintf(stderr, "plugin: %s is not stereo\n", id);
+        goto fail;
+    }
+    instance->thread_pool =
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_THREAD_POOL);
+    instance->latency_ext =
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_LATENCY);
+    if (!instance->plugin->activate(
+            instance->plugin, sample_rate, 1, max_frames)) {
+        fprintf(stderr, "plugin: %s failed to activate\n", id);
+        goto fail;
+    }
+    instance->active = 1;
+    // only valid once active
+    if (instance->latency_ext)
+        instance->latency = instance->latency_ext->get(instance->plugin);
+    call_carmack("plugin: %s, %u frames latency%s",
+                 instance->plugin->desc->name,
+                 instance->latency,
+                 instance->thread_pool ? ", thread pool" : "");
+
+    end("plugin_load");
+    return instance;
+
+fail:
+    plugin_free(instance);
+    end("plugin_load");
+    return NULL;
+}
+
+// after the audio thread is done with it. stop_processing belongs on the
+// audio thread, but nothing else runs the plugin by now
+void plugin_free(PluginInstance* instance) {
+    if (instance->plugin) {
+        if (instance->processing)
+            instance->plugin->stop_processing(instance->plugin);
+        if (instance->active) instance->plugin->deactivate(instance->plugin);
+        instance->plugin->destroy(instance->plugin);
+    }
+    if (instance->entry) instance->entry->deinit();
+    if (instance->library) dlclose(instance->library);
+    free(instance);
+}
+
+// from the UI loop: runs main thread callbacks, re-reads the latency. 1
+// when the graph has to be rebuilt to pick the change up. A restart takes
+// the plugin out of the graph first, see plugin_restart
+uint8_t plugin_idle(PluginInstance* instance) {
+    uint8_t rebuild = 0;
+    if (__atomic_exchange_n(&instance->request_callback, 0, __ATOMIC_ACQUIRE))
+        instance->plugin->on_main_thread(instance->plugin);
+    if (__atomic_exchange_n(&instance->latency_changed, 0, __ATOMIC_ACQUIRE) &&
+        instance->latency_ext) {
+        uint32_t latency = instance->latency_ext->get(instance->plugin);
+        rebuild = latency != instance->latency;
+        instance->latency = latency;
+    }
+    if (__atomic_exchange_n(&instance->request_restart, 0, __ATOMIC_ACQUIRE)) {
+        instance->restarting = 1;
+        rebuild = 1;
+    }
+    return rebuild;
+}
+
+// UI side, once no graph the audio thread can still run has the plugin in
+// it: deactivate and activate again, and take the latency it comes back
+// with. stop_processing belongs on the audio thread, as in plugin_free.
+// One that fails to activate stays out of the graph
+void plugin_restart(PluginInstance* instance) {
+    const clap_plugin_t* plugin = instance->plugin;
+    if (instance->processing) plugin->stop_processing(plugin);
+    instance->processing = 0;
+    if (instance->active) plugin->deactivate(plugin);
+    instance->active = plugin->activate(
+        plugin, instance->sample_rate, 1, instance->max_frames);
+    instance->restarting = 0;
+    if (!instance->active) {
+        fprintf(stderr, "plugin: %s failed to restart\n", plugin->desc->id);
+        return;
+    }
+    if (instance->latency_ext)
+        instance->latency = instance->latency_ext->get(plugin);
+    __atomic_store_n(&instance->latency_changed, 0, __ATOMIC_RELAXED);
+    call_carmack("plugin: %s restarted, %u frames latency",
+                 plugin->desc->name,
+                 instance->latency);
+}
+
+//-----------------------------------------------------------------------------
+// processing, audio thread and workers
+//-----------------------------------------------------------------------------
+
+// automation lanes on the plugin's node as parameter events for the next
+// plugin_process: one at the start when a still lane has changed, one every
+// automation_param_step frames while it moves. In time order, since every
+// lane is visited at each step
+void plugin_automate(PluginInstance* instance,
+                     Automation* automation,
+                     uint32_t node,
+                     uint32_t frames) {
+    instance->param_count = 0;
+    if (!automation) return;
+    uint32_t begin = automation->lane_begin[node];
+    uint32_t end = automation->lane_begin[node + 1];
+    for (uint32_t t = 0; t < frames; t += automation_param_step) {
+        for (uint32_t l = begin; l < end; l++) {
+            AutomationLane* lane = &automation->lanes[l];
+            if (lane->target != automation_param) continue;
+            if (!lane->moving && t > 0) continue;
+            float value = lane->moving ? lane->values[t] : lane->value;
+            if (value == lane->sent) continue;
+            if (instance->param_count == plugin_max_param_events) return;
+            lane->sent = value;
+            instance->params[instance->param_count++] =
+                (clap_event_param_value_t){
+                    .header =
+                        {
+                            .size = sizeof(clap_event_param_value_t),
+                            .time = t,
+                            .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                            .type = CLAP_EVENT_PARAM_VALUE,
+                        },
+                    .param_id = lane->param,
+                    .note_id = -1,
+                    .port_index = -1,
+                    .channel = -1,
+                    .key = -1,
+                    .value = value,
+                };
+        }
+    }
+}
+
+// one block through the plugin: left and right in, out_left and out_right
+// out, the events as notes along with plugin_automate's parameters. A
+// plugin that fails plays silence
+void plugin_process(PluginInstance* instance,
+                    float* left,
+                    float* right,
+                    float* out_left,
+                    float* out_right,
+                    uint32_t frames) {
+    const clap_plugin_t* plugin = instance->plugin;
+    if (!instance->processing)
+        instance->processing = plugin->start_processing(plugin);
+    if (!instance->processing) {
+        memset(out_left, 0, sizeof(float) * frames);
+        memset(out_right, 0, sizeof(float) * frames);
+        return;
+    }
+
+    instance->note_count = 0;
+    uint32_t count = instance->events ? *instance->event_count : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const SequencerEvent* event = &instance->events[i];
+        instance->notes[instance->note_count++] = (clap_event_note_t){
+            .header =
+                {
+                    .size = sizeof(clap_event_note_t),
+                    .time = event->offset,
+                    .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                    .type = event->type == sequencer_event_on
+                                ? CLAP_EVENT_NOTE_ON
+                                : CLAP_EVENT_NOTE_OFF,
+                },
+            .note_id = -1,
+            .key = event->pitch,
+            .velocity = event->velocity / 127.0,
+        };
+    }
+    // both lists are in time order; notes first on a tie
+    uint32_t n = 0;
+    uint32_t p = 0;
+    instance->in_count = 0;
+    while (n < instance->note_count || p < instance->param_count) {
+        uint8_t note = p == instance->param_count ||
+                       (n < instance->note_count &&
+                        instance->notes[n].header.time <=
+                            instance->params[p].header.time);
+        instance->in_order[instance->in_count++] =
+            note ? &instance->notes[n++].header : &instance->params[p++].header;
+    }
+
+    instance->in_channels[0] = left;
+    instance->in_channels[1] = right;
+    instance->out_channels[0] = out_left;
+    instance->out_channels[1] = out_right;
+    clap_audio_buffer_t input = {
+        .data32 = instance->in_channels,
+        .channel_count = plugin_channels,
+    };
+    clap_audio_buffer_t output = {
+        .data32 = instance->out_channels,
+        .channel_count = plugin_channels,
+    };
+    clap_process_t process = {
+        .steady_time = instance->steady_time,
+        .frames_count = frames,
+        .audio_inputs = &input,
+        .audio_outputs = &output,
+        .audio_inputs_count = instance->inputs ? 1 : 0,
+        .audio_outputs_count = 1,
+        .in_events = &instance->in_events,
+        .out_events = &instance->out_events,
+    };
+    if (plugin->process(plugin, &process) == CLAP_PROCESS_ERROR) {
+        memset(out_left, 0, sizeof(float) * frames);
+        memset(out_right, 0, sizeof(float) * frames);
+    }
+    instance->steady_time += frames;
+}
+
+// graph node: the inputs summed and lined up, through the plugin, straight
+// into the node's buffers, with the node's parameter lanes as events
+void plugin_node(void* state,
+                 AudioGraph* graph,
+                 uint32_t node,
+                 uint32_t frames) {
+    PluginInstance* instance = state;
+    plugin_automate(instance,
+                    instance->pool ? instance->pool->automation : NULL,
+                    node,
+                    frames);
+    graph_gather(
+        graph, node, instance->in_left, instance->in_right, 1.0f, frames);
+    plugin_process(instance,
+                   instance->in_left,
+                   instance->in_right,
+                   graph_left(graph, node),
+                   graph_right(graph, node),
+                   frames);
+}
@@ -0,0 +1,104 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/pool.c
+//=============================================================================
+
+#include "pool.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// every slot is written once here, so no get ever faults; the block is
+// locked on top of whatever mlockall already covers
+void pool_make(Pool* pool, uint32_t size, uint32_t capacity) {
+    assert(capacity > 0);
+    memset(pool, 0, sizeof(Pool));
+    pool->stride = (size + 63) & ~63u;
+    pool->capacity = capacity;
+    size_t bytes = (size_t)pool->stride * capacity;
+    pool->slots = aligned_alloc(64, bytes);
+    pool->next = malloc(sizeof(uint32_t) * capacity);
+    assert(pool->slots && pool->next);
+    memset(pool->slots, 0, bytes);
+    mlock(pool->slots, bytes);
+    // slot 0 on top, so a fresh pool hands out slots in address order
+    for (uint32_t i = 0; i < capacity; i++)
+        pool->next[i] = i + 1 < capacity ? i + 2 : 0;
+    pool->head = 1;
+}
+
+void pool_free(Pool* pool) {
+    munlock(pool->slots, (size_t)pool->stride * pool->capacity);
+    free(pool->slots);
+    free(pool->next);
+    memset(pool, 0, sizeof(Pool));
+}
+
+// any thread; NULL when every slot is out
+void* pool_get(Pool* pool) {
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t top;
+    do {
+        top = (uint32_t)head;
+        if (top == 0) {
+            __atomic_add_fetch(&pool->exhausted, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        uint32_t below =
+            __atomic_load_n(&pool->next[top - 1], __ATOMIC_RELAXED);
+        uint64_t tag = (head >> 32) + 1;
+        if (__atomic_compare_exchange_n(&pool->head,
+                                        &head,
+                                        (tag << 32) | below,
+                                        1,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE))
+            break;
+    } while (1);
+    uint32_t in_use = __atomic_add_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+    if (in_use > __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED))
+        __atomic_store_n(&pool->high_water, in_use, __ATOMIC_RELAXED);
+    return pool->slots + (size_t)(top - 1) * pool->stride;
+}
+
+// any thread, including the one that did not get it
+void pool_put(Pool* pool, void* object) {
+    size_t offset = (size_t)((uint8_t*)object - pool->slots);
+    assert(offset % pool->stride == 0 &&
+           offset / pool->stride < pool->capacity);
+    uint32_t slot = (uint32_t)(offset / pool->stride) + 1;
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint64_t next;
+    do {
+        __atomic_store_n(
+            &pool->next[slot - 1], (uint32_t)head, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | slot;
+    } while (!__atomic_compare_exchange_n(&pool->head,
+                                          &head,
+                                          next,
+                                          1,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_ACQUIRE));
+    __atomic_sub_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+}
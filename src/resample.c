@@ -0,0 +1,511 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/resample.c
+//=============================================================================
+
+#include "resample.h"
+#include "audio.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "mix.h"
+#include "sampler.h"
+#include "waveform.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// one row chunk as a gcc vector, like the synth's lane groups
+typedef float ResampleLanes __attribute__((vector_size(sizeof(float) *
+                                                      resample_lanes)));
+
+//-----------------------------------------------------------------------------
+// filter bank
+//-----------------------------------------------------------------------------
+
+const char* resample_quality_name(uint32_t quality) {
+    switch (quality) {
+    case resample_quality_fast:
+        return "fast";
+    case resample_quality_good:
+        return "good";
+    case resample_quality_high:
+        return "high";
+    case resample_quality_best:
+        return "best";
+    }
+    return "?";
+}
+
+// WAR_RESAMPLE_QUALITY fast, good, high (default) or best
+uint32_t resample_quality_env(void) {
+    const char* env = getenv("WAR_RESAMPLE_QUALITY");
+    for (uint32_t q = 0; env && q < resample_quality_count; q++) {
+        if (strcmp(env, resample_quality_name(q)) == 0) return q;
+    }
+    return resample_quality_high;
+}
+
+// modified bessel function of the first kind, order 0, by its series
+double resample_bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (uint32_t k = 1; k < 64 && term > sum * 1e-17; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// kaiser-windowed sinc per tier. Downsampling stretches the kernel over
+// more input taps; the transition band the length allows at the tier's
+// attenuation ends at the lower nyquist. NULL when the ratio needs more
+// than resample_max_phases rows
+Resampler* resample_make(uint32_t in_rate,
+                         uint32_t out_rate,
+                         uint32_t quality) {
+    header("resample_make");
+
+    assert(quality < resample_quality_count);
+    const uint32_t base_taps[resample_quality_count] = {16, 32, 64, 128};
+    const double attenuation[resample_quality_count] = {60, 80, 100, 120};
+    uint32_t a = in_rate;
+    uint32_t b = out_rate;
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    uint32_t phases = out_rate / a;
+    uint32_t step = in_rate / a;
+    if (phases > resample_max_phases) {
+        call_carmack("resample: %u -> %u Hz needs %u phases",
+                     in_rate,
+                     out_rate,
+                     phases);
+        end("resample_make");
+        return NULL;
+    }
+    double ratio = out_rate < in_rate ? (double)out_rate / in_rate : 1.0;
+    uint32_t taps = (uint32_t)ceil(base_taps[quality] / ratio);
+    taps = (taps + resample_lanes - 1) / resample_lanes * resample_lanes;
+    if (taps > resample_max_taps) taps = resample_max_taps;
+    double beta = 0.1102 * (attenuation[quality] - 8.7);
+    double width = (attenuation[quality] - 7.95) / (14.36 * taps * ratio);
+    double cutoff = (0.5 - width / 2.0) * ratio; // cycles per input frame
+
+    Resampler* resampler = aligned_alloc(64, sizeof(Resampler));
+    assert(resampler);
+    memset(resampler, 0, sizeof(Resampler));
+    resampler->bank = aligned_alloc(64, sizeof(float) * phases * taps);
+    assert(resampler->bank);
+    resampler->in_rate = in_rate;
+    resampler->out_rate = out_rate;
+    resampler->quality = quality;
+    resampler->phases = phases;
+    resampler->step = step;
+    resampler->taps = taps;
+
+    // tap j of row p weighs the input (p / phases + taps / 2 - 1 - j)
+    // frames before the output; every row is normalized to unity at dc
+    double half = taps / 2.0;
+    double window_scale = 1.0 / resample_bessel_i0(beta);
+    for (uint32_t p = 0; p < phases; p++) {
+        float* row = resampler->bank + (size_t)p * taps;
+        double h[resample_max_taps];
+        double sum = 0.0;
+        for (uint32_t j = 0; j < taps; j++) {
+            double d = (double)p / phases + half - 1.0 - j;
+            double x = d / half;
+            double window =
+                fabs(x) < 1.0
+                    ? resample_bessel_i0(beta * sqrt(1.0 - x * x)) *
+                          window_scale
+                    : 0.0;
+            double t = 2.0 * cutoff * d;
+            double sinc = fabs(t) < 1e-12 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+            h[j] = 2.0 * cutoff * sinc * window;
+            sum += h[j];
+        }
+        for (uint32_t j = 0; j < taps; j++) row[j] = (float)(h[j] / sum);
+    }
+    resample_reset(resampler);
+
+    call_carmack("resample: %u -> %u Hz, %s, %u phases x %u taps",
+                 in_rate,
+                 out_rate,
+                 resample_quality_name(quality),
+                 phases,
+                 taps);
+    end("resample_make");
+    return resampler;
+}
+
+void resample_reset(Resampler* resampler) {
+    resampler->phase = 0;
+    resampler->read = 0;
+    resampler->fill = resampler->taps / 2 - 1;
+    memset(resampler->left, 0, sizeof(float) * resampler->fill);
+    memset(resampler->right, 0, sizeof(float) * resampler->fill);
+}
+
+void resample_free(Resampler* resampler) {
+    if (!resampler) return;
+    free(resampler->bank);
+    free(resampler);
+}
+
+//-----------------------------------------------------------------------------
+// streaming
+//-----------------------------------------------------------------------------
+
+// outputs the buffered input can produce now
+uint32_t resample_ready(const Resampler* resampler) {
+    if (resampler->fill < resampler->read + resampler->taps) return 0;
+    uint64_t start =
+        (uint64_t)resampler->read * resampler->phases + resampler->phase;
+    uint64_t limit = (uint64_t)(resampler->fill - resampler->taps + 1) *
+                     resampler->phases;
+    return (uint32_t)((limit - start + resampler->step - 1) / resampler->step);
+}
+
+// appends what fits; the unread tail moves to the front first when needed.
+// A block always fits while fewer than a block of outputs are ready, for
+// ratios down to 2:1
+uint32_t resample_write(Resampler* resampler,
+                        const float* left,
+                        const float* right,
+                        uint32_t frames) {
+    if (resampler->fill + frames > resample_buffer_frames &&
+        resampler->read > 0) {
+        assert(resampler->read <= resampler->fill);
+        uint32_t keep = resampler->fill - resampler->read;
+        memmove(resampler->left,
+                resampler->left + resampler->read,
+                sizeof(float) * keep);
+        memmove(resampler->right,
+                resampler->right + resampler->read,
+                sizeof(float) * keep);
+        resampler->fill = keep;
+        resampler->read = 0;
+    }
+    uint32_t space = resample_buffer_frames - resampler->fill;
+    uint32_t n = frames < space ? frames : space;
+    memcpy(resampler->left + resampler->fill, left, sizeof(float) * n);
+    memcpy(resampler->right + resampler->fill, right, sizeof(float) * n);
+    resampler->fill += n;
+    return n;
+}
+
+// up to frames outputs; both channels share each row load
+__attribute__((target_clones("avx512f", "avx2", "default"))) uint32_t
+resample_read(Resampler* resampler,
+              float* left,
+              float* right,
+              uint32_t frames) {
+    uint32_t taps = resampler->taps;
+    uint32_t phases = resampler->phases;
+    uint32_t advance = resampler->step / phases;
+    uint32_t remainder = resampler->step % phases;
+    uint32_t phase = resampler->phase;
+    uint32_t read = resampler->read;
+    uint32_t fill = resampler->fill;
+    uint32_t n = 0;
+    for (; n < frames && read + taps <= fill; n++) {
+        const float* row = resampler->bank + (size_t)phase * taps;
+        const float* in_left = resampler->left + read;
+        const float* in_right = resampler->right + read;
+        ResampleLanes sum_left = {0};
+        ResampleLanes sum_right = {0};
+        for (uint32_t j = 0; j < taps; j += resample_lanes) {
+            ResampleLanes c, l, r;
+            memcpy(&c, row + j, sizeof(ResampleLanes));
+            memcpy(&l, in_left + j, sizeof(ResampleLanes));
+            memcpy(&r, in_right + j, sizeof(ResampleLanes));
+            sum_left += c * l;
+            sum_right += c * r;
+        }
+        float out_left = 0.0f;
+        float out_right = 0.0f;
+        for (uint32_t k = 0; k < resample_lanes; k++) {
+            out_left += sum_left[k];
+            out_right += sum_right[k];
+        }
+        left[n] = out_left;
+        right[n] = out_right;
+        read += advance;
+        phase += remainder;
+        if (phase >= phases) {
+            phase -= phases;
+            read++;
+        }
+    }
+    resampler->phase = phase;
+    resampler->read = read;
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// import
+//-----------------------------------------------------------------------------
+
+// the whole file as stereo float32 at rate, written beside it and renamed
+// into place when complete. Output frames are ceil(frames * rate / in)
+uint8_t resample_file(const char* path,
+                      const char* out_path,
+                      uint32_t rate,
+                      uint32_t quality) {
+    header("resample_file %s", path);
+
+    SampleFile file;
+    memset(&file, 0, sizeof(file));
+    file.data = waveform_map_wav(path,
+                                 &file.map_size,
+                                 &file.map,
+                                 &file.channels,
+                                 &file.bits,
+                                 &file.sample_rate,
+                                 &file.frames);
+    if (!file.data) {
+        end("resample_file");
+        return 0;
+    }
+    madvise(file.map, file.map_size, MADV_SEQUENTIAL);
+    uint64_t out_frames =
+        (file.frames * rate + file.sample_rate - 1) / file.sample_rate;
+    uint64_t data_bytes = out_frames * audio_channels * sizeof(float);
+    Resampler* resampler = data_bytes <= UINT32_MAX - 36
+                               ? resample_make(file.sample_rate, rate, quality)
+                               : NULL;
+    char temp_path[resample_max_path];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", out_path);
+    FILE* out = resampler ? fopen(temp_path, "wb") : NULL;
+    if (!out) {
+        call_carmack("resample: cannot convert %s", path);
+        resample_free(resampler);
+        munmap(file.map, file.map_size);
+        end("resample_file");
+        return 0;
+    }
+    audio_write_wav_header(out, rate, audio_channels, (uint32_t)data_bytes);
+
+    MixKernels k;
+    mix_select(&k);
+    float* buffers =
+        aligned_alloc(64, sizeof(float) * resample_chunk_frames * 8);
+    assert(buffers);
+    float* scratch = buffers;
+    float* in_left = buffers + resample_chunk_frames * 2;
+    float* in_right = buffers + resample_chunk_frames * 3;
+    float* out_left = buffers + resample_chunk_frames * 4;
+    float* out_right = buffers + resample_chunk_frames * 5;
+    float* interleaved = buffers + resample_chunk_frames * 6;
+    uint64_t done_in = 0;
+    uint64_t done_out = 0;
+    uint8_t ok = 1;
+    while (ok && done_out < out_frames) {
+        uint32_t n = resample_chunk_frames;
+        if (done_in < file.frames) {
+            if (n > file.frames - done_in)
+                n = (uint32_t)(file.frames - done_in);
+            sampler_read_frames(
+                &k, &file, done_in, n, scratch, in_left, in_right);
+            done_in += n;
+        } else {
+            // zeros past the end flush the last windows
+            memset(in_left, 0, sizeof(float) * n);
+            memset(in_right, 0, sizeof(float) * n);
+        }
+        uint32_t accepted = resample_write(resampler, in_left, in_right, n);
+        assert(accepted == n);
+        (void)accepted;
+        for (;;) {
+            uint64_t left_over = out_frames - done_out;
+            uint32_t want = left_over < resample_chunk_frames
+                                ? (uint32_t)left_over
+                                : resample_chunk_frames;
+            uint32_t produced =
+                resample_read(resampler, out_left, out_right, want);
+            if (produced == 0) break;
+            k.interleave(out_left, out_right, interleaved, produced);
+            ok = fwrite(interleaved,
+                        sizeof(float) * audio_channels,
+                        produced,
+                        out) == produced;
+            done_out += produced;
+        }
+    }
+    ok = fclose(out) == 0 && ok;
+    ok = ok && rename(temp_path, out_path) == 0;
+    if (!ok) {
+        call_carmack("resample: cannot write %s", out_path);
+        remove(temp_path);
+    }
+    free(buffers);
+    resample_free(resampler);
+    munmap(file.map, file.map_size);
+
+    end("resample_file");
+    return ok;
+}
+
+// <path>.<rate>.wav, converted when missing or older than the source.
+// The quality is the one in effect when it was written: delete the file
+// to convert again at another
+uint8_t resample_cached(const char* path,
+                        char* cached,
+                        size_t size,
+                        uint32_t rate) {
+    snprintf(cached, size, "%s.%u.wav", path, rate);
+    struct stat source, target;
+    if (stat(path, &source) < 0) return 0;
+    if (stat(cached, &target) == 0 && target.st_mtime >= source.st_mtime)
+        return 1;
+    return resample_file(path, cached, rate, resample_quality_env());
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+// rms error against the ideal tone at the output rate, in dB below it;
+// the edges are skipped
+double resample_bench_error(const float* out,
+                            uint32_t frames,
+                            uint32_t taps,
+                            double frequency,
+                            uint32_t rate) {
+    double error = 0.0;
+    double signal = 0.0;
+    for (uint32_t n = taps; n + taps < frames; n++) {
+        double ideal = 0.5 * sin(2.0 * M_PI * frequency * n / rate);
+        error += (out[n] - ideal) * (out[n] - ideal);
+        signal += ideal * ideal;
+    }
+    return 10.0 * log10(error / signal + 1e-30);
+}
+
+// a tone in blocks through the streaming path, timed; out gets the left
+// channel. Returns output frames per second
+double resample_bench_tone(Resampler* resampler,
+                           double frequency,
+                           float* in,
+                           float* out,
+                           uint32_t in_frames,
+                           uint32_t* out_frames) {
+    enum { bench_block = 1024 };
+    for (uint32_t i = 0; i < in_frames; i++)
+        in[i] = (float)(0.5 * sin(2.0 * M_PI * frequency * i /
+                                  resampler->in_rate));
+    float right[bench_block * 4];
+    resample_reset(resampler);
+    uint32_t produced = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t at = 0; at < in_frames; at += bench_block) {
+        uint32_t n =
+            in_frames - at < bench_block ? in_frames - at : bench_block;
+        resample_write(resampler, in + at, in + at, n);
+        produced += resample_read(
+            resampler, out + produced, right, bench_block * 4);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *out_frames = produced;
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return produced / wall;
+}
+
+// every tier on the common conversions: stereo output frames per second,
+// error on a 1 kHz and a 15 kHz tone, and how far a tone just above the
+// output nyquist is pushed down when downsampling
+void resample_bench_run(void) {
+    header("resample_bench_run");
+
+    enum {
+        bench_seconds = 10,
+        bench_pairs = 4,
+    };
+    const uint32_t pairs[bench_pairs][2] = {
+        {44100, 48000},
+        {48000, 44100},
+        {48000, 96000},
+        {96000, 48000},
+    };
+    uint32_t max_in = 96000 * bench_seconds;
+    float* in = aligned_alloc(64, sizeof(float) * max_in);
+    float* out = aligned_alloc(64, sizeof(float) * max_in * 2);
+    assert(in && out);
+    printf("quality  conversion       taps  Mframes/s  x realtime  "
+           "err 1k    err 15k   alias\n");
+    for (uint32_t q = 0; q < resample_quality_count; q++) {
+        for (uint32_t p = 0; p < bench_pairs; p++) {
+            uint32_t in_rate = pairs[p][0];
+            uint32_t out_rate = pairs[p][1];
+            Resampler* resampler = resample_make(in_rate, out_rate, q);
+            assert(resampler);
+            uint32_t in_frames = in_rate * bench_seconds;
+            uint32_t frames;
+            double speed = resample_bench_tone(
+                resampler, 1000.0, in, out, in_frames, &frames);
+            double low = resample_bench_error(
+                out, frames, resampler->taps, 1000.0, out_rate);
+            resample_bench_tone(
+                resampler, 15000.0, in, out, in_frames, &frames);
+            double high = resample_bench_error(
+                out, frames, resampler->taps, 15000.0, out_rate);
+            char alias[16] = "-";
+            if (out_rate < in_rate) {
+                double tone = out_rate * 0.5 * 1.05;
+                resample_bench_tone(
+                    resampler, tone, in, out, in_frames, &frames);
+                double power = 0.0;
+                for (uint32_t n = resampler->taps; n + resampler->taps < frames;
+                     n++)
+                    power += (double)out[n] * out[n];
+                power /= frames - 2 * resampler->taps;
+                snprintf(alias,
+                         sizeof(alias),
+                         "%.1f dB",
+                         10.0 * log10(power / 0.125 + 1e-30));
+            }
+            printf("%-8s %6u -> %-6u  %4u  %9.2f  %10.0f  %6.1f dB %6.1f dB "
+                   "%s\n",
+                   resample_quality_name(q),
+                   in_rate,
+                   out_rate,
+                   resampler->taps,
+                   speed / 1e6,
+                   speed / out_rate,
+                   low,
+                   high,
+                   alias);
+            resample_free(resampler);
+        }
+    }
+    free(in);
+    free(out);
+
+    end("resample_bench_run");
+}
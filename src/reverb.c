@@ -0,0 +1,764 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/reverb.c
+//=============================================================================
+
+#include "reverb.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "fft.h"
+#include "graph.h"
+#include "macros.h"
+#include "mix.h"
+#include "resample.h"
+#include "stats.h"
+#include "waveform.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// partitioned convolution in two segments. The first reverb_tail_start
+// frames of the response are reverb_head_frames partitions run by the
+// node itself; an output frame needs the transform of the partition it
+// falls in, one product and the inverse, so the node adds no latency at
+// any block size. The rest is reverb_tail_frames partitions on a thread
+// of its own, which gets a chunk of input the moment it is whole and has
+// a chunk's length before its output is first played. Either way the
+// products with older input are summed ahead, once a partition completes
+
+//-----------------------------------------------------------------------------
+// segments
+//-----------------------------------------------------------------------------
+
+// partition j is frames [offset + j * size, offset + (j + 1) * size) of
+// the response, transformed with size zeros after it
+void reverb_segment_make(ReverbSegment* seg,
+                         const float* left,
+                         const float* right,
+                         uint64_t frames,
+                         uint64_t offset,
+                         uint32_t size,
+                         uint32_t count) {
+    memset(seg, 0, sizeof(ReverbSegment));
+    fft_make(&seg->fft, 2 * size);
+    seg->size = size;
+    seg->count = count;
+    seg->stride = (size + 1 + 15) & ~15u;
+    size_t spectra = (size_t)2 * count * seg->stride;
+    seg->filter_re = fft_alloc(spectra);
+    seg->filter_im = fft_alloc(spectra);
+    seg->line_re = fft_alloc(spectra);
+    seg->line_im = fft_alloc(spectra);
+    seg->newest = count - 1;
+    seg->window = fft_alloc(4 * size);
+    seg->rest_re = fft_alloc(2 * seg->stride);
+    seg->rest_im = fft_alloc(2 * seg->stride);
+    seg->sum_re = fft_alloc(seg->stride);
+    seg->sum_im = fft_alloc(seg->stride);
+    seg->out = fft_alloc(2 * size);
+
+    const float* ir[2] = {left, right};
+    for (uint32_t c = 0; c < 2; c++) {
+        for (uint32_t j = 0; j < count; j++) {
+            memset(seg->out, 0, sizeof(float) * 2 * size);
+            uint64_t start = offset + (uint64_t)j * size;
+            for (uint32_t i = 0; i < size && start + i < frames; i++)
+                seg->out[i] = ir[c][start + i];
+            size_t at = ((size_t)c * count + j) * seg->stride;
+            fft_forward(
+                &seg->fft, seg->out, seg->filter_re + at, seg->filter_im + at);
+        }
+    }
+}
+
+void reverb_segment_free(ReverbSegment* seg) {
+    fft_free(&seg->fft);
+    free(seg->filter_re);
+    free(seg->filter_im);
+    free(seg->line_re);
+    free(seg->line_im);
+    free(seg->window);
+    free(seg->rest_re);
+    free(seg->rest_im);
+    free(seg->sum_re);
+    free(seg->sum_im);
+    free(seg->out);
+    memset(seg, 0, sizeof(ReverbSegment));
+}
+
+// silence in, as if the segment had just been made
+void reverb_segment_reset(ReverbSegment* seg) {
+    size_t spectra = (size_t)2 * seg->count * seg->stride;
+    memset(seg->line_re, 0, sizeof(float) * spectra);
+    memset(seg->line_im, 0, sizeof(float) * spectra);
+    memset(seg->window, 0, sizeof(float) * 4 * seg->size);
+    memset(seg->rest_re, 0, sizeof(float) * 2 * seg->stride);
+    memset(seg->rest_im, 0, sizeof(float) * 2 * seg->stride);
+    seg->newest = seg->count - 1;
+    seg->fill = 0;
+}
+
+// n more frames of the current partition in, their n outputs out. The
+// frames still to come are zeros in the window, and no output so far
+// depends on them. The partition's spectrum lands in the oldest slot of
+// the line, which no sum needs any more
+void reverb_segment_push(ReverbSegment* seg,
+                         const MixKernels* k,
+                         const float* left,
+                         const float* right,
+                         float* out_left,
+                         float* out_right,
+                         uint32_t n) {
+    assert(seg->fill + n <= seg->size);
+    uint32_t size = seg->size;
+    uint32_t stride = seg->stride;
+    uint32_t slot = (seg->newest + 1) % seg->count;
+    const float* in[2] = {left, right};
+    float* out[2] = {out_left, out_right};
+    for (uint32_t c = 0; c < 2; c++) {
+        float* window = seg->window + (size_t)2 * size * c;
+        memcpy(window + size + seg->fill, in[c], sizeof(float) * n);
+        size_t at = ((size_t)c * seg->count + slot) * stride;
+        float* x_re = seg->line_re + at;
+        float* x_im = seg->line_im + at;
+        fft_forward(&seg->fft, window, x_re, x_im);
+        memcpy(seg->sum_re, seg->rest_re + c * stride, sizeof(float) * stride);
+        memcpy(seg->sum_im, seg->rest_im + c * stride, sizeof(float) * stride);
+        size_t first = (size_t)c * seg->count * stride;
+        k->cmac(seg->sum_re,
+                seg->sum_im,
+                x_re,
+                x_im,
+                seg->filter_re + first,
+                seg->filter_im + first,
+                size + 1);
+        fft_inverse(&seg->fft, seg->sum_re, seg->sum_im, seg->out);
+        memcpy(out[c], seg->out + size + seg->fill, sizeof(float) * n);
+    }
+    seg->fill += n;
+}
+
+// once the current partition is whole: it becomes the newest in the
+// line, and every other partition's product for the next one is summed
+void reverb_segment_advance(ReverbSegment* seg, const MixKernels* k) {
+    assert(seg->fill == seg->size);
+    uint32_t size = seg->size;
+    uint32_t stride = seg->stride;
+    uint32_t count = seg->count;
+    seg->newest = (seg->newest + 1) % count;
+    seg->fill = 0;
+    for (uint32_t c = 0; c < 2; c++) {
+        float* window = seg->window + (size_t)2 * size * c;
+        memcpy(window, window + size, sizeof(float) * size);
+        memset(window + size, 0, sizeof(float) * size);
+        float* rest_re = seg->rest_re + c * stride;
+        float* rest_im = seg->rest_im + c * stride;
+        memset(rest_re, 0, sizeof(float) * stride);
+        memset(rest_im, 0, sizeof(float) * stride);
+        for (uint32_t j = 1; j < count; j++) {
+            uint32_t slot = (seg->newest + count + 1 - j) % count;
+            size_t x = ((size_t)c * count + slot) * stride;
+            size_t h = ((size_t)c * count + j) * stride;
+            k->cmac(rest_re,
+                    rest_im,
+                    seg->line_re + x,
+                    seg->line_im + x,
+                    seg->filter_re + h,
+                    seg->filter_im + h,
+                    size + 1);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// tail thread
+//-----------------------------------------------------------------------------
+
+// a chunk's output goes out through its slot's tag; a thread that has
+// fallen so far behind that the audio side is refilling the input it
+// would read drops its history and starts again from the newest chunk,
+// and the chunks it skipped play dry
+void* reverb_thread(void* arg) {
+    Reverb* reverb = arg;
+    ReverbSegment* tail = &reverb->tail;
+    uint32_t next = 0;
+    for (;;) {
+        uint32_t posted = __atomic_load_n(&reverb->posted, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reverb->quit, __ATOMIC_ACQUIRE)) break;
+        if (posted == next) {
+            // tail_sleeping and posted are a dekker pair with reverb_tail
+            __atomic_store_n(&reverb->tail_sleeping, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&reverb->posted, __ATOMIC_SEQ_CST) == next) {
+                syscall(SYS_futex,
+                        &reverb->posted,
+                        FUTEX_WAIT_PRIVATE,
+                        next,
+                        NULL,
+                        NULL,
+                        0);
+            }
+            __atomic_store_n(&reverb->tail_sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        if (posted - next >= reverb_tail_slots - 1) {
+            reverb_segment_reset(tail);
+            next = posted - 1;
+            __atomic_add_fetch(&reverb->resets, 1, __ATOMIC_RELAXED);
+        }
+        uint64_t start = stats_now_ns();
+        uint32_t slot = next % reverb_tail_slots;
+        reverb_segment_push(tail,
+                            &reverb->kernels,
+                            reverb->tail_in[slot][0],
+                            reverb->tail_in[slot][1],
+                            reverb->tail_out[slot][0],
+                            reverb->tail_out[slot][1],
+                            reverb_tail_frames);
+        __atomic_store_n(&reverb->tags[slot], next + 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&reverb->done, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reverb->host_sleeping, __ATOMIC_SEQ_CST)) {
+            syscall(SYS_futex,
+                    &reverb->done,
+                    FUTEX_WAKE_PRIVATE,
+                    1,
+                    NULL,
+                    NULL,
+                    0);
+        }
+        // the next chunk's head start, off the clock
+        reverb_segment_advance(tail, &reverb->kernels);
+        next++;
+        __atomic_add_fetch(
+            &reverb->tail_ns, stats_now_ns() - start, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// setup, UI thread
+//-----------------------------------------------------------------------------
+
+// exponentially decaying noise, a different draw per side, 60 dB down at
+// the end: a stand-in hall for runs without a response on disk
+void reverb_generate(float* left,
+                     float* right,
+                     uint64_t frames,
+                     uint32_t seed) {
+    double decay = -3.0 * M_LN10 / (double)frames;
+    uint32_t seeds[2] = {seed, seed ^ 0x9e3779b9u};
+    float* out[2] = {left, right};
+    for (uint32_t c = 0; c < 2; c++) {
+        uint32_t s = seeds[c];
+        for (uint64_t i = 0; i < frames; i++) {
+            s = s * 1664525u + 1013904223u;
+            float noise = (s >> 8) / 8388608.0f - 1.0f;
+            out[c][i] = noise * (float)exp(decay * (double)i);
+        }
+    }
+}
+
+// unit energy on the louder side, so a send level means the same for any
+// response
+void reverb_normalize(float* left, float* right, uint64_t frames) {
+    double energy[2] = {0.0, 0.0};
+    for (uint64_t i = 0; i < frames; i++) {
+        energy[0] += (double)left[i] * left[i];
+        energy[1] += (double)right[i] * right[i];
+    }
+    double louder = energy[0] > energy[1] ? energy[0] : energy[1];
+    if (louder <= 0.0) return;
+    float gain = (float)(1.0 / sqrt(louder));
+    for (uint64_t i = 0; i < frames; i++) {
+        left[i] *= gain;
+        right[i] *= gain;
+    }
+}
+
+// the response as given, cut at reverb_max_seconds. wait is for offline
+// renders: a late tail is waited for, and the thread runs at normal
+// priority. Else it asks for SCHED_FIFO under the graph and falls back
+// the way the graph does
+Reverb* reverb_make(const float* left,
+                    const float* right,
+                    uint64_t frames,
+                    uint32_t sample_rate,
+                    uint8_t wait,
+                    const char* name) {
+    header("reverb_make");
+
+    assert(frames > 0);
+    if (frames > (uint64_t)reverb_max_seconds * sample_rate)
+        frames = (uint64_t)reverb_max_seconds * sample_rate;
+    Reverb* reverb = aligned_alloc(64, sizeof(Reverb));
+    assert(reverb);
+    memset(reverb, 0, sizeof(Reverb));
+    snprintf(reverb->name, sizeof(reverb->name), "%s", name);
+    reverb->sample_rate = sample_rate;
+    reverb->ir_frames = frames;
+    reverb->wait = wait;
+    mix_select(&reverb->kernels);
+
+    uint64_t head_frames =
+        frames < reverb_tail_start ? frames : reverb_tail_start;
+    uint32_t head_count =
+        (uint32_t)((head_frames + reverb_head_frames - 1) / reverb_head_frames);
+    reverb_segment_make(
+        &reverb->head, left, right, frames, 0, reverb_head_frames, head_count);
+    if (frames > reverb_tail_start) {
+        uint32_t tail_count =
+            (uint32_t)((frames - reverb_tail_start + reverb_tail_frames - 1) /
+                       reverb_tail_frames);
+        reverb_segment_make(&reverb->tail,
+                            left,
+                            right,
+                            frames,
+                            reverb_tail_start,
+                            reverb_tail_frames,
+                            tail_count);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (!wait) {
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            struct sched_param param = {.sched_priority = reverb_priority};
+            pthread_attr_setschedparam(&attr, &param);
+        }
+        int res =
+            pthread_create(&reverb->thread, &attr, reverb_thread, reverb);
+        if (res == EPERM)
+            res = pthread_create(&reverb->thread, NULL, reverb_thread, reverb);
+        assert(res == 0);
+        (void)res;
+        pthread_attr_destroy(&attr);
+        // a deadline like the graph's, whether or not SCHED_FIFO was granted
+        pthread_setname_np(reverb->thread,
+                           wait ? "war-reverb" : "war-rt-reverb");
+    }
+    call_carmack("reverb: %s, %.2f s, %u + %u partitions",
+                 reverb->name,
+                 (double)frames / sample_rate,
+                 reverb->head.count,
+                 reverb->tail.count);
+
+    end("reverb_make");
+    return reverb;
+}
+
+// source is a PCM16 or float32 WAV, converted once if its rate is not the
+// engine's, or a length in seconds for a generated response. Mono plays
+// on both sides; past two channels only the first two are used
+Reverb* reverb_load(const char* source, uint32_t sample_rate, uint8_t wait) {
+    char name[reverb_max_name];
+    char* rest = NULL;
+    double seconds = strtod(source, &rest);
+    if (rest != source && !*rest) {
+        if (!(seconds > 0.0 && seconds <= reverb_max_seconds)) return NULL;
+        uint64_t frames = (uint64_t)(seconds * sample_rate);
+        if (!frames) return NULL;
+        float* ir = malloc(sizeof(float) * 2 * frames);
+        assert(ir);
+        reverb_generate(ir, ir + frames, frames, 12345);
+        reverb_normalize(ir, ir + frames, frames);
+        snprintf(name, sizeof(name), "hall %g s", seconds);
+        Reverb* reverb =
+            reverb_make(ir, ir + frames, frames, sample_rate, wait, name);
+        free(ir);
+        return reverb;
+    }
+
+    void* map = NULL;
+    size_t map_size = 0;
+    uint32_t channels = 0, bits = 0, rate = 0;
+    uint64_t frames = 0;
+    const uint8_t* data = waveform_map_wav(
+        source, &map_size, &map, &channels, &bits, &rate, &frames);
+    if (!data) return NULL;
+    char converted[resample_max_path];
+    if (rate != sample_rate &&
+        resample_cached(source, converted, sizeof(converted), sample_rate)) {
+        munmap(map, map_size);
+        data = waveform_map_wav(
+            converted, &map_size, &map, &channels, &bits, &rate, &frames);
+        if (!data) return NULL;
+    }
+    if (frames > (uint64_t)reverb_max_seconds * sample_rate)
+        frames = (uint64_t)reverb_max_seconds * sample_rate;
+    if (!frames) {
+        munmap(map, map_size);
+        return NULL;
+    }
+    float* ir = malloc(sizeof(float) * 2 * frames);
+    assert(ir);
+    uint32_t bytes = bits / 8;
+    for (uint64_t i = 0; i < frames; i++) {
+        for (uint32_t c = 0; c < 2; c++) {
+            const uint8_t* at =
+                data + (i * channels + (c < channels ? c : 0)) * bytes;
+            if (bits == 16) {
+                int16_t s;
+                memcpy(&s, at, sizeof(s));
+                ir[c * frames + i] = s / 32768.0f;
+            } else {
+                memcpy(&ir[c * frames + i], at, sizeof(float));
+            }
+        }
+    }
+    munmap(map, map_size);
+    reverb_normalize(ir, ir + frames, frames);
+    const char* base = strrchr(source, '/');
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : source);
+    Reverb* reverb =
+        reverb_make(ir, ir + frames, frames, sample_rate, wait, name);
+    free(ir);
+    return reverb;
+}
+
+// after the audio thread is done with it
+void reverb_free(Reverb* reverb) {
+    if (reverb->tail.count) {
+        __atomic_store_n(&reverb->quit, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&reverb->posted, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex,
+                &reverb->posted,
+                FUTEX_WAKE_PRIVATE,
+                INT32_MAX,
+                NULL,
+                NULL,
+                0);
+        pthread_join(reverb->thread, NULL);
+        reverb_segment_free(&reverb->tail);
+    }
+    reverb_segment_free(&reverb->head);
+    free(reverb);
+}
+
+//-----------------------------------------------------------------------------
+// audio thread and workers
+//-----------------------------------------------------------------------------
+
+// 1 if the chunk's tail is in. Only an offline render waits, and it
+// sleeps on done the way the tail thread sleeps on posted
+uint8_t reverb_tail_ready(Reverb* reverb, uint32_t chunk) {
+    uint32_t slot = chunk % reverb_tail_slots;
+    if (__atomic_load_n(&reverb->tags[slot], __ATOMIC_ACQUIRE) == chunk + 1)
+        return 1;
+    if (!reverb->wait) {
+        __atomic_store_n(
+            &reverb->late_chunks, reverb->late_chunks + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    for (;;) {
+        __atomic_store_n(&reverb->host_sleeping, 1, __ATOMIC_SEQ_CST);
+        uint32_t done = __atomic_load_n(&reverb->done, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reverb->tags[slot], __ATOMIC_ACQUIRE) !=
+            chunk + 1) {
+            syscall(SYS_futex,
+                    &reverb->done,
+                    FUTEX_WAIT_PRIVATE,
+                    done,
+                    NULL,
+                    NULL,
+                    0);
+        }
+        __atomic_store_n(&reverb->host_sleeping, 0, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reverb->tags[slot], __ATOMIC_ACQUIRE) ==
+            chunk + 1)
+            return 1;
+    }
+}
+
+// n frames that stay inside one head partition, so inside one chunk: the
+// input goes to the tail thread, and the tail's output for these frames,
+// computed from input at least reverb_tail_start frames old, is added
+void reverb_tail(Reverb* reverb,
+                 const MixKernels* k,
+                 const float* left,
+                 const float* right,
+                 float* out_left,
+                 float* out_right,
+                 uint32_t n) {
+    uint64_t at = reverb->frame;
+    uint32_t chunk = (uint32_t)(at / reverb_tail_frames);
+    uint32_t offset = (uint32_t)(at % reverb_tail_frames);
+    uint32_t slot = chunk % reverb_tail_slots;
+    memcpy(reverb->tail_in[slot][0] + offset, left, sizeof(float) * n);
+    memcpy(reverb->tail_in[slot][1] + offset, right, sizeof(float) * n);
+    if (offset + n == reverb_tail_frames) {
+        __atomic_store_n(&reverb->posted, chunk + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reverb->tail_sleeping, __ATOMIC_SEQ_CST)) {
+            syscall(SYS_futex,
+                    &reverb->posted,
+                    FUTEX_WAKE_PRIVATE,
+                    1,
+                    NULL,
+                    NULL,
+                    0);
+        }
+    }
+    if (at < reverb_tail_start) return;
+    uint64_t play = at - reverb_tail_start;
+    chunk = (uint32_t)(play / reverb_tail_frames);
+    offset = (uint32_t)(play % reverb_tail_frames);
+    // decided once a chunk, so a chunk plays whole or not at all
+    if (!offset) reverb->playing = reverb_tail_ready(reverb, chunk);
+    if (!reverb->playing) return;
+    slot = chunk % reverb_tail_slots;
+    k->add(out_left, reverb->tail_out[slot][0] + offset, 1.0f, n);
+    k->add(out_right, reverb->tail_out[slot][1] + offset, 1.0f, n);
+}
+
+// any number of frames, split where head partitions end
+void reverb_process(Reverb* reverb,
+                    const MixKernels* k,
+                    const float* left,
+                    const float* right,
+                    float* out_left,
+                    float* out_right,
+                    uint32_t frames) {
+    ReverbSegment* head = &reverb->head;
+    uint32_t done = 0;
+    while (done < frames) {
+        uint32_t n = head->size - head->fill;
+        if (n > frames - done) n = frames - done;
+        reverb_segment_push(head,
+                            k,
+                            left + done,
+                            right + done,
+                            out_left + done,
+                            out_right + done,
+                            n);
+        if (head->fill == head->size) reverb_segment_advance(head, k);
+        if (reverb->tail.count) {
+            reverb_tail(reverb,
+                        k,
+                        left + done,
+                        right + done,
+                        out_left + done,
+                        out_right + done,
+                        n);
+        }
+        reverb->frame += n;
+        done += n;
+    }
+}
+
+// graph node: the inputs summed dry, the output all wet
+void reverb_node(void* state,
+                 AudioGraph* graph,
+                 uint32_t node,
+                 uint32_t frames) {
+    Reverb* reverb = state;
+    graph_gather(
+        graph, node, reverb->in_left, reverb->in_right, 1.0f, frames);
+    reverb_process(reverb,
+                   graph->kernels,
+                   reverb->in_left,
+                   reverb->in_right,
+                   graph_left(graph, node),
+                   graph_right(graph, node),
+                   frames);
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+// the threaded path against a direct convolution in double, fed in
+// uneven pieces; then the work per block of each segment for several
+// long responses, against one uniform partitioning at the block size
+void reverb_bench_run(void) {
+    header("reverb_bench_run");
+
+    enum {
+        check_ir_frames = 30000,
+        check_frames = 40000,
+        check_every = 37,
+        bench_reverbs = 4,
+        bench_seconds = 4,
+        bench_blocks = 2000,
+    };
+    MixKernels kernels;
+    mix_select(&kernels);
+
+    float* ir = malloc(sizeof(float) * 2 * check_ir_frames);
+    float* in = malloc(sizeof(float) * 2 * check_frames);
+    float* out = malloc(sizeof(float) * 2 * check_frames);
+    assert(ir && in && out);
+    reverb_generate(ir, ir + check_ir_frames, check_ir_frames, 777);
+    reverb_normalize(ir, ir + check_ir_frames, check_ir_frames);
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < 2 * check_frames; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        in[i] = ((seed >> 8) / 8388608.0f - 1.0f) * 0.5f;
+    }
+    Reverb* reverb = reverb_make(ir,
+                                 ir + check_ir_frames,
+                                 check_ir_frames,
+                                 audio_sample_rate,
+                                 1,
+                                 "check");
+    const uint32_t pieces[] = {128, 61, 300, 1, 2048, 7, 1000};
+    uint32_t done = 0;
+    for (uint32_t p = 0; done < check_frames; p++) {
+        uint32_t n = pieces[p % (sizeof(pieces) / sizeof(pieces[0]))];
+        if (n > check_frames - done) n = check_frames - done;
+        reverb_process(reverb,
+                       &kernels,
+                       in + done,
+                       in + check_frames + done,
+                       out + done,
+                       out + check_frames + done,
+                       n);
+        done += n;
+    }
+    double worst = 0.0;
+    double power = 0.0;
+    uint32_t checked = 0;
+    for (uint32_t c = 0; c < 2; c++) {
+        const float* x = in + c * check_frames;
+        const float* h = ir + c * check_ir_frames;
+        const float* y = out + c * check_frames;
+        for (uint32_t i = 0; i < check_frames; i += check_every) {
+            double sum = 0.0;
+            for (uint32_t j = 0; j <= i && j < check_ir_frames; j++)
+                sum += (double)x[i - j] * h[j];
+            double d = fabs(sum - y[i]);
+            worst = d > worst ? d : worst;
+            power += sum * sum;
+            checked++;
+        }
+    }
+    printf("reverb %.2f s response, uneven pieces: max error %.2g (%.1f dB "
+           "under the output), %" PRIu64 " late chunks\n",
+           (double)check_ir_frames / audio_sample_rate,
+           worst,
+           20.0 * log10(sqrt(power / checked) / (worst > 0 ? worst : 1e-30)),
+           reverb->late_chunks);
+    reverb_free(reverb);
+    free(ir);
+    free(out);
+
+    // each segment timed on this thread, as its own thread would run it
+    uint64_t frames = (uint64_t)bench_seconds * audio_sample_rate;
+    ir = malloc(sizeof(float) * 2 * frames);
+    assert(ir);
+    ReverbSegment* heads = malloc(sizeof(ReverbSegment) * bench_reverbs);
+    ReverbSegment* tails = malloc(sizeof(ReverbSegment) * bench_reverbs);
+    assert(heads && tails);
+    for (uint32_t r = 0; r < bench_reverbs; r++) {
+        reverb_generate(ir, ir + frames, frames, 1000 + r);
+        reverb_normalize(ir, ir + frames, frames);
+        reverb_segment_make(&heads[r],
+                            ir,
+                            ir + frames,
+                            frames,
+                            0,
+                            reverb_head_frames,
+                            reverb_head_count);
+        reverb_segment_make(
+            &tails[r],
+            ir,
+            ir + frames,
+            frames,
+            reverb_tail_start,
+            reverb_tail_frames,
+            (uint32_t)((frames - reverb_tail_start + reverb_tail_frames - 1) /
+                       reverb_tail_frames));
+    }
+    float* scratch = malloc(sizeof(float) * 2 * reverb_tail_frames);
+    assert(scratch);
+    uint32_t block = reverb_head_frames;
+    double t0 = mix_bench_seconds();
+    for (uint32_t b = 0; b < bench_blocks; b++) {
+        uint32_t at = (b * block) % (check_frames - block);
+        for (uint32_t r = 0; r < bench_reverbs; r++) {
+            reverb_segment_push(&heads[r],
+                                &kernels,
+                                in + at,
+                                in + check_frames + at,
+                                scratch,
+                                scratch + block,
+                                block);
+            reverb_segment_advance(&heads[r], &kernels);
+        }
+    }
+    double head_us = (mix_bench_seconds() - t0) * 1e6 / bench_blocks;
+    uint32_t chunks = bench_blocks / reverb_tail_ratio;
+    t0 = mix_bench_seconds();
+    for (uint32_t b = 0; b < chunks; b++) {
+        uint32_t at = (b * reverb_tail_frames) %
+                      (check_frames - reverb_tail_frames);
+        for (uint32_t r = 0; r < bench_reverbs; r++) {
+            reverb_segment_push(&tails[r],
+                                &kernels,
+                                in + at,
+                                in + check_frames + at,
+                                scratch,
+                                scratch + reverb_tail_frames,
+                                reverb_tail_frames);
+            reverb_segment_advance(&tails[r], &kernels);
+        }
+    }
+    double tail_us = (mix_bench_seconds() - t0) * 1e6 / chunks;
+    double block_us = 1e6 * block / audio_sample_rate;
+    double chunk_us = 1e6 * reverb_tail_frames / audio_sample_rate;
+    // complex products per frame per side, for one response
+    double uniform = (double)((frames + block - 1) / block) * (block + 1) /
+                     block;
+    double split =
+        (double)reverb_head_count * (block + 1) / block +
+        (double)tails[0].count * (reverb_tail_frames + 1) / reverb_tail_frames;
+    printf("reverb %u x %u s, %s: graph %.1f us per %u-frame block (%.1f%%), "
+           "tail thread %.1f us per %u-frame chunk (%.1f%%)\n",
+           bench_reverbs,
+           bench_seconds,
+           kernels.name,
+           head_us,
+           block,
+           100.0 * head_us / block_us,
+           tail_us,
+           reverb_tail_frames,
+           100.0 * tail_us / chunk_us);
+    printf("reverb products per frame for one: %.0f split, %.0f uniform at "
+           "%u frames, no added latency either way\n",
+           split,
+           uniform,
+           block);
+    for (uint32_t r = 0; r < bench_reverbs; r++) {
+        reverb_segment_free(&heads[r]);
+        reverb_segment_free(&tails[r]);
+    }
+    free(heads);
+    free(tails);
+    free(scratch);
+    free(ir);
+    free(in);
+    end("reverb_bench_run");
+}
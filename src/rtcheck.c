@@ -0,0 +1,149 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/rtcheck.c
+//=============================================================================
+
+// RT_CHECK=1 builds replace the allocator and pthread_mutex_lock for the
+// whole process, and report every call made on a real-time thread (any
+// thread named war-rt-*) with its stack. WAR_RT_CHECK_ABORT=1 aborts on
+// the first one instead, for a core to look at. The thread is told apart
+// by its name so no state is needed: a prctl per call is fine for a debug
+// build
+
+#if RT_CHECK
+
+#include "rtcheck.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+enum {
+    rtcheck_frames = 32,
+};
+
+// glibc's own entry points, which it provides for replacing malloc
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+
+uint8_t rtcheck_thread(void) {
+    char name[16] = {0};
+    if (prctl(PR_GET_NAME, name) != 0) return 0;
+    return strncmp(name, "war-rt-", 7) == 0;
+}
+
+// nothing here allocates: backtrace was primed at startup and the
+// symbols go straight to the fd
+void rtcheck_report(const char* call, size_t size) {
+    char name[16] = {0};
+    prctl(PR_GET_NAME, name);
+    char line[128];
+    int n = snprintf(
+        line, sizeof(line), "rt check: %s(%zu) on %s\n", call, size, name);
+    if (n > 0) write(STDERR_FILENO, line, (size_t)n);
+    void* frames[rtcheck_frames];
+    int depth = backtrace(frames, rtcheck_frames);
+    backtrace_symbols_fd(frames + 1, depth - 1, STDERR_FILENO);
+    const char* fatal = getenv("WAR_RT_CHECK_ABORT");
+    if (fatal && fatal[0] == '1') abort();
+}
+
+// the real lock. The one global in the tree: an interposed symbol has no
+// caller to hand it state. Set at startup, or by a lock taken before that
+int (*rtcheck_mutex_lock)(pthread_mutex_t*);
+
+int (*rtcheck_resolve_mutex_lock(void))(pthread_mutex_t*) {
+    int (*lock)(pthread_mutex_t*) =
+        (int (*)(pthread_mutex_t*))dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    assert(lock);
+    __atomic_store_n(&rtcheck_mutex_lock, lock, __ATOMIC_RELEASE);
+    return lock;
+}
+
+// the first backtrace loads libgcc, which allocates
+__attribute__((constructor)) void rtcheck_init(void) {
+    void* frame;
+    backtrace(&frame, 1);
+    if (!__atomic_load_n(&rtcheck_mutex_lock, __ATOMIC_ACQUIRE))
+        rtcheck_resolve_mutex_lock();
+    call_carmack("rt check: reporting allocations and locks on war-rt-*");
+}
+
+void* malloc(size_t size) {
+    if (rtcheck_thread()) rtcheck_report("malloc", size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (rtcheck_thread()) rtcheck_report("calloc", count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    if (rtcheck_thread()) rtcheck_report("realloc", size);
+    return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    if (rtcheck_thread()) rtcheck_report("memalign", size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    if (rtcheck_thread()) rtcheck_report("aligned_alloc", size);
+    return __libc_memalign(alignment, size);
+}
+
+// libc's contract: a power of two and a multiple of a pointer, or EINVAL
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+    if (rtcheck_thread()) rtcheck_report("posix_memalign", size);
+    if (!alignment || alignment % sizeof(void*) ||
+        (alignment & (alignment - 1)))
+        return EINVAL;
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer ? 0 : ENOMEM;
+}
+
+void free(void* pointer) {
+    if (pointer && rtcheck_thread()) rtcheck_report("free", 0);
+    __libc_free(pointer);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    if (rtcheck_thread()) rtcheck_report("pthread_mutex_lock", 0);
+    int (*lock)(pthread_mutex_t*) =
+        __atomic_load_n(&rtcheck_mutex_lock, __ATOMIC_ACQUIRE);
+    if (!lock) lock = rtcheck_resolve_mutex_lock();
+    return lock(mutex);
+}
+
+#endif // RT_CHECK
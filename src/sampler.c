@@ -0,0 +1,377 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/sampler.c
+//=============================================================================
+
+#include "sampler.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "mix.h"
+#include "resample.h"
+#include "waveform.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// clips stream from mapped files into per-stream rings on an io thread.
+// The audio thread only ever reads rings, so a cold page costs the io
+// thread a fault, never the audio thread; a ring that runs dry plays
+// silence and is counted in underruns
+
+Sampler* sampler_make(void) {
+    Sampler* sampler = aligned_alloc(64, sizeof(Sampler));
+    assert(sampler);
+    memset(sampler, 0, sizeof(Sampler));
+    for (uint32_t i = 0; i < sampler_max_clips; i++)
+        sampler->clip_stream[i] = UINT32_MAX;
+    sampler->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    mix_select(&sampler->kernels);
+    return sampler;
+}
+
+// maps the file and parses the header; no sample data is read. A file at
+// another rate is converted once, at import, and its converted copy mapped
+// instead, so streams never resample
+uint32_t sampler_open_file(Sampler* sampler, const char* path) {
+    if (sampler->file_count == sampler_max_files) return UINT32_MAX;
+    SampleFile* file = &sampler->files[sampler->file_count];
+    const void* data = waveform_map_wav(path,
+                                        &file->map_size,
+                                        &file->map,
+                                        &file->channels,
+                                        &file->bits,
+                                        &file->sample_rate,
+                                        &file->frames);
+    if (!data) {
+        call_carmack("sampler: %s is not PCM16 or float32 WAV", path);
+        return UINT32_MAX;
+    }
+    char converted[resample_max_path];
+    if (file->sample_rate != audio_sample_rate &&
+        resample_cached(
+            path, converted, sizeof(converted), audio_sample_rate)) {
+        munmap(file->map, file->map_size);
+        data = waveform_map_wav(converted,
+                                &file->map_size,
+                                &file->map,
+                                &file->channels,
+                                &file->bits,
+                                &file->sample_rate,
+                                &file->frames);
+        if (!data) return UINT32_MAX;
+    }
+    file->data = data;
+    // the kernel's own readahead would fault in far more than a ring holds,
+    // and under mlockall every page read would stay resident
+    madvise(file->map, file->map_size, MADV_RANDOM);
+    munlock(file->map, file->map_size);
+    return sampler->file_count++;
+}
+
+// UI side, before or during playback; clamped to the file
+uint8_t sampler_add_clip(Sampler* sampler,
+                         uint32_t file,
+                         uint64_t start,
+                         uint64_t offset,
+                         uint64_t length,
+                         float gain) {
+    uint32_t count = __atomic_load_n(&sampler->clip_count, __ATOMIC_RELAXED);
+    if (count == sampler_max_clips || file >= sampler->file_count) return 0;
+    uint64_t frames = sampler->files[file].frames;
+    if (offset >= frames) return 0;
+    if (length > frames - offset) length = frames - offset;
+    sampler->clips[count] = (SamplerClip){
+        .file = file,
+        .start = start,
+        .offset = offset,
+        .length = length,
+        .gain = gain,
+    };
+    __atomic_store_n(&sampler->clip_count, count + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// io thread
+//-----------------------------------------------------------------------------
+
+// planar float from any supported layout; extra channels are ignored.
+// scratch holds frames * 2 floats
+void sampler_read_frames(const MixKernels* k,
+                         const SampleFile* file,
+                         uint64_t frame,
+                         uint32_t frames,
+                         float* scratch,
+                         float* left,
+                         float* right) {
+    uint32_t channels = file->channels;
+    if (file->bits == 16) {
+        const int16_t* in = (const int16_t*)file->data + frame * channels;
+        if (channels == 1) {
+            k->from_s16(in, left, frames);
+            memcpy(right, left, sizeof(float) * frames);
+        } else if (channels == 2) {
+            k->from_s16(in, scratch, frames * 2);
+            k->deinterleave(scratch, left, right, frames);
+        } else {
+            for (uint32_t i = 0; i < frames; i++) {
+                left[i] = in[i * channels + 0] * (1.0f / 32768.0f);
+                right[i] = in[i * channels + 1] * (1.0f / 32768.0f);
+            }
+        }
+    } else {
+        const float* in = (const float*)file->data + frame * channels;
+        if (channels == 1) {
+            memcpy(left, in, sizeof(float) * frames);
+            memcpy(right, in, sizeof(float) * frames);
+        } else if (channels == 2) {
+            k->deinterleave(in, left, right, frames);
+        } else {
+            for (uint32_t i = 0; i < frames; i++) {
+                left[i] = in[i * channels + 0];
+                right[i] = in[i * channels + 1];
+            }
+        }
+    }
+}
+
+// tops the ring up, then unmaps what the audio thread has consumed and
+// asks for the next stretch of the file ahead of time
+void sampler_fill(Sampler* sampler, SamplerStream* stream) {
+    const SamplerClip* clip = &sampler->clips[stream->clip];
+    const SampleFile* file = &sampler->files[clip->file];
+    uint64_t skip = stream->start - clip->start;
+    uint64_t first = clip->offset + skip;
+    uint64_t total = clip->length - skip;
+    uint64_t read = __atomic_load_n(&stream->read, __ATOMIC_ACQUIRE);
+    uint64_t write = stream->write;
+    // the audio thread got ahead of us: what it passed is not needed
+    if (read > write) write = read;
+    uint8_t wrote = 0;
+    while (write < total && write - read < sampler_ring_frames) {
+        uint64_t at = write & (sampler_ring_frames - 1);
+        uint64_t n = total - write;
+        uint64_t space = sampler_ring_frames - (write - read);
+        n = n < space ? n : space;
+        n = n < sampler_chunk_frames ? n : sampler_chunk_frames;
+        n = n < sampler_ring_frames - at ? n : sampler_ring_frames - at;
+        sampler_read_frames(&sampler->kernels,
+                            file,
+                            first + write,
+                            (uint32_t)n,
+                            sampler->scratch,
+                            stream->left + at,
+                            stream->right + at);
+        write += n;
+        __atomic_store_n(&stream->write, write, __ATOMIC_RELEASE);
+        wrote = 1;
+    }
+    if (write != stream->write) {
+        __atomic_store_n(&stream->write, write, __ATOMIC_RELEASE);
+    }
+
+    size_t frame_bytes = file->channels * (file->bits / 8);
+    size_t data_offset = (size_t)(file->data - (const uint8_t*)file->map);
+    size_t mask = ~(sampler->page_size - 1);
+    size_t consumed = (data_offset + (first + read) * frame_bytes) & mask;
+    if (consumed > stream->released) {
+        madvise((uint8_t*)file->map + stream->released,
+                consumed - stream->released,
+                MADV_DONTNEED);
+        stream->released = consumed;
+    }
+    if (wrote && write < total) {
+        size_t ahead = (data_offset + (first + write) * frame_bytes) & mask;
+        size_t length = sampler_chunk_frames * 4 * frame_bytes;
+        if (ahead < file->map_size) {
+            if (length > file->map_size - ahead)
+                length = file->map_size - ahead;
+            madvise((uint8_t*)file->map + ahead, length, MADV_WILLNEED);
+        }
+    }
+}
+
+// one pass of the io thread: recycle finished streams, start streams for
+// clips within a ring's length of the transport, top every ring up
+void sampler_service(Sampler* sampler) {
+    for (uint32_t s = 0; s < sampler_max_streams; s++) {
+        SamplerStream* stream = &sampler->streams[s];
+        if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) !=
+            sampler_stream_done)
+            continue;
+        sampler->clip_stream[stream->clip] = UINT32_MAX;
+        stream->state = sampler_stream_idle;
+    }
+
+    uint64_t transport = __atomic_load_n(&sampler->transport, __ATOMIC_ACQUIRE);
+    uint32_t clips = __atomic_load_n(&sampler->clip_count, __ATOMIC_ACQUIRE);
+    uint32_t next_idle = 0;
+    for (uint32_t c = 0; c < clips; c++) {
+        const SamplerClip* clip = &sampler->clips[c];
+        if (sampler->clip_stream[c] != UINT32_MAX) continue;
+        if (clip->start + clip->length <= transport) continue;
+        if (clip->start >= transport + sampler_ring_frames) continue;
+        while (next_idle < sampler_max_streams &&
+               sampler->streams[next_idle].state != sampler_stream_idle)
+            next_idle++;
+        if (next_idle == sampler_max_streams) break;
+        SamplerStream* stream = &sampler->streams[next_idle];
+        const SampleFile* file = &sampler->files[clip->file];
+        stream->clip = c;
+        // after a seek into the clip, start where the transport is
+        stream->start = clip->start > transport ? clip->start : transport;
+        stream->write = 0;
+        stream->read = 0;
+        size_t frame_bytes = file->channels * (file->bits / 8);
+        size_t data_offset = (size_t)(file->data - (const uint8_t*)file->map);
+        stream->released =
+            (data_offset +
+             (clip->offset + stream->start - clip->start) * frame_bytes) &
+            ~(sampler->page_size - 1);
+        sampler_fill(sampler, stream);
+        __atomic_store_n(&stream->state, sampler_stream_live, __ATOMIC_RELEASE);
+        sampler->clip_stream[c] = next_idle;
+    }
+
+    for (uint32_t s = 0; s < sampler_max_streams; s++) {
+        SamplerStream* stream = &sampler->streams[s];
+        if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) ==
+            sampler_stream_live)
+            sampler_fill(sampler, stream);
+    }
+}
+
+void* sampler_thread(void* arg) {
+    Sampler* sampler = arg;
+    struct timespec period = {0, sampler_io_period_ns};
+    while (__atomic_load_n(&sampler->running, __ATOMIC_ACQUIRE)) {
+        sampler_service(sampler);
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+// normal priority on purpose: it may block on the disk
+void sampler_start(Sampler* sampler) {
+    header("sampler_start");
+    __atomic_store_n(&sampler->running, 1, __ATOMIC_RELEASE);
+    int res = pthread_create(&sampler->thread, NULL, sampler_thread, sampler);
+    assert(res == 0);
+    (void)res;
+    end("sampler_start");
+}
+
+// stops the io thread if it runs; the audio thread must be done with it
+void sampler_free(Sampler* sampler) {
+    if (__atomic_load_n(&sampler->running, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&sampler->running, 0, __ATOMIC_RELEASE);
+        pthread_join(sampler->thread, NULL);
+    }
+    for (uint32_t i = 0; i < sampler->file_count; i++)
+        munmap(sampler->files[i].map, sampler->files[i].map_size);
+    free(sampler);
+}
+
+//-----------------------------------------------------------------------------
+// audio thread
+//-----------------------------------------------------------------------------
+
+// every block, playing or not; a jump in the transport retires all streams
+// so the io thread restarts them at the new position
+void sampler_locate(Sampler* sampler, uint64_t frame) {
+    if (frame == sampler->expected) return;
+    sampler->expected = frame;
+    __atomic_store_n(&sampler->transport, frame, __ATOMIC_RELEASE);
+    for (uint32_t s = 0; s < sampler_max_streams; s++) {
+        SamplerStream* stream = &sampler->streams[s];
+        if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) ==
+            sampler_stream_live)
+            __atomic_store_n(
+                &stream->state, sampler_stream_done, __ATOMIC_RELEASE);
+    }
+}
+
+// adds [frame, frame + frames) of every live stream onto the bus
+void sampler_render(Sampler* sampler,
+                    const MixKernels* k,
+                    uint64_t frame,
+                    uint32_t frames,
+                    float* left,
+                    float* right) {
+    uint64_t block_end = frame + frames;
+    sampler->expected = block_end;
+    // published before any stream is marked done, so the io thread never
+    // restarts a clip that just ended
+    __atomic_store_n(&sampler->transport, block_end, __ATOMIC_RELEASE);
+    for (uint32_t s = 0; s < sampler_max_streams; s++) {
+        SamplerStream* stream = &sampler->streams[s];
+        if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) !=
+            sampler_stream_live)
+            continue;
+        const SamplerClip* clip = &sampler->clips[stream->clip];
+        uint64_t clip_end = clip->start + clip->length;
+        uint64_t from = frame > stream->start ? frame : stream->start;
+        uint64_t to = block_end < clip_end ? block_end : clip_end;
+        if (from < to) {
+            uint64_t read = stream->read;
+            if (from - stream->start > read) read = from - stream->start;
+            uint64_t write = __atomic_load_n(&stream->write, __ATOMIC_ACQUIRE);
+            uint32_t n = (uint32_t)(to - from);
+            uint64_t available = write > read ? write - read : 0;
+            uint32_t m = n < available ? n : (uint32_t)available;
+            uint32_t at = (uint32_t)(read & (sampler_ring_frames - 1));
+            uint32_t first = m < sampler_ring_frames - at
+                                 ? m
+                                 : sampler_ring_frames - at;
+            float* l = left + (from - frame);
+            float* r = right + (from - frame);
+            k->add(l, stream->left + at, clip->gain, first);
+            k->add(r, stream->right + at, clip->gain, first);
+            k->add(l + first, stream->left, clip->gain, m - first);
+            k->add(r + first, stream->right, clip->gain, m - first);
+            sampler->underruns += n - m;
+            __atomic_store_n(&stream->read, read + n, __ATOMIC_RELEASE);
+        }
+        if (block_end >= clip_end) {
+            __atomic_store_n(
+                &stream->state, sampler_stream_done, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// WAR_AUDIO=<file.wav> plays at the timeline origin, where the waveform
+// clip is drawn
+void sampler_load_env_clip(Sampler* sampler) {
+    const char* path = getenv("WAR_AUDIO");
+    if (!path) return;
+    uint32_t file = sampler_open_file(sampler, path);
+    if (file == UINT32_MAX) return;
+    if (sampler->files[file].sample_rate != audio_sample_rate) {
+        call_carmack("sampler: %s is %u Hz and could not be converted",
+                     path,
+                     sampler->files[file].sample_rate);
+    }
+    sampler_add_clip(
+        sampler, file, 0, 0, sampler->files[file].frames, 1.0f);
+}
@@ -0,0 +1,546 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/sandbox.c
+//=============================================================================
+
+#include "sandbox.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "graph.h"
+#include "macros.h"
+#include "mix.h"
+#include "plugin.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <math.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// plugins in child processes. The child is this binary again, started
+// with WAR_SANDBOX_FD naming its end of a socketpair; the memfd for the
+// shared page goes over that socket with SCM_RIGHTS, the way wl_shm pools
+// reach the compositor. After setup the socket is idle: a block is the
+// host gathering straight into the shared input, one store and maybe one
+// FUTEX_WAKE each way, and the output copied into the graph
+
+//-----------------------------------------------------------------------------
+// host side, UI thread
+//-----------------------------------------------------------------------------
+
+// on one core the other side cannot run while this one spins
+uint32_t sandbox_spin(void) {
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? sandbox_spin_iterations : 0;
+}
+
+// id NULL takes the library's first plugin. NULL when the child cannot
+// be started or the plugin does not load in it
+SandboxPlugin* sandbox_load(const char* path,
+                            const char* id,
+                            uint32_t sample_rate,
+                            uint32_t max_frames) {
+    header("sandbox_load");
+
+    assert(max_frames <= audio_max_block_frames);
+    SandboxPlugin* sandbox = calloc(1, sizeof(SandboxPlugin));
+    assert(sandbox);
+    sandbox->socket = -1;
+    sandbox->sample_rate = sample_rate;
+    sandbox->spin = sandbox_spin();
+    // WAR_SANDBOX_BUDGET: percent of a block, 1 to 100
+    const char* budget = getenv("WAR_SANDBOX_BUDGET");
+    sandbox->budget_percent =
+        budget ? (uint32_t)strtoul(budget, NULL, 10) : sandbox_budget_percent;
+    if (sandbox->budget_percent < 1 || sandbox->budget_percent > 100)
+        sandbox->budget_percent = sandbox_budget_percent;
+    int memfd = -1;
+    int sockets[2] = {-1, -1};
+    char** env = NULL;
+
+    memfd = syscall(SYS_memfd_create, "war-sandbox", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, sizeof(SandboxShared)) < 0) {
+        perror("sandbox: memfd");
+        goto fail;
+    }
+    sandbox->shared = mmap(NULL,
+                           sizeof(SandboxShared),
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED,
+                           memfd,
+                           0);
+    if (sandbox->shared == MAP_FAILED) {
+        sandbox->shared = NULL;
+        perror("sandbox: mmap");
+        goto fail;
+    }
+    memset(sandbox->shared, 0, sizeof(SandboxShared));
+    mlock(sandbox->shared, sizeof(SandboxShared));
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0) {
+        perror("sandbox: socketpair");
+        goto fail;
+    }
+    // only the child's end survives the exec
+    fcntl(sockets[1], F_SETFD, 0);
+    uint32_t env_count = 0;
+    while (environ[env_count]) env_count++;
+    env = malloc(sizeof(char*) * (env_count + 2));
+    assert(env);
+    char fd_var[32];
+    snprintf(fd_var, sizeof(fd_var), "WAR_SANDBOX_FD=%d", sockets[1]);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < env_count; i++) {
+        if (strncmp(environ[i], "WAR_SANDBOX_FD=", 15))
+            env[kept++] = environ[i];
+    }
+    env[kept++] = fd_var;
+    env[kept] = NULL;
+    char* argv[] = {"war-sandbox", NULL};
+    int res = posix_spawn(
+        &sandbox->pid, "/proc/self/exe", NULL, NULL, argv, env);
+    close(sockets[1]);
+    sockets[1] = -1;
+    free(env);
+    env = NULL;
+    if (res) {
+        fprintf(stderr, "sandbox: spawn: %s\n", strerror(res));
+        sandbox->pid = 0;
+        goto fail;
+    }
+    sandbox->socket = sockets[0];
+    sockets[0] = -1;
+
+    SandboxSetup setup = {
+        .sample_rate = sample_rate,
+        .max_frames = max_frames,
+    };
+    snprintf(setup.path, sizeof(setup.path), "%s", path);
+    snprintf(setup.id, sizeof(setup.id), "%s", id ? id : "");
+    struct iovec iov = {.iov_base = &setup, .iov_len = sizeof(setup)};
+    char cmsgbuf[CMSG_SPACE(sizeof(int))];
+    memset(cmsgbuf, 0, sizeof(cmsgbuf));
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf;
+    msg.msg_controllen = sizeof(cmsgbuf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    *((int*)CMSG_DATA(cmsg)) = memfd;
+    if (sendmsg(sandbox->socket, &msg, MSG_NOSIGNAL) != sizeof(setup)) {
+        perror("sandbox: sendmsg");
+        goto fail;
+    }
+    close(memfd);
+    memfd = -1;
+
+    SandboxReply reply = {0};
+    struct pollfd pfd = {.fd = sandbox->socket, .events = POLLIN};
+    if (poll(&pfd, 1, sandbox_setup_timeout_ms) != 1 ||
+        recv(sandbox->socket, &reply, sizeof(reply), 0) != sizeof(reply) ||
+        !reply.ok) {
+        fprintf(stderr, "sandbox: %s did not load in the child\n", path);
+        goto fail;
+    }
+    sandbox->latency = reply.latency;
+    memcpy(sandbox->name, reply.name, sizeof(sandbox->name));
+    sandbox->name[sandbox_max_name - 1] = 0;
+    call_carmack("sandbox: %s in pid %d, %u frames latency",
+                 sandbox->name,
+                 sandbox->pid,
+                 sandbox->latency);
+
+    end("sandbox_load");
+    return sandbox;
+
+fail:
+    if (memfd >= 0) close(memfd);
+    if (sockets[0] >= 0) close(sockets[0]);
+    if (sockets[1] >= 0) close(sockets[1]);
+    sandbox_free(sandbox);
+    end("sandbox_load");
+    return NULL;
+}
+
+// after the audio thread is done with it: asks the child to quit, and
+// kills it if it does not
+void sandbox_free(SandboxPlugin* sandbox) {
+    if (sandbox->pid > 0 && !sandbox->dead && sandbox->shared) {
+        SandboxShared* shared = sandbox->shared;
+        __atomic_store_n(&shared->quit, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&shared->request, 1, __ATOMIC_SEQ_CST);
+        syscall(
+            SYS_futex, &shared->request, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+    }
+    if (sandbox->pid > 0) {
+        int status;
+        pid_t reaped = 0;
+        for (uint32_t ms = 0; ms < sandbox_quit_timeout_ms; ms++) {
+            reaped = waitpid(sandbox->pid, &status, WNOHANG);
+            if (reaped) break;
+            struct timespec wait = {.tv_nsec = 1000000};
+            nanosleep(&wait, NULL);
+        }
+        if (!reaped) {
+            kill(sandbox->pid, SIGKILL);
+            waitpid(sandbox->pid, &status, 0);
+        }
+    }
+    if (sandbox->socket >= 0) close(sandbox->socket);
+    if (sandbox->shared) munmap(sandbox->shared, sizeof(SandboxShared));
+    free(sandbox);
+}
+
+// from the UI loop. 1 once the child has died; its node is silent from
+// then on and the session carries on without it
+uint8_t sandbox_idle(SandboxPlugin* sandbox) {
+    if (__atomic_load_n(&sandbox->dead, __ATOMIC_RELAXED)) return 1;
+    int status;
+    if (waitpid(sandbox->pid, &status, WNOHANG) != sandbox->pid) return 0;
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr,
+                "sandbox: %s died on signal %d\n",
+                sandbox->name,
+                WTERMSIG(status));
+    } else {
+        fprintf(stderr,
+                "sandbox: %s exited with %d\n",
+                sandbox->name,
+                WEXITSTATUS(status));
+    }
+    sandbox->pid = 0;
+    __atomic_store_n(&sandbox->dead, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// host side, audio thread and workers
+//-----------------------------------------------------------------------------
+
+uint64_t sandbox_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// 1 once done reaches request, 0 at the deadline. Spins first: a child
+// that is awake answers well inside the time a sleep and wake would take
+uint8_t sandbox_wait(SandboxShared* shared,
+                     uint32_t request,
+                     uint32_t spin,
+                     uint64_t deadline_ns) {
+    for (uint32_t i = 0; i < spin; i++) {
+        if (__atomic_load_n(&shared->done, __ATOMIC_ACQUIRE) == request)
+            return 1;
+        __builtin_ia32_pause();
+    }
+    for (;;) {
+        uint64_t now = sandbox_now_ns();
+        if (now >= deadline_ns) break;
+        struct timespec timeout = {
+            .tv_sec = (time_t)((deadline_ns - now) / 1000000000ull),
+            .tv_nsec = (long)((deadline_ns - now) % 1000000000ull),
+        };
+        __atomic_store_n(&shared->host_sleeping, 1, __ATOMIC_SEQ_CST);
+        uint32_t done = __atomic_load_n(&shared->done, __ATOMIC_SEQ_CST);
+        if (done != request) {
+            syscall(
+                SYS_futex, &shared->done, FUTEX_WAIT, done, &timeout, NULL, 0);
+        }
+        __atomic_store_n(&shared->host_sleeping, 0, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shared->done, __ATOMIC_ACQUIRE) == request)
+            return 1;
+    }
+    return __atomic_load_n(&shared->done, __ATOMIC_ACQUIRE) == request;
+}
+
+// graph node: inputs gathered into the shared page, the child woken if it
+// sleeps, and its answer waited for until budget_percent of the block has
+// gone since the graph started it. Nodes before this one have spent part
+// of it already, and the ones after need the rest
+void sandbox_node(void* state,
+                  AudioGraph* graph,
+                  uint32_t node,
+                  uint32_t frames) {
+    SandboxPlugin* sandbox = state;
+    SandboxShared* shared = sandbox->shared;
+    float* left = graph_left(graph, node);
+    float* right = graph_right(graph, node);
+    uint64_t deadline =
+        graph->block_start_ns + (uint64_t)frames * 10000000ull *
+                                    sandbox->budget_percent /
+                                    sandbox->sample_rate;
+    if (__atomic_load_n(&sandbox->dead, __ATOMIC_RELAXED) ||
+        sandbox_now_ns() >= deadline ||
+        __atomic_load_n(&shared->done, __ATOMIC_ACQUIRE) != sandbox->request)
+        goto silence;
+
+    graph_gather(graph, node, shared->in[0], shared->in[1], 1.0f, frames);
+    uint32_t count = sandbox->events ? *sandbox->event_count : 0;
+    memcpy(shared->events, sandbox->events, sizeof(SequencerEvent) * count);
+    shared->event_count = count;
+    shared->frames = frames;
+    uint32_t request = ++sandbox->request;
+    __atomic_store_n(&shared->request, request, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->child_sleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &shared->request, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+    if (!sandbox_wait(shared, request, sandbox->spin, deadline))
+        goto silence;
+    memcpy(left, shared->out[0], sizeof(float) * frames);
+    memcpy(right, shared->out[1], sizeof(float) * frames);
+    return;
+
+silence:
+    sandbox->late_blocks++;
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+}
+
+//-----------------------------------------------------------------------------
+// child side
+//-----------------------------------------------------------------------------
+
+// main() of a WAR started with WAR_SANDBOX_FD: load the plugin, answer,
+// then serve blocks until told to quit. Dies with its parent
+void sandbox_child_run(void) {
+    header("sandbox_child_run");
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    int fd = (int)strtol(getenv("WAR_SANDBOX_FD"), NULL, 10);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    SandboxSetup setup;
+    struct iovec iov = {.iov_base = &setup, .iov_len = sizeof(setup)};
+    char cmsgbuf[CMSG_SPACE(sizeof(int))];
+    memset(cmsgbuf, 0, sizeof(cmsgbuf));
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf;
+    msg.msg_controllen = sizeof(cmsgbuf);
+    ssize_t got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (got != sizeof(setup) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "sandbox: bad setup\n");
+        end("sandbox_child_run");
+        return;
+    }
+    int memfd = *((int*)CMSG_DATA(cmsg));
+    SandboxShared* shared = mmap(NULL,
+                                 sizeof(SandboxShared),
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_SHARED,
+                                 memfd,
+                                 0);
+    close(memfd);
+    assert(shared != MAP_FAILED);
+    mlock(shared, sizeof(SandboxShared));
+    setup.path[sandbox_max_path - 1] = 0;
+    setup.id[sandbox_max_id - 1] = 0;
+
+    // no graph here: thread-pool tasks run on this thread
+    PluginInstance* instance = plugin_load(setup.path,
+                                           setup.id[0] ? setup.id : NULL,
+                                           setup.sample_rate,
+                                           setup.max_frames,
+                                           NULL);
+    SandboxReply reply = {.ok = instance != NULL};
+    if (instance) {
+        reply.latency = instance->latency;
+        snprintf(reply.name,
+                 sizeof(reply.name),
+                 "%s",
+                 instance->plugin->desc->name);
+    }
+    send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+    if (!instance) {
+        end("sandbox_child_run");
+        return;
+    }
+    instance->events = shared->events;
+    instance->event_count = &shared->event_count;
+
+    // the same standing as the graph workers it stands in for
+    struct sched_param param = {.sched_priority = sandbox_priority};
+    if (sched_setscheduler(0, SCHED_FIFO, &param) && errno != EPERM)
+        perror("sandbox: sched_setscheduler");
+    prctl(PR_SET_NAME, "war-rt-sandbox");
+
+    uint32_t spin = sandbox_spin();
+    uint32_t seen = 0;
+    for (;;) {
+        uint32_t request =
+            __atomic_load_n(&shared->request, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; request == seen && i < spin; i++) {
+            __builtin_ia32_pause();
+            request = __atomic_load_n(&shared->request, __ATOMIC_ACQUIRE);
+        }
+        if (request == seen) {
+            // child_sleeping and request are a dekker pair with the host
+            __atomic_store_n(&shared->child_sleeping, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&shared->request, __ATOMIC_SEQ_CST) == seen) {
+                syscall(SYS_futex,
+                        &shared->request,
+                        FUTEX_WAIT,
+                        seen,
+                        NULL,
+                        NULL,
+                        0);
+            }
+            __atomic_store_n(&shared->child_sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        seen = request;
+        if (__atomic_load_n(&shared->quit, __ATOMIC_ACQUIRE)) break;
+        plugin_process(instance,
+                       shared->in[0],
+                       shared->in[1],
+                       shared->out[0],
+                       shared->out[1],
+                       shared->frames);
+        __atomic_store_n(&shared->done, seen, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&shared->host_sleeping, __ATOMIC_SEQ_CST)) {
+            syscall(SYS_futex, &shared->done, FUTEX_WAKE, 1, NULL, NULL, 0);
+        }
+    }
+    plugin_free(instance);
+    munmap(shared, sizeof(SandboxShared));
+    close(fd);
+
+    end("sandbox_child_run");
+}
+
+//-----------------------------------------------------------------------------
+// benchmark
+//-----------------------------------------------------------------------------
+
+void sandbox_bench_source(void* state,
+                          AudioGraph* graph,
+                          uint32_t node,
+                          uint32_t frames) {
+    uint32_t* seed = state;
+    float* left = graph_left(graph, node);
+    float* right = graph_right(graph, node);
+    for (uint32_t i = 0; i < frames; i++) {
+        *seed = *seed * 1664525u + 1013904223u;
+        left[i] = (float)(int32_t)*seed / 2147483648.0f;
+        right[i] = -left[i];
+    }
+}
+
+// the same plugin in process and sandboxed, fed the same noise: the
+// difference per block is what the bridge costs, and the outputs match
+void sandbox_bench_run(void) {
+    header("sandbox_bench_run");
+
+    enum {
+        bench_blocks = 20000,
+        bench_block = audio_block_frames,
+    };
+    const char* path = getenv("WAR_PLUGIN");
+    if (!path) path = "build/plugins/war_test.clap";
+    PluginInstance* instance = plugin_load(
+        path, getenv("WAR_PLUGIN_ID"), audio_sample_rate, bench_block, NULL);
+    SandboxPlugin* sandbox = sandbox_load(
+        path, getenv("WAR_PLUGIN_ID"), audio_sample_rate, bench_block);
+    if (!instance || !sandbox) {
+        printf("sandbox: no %s, skipped\n", path);
+        if (instance) plugin_free(instance);
+        if (sandbox) sandbox_free(sandbox);
+        end("sandbox_bench_run");
+        return;
+    }
+
+    MixKernels kernels;
+    mix_select(&kernels);
+    GraphDesc* desc = malloc(sizeof(GraphDesc));
+    GraphPool* pool = aligned_alloc(64, sizeof(GraphPool));
+    assert(desc && pool);
+    memset(pool, 0, sizeof(GraphPool));
+    uint32_t seeds[2] = {1, 1};
+    AudioGraph* graphs[2];
+    for (uint32_t g = 0; g < 2; g++) {
+        graph_desc_init(desc);
+        uint32_t source = graph_add_node(
+            desc, sandbox_bench_source, &seeds[g], 1.0f, 1.0f);
+        desc->output = g ? graph_add_node(desc, sandbox_node, sandbox, 1, 1)
+                         : graph_add_node(desc, plugin_node, instance, 1, 1);
+        graph_connect(desc, source, desc->output);
+        graphs[g] = graph_compile(desc, bench_block, 1, &kernels);
+        assert(graphs[g]);
+    }
+
+    double avg[2], worst[2];
+    float error = 0.0f;
+    for (uint32_t g = 0; g < 2; g++) {
+        double total = 0.0;
+        worst[g] = 0.0;
+        for (uint32_t i = 0; i < bench_blocks; i++) {
+            uint64_t t0 = sandbox_now_ns();
+            graph_run(pool, graphs[g], bench_block);
+            double us = (sandbox_now_ns() - t0) / 1e3;
+            total += us;
+            worst[g] = us > worst[g] ? us : worst[g];
+        }
+        avg[g] = total / bench_blocks;
+    }
+    // both have seen the same input, so the last blocks are the same
+    for (uint32_t i = 0; i < bench_block; i++) {
+        float d = graph_left(graphs[0], 1)[i] - graph_left(graphs[1], 1)[i];
+        error = fabsf(d) > error ? fabsf(d) : error;
+    }
+    printf("sandbox %s, %u-frame blocks: in process avg %.2f us max %.2f "
+           "us, sandboxed avg %.2f us max %.2f us, bridge %.2f us per "
+           "block, %" PRIu64 " late, max diff %g\n",
+           sandbox->name,
+           bench_block,
+           avg[0],
+           worst[0],
+           avg[1],
+           worst[1],
+           avg[1] - avg[0],
+           sandbox->late_blocks,
+           error);
+
+    graph_free(graphs[0]);
+    graph_free(graphs[1]);
+    free(pool);
+    free(desc);
+    sandbox_free(sandbox);
+    plugin_free(instance);
+
+    end("sandbox_bench_run");
+}
@@ -0,0 +1,234 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/sequencer.c
+//=============================================================================
+
+#include "sequencer.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "notes.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// tempo map
+//-----------------------------------------------------------------------------
+
+// points sorted by tick, the first at tick 0; segment sample offsets are
+// integrated once here instead of per event
+void tempo_map_build(TempoMap* map,
+                     uint32_t sample_rate,
+                     const TempoPoint* points,
+                     uint32_t count) {
+    assert(count > 0 && count <= max_tempo_points);
+    assert(points[0].tick == 0);
+    map->sample_rate = sample_rate;
+    map->count = count;
+    map->cached = 0;
+    double sample = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) {
+            assert(points[i].tick > points[i - 1].tick);
+            const TempoSegment* prev = &map->segments[i - 1];
+            sample += (points[i].tick - prev->tick) * prev->samples_per_tick;
+        }
+        map->segments[i] = (TempoSegment){
+            .tick = points[i].tick,
+            .sample = sample,
+            .samples_per_tick =
+                sample_rate * 60.0 / (points[i].bpm * note_ticks_per_beat),
+        };
+    }
+}
+
+void tempo_map_constant(TempoMap* map, uint32_t sample_rate, float bpm) {
+    TempoPoint point = {.tick = 0, .bpm = bpm};
+    tempo_map_build(map, sample_rate, &point, 1);
+}
+
+// cached segment first, then its successor, then a binary search
+uint32_t tempo_map_find_tick(TempoMap* map, uint32_t tick) {
+    uint32_t i = map->cached;
+    const TempoSegment* s = map->segments;
+    if (s[i].tick <= tick && (i + 1 == map->count || s[i + 1].tick > tick))
+        return i;
+    if (i + 1 < map->count && s[i + 1].tick <= tick &&
+        (i + 2 == map->count || s[i + 2].tick > tick)) {
+        map->cached = i + 1;
+        return i + 1;
+    }
+    uint32_t lo = 0, hi = map->count - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (s[mid].tick <= tick) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    map->cached = lo;
+    return lo;
+}
+
+double tempo_map_tick_to_sample(TempoMap* map, uint32_t tick) {
+    const TempoSegment* s = &map->segments[tempo_map_find_tick(map, tick)];
+    return s->sample + (tick - s->tick) * s->samples_per_tick;
+}
+
+double tempo_map_sample_to_tick(const TempoMap* map, double sample) {
+    uint32_t lo = 0, hi = map->count - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (map->segments[mid].sample <= sample) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    const TempoSegment* s = &map->segments[lo];
+    return s->tick + (sample - s->sample) / s->samples_per_tick;
+}
+
+//-----------------------------------------------------------------------------
+// sequencer, audio thread
+//-----------------------------------------------------------------------------
+
+// the caller checks for room before its note on goes out
+void sequencer_push_off(Sequencer* seq, uint64_t sample, uint8_t pitch) {
+    assert(seq->off_count < max_pending_offs);
+    uint32_t i = seq->off_count++;
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (seq->offs[parent].sample <= sample) break;
+        seq->offs[i] = seq->offs[parent];
+        i = parent;
+    }
+    seq->offs[i] = (PendingOff){.sample = sample, .pitch = pitch};
+}
+
+PendingOff sequencer_pop_off(Sequencer* seq) {
+    PendingOff top = seq->offs[0];
+    PendingOff last = seq->offs[--seq->off_count];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= seq->off_count) break;
+        if (child + 1 < seq->off_count &&
+            seq->offs[child + 1].sample < seq->offs[child].sample)
+            child++;
+        if (last.sample <= seq->offs[child].sample) break;
+        seq->offs[i] = seq->offs[child];
+        i = child;
+    }
+    if (seq->off_count) seq->offs[i] = last;
+    return top;
+}
+
+void sequencer_emit(Sequencer* seq,
+                    uint32_t offset,
+                    uint8_t type,
+                    uint8_t pitch,
+                    uint8_t velocity) {
+    seq->events[seq->event_count++] = (SequencerEvent){
+        .offset = offset,
+        .type = type,
+        .pitch = pitch,
+        .velocity = velocity,
+    };
+}
+
+// pops offs due before limit; late ones land at the block start. One slot
+// is always kept for the note on that follows
+void sequencer_emit_offs(Sequencer* seq, uint64_t frame, uint64_t limit) {
+    while (seq->off_count && seq->offs[0].sample < limit &&
+           seq->event_count < max_block_events - 1) {
+        PendingOff due = sequencer_pop_off(seq);
+        uint64_t at = due.sample < frame ? frame : due.sample;
+        sequencer_emit(
+            seq, (uint32_t)(at - frame), sequencer_event_off, due.pitch, 0);
+    }
+}
+
+// pending offs are the caller's to release (stop, seek, new snapshot)
+void sequencer_reset(Sequencer* seq) {
+    seq->off_count = 0;
+    seq->event_count = 0;
+    seq->needs_seek = 1;
+    seq->deferred = 0;
+}
+
+// events for [frame, frame + frames) with sample offsets, in order; offs
+// first at equal offsets so a repeated pitch retriggers. Ons past the cap
+// are owed to the next block and play late at its start; an on whose off
+// has no room is dropped rather than left stuck
+void sequencer_collect(Sequencer* seq,
+                       TempoMap* map,
+                       uint64_t frame,
+                       uint32_t frames) {
+    seq->event_count = 0;
+    const NoteTrack* track = seq->track;
+    uint64_t block_end = frame + frames;
+
+    if (track && seq->needs_seek) {
+        double tick = tempo_map_sample_to_tick(map, (double)frame);
+        seq->next_note = notes_lower_bound(track, (uint32_t)floor(tick));
+        seq->needs_seek = 0;
+    }
+
+    uint32_t next = seq->next_note;
+    uint32_t count = track ? track->count : 0;
+    // leave room for the offs this block may pop
+    while (next < count && seq->event_count < max_block_events / 2) {
+        uint64_t on =
+            (uint64_t)tempo_map_tick_to_sample(map, track->start[next]);
+        if (on >= block_end) break;
+        if (on >= frame) {
+            seq->deferred = 0;
+        } else if (seq->deferred) {
+            on = frame;
+            __atomic_add_fetch(&seq->late_notes, 1, __ATOMIC_RELAXED);
+        }
+        if (on >= frame && !(track->flags[next] & note_flag_muted)) {
+            sequencer_emit_offs(seq, frame, on + 1);
+            if (seq->off_count < max_pending_offs) {
+                sequencer_emit(seq,
+                               (uint32_t)(on - frame),
+                               sequencer_event_on,
+                               track->pitch[next],
+                               track->velocity[next]);
+                uint64_t off = (uint64_t)tempo_map_tick_to_sample(
+                    map, track->start[next] + track->length[next]);
+                sequencer_push_off(seq, off, track->pitch[next]);
+            } else {
+                __atomic_add_fetch(
+                    &seq->dropped_notes, 1, __ATOMIC_RELAXED);
+            }
+        }
+        next++;
+    }
+    seq->next_note = next;
+    // stopped at the cap: whatever is left before block_end is owed
+    if (next < count && seq->event_count >= max_block_events / 2)
+        seq->deferred = 1;
+
+    sequencer_emit_offs(seq, frame, block_end);
+}
@@ -0,0 +1,66 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/shaders/waveform.frag.glsl
+//=============================================================================
+
+
+#version 450
+// min/max envelope with the rms body drawn brighter; the level is picked on
+// the cpu so one pixel column reads at most a handful of peaks
+layout(std430, set = 0, binding = 0) readonly buffer Peaks {
+    vec4 peaks[]; // min, max, rms, pad
+};
+layout(push_constant) uniform Push {
+    vec4 rect;
+    vec4 color;
+    vec2 target;
+    float first_peak;
+    float peaks_per_pixel;
+    uint level_offset;
+    uint level_count;
+} pc;
+layout(location = 0) out vec4 out_color;
+void main() {
+    float column = floor(gl_FragCoord.x - pc.rect.x);
+    float p0 = pc.first_peak + column * pc.peaks_per_pixel;
+    int i0 = int(floor(p0));
+    int i1 = max(i0 + 1, int(ceil(p0 + pc.peaks_per_pixel)));
+    i1 = min(min(i1, int(pc.level_count)), i0 + 8);
+    if (i0 < 0 || i0 >= i1) discard;
+    float lo = 1.0;
+    float hi = -1.0;
+    float sum = 0.0;
+    for (int i = i0; i < i1; i++) {
+        vec4 p = peaks[pc.level_offset + uint(i)];
+        lo = min(lo, p.x);
+        hi = max(hi, p.y);
+        sum += p.z * p.z;
+    }
+    float rms = sqrt(sum / float(i1 - i0));
+    float half_h = pc.rect.w * 0.5;
+    float v = (pc.rect.y + half_h - gl_FragCoord.y) / half_h;
+    // at least one pixel so silence still shows a line
+    float pixel = 1.0 / half_h;
+    if (abs(v) <= rms + pixel) {
+        out_color = pc.color;
+    } else if (v >= lo - pixel && v <= hi + pixel) {
+        out_color = vec4(pc.color.rgb, pc.color.a * 0.6);
+    } else {
+        discard;
+    }
+}
@@ -0,0 +1,37 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+// 
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/shaders/waveform.vert.glsl
+//=============================================================================
+
+
+#version 450
+// one quad per audio clip, corners from gl_VertexIndex (triangle strip)
+layout(push_constant) uniform Push {
+    vec4 rect; // x, y, w, h in pixels
+    vec4 color;
+    vec2 target;
+    float first_peak;
+    float peaks_per_pixel;
+    uint level_offset;
+    uint level_count;
+} pc;
+void main() {
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    vec2 pos = pc.rect.xy + corner * pc.rect.zw;
+    gl_Position = vec4(pos / pc.target * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,155 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/stats.c
+//=============================================================================
+
+#include "stats.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// per node and per block timings in a mapped file. Every counter has one
+// writer at a time (a node runs on one thread per block, blocks on the
+// audio thread), so recording is plain relaxed stores: no atomics that
+// contend, nothing a reader can stall. Readers take deltas, see war-top
+
+//-----------------------------------------------------------------------------
+// recording, audio thread and workers
+//-----------------------------------------------------------------------------
+
+uint64_t stats_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+uint32_t stats_bucket(uint64_t ns) {
+    uint32_t bucket = 63 - (uint32_t)__builtin_clzll(ns | 1);
+    return bucket < stats_buckets ? bucket : stats_buckets - 1;
+}
+
+void stats_record(StatsNode* node, uint64_t ns) {
+    uint32_t bucket = stats_bucket(ns);
+    __atomic_store_n(&node->histogram[bucket],
+                     node->histogram[bucket] + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&node->ns_last, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->ns_total, node->ns_total + ns, __ATOMIC_RELAXED);
+    if (ns > node->ns_max)
+        __atomic_store_n(&node->ns_max, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->calls, node->calls + 1, __ATOMIC_RELAXED);
+}
+
+// a whole block against its length
+void stats_block(StatsPage* page, uint64_t ns, uint64_t budget_ns) {
+    uint32_t bucket = stats_bucket(ns);
+    __atomic_store_n(&page->block_histogram[bucket],
+                     page->block_histogram[bucket] + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&page->block_ns_last, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &page->block_ns_total, page->block_ns_total + ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->budget_ns_total,
+                     page->budget_ns_total + budget_ns,
+                     __ATOMIC_RELAXED);
+    if (ns > page->block_ns_max)
+        __atomic_store_n(&page->block_ns_max, ns, __ATOMIC_RELAXED);
+    if (ns > budget_ns)
+        __atomic_store_n(&page->misses, page->misses + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->blocks, page->blocks + 1, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+// the file, UI thread
+//-----------------------------------------------------------------------------
+
+// WAR_STATS names the file, WAR_STATS=0 turns profiling off; the default
+// is one file per process in /dev/shm. 0 when off
+uint8_t stats_env_path(char* path, size_t size) {
+    const char* env = getenv("WAR_STATS");
+    if (env && !strcmp(env, "0")) return 0;
+    if (env && env[0]) {
+        snprintf(path, size, "%s", env);
+    } else {
+        snprintf(path, size, "/dev/shm/war-stats.%d", (int)getpid());
+    }
+    return 1;
+}
+
+// NULL when the file cannot be made; profiling is then off
+StatsPage* stats_open(const char* path, uint32_t sample_rate) {
+    header("stats_open");
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(StatsPage)) < 0) {
+        call_carmack("stats: cannot create %s", path);
+        if (fd >= 0) close(fd);
+        end("stats_open");
+        return NULL;
+    }
+    StatsPage* page = mmap(
+        NULL, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        unlink(path);
+        end("stats_open");
+        return NULL;
+    }
+    // written from the audio thread: no faults there
+    memset(page, 0, sizeof(StatsPage));
+    mlock(page, sizeof(StatsPage));
+    page->version = stats_version;
+    page->pid = (int32_t)getpid();
+    page->sample_rate = sample_rate;
+    // last, so a reader that sees the magic sees the rest
+    __atomic_store_n(&page->magic, stats_magic, __ATOMIC_RELEASE);
+    call_carmack("stats: %s", path);
+
+    end("stats_open");
+    return page;
+}
+
+void stats_close(StatsPage* page, const char* path) {
+    munmap(page, sizeof(StatsPage));
+    unlink(path);
+}
+
+// the graph records into the page from its next block. Slots keep their
+// counters; a reader that sees the generation move starts its deltas over
+void stats_attach(StatsPage* page, AudioGraph* graph) {
+    __atomic_add_fetch(&page->generation, 1, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < graph->node_count; i++) {
+        const char* name = graph->nodes[i].name;
+        snprintf(page->nodes[i].name,
+                 stats_max_name,
+                 "%s",
+                 name ? name : "sum");
+    }
+    __atomic_store_n(&page->node_count, graph->node_count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&page->generation, 1, __ATOMIC_RELEASE);
+    graph->stats = page->nodes;
+}
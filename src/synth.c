@@ -0,0 +1,260 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/synth.c
+//=============================================================================
+
+#include "synth.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// one lane group as a gcc vector; the compiler maps it onto whatever
+// registers the clone being built has (4 xmm, 2 ymm or 1 zmm)
+typedef float SynthLanes __attribute__((vector_size(sizeof(float) *
+                                                    synth_lanes)));
+typedef int32_t SynthMask __attribute__((vector_size(sizeof(int32_t) *
+                                                     synth_lanes)));
+
+// one-pole coefficient reaching 1 - 1/e of the way in seconds
+float synth_rate(uint32_t sample_rate, float seconds) {
+    return 1.0f - expf(-1.0f / (seconds * (float)sample_rate));
+}
+
+void synth_make(Synth* synth, uint32_t sample_rate) {
+    memset(synth, 0, sizeof(Synth));
+    synth->sample_rate = sample_rate;
+    synth->attack_rate = synth_rate(sample_rate, 0.003f);
+    synth->decay_rate = synth_rate(sample_rate, 0.2f);
+    synth->sustain = 0.6f;
+    synth->release_rate = synth_rate(sample_rate, 0.15f);
+}
+
+// lowest free voice; when all are busy the oldest releasing voice, else
+// the oldest voice. Same notes in, same voices out, every run
+uint32_t synth_allocate(const Synth* synth) {
+    if (synth->active < synth_max_voices) {
+        for (uint32_t g = 0; g < synth_groups; g++) {
+            if (synth->group_active[g] == synth_lanes) continue;
+            for (uint32_t l = 0; l < synth_lanes; l++) {
+                uint32_t v = g * synth_lanes + l;
+                if (synth->stage[v] == synth_stage_off) return v;
+            }
+        }
+    }
+    uint32_t oldest = 0, oldest_released = UINT32_MAX;
+    for (uint32_t v = 0; v < synth_max_voices; v++) {
+        if (synth->serial[v] < synth->serial[oldest]) oldest = v;
+        if (synth->stage[v] == synth_stage_release &&
+            (oldest_released == UINT32_MAX ||
+             synth->serial[v] < synth->serial[oldest_released]))
+            oldest_released = v;
+    }
+    return oldest_released != UINT32_MAX ? oldest_released : oldest;
+}
+
+void synth_note_on(Synth* synth, uint32_t pitch, float velocity) {
+    uint32_t v = synth_allocate(synth);
+    uint32_t group = v / synth_lanes;
+    if (synth->stage[v] == synth_stage_off) {
+        synth->group_active[group]++;
+        synth->active++;
+        // a stolen voice keeps phase, level and filter so it does not click
+        synth->phase[v] = 0.0f;
+        synth->level[v] = 0.0f;
+        synth->filter[v] = 0.0f;
+    }
+    float sample_rate = (float)synth->sample_rate;
+    float hz = 440.0f * powf(2.0f, ((float)pitch - 69.0f) / 12.0f);
+    float step = hz / sample_rate;
+    // brighter with velocity, never past the top of the band
+    float cutoff = hz * (2.0f + 14.0f * velocity);
+    if (cutoff > 0.45f * sample_rate) cutoff = 0.45f * sample_rate;
+    synth->step[v] = step;
+    synth->inv_step[v] = 1.0f / step;
+    synth->gain[v] = velocity;
+    synth->cutoff[v] = 1.0f - expf(-2.0f * (float)M_PI * cutoff / sample_rate);
+    // aims past 1 so the exponential attack reaches full level in time
+    synth->target[v] = 1.5f;
+    synth->rate[v] = synth->attack_rate;
+    synth->stage[v] = synth_stage_attack;
+    synth->pitch[v] = (uint8_t)pitch;
+    synth->serial[v] = ++synth->next_serial;
+}
+
+void synth_release(Synth* synth, uint32_t v) {
+    synth->stage[v] = synth_stage_release;
+    synth->target[v] = 0.0f;
+    synth->rate[v] = synth->release_rate;
+}
+
+void synth_note_off(Synth* synth, uint32_t pitch) {
+    for (uint32_t v = 0; v < synth_max_voices; v++) {
+        uint8_t stage = synth->stage[v];
+        if (synth->pitch[v] == pitch && stage != synth_stage_off &&
+            stage != synth_stage_release)
+            synth_release(synth, v);
+    }
+}
+
+void synth_release_all(Synth* synth) {
+    for (uint32_t v = 0; v < synth_max_voices; v++) {
+        uint8_t stage = synth->stage[v];
+        if (stage != synth_stage_off && stage != synth_stage_release)
+            synth_release(synth, v);
+    }
+}
+
+// band-limited saw (polyblep) into a one-pole lowpass, times the envelope;
+// every lane of the group at once, summed into the chunk accumulator
+__attribute__((target_clones("avx512f", "avx2", "default"))) void
+synth_render_group(Synth* synth, uint32_t group, uint32_t frames) {
+    uint32_t base = group * synth_lanes;
+    SynthLanes phase, step, inv_step, level, target, rate, gain, filter;
+    SynthLanes cutoff;
+    memcpy(&phase, synth->phase + base, sizeof(SynthLanes));
+    memcpy(&step, synth->step + base, sizeof(SynthLanes));
+    memcpy(&inv_step, synth->inv_step + base, sizeof(SynthLanes));
+    memcpy(&level, synth->level + base, sizeof(SynthLanes));
+    memcpy(&target, synth->target + base, sizeof(SynthLanes));
+    memcpy(&rate, synth->rate + base, sizeof(SynthLanes));
+    memcpy(&gain, synth->gain + base, sizeof(SynthLanes));
+    memcpy(&filter, synth->filter + base, sizeof(SynthLanes));
+    memcpy(&cutoff, synth->cutoff + base, sizeof(SynthLanes));
+    SynthLanes zero = {0};
+    SynthLanes one = zero + 1.0f;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        SynthLanes saw = phase * 2.0f - 1.0f;
+        // residuals for the wrap just behind and just ahead of the phase
+        SynthLanes x0 = phase * inv_step;
+        SynthLanes x1 = (phase - 1.0f) * inv_step;
+        SynthLanes b0 = x0 + x0 - x0 * x0 - 1.0f;
+        SynthLanes b1 = x1 * x1 + x1 + x1 + 1.0f;
+        saw -= (SynthLanes)((SynthMask)b0 & (phase < step));
+        saw -= (SynthLanes)((SynthMask)b1 & (phase > one - step));
+        filter += (saw - filter) * cutoff;
+
+        SynthLanes acc;
+        memcpy(&acc, synth->lanes + i * synth_lanes, sizeof(SynthLanes));
+        acc += filter * level * gain;
+        memcpy(synth->lanes + i * synth_lanes, &acc, sizeof(SynthLanes));
+
+        level += (target - level) * rate;
+        phase += step;
+        phase -= (SynthLanes)((SynthMask)one & (phase >= one));
+    }
+
+    memcpy(synth->phase + base, &phase, sizeof(SynthLanes));
+    memcpy(synth->level + base, &level, sizeof(SynthLanes));
+    memcpy(synth->filter + base, &filter, sizeof(SynthLanes));
+}
+
+// stage changes are checked once per chunk, not per sample
+void synth_update_stages(Synth* synth, uint32_t group) {
+    for (uint32_t l = 0; l < synth_lanes; l++) {
+        uint32_t v = group * synth_lanes + l;
+        switch (synth->stage[v]) {
+        case synth_stage_attack:
+            if (synth->level[v] < 1.0f) break;
+            synth->stage[v] = synth_stage_decay;
+            synth->target[v] = synth->sustain;
+            synth->rate[v] = synth->decay_rate;
+            break;
+        case synth_stage_decay:
+            if (synth->level[v] - synth->sustain > 1e-3f) break;
+            synth->stage[v] = synth_stage_sustain;
+            break;
+        case synth_stage_release:
+            if (synth->level[v] > 1e-4f) break;
+            synth->stage[v] = synth_stage_off;
+            synth->level[v] = 0.0f;
+            synth->gain[v] = 0.0f;
+            synth->step[v] = 0.0f;
+            synth->inv_step[v] = 0.0f;
+            synth->group_active[group]--;
+            synth->active--;
+            break;
+        }
+    }
+}
+
+// mono, overwrites out; groups with no sounding voice cost nothing
+void synth_render(Synth* synth, float* out, uint32_t frames) {
+    for (uint32_t done = 0; done < frames;) {
+        uint32_t n = frames - done < synth_chunk ? frames - done : synth_chunk;
+        memset(synth->lanes, 0, sizeof(float) * synth_lanes * n);
+        for (uint32_t g = 0; g < synth_groups; g++) {
+            if (!synth->group_active[g]) continue;
+            synth_render_group(synth, g, n);
+            synth_update_stages(synth, g);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            float sum = 0.0f;
+            for (uint32_t l = 0; l < synth_lanes; l++)
+                sum += synth->lanes[i * synth_lanes + l];
+            out[done + i] = sum;
+        }
+        done += n;
+    }
+}
+
+// voices held for the whole run at each polyphony, as a share of one core
+void synth_bench_run(void) {
+    header("synth_bench_run");
+
+    enum {
+        bench_seconds = 10,
+        bench_block = audio_block_frames,
+    };
+    const uint32_t counts[] = {16, 64, 256, synth_max_voices};
+    float out[bench_block];
+    Synth* synth = aligned_alloc(64, sizeof(Synth));
+    assert(synth);
+    for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        synth_make(synth, audio_sample_rate);
+        for (uint32_t v = 0; v < counts[c]; v++)
+            synth_note_on(synth, 24 + v % 96, 0.5f + (v % 7) / 14.0f);
+        uint32_t blocks = bench_seconds * audio_sample_rate / bench_block;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        float peak = 0.0f;
+        for (uint32_t b = 0; b < blocks; b++) {
+            synth_render(synth, out, bench_block);
+            peak = fabsf(out[0]) > peak ? fabsf(out[0]) : peak;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double wall =
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("synth %3u voices: %.2f%% of a core (%u active, peak %.1f)\n",
+               counts[c],
+               100.0 * wall / bench_seconds,
+               synth->active,
+               peak);
+    }
+    free(synth);
+
+    end("synth_bench_run");
+}
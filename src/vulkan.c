@@ -22,6 +22,8 @@
 #include "data.h"
 #include "debug_macros.h"
 #include "macros.h"
+#include "notes.h"
+#include "waveform.h"
 
 #include <assert.h>
 #include <dirent.h>
@@ -50,7 +52,12 @@
 #include <vulkan/vulkan_core.h>
 
 VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
-    header("vulkan_make_dmabuf_fd");
+    return vulkan_make_context(width, height, 1);
+}
+
+VulkanContext
+vulkan_make_context(uint32_t width, uint32_t height, uint8_t export_dmabuf) {
+    header("vulkan_make_context");
 
     VkInstanceCreateInfo instance_info = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -104,7 +111,8 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
         }
     }
 
-    assert(has_external_memory && has_external_memory_fd);
+    // headless rendering needs no exportable memory (lavapipe, CI)
+    assert(!export_dmabuf || (has_external_memory && has_external_memory_fd));
 
     uint32_t queue_family_index = 0;
 
@@ -119,7 +127,7 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .queueCreateInfoCount = 1,
         .pQueueCreateInfos = &queue_info,
-        .enabledExtensionCount = 2,
+        .enabledExtensionCount = export_dmabuf ? 2 : 0,
         .ppEnabledExtensionNames = device_extensions,
     };
     VkDevice device;
@@ -128,23 +136,92 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
     VkQueue queue;
     vkGetDeviceQueue(device, queue_family_index, 0, &queue);
 
-    VkCommandPool cmd_pool;
-    VkCommandPoolCreateInfo pool_info = {
+    enum {
+        max_queue_families = 16,
+    };
+    uint32_t queue_family_count = max_queue_families;
+    VkQueueFamilyProperties queue_families[max_queue_families];
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        physical_device, &queue_family_count, queue_families);
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+    // two timestamps per frame in flight: top and bottom of the frame
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if (queue_families[queue_family_index].timestampValidBits) {
+        VkQueryPoolCreateInfo query_pool_info = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2 * max_frames_in_flight,
+        };
+        VkResult query_res =
+            vkCreateQueryPool(device, &query_pool_info, NULL, &query_pool);
+        assert(query_res == VK_SUCCESS);
+    }
+
+    VkFence frame_fences[max_frames_in_flight];
+    VkCommandPool frame_cmd_pools[max_frames_in_flight];
+    VkCommandBuffer frame_cmd_buffers[max_frames_in_flight];
+    VkCommandBuffer dynamic_cmd_buffers[max_frames_in_flight];
+    VkResult res;
+    for (uint32_t i = 0; i < max_frames_in_flight; i++) {
+        VkFenceCreateInfo fence_info = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        };
+        res = vkCreateFence(device, &fence_info, NULL, &frame_fences[i]);
+        assert(res == VK_SUCCESS);
+
+        // transient, no per-buffer reset: the whole pool is reset each frame
+        VkCommandPoolCreateInfo frame_pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .queueFamilyIndex = queue_family_index,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        };
+        res = vkCreateCommandPool(
+            device, &frame_pool_info, NULL, &frame_cmd_pools[i]);
+        assert(res == VK_SUCCESS);
+
+        VkCommandBufferAllocateInfo primary_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = frame_cmd_pools[i],
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        res = vkAllocateCommandBuffers(
+            device, &primary_info, &frame_cmd_buffers[i]);
+        assert(res == VK_SUCCESS);
+
+        VkCommandBufferAllocateInfo dynamic_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = frame_cmd_pools[i],
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1,
+        };
+        res = vkAllocateCommandBuffers(
+            device, &dynamic_info, &dynamic_cmd_buffers[i]);
+        assert(res == VK_SUCCESS);
+    }
+
+    VkCommandPool static_cmd_pool;
+    VkCommandPoolCreateInfo static_pool_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .queueFamilyIndex = queue_family_index,
         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
     };
-    VkResult res = vkCreateCommandPool(device, &pool_info, NULL, &cmd_pool);
+    res =
+        vkCreateCommandPool(device, &static_pool_info, NULL, &static_cmd_pool);
     assert(res == VK_SUCCESS);
 
-    VkCommandBuffer cmd_buffer;
-    VkCommandBufferAllocateInfo cmd_buf_info = {
+    VkCommandBuffer static_cmd_buffers[layer_static_count];
+    VkCommandBufferAllocateInfo static_buf_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = cmd_pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
+        .commandPool = static_cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = layer_static_count,
     };
-    res = vkAllocateCommandBuffers(device, &cmd_buf_info, &cmd_buffer);
+    res =
+        vkAllocateCommandBuffers(device, &static_buf_info, static_cmd_buffers);
     assert(res == VK_SUCCESS);
 
     VkExternalMemoryImageCreateInfo ext_mem_image_info = {
@@ -153,7 +230,7 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
     };
     VkImageCreateInfo image_create_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .pNext = &ext_mem_image_info,
+        .pNext = export_dmabuf ? &ext_mem_image_info : NULL,
         .imageType = VK_IMAGE_TYPE_2D,
         .format = VK_FORMAT_A8B8G8R8_UNORM_PACK32,
         .extent = {width, height, 1},
@@ -161,7 +238,8 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
         .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                 VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
@@ -178,7 +256,7 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
     };
     VkMemoryAllocateInfo mem_alloc_info = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = &export_alloc_info,
+        .pNext = export_dmabuf ? &export_alloc_info : NULL,
         .allocationSize = mem_reqs.size,
         .memoryTypeIndex =
             vulkan_find_memory_type(mem_reqs.memoryTypeBits,
@@ -196,12 +274,20 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
         .memory = memory,
         .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
     };
-    int dmabuf_fd;
-    PFN_vkGetMemoryFdKHR vkGetMemoryFdKHR =
-        (PFN_vkGetMemoryFdKHR)vkGetDeviceProcAddr(device, "vkGetMemoryFdKHR");
-    res = vkGetMemoryFdKHR(device, &get_fd_info, &dmabuf_fd);
-    assert(res == VK_SUCCESS);
-    assert(dmabuf_fd > 0);
+    int dmabuf_fd = -1;
+    if (export_dmabuf) {
+        PFN_vkGetMemoryFdKHR vkGetMemoryFdKHR =
+            (PFN_vkGetMemoryFdKHR)vkGetDeviceProcAddr(device,
+                                                      "vkGetMemoryFdKHR");
+        res = vkGetMemoryFdKHR(device, &get_fd_info, &dmabuf_fd);
+        assert(res == VK_SUCCESS);
+        assert(dmabuf_fd > 0);
+    }
+
+    // headless frames are copied out instead of handed to a compositor
+    VkImageLayout final_layout = export_dmabuf
+                                     ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+                                     : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
     VkAttachmentDescription color_attachment = {
         .flags = 0,
@@ -212,10 +298,7 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout =
-            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, // or
-                                             // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                                             // depending on usage
+        .finalLayout = final_layout,
     };
     VkAttachmentReference color_attachment_ref = {
         .attachment = 0,
@@ -237,6 +320,16 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
     res = vkCreateRenderPass(device, &render_pass_info, NULL, &render_pass);
     assert(res == VK_SUCCESS);
 
+    // compatible with render_pass, keeps the shifted canvas when scrolling
+    VkAttachmentDescription load_attachment = color_attachment;
+    load_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    load_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    render_pass_info.pAttachments = &load_attachment;
+    VkRenderPass load_render_pass;
+    res =
+        vkCreateRenderPass(device, &render_pass_info, NULL, &load_render_pass);
+    assert(res == VK_SUCCESS);
+
     VkImageViewCreateInfo image_view_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = image,
@@ -364,19 +457,41 @@ VulkanContext vulkan_make_dmabuf_fd(uint32_t width, uint32_t height) {
 
     free(available_extensions);
 
-    end("vulkan_make_dmabuf_fd");
-    return (VulkanContext){.dmabuf_fd = dmabuf_fd,
-                           .instance = instance,
-                           .physical_device = physical_device,
-                           .device = device,
-                           .queue = queue,
-                           .queue_family_index = queue_family_index,
-                           .image = image,
-                           .memory = memory,
-                           .cmd_pool = cmd_pool,
-                           .cmd_buffer = cmd_buffer,
-                           .pipeline = NULL, // COMMENT: unnullify
-                           .pipeline_layout = NULL};
+    end("vulkan_make_context");
+    VulkanContext ctx = {
+        .dmabuf_fd = dmabuf_fd,
+        .instance = instance,
+        .physical_device = physical_device,
+        .device = device,
+        .queue = queue,
+        .queue_family_index = queue_family_index,
+        .image = image,
+        .memory = memory,
+        .image_view = image_view,
+        .render_pass = render_pass,
+        .load_render_pass = load_render_pass,
+        .frame_buffer = framebuffer,
+        .width = width,
+        .height = height,
+        .final_layout = final_layout,
+        .frame_index = 0,
+        .query_pool = query_pool,
+        .timestamp_period = device_properties.limits.timestampPeriod,
+        .static_cmd_pool = static_cmd_pool,
+        .pipeline = NULL, // COMMENT: unnullify
+        .pipeline_layout = NULL,
+    };
+    memcpy(ctx.frame_fences, frame_fences, sizeof(frame_fences));
+    memcpy(ctx.frame_cmd_pools, frame_cmd_pools, sizeof(frame_cmd_pools));
+    memcpy(ctx.frame_cmd_buffers, frame_cmd_buffers, sizeof(frame_cmd_buffers));
+    memcpy(ctx.dynamic_cmd_buffers,
+           dynamic_cmd_buffers,
+           sizeof(dynamic_cmd_buffers));
+    memcpy(ctx.static_cmd_buffers,
+           static_cmd_buffers,
+           sizeof(static_cmd_buffers));
+    vulkan_make_waveform_pipeline(&ctx);
+    return ctx;
 }
 
 uint32_t vulkan_find_memory_type(uint32_t type_filter,
@@ -402,3 +517,1014 @@ uint32_t vulkan_find_memory_type(uint32_t type_filter,
     call_carmack("Failed to find suitable memory type!");
     exit(EXIT_FAILURE);
 }
+
+void vulkan_clear_rects(VkCommandBuffer cmd,
+                        const float color[4],
+                        VkClearRect* rects,
+                        uint32_t rect_count) {
+    if (rect_count == 0) return;
+    VkClearAttachment clear = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .colorAttachment = 0,
+        .clearValue = {.color = {.float32 = {color[0],
+                                             color[1],
+                                             color[2],
+                                             color[3]}}},
+    };
+    vkCmdClearAttachments(cmd, 1, &clear, rect_count, rects);
+}
+
+uint8_t vulkan_push_rect(VkClearRect* rects,
+                         uint32_t* rect_count,
+                         int32_t x,
+                         int32_t y,
+                         int32_t w,
+                         int32_t h,
+                         const VkRect2D* clip) {
+    int32_t clip_x1 = clip->offset.x + (int32_t)clip->extent.width;
+    int32_t clip_y1 = clip->offset.y + (int32_t)clip->extent.height;
+    if (x < clip->offset.x) {
+        w -= clip->offset.x - x;
+        x = clip->offset.x;
+    }
+    if (y < clip->offset.y) {
+        h -= clip->offset.y - y;
+        y = clip->offset.y;
+    }
+    if (x + w > clip_x1) w = clip_x1 - x;
+    if (y + h > clip_y1) h = clip_y1 - y;
+    if (w <= 0 || h <= 0) return 0;
+    rects[(*rect_count)++] = (VkClearRect){
+        .rect = {.offset = {x, y}, .extent = {(uint32_t)w, (uint32_t)h}},
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+    return 1;
+}
+
+void vulkan_record_layer(VkCommandBuffer cmd,
+                         uint32_t layer,
+                         const PianoRollView* view,
+                         const VkRect2D* clip) {
+    enum {
+        max_rects = 512,
+        pitch_count = 128,
+    };
+    VkClearRect rects[max_rects];
+    uint32_t rect_count = 0;
+
+    int32_t roll_x = (int32_t)view->sidebar_width;
+    int32_t roll_w = (int32_t)view->width - roll_x;
+    int32_t row_h = (int32_t)view->cell_height;
+    if (row_h < 1) row_h = 1;
+
+    // rows from the top: highest pitch first
+    uint32_t first_row = (uint32_t)(view->scroll_y / view->cell_height);
+    uint32_t last_row =
+        (uint32_t)((view->scroll_y + view->height) / view->cell_height) + 1;
+    if (last_row > pitch_count) last_row = pitch_count;
+
+    switch (layer) {
+    case layer_octave_bands: {
+        const float black_row[4] = {0.10f, 0.10f, 0.12f, 1.0f};
+        const float octave_line[4] = {0.30f, 0.30f, 0.34f, 1.0f};
+        for (uint32_t row = first_row; row < last_row; row++) {
+            uint32_t pitch_class = (pitch_count - 1 - row) % 12;
+            if (pitch_class == 1 || pitch_class == 3 || pitch_class == 6 ||
+                pitch_class == 8 || pitch_class == 10) {
+                int32_t y = (int32_t)(row * view->cell_height - view->scroll_y);
+                vulkan_push_rect(
+                    rects, &rect_count, roll_x, y, roll_w, row_h, clip);
+            }
+            if (rect_count == max_rects) {
+                vulkan_clear_rects(cmd, black_row, rects, rect_count);
+                rect_count = 0;
+            }
+        }
+        vulkan_clear_rects(cmd, black_row, rects, rect_count);
+        rect_count = 0;
+        for (uint32_t row = first_row; row < last_row; row++) {
+            if ((pitch_count - 1 - row) % 12 != 0) continue;
+            int32_t y = (int32_t)((row + 1) * view->cell_height -
+                                  view->scroll_y) -
+                        1;
+            vulkan_push_rect(rects, &rect_count, roll_x, y, roll_w, 1, clip);
+        }
+        vulkan_clear_rects(cmd, octave_line, rects, rect_count);
+        break;
+    }
+    case layer_grid: {
+        const float colors[3][4] = {
+            {0.18f, 0.18f, 0.20f, 1.0f}, // cell
+            {0.26f, 0.26f, 0.30f, 1.0f}, // beat
+            {0.40f, 0.40f, 0.46f, 1.0f}, // bar
+        };
+        uint32_t cells_per_bar = view->cells_per_beat * view->beats_per_bar;
+        // the canvas may start left of the timeline origin
+        float left = view->scroll_x + (float)(clip->offset.x - roll_x);
+        uint32_t first_col =
+            left > 0 ? (uint32_t)(left / view->cell_width) : 0;
+        uint32_t last_col =
+            (uint32_t)((left + clip->extent.width) / view->cell_width) + 1;
+        // one clear call per line weight
+        for (uint32_t weight = 0; weight < 3; weight++) {
+            rect_count = 0;
+            for (uint32_t col = first_col; col <= last_col; col++) {
+                uint32_t col_weight = (col % cells_per_bar == 0)         ? 2 :
+                                      (col % view->cells_per_beat == 0) ? 1 :
+                                                                          0;
+                if (col_weight != weight) continue;
+                int32_t x = roll_x + (int32_t)(col * view->cell_width -
+                                               view->scroll_x);
+                if (x < roll_x) continue;
+                vulkan_push_rect(rects,
+                                 &rect_count,
+                                 x,
+                                 0,
+                                 1,
+                                 (int32_t)view->height,
+                                 clip);
+                if (rect_count == max_rects) {
+                    vulkan_clear_rects(cmd, colors[weight], rects, rect_count);
+                    rect_count = 0;
+                }
+            }
+            vulkan_clear_rects(cmd, colors[weight], rects, rect_count);
+        }
+        break;
+    }
+    case layer_key_sidebar: {
+        const float white_key[4] = {0.85f, 0.85f, 0.85f, 1.0f};
+        const float black_key[4] = {0.05f, 0.05f, 0.05f, 1.0f};
+        uint32_t black_count = 0;
+        VkClearRect black_rects[max_rects];
+        for (uint32_t row = first_row; row < last_row; row++) {
+            uint32_t pitch_class = (pitch_count - 1 - row) % 12;
+            uint8_t is_black = pitch_class == 1 || pitch_class == 3 ||
+                               pitch_class == 6 || pitch_class == 8 ||
+                               pitch_class == 10;
+            int32_t y = (int32_t)(row * view->cell_height - view->scroll_y);
+            // 1 pixel gap between keys
+            if (is_black) {
+                vulkan_push_rect(black_rects,
+                                 &black_count,
+                                 0,
+                                 y,
+                                 (int32_t)view->sidebar_width,
+                                 row_h - 1,
+                                 clip);
+            } else {
+                vulkan_push_rect(rects,
+                                 &rect_count,
+                                 0,
+                                 y,
+                                 (int32_t)view->sidebar_width,
+                                 row_h - 1,
+                                 clip);
+            }
+        }
+        vulkan_clear_rects(cmd, white_key, rects, rect_count);
+        vulkan_clear_rects(cmd, black_key, black_rects, black_count);
+        break;
+    }
+    }
+}
+
+// only the notes the interval index returns for the clip are visited
+void vulkan_record_notes(VkCommandBuffer cmd,
+                         const PianoRollView* view,
+                         const VkRect2D* clip) {
+    const NoteTrack* track = view->notes;
+    if (!track || !track->count) return;
+    enum {
+        max_rects = 512,
+        pitch_count = 128,
+    };
+    const float note_color[4] = {0.85f, 0.55f, 0.25f, 1.0f};
+    const float selected_color[4] = {0.95f, 0.85f, 0.45f, 1.0f};
+    VkClearRect rects[max_rects];
+    VkClearRect selected_rects[max_rects];
+    uint32_t indices[max_rects];
+    uint32_t rect_count = 0;
+    uint32_t selected_count = 0;
+
+    float roll_x = (float)view->sidebar_width;
+    float ticks_per_cell = (float)note_ticks_per_beat / view->cells_per_beat;
+    float ticks_per_pixel = ticks_per_cell / view->cell_width;
+    float left = view->scroll_x + (float)clip->offset.x - roll_x;
+    float right = left + (float)clip->extent.width;
+    if (right <= 0.0f) return;
+    uint32_t t0 = left > 0.0f ? (uint32_t)(left * ticks_per_pixel) : 0;
+    uint32_t t1 = (uint32_t)(right * ticks_per_pixel) + 1;
+    int32_t top_row = (int32_t)(view->scroll_y / view->cell_height);
+    int32_t bottom_row =
+        (int32_t)((view->scroll_y + view->height) / view->cell_height);
+    if (top_row > pitch_count - 1) return;
+    uint8_t p1 = top_row < 0 ? pitch_count - 1 : pitch_count - 1 - top_row;
+    uint8_t p0 =
+        bottom_row > pitch_count - 1 ? 0 : pitch_count - 1 - bottom_row;
+
+    uint32_t resume = 0;
+    uint32_t found;
+    while ((found = notes_query(
+                track, t0, t1, p0, p1, indices, max_rects, &resume))) {
+        for (uint32_t n = 0; n < found; n++) {
+            uint32_t i = indices[n];
+            if (track->flags[i] & note_flag_muted) continue;
+            int32_t x = (int32_t)(roll_x + track->start[i] / ticks_per_pixel -
+                                  view->scroll_x);
+            int32_t w = (int32_t)(track->length[i] / ticks_per_pixel) - 1;
+            if (w < 1) w = 1;
+            uint32_t row = pitch_count - 1 - track->pitch[i];
+            int32_t y = (int32_t)(row * view->cell_height - view->scroll_y);
+            int32_t h = (int32_t)view->cell_height - 1;
+            // a note may start left of the roll; keep it off the sidebar
+            if (x < (int32_t)roll_x) {
+                w -= (int32_t)roll_x - x;
+                x = (int32_t)roll_x;
+            }
+            if (track->flags[i] & note_flag_selected) {
+                vulkan_push_rect(
+                    selected_rects, &selected_count, x, y, w, h, clip);
+            } else {
+                vulkan_push_rect(rects, &rect_count, x, y, w, h, clip);
+            }
+        }
+        vulkan_clear_rects(cmd, note_color, rects, rect_count);
+        vulkan_clear_rects(cmd, selected_color, selected_rects, selected_count);
+        rect_count = 0;
+        selected_count = 0;
+    }
+}
+
+void vulkan_begin_secondary(VulkanContext* ctx,
+                            VkCommandBuffer cmd,
+                            VkCommandBufferUsageFlags flags) {
+    VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = ctx->render_pass,
+        .subpass = 0,
+        .framebuffer = ctx->frame_buffer,
+    };
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | flags,
+        .pInheritanceInfo = &inheritance,
+    };
+    VkResult res = vkBeginCommandBuffer(cmd, &begin_info);
+    assert(res == VK_SUCCESS);
+}
+
+void vulkan_record_static_layer(VulkanContext* ctx,
+                                uint32_t layer,
+                                const PianoRollView* view) {
+    header("vulkan_record_static_layer %u", layer);
+
+    VkCommandBuffer cmd = ctx->static_cmd_buffers[layer];
+    VkResult res = vkResetCommandBuffer(cmd, 0);
+    assert(res == VK_SUCCESS);
+    vulkan_begin_secondary(
+        ctx, cmd, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+    VkRect2D clip = {.offset = {0, 0}, .extent = {view->width, view->height}};
+    vulkan_record_layer(cmd, layer, view, &clip);
+    res = vkEndCommandBuffer(cmd);
+    assert(res == VK_SUCCESS);
+    ctx->static_layer_valid[layer] = 1;
+
+    end("vulkan_record_static_layer");
+}
+
+void vulkan_update_static_layers(VulkanContext* ctx,
+                                 const PianoRollView* view) {
+    const PianoRollView* old = &ctx->static_view;
+    uint8_t rows_changed = old->scroll_y != view->scroll_y ||
+                           old->cell_height != view->cell_height ||
+                           old->height != view->height;
+    uint8_t dirty[layer_static_count] = {
+        [layer_octave_bands] = rows_changed || old->width != view->width ||
+                               old->sidebar_width != view->sidebar_width,
+        [layer_grid] = old->scroll_x != view->scroll_x ||
+                       old->cell_width != view->cell_width ||
+                       old->cells_per_beat != view->cells_per_beat ||
+                       old->beats_per_bar != view->beats_per_bar ||
+                       old->width != view->width ||
+                       old->height != view->height ||
+                       old->sidebar_width != view->sidebar_width,
+        [layer_key_sidebar] =
+            rows_changed || old->sidebar_width != view->sidebar_width,
+    };
+
+    uint8_t any_dirty = 0;
+    for (uint32_t i = 0; i < layer_static_count; i++) {
+        dirty[i] = dirty[i] || !ctx->static_layer_valid[i];
+        any_dirty |= dirty[i];
+    }
+    if (!any_dirty) return;
+
+    // static buffers may still be pending in another frame
+    VkResult res = vkWaitForFences(ctx->device,
+                                   max_frames_in_flight,
+                                   ctx->frame_fences,
+                                   VK_TRUE,
+                                   UINT64_MAX);
+    assert(res == VK_SUCCESS);
+    for (uint32_t i = 0; i < layer_static_count; i++) {
+        if (dirty[i]) vulkan_record_static_layer(ctx, i, view);
+    }
+    ctx->static_view = *view;
+}
+
+void vulkan_record_dynamic_layers(VulkanContext* ctx,
+                                  VkCommandBuffer cmd,
+                                  const PianoRollView* view) {
+    vulkan_begin_secondary(
+        ctx, cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    VkRect2D clip = {.offset = {0, 0}, .extent = {view->width, view->height}};
+    vulkan_record_waveforms(ctx, cmd, view, &clip);
+    vulkan_record_notes(cmd, view, &clip);
+    // cursor, playhead and selection live on wl_subsurface overlays
+
+    VkResult res = vkEndCommandBuffer(cmd);
+    assert(res == VK_SUCCESS);
+}
+
+VkCommandBuffer vulkan_begin_frame(VulkanContext* ctx) {
+    uint32_t frame = ctx->frame_index;
+
+    VkResult res = vkWaitForFences(
+        ctx->device, 1, &ctx->frame_fences[frame], VK_TRUE, UINT64_MAX);
+    assert(res == VK_SUCCESS);
+    res = vkResetFences(ctx->device, 1, &ctx->frame_fences[frame]);
+    assert(res == VK_SUCCESS);
+    res = vkResetCommandPool(ctx->device, ctx->frame_cmd_pools[frame], 0);
+    assert(res == VK_SUCCESS);
+
+    VkCommandBuffer cmd = ctx->frame_cmd_buffers[frame];
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    res = vkBeginCommandBuffer(cmd, &begin_info);
+    assert(res == VK_SUCCESS);
+    if (ctx->query_pool) {
+        vkCmdResetQueryPool(cmd, ctx->query_pool, frame * 2, 2);
+        vkCmdWriteTimestamp(cmd,
+                            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            ctx->query_pool,
+                            frame * 2);
+    }
+    return cmd;
+}
+
+void vulkan_end_frame(VulkanContext* ctx) {
+    uint32_t frame = ctx->frame_index;
+    VkCommandBuffer cmd = ctx->frame_cmd_buffers[frame];
+
+    if (ctx->query_pool) {
+        vkCmdWriteTimestamp(cmd,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            ctx->query_pool,
+                            frame * 2 + 1);
+    }
+    VkResult res = vkEndCommandBuffer(cmd);
+    assert(res == VK_SUCCESS);
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmd,
+    };
+    res = vkQueueSubmit(ctx->queue, 1, &submit_info, ctx->frame_fences[frame]);
+    assert(res == VK_SUCCESS);
+
+    ctx->frame_index = (frame + 1) % max_frames_in_flight;
+}
+
+void vulkan_render_frame(VulkanContext* ctx, const PianoRollView* view) {
+    uint32_t frame = ctx->frame_index;
+
+    // before begin_frame resets this frame's fence
+    vulkan_update_static_layers(ctx, view);
+
+    VkCommandBuffer cmd = vulkan_begin_frame(ctx);
+    vulkan_record_dynamic_layers(ctx, ctx->dynamic_cmd_buffers[frame], view);
+
+    VkClearValue clear_value = {
+        .color = {.float32 = {0.14f, 0.14f, 0.16f, 1.0f}},
+    };
+    VkRenderPassBeginInfo render_pass_begin = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = ctx->render_pass,
+        .framebuffer = ctx->frame_buffer,
+        .renderArea = {.offset = {0, 0}, .extent = {ctx->width, ctx->height}},
+        .clearValueCount = 1,
+        .pClearValues = &clear_value,
+    };
+    vkCmdBeginRenderPass(
+        cmd, &render_pass_begin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    VkCommandBuffer layers[layer_static_count + 1];
+    memcpy(layers, ctx->static_cmd_buffers, sizeof(ctx->static_cmd_buffers));
+    layers[layer_static_count] = ctx->dynamic_cmd_buffers[frame];
+    vkCmdExecuteCommands(cmd, layer_static_count + 1, layers);
+    vkCmdEndRenderPass(cmd);
+
+    vulkan_end_frame(ctx);
+}
+
+void vulkan_image_barrier(VkCommandBuffer cmd,
+                          VkImage image,
+                          VkImageLayout old_layout,
+                          VkImageLayout new_layout,
+                          VkPipelineStageFlags src_stage,
+                          VkAccessFlags src_access,
+                          VkPipelineStageFlags dst_stage,
+                          VkAccessFlags dst_access) {
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+    };
+    vkCmdPipelineBarrier(
+        cmd, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+void vulkan_scroll_canvas(VulkanContext* ctx,
+                          const PianoRollView* view,
+                          int32_t shift) {
+    header("vulkan_scroll_canvas %d", shift);
+
+    int32_t roll_x = (int32_t)view->sidebar_width;
+    int32_t canvas_w = (int32_t)ctx->width;
+    int32_t distance = shift < 0 ? -shift : shift;
+    if (shift == 0) return;
+    if (distance >= canvas_w - roll_x) {
+        // nothing survives the shift
+        vulkan_render_frame(ctx, view);
+        return;
+    }
+
+    uint32_t frame = ctx->frame_index;
+    VkCommandBuffer cmd = vulkan_begin_frame(ctx);
+
+    vulkan_image_barrier(cmd,
+                         ctx->image,
+                         ctx->final_layout,
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_TRANSFER_READ_BIT |
+                             VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    // copy within the image in non-overlapping chunks of the shift width,
+    // walking away from the exposed edge so no source is overwritten early
+    int32_t kept_w = canvas_w - roll_x - distance;
+    for (int32_t done = 0; done < kept_w; done += distance) {
+        int32_t w = kept_w - done < distance ? kept_w - done : distance;
+        int32_t dst_x = shift > 0 ? roll_x + done : canvas_w - done - w;
+        VkImageCopy region = {
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .srcOffset = {dst_x + shift, 0, 0},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .dstOffset = {dst_x, 0, 0},
+            .extent = {(uint32_t)w, ctx->height, 1},
+        };
+        vkCmdCopyImage(cmd,
+                       ctx->image,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       ctx->image,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       1,
+                       &region);
+        vulkan_image_barrier(cmd,
+                             ctx->image,
+                             VK_IMAGE_LAYOUT_GENERAL,
+                             VK_IMAGE_LAYOUT_GENERAL,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_ACCESS_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_ACCESS_TRANSFER_READ_BIT |
+                                 VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+
+    vulkan_image_barrier(cmd,
+                         ctx->image,
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+    // only the newly exposed strip is rendered
+    VkRect2D strip = {
+        .offset = {shift > 0 ? canvas_w - distance : roll_x, 0},
+        .extent = {(uint32_t)distance, ctx->height},
+    };
+    VkCommandBuffer strip_cmd = ctx->dynamic_cmd_buffers[frame];
+    vulkan_begin_secondary(
+        ctx, strip_cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    const float background[4] = {0.14f, 0.14f, 0.16f, 1.0f};
+    VkClearRect strip_rect = {
+        .rect = strip,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+    vulkan_clear_rects(strip_cmd, background, &strip_rect, 1);
+    vulkan_record_layer(strip_cmd, layer_octave_bands, view, &strip);
+    vulkan_record_layer(strip_cmd, layer_grid, view, &strip);
+    vulkan_record_waveforms(ctx, strip_cmd, view, &strip);
+    vulkan_record_notes(strip_cmd, view, &strip);
+    VkResult res = vkEndCommandBuffer(strip_cmd);
+    assert(res == VK_SUCCESS);
+
+    VkRenderPassBeginInfo render_pass_begin = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = ctx->load_render_pass,
+        .framebuffer = ctx->frame_buffer,
+        .renderArea = strip,
+    };
+    vkCmdBeginRenderPass(
+        cmd, &render_pass_begin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(cmd, 1, &strip_cmd);
+    vkCmdEndRenderPass(cmd);
+
+    vulkan_end_frame(ctx);
+
+    end("vulkan_scroll_canvas");
+}
+
+double vulkan_frame_gpu_ms(VulkanContext* ctx, uint32_t frame) {
+    if (!ctx->query_pool) return -1.0;
+    uint64_t timestamps[2];
+    VkResult res = vkGetQueryPoolResults(
+        ctx->device,
+        ctx->query_pool,
+        frame * 2,
+        2,
+        sizeof(timestamps),
+        timestamps,
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    assert(res == VK_SUCCESS);
+    return (double)(timestamps[1] - timestamps[0]) * ctx->timestamp_period /
+           1e6;
+}
+
+void vulkan_make_readback(VulkanContext* ctx) {
+    header("vulkan_make_readback");
+
+    VkBufferCreateInfo buffer_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (VkDeviceSize)ctx->width * ctx->height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkResult res =
+        vkCreateBuffer(ctx->device, &buffer_info, NULL, &ctx->readback_buffer);
+    assert(res == VK_SUCCESS);
+
+    VkMemoryRequirements mem_reqs;
+    vkGetBufferMemoryRequirements(ctx->device, ctx->readback_buffer, &mem_reqs);
+    VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = mem_reqs.size,
+        .memoryTypeIndex =
+            vulkan_find_memory_type(mem_reqs.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                    ctx->physical_device),
+    };
+    res = vkAllocateMemory(
+        ctx->device, &alloc_info, NULL, &ctx->readback_memory);
+    assert(res == VK_SUCCESS);
+    res = vkBindBufferMemory(
+        ctx->device, ctx->readback_buffer, ctx->readback_memory, 0);
+    assert(res == VK_SUCCESS);
+    res = vkMapMemory(ctx->device,
+                      ctx->readback_memory,
+                      0,
+                      VK_WHOLE_SIZE,
+                      0,
+                      (void**)&ctx->readback_pixels);
+    assert(res == VK_SUCCESS);
+
+    end("vulkan_make_readback");
+}
+
+// copies the last rendered frame into readback_pixels (RGBA, tightly packed)
+void vulkan_read_pixels(VulkanContext* ctx) {
+    assert(ctx->readback_buffer);
+    uint32_t frame = ctx->frame_index;
+    VkCommandBuffer cmd = vulkan_begin_frame(ctx);
+
+    vulkan_image_barrier(cmd,
+                         ctx->image,
+                         ctx->final_layout,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_TRANSFER_READ_BIT);
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {ctx->width, ctx->height, 1},
+    };
+    vkCmdCopyImageToBuffer(cmd,
+                           ctx->image,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           ctx->readback_buffer,
+                           1,
+                           &region);
+    VkBufferMemoryBarrier host_barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = ctx->readback_buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+    vkCmdPipelineBarrier(cmd,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0,
+                         NULL,
+                         1,
+                         &host_barrier,
+                         0,
+                         NULL);
+    vulkan_image_barrier(cmd,
+                         ctx->image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         ctx->final_layout,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_TRANSFER_READ_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0);
+    vulkan_end_frame(ctx);
+
+    VkResult res = vkWaitForFences(
+        ctx->device, 1, &ctx->frame_fences[frame], VK_TRUE, UINT64_MAX);
+    assert(res == VK_SUCCESS);
+}
+
+VkShaderModule vulkan_load_shader(VkDevice device, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return VK_NULL_HANDLE;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint32_t* code = malloc(size);
+    assert(code);
+    size_t read = fread(code, 1, size, file);
+    fclose(file);
+    assert(read == (size_t)size);
+
+    VkShaderModuleCreateInfo shader_info = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = (size_t)size,
+        .pCode = code,
+    };
+    VkShaderModule module;
+    VkResult res = vkCreateShaderModule(device, &shader_info, NULL, &module);
+    assert(res == VK_SUCCESS);
+    free(code);
+    return module;
+}
+
+// peaks live in one host-visible storage buffer, drawn by a fragment shader
+// that reads only the pyramid level matching the zoom
+void vulkan_make_waveform_pipeline(VulkanContext* ctx) {
+    header("vulkan_make_waveform_pipeline");
+
+    VkShaderModule vert_shader =
+        vulkan_load_shader(ctx->device, "build/shaders/waveform.vert.spv");
+    VkShaderModule frag_shader =
+        vulkan_load_shader(ctx->device, "build/shaders/waveform.frag.spv");
+    if (!vert_shader || !frag_shader) {
+        call_carmack("waveform shaders missing, audio clips disabled");
+        end("vulkan_make_waveform_pipeline");
+        return;
+    }
+
+    VkBufferCreateInfo buffer_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = sizeof(WaveformPeak) * (VkDeviceSize)waveform_buffer_peaks,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkResult res = vkCreateBuffer(
+        ctx->device, &buffer_info, NULL, &ctx->waveform_buffer);
+    assert(res == VK_SUCCESS);
+    VkMemoryRequirements mem_reqs;
+    vkGetBufferMemoryRequirements(ctx->device, ctx->waveform_buffer, &mem_reqs);
+    VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = mem_reqs.size,
+        .memoryTypeIndex =
+            vulkan_find_memory_type(mem_reqs.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                    ctx->physical_device),
+    };
+    res = vkAllocateMemory(
+        ctx->device, &alloc_info, NULL, &ctx->waveform_memory);
+    assert(res == VK_SUCCESS);
+    res = vkBindBufferMemory(
+        ctx->device, ctx->waveform_buffer, ctx->waveform_memory, 0);
+    assert(res == VK_SUCCESS);
+    res = vkMapMemory(ctx->device,
+                      ctx->waveform_memory,
+                      0,
+                      VK_WHOLE_SIZE,
+                      0,
+                      (void**)&ctx->waveform_mapped);
+    assert(res == VK_SUCCESS);
+
+    VkDescriptorSetLayoutBinding binding = {
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &binding,
+    };
+    res = vkCreateDescriptorSetLayout(
+        ctx->device, &set_layout_info, NULL, &ctx->waveform_set_layout);
+    assert(res == VK_SUCCESS);
+    VkDescriptorPoolSize pool_size = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+    };
+    VkDescriptorPoolCreateInfo pool_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &pool_size,
+    };
+    res = vkCreateDescriptorPool(
+        ctx->device, &pool_info, NULL, &ctx->waveform_descriptor_pool);
+    assert(res == VK_SUCCESS);
+    VkDescriptorSetAllocateInfo set_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = ctx->waveform_descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &ctx->waveform_set_layout,
+    };
+    res = vkAllocateDescriptorSets(ctx->device, &set_info, &ctx->waveform_set);
+    assert(res == VK_SUCCESS);
+    VkDescriptorBufferInfo descriptor_buffer = {
+        .buffer = ctx->waveform_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = ctx->waveform_set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &descriptor_buffer,
+    };
+    vkUpdateDescriptorSets(ctx->device, 1, &write, 0, NULL);
+
+    VkPushConstantRange push_range = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(WaveformPush),
+    };
+    VkPipelineLayoutCreateInfo layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &ctx->waveform_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_range,
+    };
+    res = vkCreatePipelineLayout(
+        ctx->device, &layout_info, NULL, &ctx->waveform_pipeline_layout);
+    assert(res == VK_SUCCESS);
+
+    VkPipelineShaderStageCreateInfo stages[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vert_shader,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = frag_shader,
+            .pName = "main",
+        },
+    };
+    // the quad comes from gl_VertexIndex, no vertex buffers
+    VkPipelineVertexInputStateCreateInfo vertex_input = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    };
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+    };
+    VkPipelineViewportStateCreateInfo viewport_state = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+    VkPipelineRasterizationStateCreateInfo rasterization = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .lineWidth = 1.0f,
+    };
+    VkPipelineMultisampleStateCreateInfo multisample = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    VkPipelineColorBlendAttachmentState blend_attachment = {
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+    };
+    VkPipelineColorBlendStateCreateInfo color_blend = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount = 1,
+        .pAttachments = &blend_attachment,
+    };
+    VkDynamicState dynamic_states[2] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+    VkPipelineDynamicStateCreateInfo dynamic_state = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamic_states,
+    };
+    VkGraphicsPipelineCreateInfo pipeline_info = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = stages,
+        .pVertexInputState = &vertex_input,
+        .pInputAssemblyState = &input_assembly,
+        .pViewportState = &viewport_state,
+        .pRasterizationState = &rasterization,
+        .pMultisampleState = &multisample,
+        .pColorBlendState = &color_blend,
+        .pDynamicState = &dynamic_state,
+        .layout = ctx->waveform_pipeline_layout,
+        .renderPass = ctx->render_pass,
+        .subpass = 0,
+    };
+    res = vkCreateGraphicsPipelines(ctx->device,
+                                    VK_NULL_HANDLE,
+                                    1,
+                                    &pipeline_info,
+                                    NULL,
+                                    &ctx->waveform_pipeline);
+    assert(res == VK_SUCCESS);
+    vkDestroyShaderModule(ctx->device, vert_shader, NULL);
+    vkDestroyShaderModule(ctx->device, frag_shader, NULL);
+
+    end("vulkan_make_waveform_pipeline");
+}
+
+// copies the pyramid into the storage buffer once; UINT32_MAX when full
+uint32_t vulkan_upload_waveform(VulkanContext* ctx,
+                                const WaveformPyramid* pyramid) {
+    if (!ctx->waveform_pipeline || ctx->waveform_count == max_waveforms ||
+        pyramid->peak_count > waveform_buffer_peaks - ctx->waveform_peaks_used)
+        return UINT32_MAX;
+    uint32_t index = ctx->waveform_count++;
+    WaveformPyramid* gpu = &ctx->waveforms[index];
+    *gpu = *pyramid;
+    gpu->gpu_base = ctx->waveform_peaks_used;
+    memcpy(ctx->waveform_mapped + gpu->gpu_base,
+           pyramid->peaks,
+           sizeof(WaveformPeak) * pyramid->peak_count);
+    ctx->waveform_peaks_used += pyramid->peak_count;
+    return index;
+}
+
+void vulkan_add_waveform_clip(VulkanContext* ctx,
+                              uint32_t waveform,
+                              float start_col,
+                              uint32_t row,
+                              uint32_t rows) {
+    assert(waveform < ctx->waveform_count);
+    if (ctx->waveform_clip_count == max_waveform_clips) return;
+    ctx->waveform_clips[ctx->waveform_clip_count++] = (WaveformClip){
+        .waveform = waveform,
+        .start_col = start_col,
+        .row = row,
+        .rows = rows,
+    };
+}
+
+void vulkan_record_waveforms(VulkanContext* ctx,
+                             VkCommandBuffer cmd,
+                             const PianoRollView* view,
+                             const VkRect2D* clip) {
+    if (!ctx->waveform_pipeline || !ctx->waveform_clip_count ||
+        view->seconds_per_cell <= 0.0f)
+        return;
+
+    // roll area only, the sidebar stays on top
+    float roll_x = (float)view->sidebar_width;
+    float visible_x0 = (float)clip->offset.x > roll_x ? clip->offset.x : roll_x;
+    float visible_x1 = (float)(clip->offset.x + clip->extent.width);
+    if (visible_x1 <= visible_x0) return;
+    VkRect2D scissor = {
+        .offset = {(int32_t)visible_x0, clip->offset.y},
+        .extent = {(uint32_t)(visible_x1 - visible_x0), clip->extent.height},
+    };
+    VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)view->width,
+        .height = (float)view->height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdBindPipeline(
+        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx->waveform_pipeline);
+    vkCmdBindDescriptorSets(cmd,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            ctx->waveform_pipeline_layout,
+                            0,
+                            1,
+                            &ctx->waveform_set,
+                            0,
+                            NULL);
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    for (uint32_t i = 0; i < ctx->waveform_clip_count; i++) {
+        const WaveformClip* c = &ctx->waveform_clips[i];
+        const WaveformPyramid* w = &ctx->waveforms[c->waveform];
+        float samples_per_pixel =
+            view->seconds_per_cell * w->sample_rate / view->cell_width;
+        float x = roll_x + c->start_col * view->cell_width - view->scroll_x;
+        float width = (float)w->sample_count / samples_per_pixel;
+        float y = c->row * view->cell_height - view->scroll_y;
+        float height = c->rows * view->cell_height;
+        // cull, then trim to the visible span so the quad stays small
+        if (x + width <= visible_x0 || x >= visible_x1) continue;
+        if (y + height <= 0.0f || y >= (float)view->height) continue;
+        float skipped = x < visible_x0 ? visible_x0 - x : 0.0f;
+        float right = x + width < visible_x1 ? x + width : visible_x1;
+
+        uint32_t level = waveform_pick_level(w, samples_per_pixel);
+        float samples_per_peak = (float)waveform_base_samples;
+        for (uint32_t l = 0; l < level; l++)
+            samples_per_peak *= waveform_level_factor;
+        float peaks_per_pixel = samples_per_pixel / samples_per_peak;
+        WaveformPush push = {
+            .rect = {x + skipped, y, right - (x + skipped), height},
+            .color = {0.45f, 0.70f, 0.85f, 0.85f},
+            .target = {(float)view->width, (float)view->height},
+            .first_peak = skipped * peaks_per_pixel,
+            .peaks_per_pixel = peaks_per_pixel,
+            .level_offset = w->gpu_base + w->level_offsets[level],
+            .level_count = w->level_counts[level],
+        };
+        vkCmdPushConstants(cmd,
+                           ctx->waveform_pipeline_layout,
+                           VK_SHADER_STAGE_VERTEX_BIT |
+                               VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0,
+                           sizeof(push),
+                           &push);
+        vkCmdDraw(cmd, 4, 1, 0, 0);
+    }
+}
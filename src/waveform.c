@@ -0,0 +1,318 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// src/waveform.c
+//=============================================================================
+
+#include "waveform.h"
+#include "data.h"
+#include "debug_macros.h"
+#include "macros.h"
+#include "vulkan.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the pyramid is cached as <audio>.peaks and rebuilt when the audio changes
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint64_t sample_count;
+    uint64_t audio_size;
+    int64_t audio_mtime;
+    uint32_t level_count;
+    uint32_t peak_count;
+    uint32_t level_offsets[waveform_max_levels];
+    uint32_t level_counts[waveform_max_levels];
+} WaveformCacheHeader;
+
+enum {
+    waveform_cache_version = 1,
+    max_path = 4096,
+};
+
+// lays out every level up front so the build never reallocates
+void waveform_layout(WaveformPyramid* pyramid,
+                     uint64_t sample_count,
+                     uint32_t sample_rate) {
+    pyramid->sample_count = sample_count;
+    pyramid->sample_rate = sample_rate;
+    pyramid->level_count = 0;
+    pyramid->peak_count = 0;
+    uint64_t count =
+        (sample_count + waveform_base_samples - 1) / waveform_base_samples;
+    if (count == 0) count = 1;
+    while (pyramid->level_count < waveform_max_levels) {
+        uint32_t level = pyramid->level_count++;
+        pyramid->level_offsets[level] = pyramid->peak_count;
+        pyramid->level_counts[level] = (uint32_t)count;
+        pyramid->peak_count += (uint32_t)count;
+        if (count == 1) break;
+        count = (count + waveform_level_factor - 1) / waveform_level_factor;
+    }
+}
+
+// level 0 straight from the samples; channels fold into one envelope
+void waveform_build_base(WaveformPyramid* pyramid,
+                         const void* samples,
+                         uint32_t channels,
+                         uint32_t bits) {
+    WaveformPeak* out = pyramid->peaks + pyramid->level_offsets[0];
+    const int16_t* s16 = samples;
+    const float* f32 = samples;
+    for (uint32_t peak = 0; peak < pyramid->level_counts[0]; peak++) {
+        uint64_t first = (uint64_t)peak * waveform_base_samples;
+        uint64_t last = first + waveform_base_samples;
+        if (last > pyramid->sample_count) last = pyramid->sample_count;
+        float lo = 0.0f, hi = 0.0f, sum = 0.0f;
+        uint64_t begin = first * channels;
+        uint64_t stop = last * channels;
+        if (bits == 16) {
+            for (uint64_t i = begin; i < stop; i++) {
+                float v = s16[i] * (1.0f / 32768.0f);
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+                sum += v * v;
+            }
+        } else {
+            for (uint64_t i = begin; i < stop; i++) {
+                float v = f32[i];
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+                sum += v * v;
+            }
+        }
+        uint64_t n = stop - begin;
+        out[peak] = (WaveformPeak){
+            .min = lo,
+            .max = hi,
+            .rms = n ? sqrtf(sum / (float)n) : 0.0f,
+        };
+    }
+}
+
+// every coarser level merges waveform_level_factor peaks of the one below
+void waveform_build_levels(WaveformPyramid* pyramid) {
+    for (uint32_t level = 1; level < pyramid->level_count; level++) {
+        const WaveformPeak* in =
+            pyramid->peaks + pyramid->level_offsets[level - 1];
+        uint32_t in_count = pyramid->level_counts[level - 1];
+        WaveformPeak* out = pyramid->peaks + pyramid->level_offsets[level];
+        for (uint32_t peak = 0; peak < pyramid->level_counts[level]; peak++) {
+            uint32_t first = peak * waveform_level_factor;
+            uint32_t last = first + waveform_level_factor;
+            if (last > in_count) last = in_count;
+            WaveformPeak merged = in[first];
+            float sum = 0.0f;
+            for (uint32_t i = first; i < last; i++) {
+                merged.min = in[i].min < merged.min ? in[i].min : merged.min;
+                merged.max = in[i].max > merged.max ? in[i].max : merged.max;
+                sum += in[i].rms * in[i].rms;
+            }
+            merged.rms = sqrtf(sum / (float)(last - first));
+            out[peak] = merged;
+        }
+    }
+}
+
+// mmaps a PCM16 or float32 WAV; returns the data chunk or NULL
+const void* waveform_map_wav(const char* path,
+                             size_t* map_size,
+                             void** map,
+                             uint32_t* channels,
+                             uint32_t* bits,
+                             uint32_t* sample_rate,
+                             uint64_t* frames) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 44) {
+        close(fd);
+        return NULL;
+    }
+    uint8_t* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    *map = data;
+    *map_size = st.st_size;
+    if (memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) goto fail;
+
+    uint16_t format = 0;
+    *channels = 0;
+    size_t at = 12;
+    while (at + 8 <= (size_t)st.st_size) {
+        uint32_t chunk_size = read_le32(data + at + 4);
+        const uint8_t* chunk = data + at + 8;
+        if (!memcmp(data + at, "fmt ", 4) && chunk_size >= 16) {
+            format = read_le16(chunk);
+            *channels = read_le16(chunk + 2);
+            *sample_rate = read_le32(chunk + 4);
+            *bits = read_le16(chunk + 14);
+        } else if (!memcmp(data + at, "data", 4) && *channels) {
+            size_t available = (size_t)st.st_size - (at + 8);
+            if (chunk_size > available) chunk_size = available;
+            uint8_t pcm16 = format == 1 && *bits == 16;
+            uint8_t float32 = format == 3 && *bits == 32;
+            if (!pcm16 && !float32) goto fail;
+            *frames = chunk_size / (*channels * (*bits / 8));
+            return chunk;
+        }
+        at += 8 + chunk_size + (chunk_size & 1);
+    }
+fail:
+    munmap(data, st.st_size);
+    *map = NULL;
+    return NULL;
+}
+
+uint8_t waveform_load_cache(const char* cache_path,
+                            uint64_t audio_size,
+                            int64_t audio_mtime,
+                            WaveformPyramid* pyramid) {
+    FILE* file = fopen(cache_path, "rb");
+    if (!file) return 0;
+    WaveformCacheHeader h;
+    uint8_t ok = fread(&h, sizeof(h), 1, file) == 1 &&
+                 !memcmp(h.magic, "WARPEAKS", 8) &&
+                 h.version == waveform_cache_version &&
+                 h.audio_size == audio_size && h.audio_mtime == audio_mtime &&
+                 h.level_count <= waveform_max_levels;
+    if (ok) {
+        pyramid->sample_count = h.sample_count;
+        pyramid->sample_rate = h.sample_rate;
+        pyramid->level_count = h.level_count;
+        pyramid->peak_count = h.peak_count;
+        memcpy(pyramid->level_offsets,
+               h.level_offsets,
+               sizeof(h.level_offsets));
+        memcpy(pyramid->level_counts, h.level_counts, sizeof(h.level_counts));
+        pyramid->peaks = malloc(sizeof(WaveformPeak) * h.peak_count);
+        assert(pyramid->peaks);
+        ok = fread(pyramid->peaks, sizeof(WaveformPeak), h.peak_count, file) ==
+             h.peak_count;
+        if (!ok) {
+            free(pyramid->peaks);
+            pyramid->peaks = NULL;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+void waveform_save_cache(const char* cache_path,
+                         uint64_t audio_size,
+                         int64_t audio_mtime,
+                         const WaveformPyramid* pyramid) {
+    FILE* file = fopen(cache_path, "wb");
+    if (!file) {
+        call_carmack("waveform: cannot write %s", cache_path);
+        return;
+    }
+    WaveformCacheHeader h = {
+        .magic = {'W', 'A', 'R', 'P', 'E', 'A', 'K', 'S'},
+        .version = waveform_cache_version,
+        .sample_rate = pyramid->sample_rate,
+        .sample_count = pyramid->sample_count,
+        .audio_size = audio_size,
+        .audio_mtime = audio_mtime,
+        .level_count = pyramid->level_count,
+        .peak_count = pyramid->peak_count,
+    };
+    memcpy(h.level_offsets, pyramid->level_offsets, sizeof(h.level_offsets));
+    memcpy(h.level_counts, pyramid->level_counts, sizeof(h.level_counts));
+    fwrite(&h, sizeof(h), 1, file);
+    fwrite(pyramid->peaks, sizeof(WaveformPeak), pyramid->peak_count, file);
+    fclose(file);
+}
+
+// loads <path>.peaks, or builds the pyramid from the WAV and writes it there
+uint8_t waveform_open(const char* path, WaveformPyramid* pyramid) {
+    header("waveform_open %s", path);
+
+    struct stat audio;
+    if (stat(path, &audio) < 0) {
+        call_carmack("waveform: cannot stat %s", path);
+        end("waveform_open");
+        return 0;
+    }
+    char cache_path[max_path];
+    snprintf(cache_path, sizeof(cache_path), "%s.peaks", path);
+    uint64_t audio_size = (uint64_t)audio.st_size;
+    int64_t audio_mtime = (int64_t)audio.st_mtime;
+    if (waveform_load_cache(cache_path, audio_size, audio_mtime, pyramid)) {
+        call_carmack("waveform: cached %u peaks", pyramid->peak_count);
+        end("waveform_open");
+        return 1;
+    }
+
+    void* map = NULL;
+    size_t map_size = 0;
+    uint32_t channels = 0, bits = 0, sample_rate = 0;
+    uint64_t frames = 0;
+    const void* samples = waveform_map_wav(
+        path, &map_size, &map, &channels, &bits, &sample_rate, &frames);
+    if (!samples) {
+        call_carmack("waveform: %s is not PCM16 or float32 WAV", path);
+        end("waveform_open");
+        return 0;
+    }
+    waveform_layout(pyramid, frames, sample_rate);
+    pyramid->peaks = malloc(sizeof(WaveformPeak) * pyramid->peak_count);
+    assert(pyramid->peaks);
+    waveform_build_base(pyramid, samples, channels, bits);
+    waveform_build_levels(pyramid);
+    munmap(map, map_size);
+    waveform_save_cache(cache_path, audio_size, audio_mtime, pyramid);
+
+    end("waveform_open");
+    return 1;
+}
+
+// finest level with at least one sample per pixel per peak, so a pixel
+// column reads at most waveform_level_factor peaks
+uint32_t waveform_pick_level(const WaveformPyramid* pyramid,
+                             float samples_per_pixel) {
+    uint32_t level = 0;
+    float samples_per_peak = waveform_base_samples;
+    while (level + 1 < pyramid->level_count &&
+           samples_per_peak * waveform_level_factor <= samples_per_pixel) {
+        samples_per_peak *= waveform_level_factor;
+        level++;
+    }
+    return level;
+}
+
+// WAR_AUDIO=<file.wav> places one clip at the timeline origin
+void waveform_load_env_clip(VulkanContext* ctx) {
+    const char* path = getenv("WAR_AUDIO");
+    if (!path || !ctx->waveform_pipeline) return;
+    WaveformPyramid pyramid;
+    if (!waveform_open(path, &pyramid)) return;
+    uint32_t waveform = vulkan_upload_waveform(ctx, &pyramid);
+    if (waveform == UINT32_MAX) return;
+    // one octave below C6
+    vulkan_add_waveform_clip(ctx, waveform, 0.0f, 48 + 1, 12);
+}
@@ -19,10 +19,18 @@
 //=============================================================================
 
 #include "wayland.h"
+#include "alsa.h"
+#include "audio.h"
 #include "data.h"
 #include "debug_macros.h"
 #include "macros.h"
+#include "meter.h"
+#include "midi.h"
+#include "notes.h"
+#include "sampler.h"
+#include "sequencer.h"
 #include "vulkan.h"
+#include "waveform.h"
 
 #include <assert.h>
 #include <dirent.h>
@@ -67,9 +75,65 @@ void wayland_init() {
         height = 1080,
         stride = width * 4,
         ARGB8888 = 0,
+        // horizontal slack on both sides for viewport-only scrolling
+        scroll_margin = 512,
+        canvas_width = width + 2 * scroll_margin,
+        canvas_stride = canvas_width * 4,
+        pitch_count = 128,
     };
 #if DMABUF
-    VulkanContext vulkan_context = vulkan_make_dmabuf_fd(width, height);
+    VulkanContext vulkan_context = vulkan_make_dmabuf_fd(canvas_width, height);
+    PianoRollView view = {
+        .width = width,
+        .height = height,
+        .scroll_x = 0,
+        .scroll_y = 48 * 20, // C6 at the top
+        .cell_width = 24,
+        .cell_height = 20,
+        .cells_per_beat = 4,
+        .beats_per_bar = 4,
+        .sidebar_width = 96,
+        .cursor_col = 0,
+        .cursor_row = 48 + 12,
+        .playhead_col = 0,
+        .selection_cols = 0,
+    };
+    // the canvas keeps the sidebar at x = 0 and the roll after it; the main
+    // surface crops the roll with its viewport, the sidebar subsurface crops
+    // the sidebar out of the same buffer
+    float canvas_scroll_x = -(float)scroll_margin;
+    uint8_t canvas_dirty = 1;
+
+    // overlays never touch the canvas: moving one is a set_position (and a
+    // set_destination when it resizes) applied with the next main commit
+    OverlaySurface overlays[overlay_count] = {0};
+    uint8_t overlays_created = 0;
+    uint32_t overlay_pool_id = 0;
+    uint8_t playing = 0;
+    uint32_t auditioning = pitch_count; // the pitch j or k is holding
+    float tempo_bpm = 120.0f;
+    // the UI's own copy for playhead conversion, same as the engine's
+    TempoMap tempo_map;
+    tempo_map_constant(&tempo_map, audio_sample_rate, tempo_bpm);
+    // the playhead follows the engine's position events, not frame time;
+    // the device's period is the engine block
+    AlsaDevice* audio_device = alsa_open_env(audio_sample_rate);
+    AudioEngine* audio = audio_make_engine(
+        audio_sample_rate,
+        audio_device ? audio_device->period_frames : audio_block_frames);
+    audio->device = audio_device;
+    Sampler* sampler = sampler_make();
+    sampler_load_env_clip(sampler);
+    sampler_start(sampler);
+    audio->sampler = sampler;
+    audio_load_env_plugin(audio);
+    audio_start(audio);
+    midi_start(audio);
+    view.seconds_per_cell = 60.0f / tempo_bpm / view.cells_per_beat;
+    NoteTrack note_track;
+    notes_make_track(&note_track, 0);
+    view.notes = &note_track;
+    waveform_load_env_clip(&vulkan_context);
 #endif
 #if WL_SHM
     int shm_fd = syscall(SYS_memfd_create, "shm", MFD_CLOEXEC);
@@ -93,14 +157,21 @@ void wayland_init() {
     uint32_t zwp_linux_buffer_params_v1_id = 0;
     uint32_t zwp_linux_dmabuf_feedback_v1_id = 0;
 #endif
-#if WL_SHM
     uint32_t wl_shm_id = 0;
+#if WL_SHM
     uint32_t wl_shm_pool_id = 0;
 #endif
     uint32_t wl_buffer_id = 0;
     uint32_t wl_callback_id = 0;
     uint32_t wl_compositor_id = 0;
     uint32_t wl_surface_id = 0;
+    uint32_t wl_subcompositor_id = 0;
+#if DMABUF
+    uint32_t sidebar_surface_id = 0;
+    uint32_t sidebar_subsurface_id = 0;
+    uint32_t wp_viewport_id = 0;
+    uint32_t sidebar_viewport_id = 0;
+#endif
     uint32_t xdg_wm_base_id = 0;
     uint32_t xdg_surface_id = 0;
     uint32_t xdg_toplevel_id = 0;
@@ -155,9 +226,14 @@ void wayland_init() {
 
     uint32_t new_id = wl_registry_id + 1;
     while (1) {
-        int ret = poll(&pfd, 1, -1);
+        // frame callbacks stop while the window is hidden: the engine's
+        // events are drained on a timer as well, or its commands back up
+        int ret = poll(&pfd, 1, audio_idle_ms);
         assert(ret >= 0);
-        if (ret == 0) call_carmack("timeout");
+#if DMABUF
+        audio_drain(audio);
+        audio_idle(audio);
+#endif
 
         if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
             call_carmack("wayland socket error or hangup: %s", strerror(errno));
@@ -200,18 +276,24 @@ void wayland_init() {
                 const char* iname = (const char*)buffer + offset +
                                     16; // COMMENT OPTIMIZE: perfect hash
                 if (strcmp(iname, "wl_shm") == 0) {
-#if WL_SHM
                     wayland_registry_bind(fd, buffer, offset, size, new_id);
                     wl_shm_id = new_id;
+#if WL_SHM
                     obj_op[obj_op_index(wl_shm_id, 0)] = &&wl_shm_format;
-                    new_id++;
 #endif
+                    new_id++;
                 } else if (strcmp(iname, "wl_compositor") == 0) {
                     wayland_registry_bind(fd, buffer, offset, size, new_id);
                     wl_compositor_id = new_id;
                     obj_op[obj_op_index(wl_compositor_id, 0)] =
                         &&wl_compositor_jump;
                     new_id++;
+                } else if (strcmp(iname, "wl_subcompositor") == 0) {
+                    wayland_registry_bind(fd, buffer, offset, size, new_id);
+                    wl_subcompositor_id = new_id;
+                    obj_op[obj_op_index(wl_subcompositor_id, 0)] =
+                        &&wl_subcompositor_jump;
+                    new_id++;
                 } else if (strcmp(iname, "wl_output") == 0) {
                     wayland_registry_bind(fd, buffer, offset, size, new_id);
                     wl_output_id = new_id;
@@ -374,6 +456,239 @@ void wayland_init() {
                     new_id++;
                 }
 #if DMABUF
+                if (!wp_viewport_id && wp_viewporter_id &&
+                    wl_subcompositor_id && wl_surface_id) {
+                    uint8_t get_viewport[16];
+                    write_le32(get_viewport, wp_viewporter_id);
+                    write_le16(get_viewport + 4, 1);
+                    write_le16(get_viewport + 6, 16);
+                    write_le32(get_viewport + 8, new_id);
+                    write_le32(get_viewport + 12, wl_surface_id);
+                    dump_bytes("wp_viewporter::get_viewport request",
+                               get_viewport,
+                               16);
+                    call_carmack("bound: wp_viewport");
+                    ssize_t get_viewport_written = write(fd, get_viewport, 16);
+                    assert(get_viewport_written == 16);
+                    wp_viewport_id = new_id;
+                    new_id++;
+
+                    uint8_t create_sidebar_surface[12];
+                    write_le32(create_sidebar_surface, wl_compositor_id);
+                    write_le16(create_sidebar_surface + 4, 0);
+                    write_le16(create_sidebar_surface + 6, 12);
+                    write_le32(create_sidebar_surface + 8, new_id);
+                    dump_bytes("create_surface request",
+                               create_sidebar_surface,
+                               12);
+                    call_carmack("bound: wl_surface (sidebar)");
+                    ssize_t create_sidebar_surface_written =
+                        write(fd, create_sidebar_surface, 12);
+                    assert(create_sidebar_surface_written == 12);
+                    sidebar_surface_id = new_id;
+                    obj_op[obj_op_index(sidebar_surface_id, 0)] =
+                        &&wl_surface_enter;
+                    obj_op[obj_op_index(sidebar_surface_id, 1)] =
+                        &&wl_surface_leave;
+                    new_id++;
+
+                    // synchronized: sidebar state lands with the parent commit
+                    uint8_t get_subsurface[20];
+                    write_le32(get_subsurface, wl_subcompositor_id);
+                    write_le16(get_subsurface + 4, 1);
+                    write_le16(get_subsurface + 6, 20);
+                    write_le32(get_subsurface + 8, new_id);
+                    write_le32(get_subsurface + 12, sidebar_surface_id);
+                    write_le32(get_subsurface + 16, wl_surface_id);
+                    dump_bytes("wl_subcompositor::get_subsurface request",
+                               get_subsurface,
+                               20);
+                    call_carmack("bound: wl_subsurface (sidebar)");
+                    ssize_t get_subsurface_written =
+                        write(fd, get_subsurface, 20);
+                    assert(get_subsurface_written == 20);
+                    sidebar_subsurface_id = new_id;
+                    new_id++;
+
+                    uint8_t sidebar_set_position[16];
+                    write_le32(sidebar_set_position, sidebar_subsurface_id);
+                    write_le16(sidebar_set_position + 4, 1);
+                    write_le16(sidebar_set_position + 6, 16);
+                    write_le32(sidebar_set_position + 8, 0);
+                    write_le32(sidebar_set_position + 12, 0);
+                    dump_bytes("wl_subsurface::set_position request",
+                               sidebar_set_position,
+                               16);
+                    ssize_t sidebar_set_position_written =
+                        write(fd, sidebar_set_position, 16);
+                    assert(sidebar_set_position_written == 16);
+
+                    uint8_t get_sidebar_viewport[16];
+                    write_le32(get_sidebar_viewport, wp_viewporter_id);
+                    write_le16(get_sidebar_viewport + 4, 1);
+                    write_le16(get_sidebar_viewport + 6, 16);
+                    write_le32(get_sidebar_viewport + 8, new_id);
+                    write_le32(get_sidebar_viewport + 12, sidebar_surface_id);
+                    dump_bytes("wp_viewporter::get_viewport request",
+                               get_sidebar_viewport,
+                               16);
+                    call_carmack("bound: wp_viewport (sidebar)");
+                    ssize_t get_sidebar_viewport_written =
+                        write(fd, get_sidebar_viewport, 16);
+                    assert(get_sidebar_viewport_written == 16);
+                    sidebar_viewport_id = new_id;
+                    new_id++;
+                }
+                if (!overlays_created && wp_viewport_id && wl_shm_id) {
+                    // one ARGB8888 premultiplied pixel per overlay
+                    uint32_t overlay_pixels[overlay_count] = {
+                        [overlay_playhead] = 0xffe04040,
+                        [overlay_cursor] = 0xfff2bf33,
+                        [overlay_selection] = 0x40060c14,
+                        [overlay_meter_left] = 0xff40c060,
+                        [overlay_meter_right] = 0xff40c060,
+                        [overlay_loudness] = 0xfff0f0f0,
+                    };
+                    for (uint32_t i = 0; i < overlay_spectrum_bands; i++)
+                        overlay_pixels[overlay_spectrum + i] = 0x80306080;
+                    int overlay_fd =
+                        syscall(SYS_memfd_create, "overlay", MFD_CLOEXEC);
+                    assert(overlay_fd >= 0);
+                    ssize_t overlay_pixels_written = write(
+                        overlay_fd, overlay_pixels, sizeof(overlay_pixels));
+                    assert(overlay_pixels_written == sizeof(overlay_pixels));
+
+                    uint8_t create_pool[16];
+                    write_le32(create_pool, wl_shm_id);
+                    write_le16(create_pool + 4, 0);
+                    write_le16(create_pool + 6, 16);
+                    write_le32(create_pool + 8, new_id);
+                    write_le32(create_pool + 12, sizeof(overlay_pixels));
+                    struct iovec iov = {
+                        .iov_base = create_pool,
+                        .iov_len = 16,
+                    };
+                    char cmsgbuf[CMSG_SPACE(sizeof(int))] = {0};
+                    struct msghdr msg = {0};
+                    msg.msg_iov = &iov;
+                    msg.msg_iovlen = 1;
+                    msg.msg_control = cmsgbuf;
+                    msg.msg_controllen = sizeof(cmsgbuf);
+                    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+                    cmsg->cmsg_level = SOL_SOCKET;
+                    cmsg->cmsg_type = SCM_RIGHTS;
+                    *((int*)CMSG_DATA(cmsg)) = overlay_fd;
+                    ssize_t pool_sent = sendmsg(fd, &msg, 0);
+                    if (pool_sent < 0) perror("sendmsg");
+                    assert(pool_sent == 16);
+                    dump_bytes("wl_shm_create_pool request", create_pool, 16);
+                    call_carmack("bound: wl_shm_pool (overlays)");
+                    close(overlay_fd);
+                    overlay_pool_id = new_id;
+                    new_id++;
+
+                    for (uint32_t i = 0; i < overlay_count; i++) {
+                        OverlaySurface* overlay = &overlays[i];
+
+                        uint8_t create_buffer[32];
+                        write_le32(create_buffer, overlay_pool_id);
+                        write_le16(create_buffer + 4, 0);
+                        write_le16(create_buffer + 6, 32);
+                        write_le32(create_buffer + 8, new_id);
+                        write_le32(create_buffer + 12, i * 4); // offset
+                        write_le32(create_buffer + 16, 1);
+                        write_le32(create_buffer + 20, 1);
+                        write_le32(create_buffer + 24, 4);
+                        write_le32(create_buffer + 28, ARGB8888);
+                        dump_bytes("wl_shm_pool_create_buffer request",
+                                   create_buffer,
+                                   32);
+                        ssize_t create_buffer_written =
+                            write(fd, create_buffer, 32);
+                        assert(create_buffer_written == 32);
+                        overlay->buffer_id = new_id;
+                        // never released in practice, a 1x1 buffer is copied
+                        obj_op[obj_op_index(overlay->buffer_id, 0)] =
+                            &&wl_buffer_release;
+                        new_id++;
+
+                        uint8_t create_surface[12];
+                        write_le32(create_surface, wl_compositor_id);
+                        write_le16(create_surface + 4, 0);
+                        write_le16(create_surface + 6, 12);
+                        write_le32(create_surface + 8, new_id);
+                        dump_bytes(
+                            "create_surface request", create_surface, 12);
+                        ssize_t create_surface_written =
+                            write(fd, create_surface, 12);
+                        assert(create_surface_written == 12);
+                        overlay->surface_id = new_id;
+                        obj_op[obj_op_index(overlay->surface_id, 0)] =
+                            &&wl_surface_enter;
+                        obj_op[obj_op_index(overlay->surface_id, 1)] =
+                            &&wl_surface_leave;
+                        new_id++;
+
+                        uint8_t get_subsurface[20];
+                        write_le32(get_subsurface, wl_subcompositor_id);
+                        write_le16(get_subsurface + 4, 1);
+                        write_le16(get_subsurface + 6, 20);
+                        write_le32(get_subsurface + 8, new_id);
+                        write_le32(get_subsurface + 12, overlay->surface_id);
+                        write_le32(get_subsurface + 16, wl_surface_id);
+                        dump_bytes("wl_subcompositor::get_subsurface request",
+                                   get_subsurface,
+                                   20);
+                        ssize_t get_subsurface_written =
+                            write(fd, get_subsurface, 20);
+                        assert(get_subsurface_written == 20);
+                        overlay->subsurface_id = new_id;
+                        new_id++;
+
+                        uint8_t get_viewport[16];
+                        write_le32(get_viewport, wp_viewporter_id);
+                        write_le16(get_viewport + 4, 1);
+                        write_le16(get_viewport + 6, 16);
+                        write_le32(get_viewport + 8, new_id);
+                        write_le32(get_viewport + 12, overlay->surface_id);
+                        dump_bytes("wp_viewporter::get_viewport request",
+                                   get_viewport,
+                                   16);
+                        ssize_t get_viewport_written =
+                            write(fd, get_viewport, 16);
+                        assert(get_viewport_written == 16);
+                        overlay->viewport_id = new_id;
+                        new_id++;
+
+                        // empty input region: clicks go to the roll below
+                        uint8_t create_region[12];
+                        write_le32(create_region, wl_compositor_id);
+                        write_le16(create_region + 4, 1);
+                        write_le16(create_region + 6, 12);
+                        write_le32(create_region + 8, new_id);
+                        ssize_t create_region_written =
+                            write(fd, create_region, 12);
+                        assert(create_region_written == 12);
+                        uint8_t set_input_region[12];
+                        write_le32(set_input_region, overlay->surface_id);
+                        write_le16(set_input_region + 4, 5);
+                        write_le16(set_input_region + 6, 12);
+                        write_le32(set_input_region + 8, new_id);
+                        ssize_t set_input_region_written =
+                            write(fd, set_input_region, 12);
+                        assert(set_input_region_written == 12);
+                        uint8_t destroy_region[8];
+                        write_le32(destroy_region, new_id);
+                        write_le16(destroy_region + 4, 0);
+                        write_le16(destroy_region + 6, 8);
+                        ssize_t destroy_region_written =
+                            write(fd, destroy_region, 8);
+                        assert(destroy_region_written == 8);
+                        new_id++;
+                    }
+                    overlays_created = 1;
+                }
                 if (!zwp_linux_dmabuf_feedback_v1_id &&
                     zwp_linux_dmabuf_v1_id && wl_surface_id) {
                     uint8_t get_surface_feedback[16];
@@ -459,7 +774,251 @@ void wayland_init() {
                 goto done;
             wl_callback_done:
                 dump_bytes("wl_callback::done event", buffer + offset, size);
-                // COMMENT ADD: render logic
+#if DMABUF
+                if (playing) {
+                    uint64_t audio_frame =
+                        __atomic_load_n(&audio->position, __ATOMIC_RELAXED);
+                    double tick = tempo_map_sample_to_tick(
+                        &tempo_map, (double)audio_frame);
+                    view.playhead_col = (float)(tick * view.cells_per_beat /
+                                                note_ticks_per_beat);
+                    // follow: keep the playhead at three quarters of the roll
+                    float roll_width = (float)(width - view.sidebar_width);
+                    float playhead_x = view.playhead_col * view.cell_width;
+                    if (playhead_x - view.scroll_x > 0.75f * roll_width) {
+                        view.scroll_x = playhead_x - 0.75f * roll_width;
+                    }
+                }
+
+                PianoRollView canvas_view = view;
+                canvas_view.width = canvas_width;
+                canvas_view.scroll_x = canvas_scroll_x;
+                int32_t canvas_src_x =
+                    (int32_t)(view.scroll_x - canvas_scroll_x);
+                uint8_t canvas_changed = canvas_dirty;
+                if (canvas_src_x < 0 || canvas_src_x > 2 * scroll_margin) {
+                    // re-center the source rect, shift the canvas under it
+                    int32_t shift = canvas_src_x - scroll_margin;
+                    canvas_scroll_x += shift;
+                    canvas_view.scroll_x = canvas_scroll_x;
+                    canvas_src_x = scroll_margin;
+                    if (!canvas_dirty) {
+                        vulkan_scroll_canvas(
+                            &vulkan_context, &canvas_view, shift);
+                    }
+                    canvas_changed = 1;
+                }
+                if (canvas_dirty) {
+                    vulkan_render_frame(&vulkan_context, &canvas_view);
+                    canvas_dirty = 0;
+
+                    // new contents: attach again, the protocol does not
+                    // promise an attached dmabuf is sampled anew
+                    uint8_t sidebar_attach[20];
+                    write_le32(sidebar_attach, sidebar_surface_id);
+                    write_le16(sidebar_attach + 4, 1);
+                    write_le16(sidebar_attach + 6, 20);
+                    write_le32(sidebar_attach + 8, wl_buffer_id);
+                    write_le32(sidebar_attach + 12, 0);
+                    write_le32(sidebar_attach + 16, 0);
+                    dump_bytes(
+                        "wl_surface_attach request", sidebar_attach, 20);
+                    ssize_t sidebar_attach_written =
+                        write(fd, sidebar_attach, 20);
+                    assert(sidebar_attach_written == 20);
+
+                    uint8_t sidebar_damage[24];
+                    write_le32(sidebar_damage, sidebar_surface_id);
+                    write_le16(sidebar_damage + 4, 2);
+                    write_le16(sidebar_damage + 6, 24);
+                    write_le32(sidebar_damage + 8, 0);
+                    write_le32(sidebar_damage + 12, 0);
+                    write_le32(sidebar_damage + 16, view.sidebar_width);
+                    write_le32(sidebar_damage + 20, height);
+                    dump_bytes(
+                        "wl_surface_damage request", sidebar_damage, 24);
+                    ssize_t sidebar_damage_written =
+                        write(fd, sidebar_damage, 24);
+                    assert(sidebar_damage_written == 24);
+
+                    uint8_t sidebar_commit[8];
+                    write_le32(sidebar_commit, sidebar_surface_id);
+                    write_le16(sidebar_commit + 4, 6);
+                    write_le16(sidebar_commit + 6, 8);
+                    dump_bytes(
+                        "wl_surface_commit request", sidebar_commit, 8);
+                    ssize_t sidebar_commit_written =
+                        write(fd, sidebar_commit, 8);
+                    assert(sidebar_commit_written == 8);
+                }
+                if (canvas_changed) {
+                    uint8_t frame_attach[20];
+                    write_le32(frame_attach, wl_surface_id);
+                    write_le16(frame_attach + 4, 1);
+                    write_le16(frame_attach + 6, 20);
+                    write_le32(frame_attach + 8, wl_buffer_id);
+                    write_le32(frame_attach + 12, 0);
+                    write_le32(frame_attach + 16, 0);
+                    dump_bytes("wl_surface_attach request", frame_attach, 20);
+                    ssize_t frame_attach_written = write(fd, frame_attach, 20);
+                    assert(frame_attach_written == 20);
+
+                    uint8_t frame_damage[24];
+                    write_le32(frame_damage, wl_surface_id);
+                    write_le16(frame_damage + 4, 2);
+                    write_le16(frame_damage + 6, 24);
+                    write_le32(frame_damage + 8, 0);
+                    write_le32(frame_damage + 12, 0);
+                    write_le32(frame_damage + 16, width);
+                    write_le32(frame_damage + 20, height);
+                    dump_bytes("wl_surface_damage request", frame_damage, 24);
+                    ssize_t frame_damage_written = write(fd, frame_damage, 24);
+                    assert(frame_damage_written == 24);
+                }
+
+                if (overlays_created) {
+                    // subsurfaces are not clipped to the parent: each is
+                    // cut to the roll here, or hidden
+                    int32_t roll[4] = {
+                        (int32_t)view.sidebar_width,
+                        0,
+                        (int32_t)width,
+                        (int32_t)height,
+                    };
+                    int32_t playhead_x =
+                        roll[0] +
+                        (int32_t)(view.playhead_col * view.cell_width -
+                                  view.scroll_x);
+                    wayland_overlay_place(fd,
+                                          &overlays[overlay_playhead],
+                                          playhead_x,
+                                          0,
+                                          2,
+                                          (int32_t)height,
+                                          roll);
+                    int32_t cursor_x =
+                        roll[0] +
+                        (int32_t)(view.cursor_col * view.cell_width -
+                                  view.scroll_x);
+                    wayland_overlay_place(
+                        fd,
+                        &overlays[overlay_cursor],
+                        cursor_x,
+                        (int32_t)(view.cursor_row * view.cell_height -
+                                  view.scroll_y),
+                        (int32_t)view.cell_width,
+                        (int32_t)view.cell_height,
+                        roll);
+                    int32_t selection_x =
+                        roll[0] +
+                        (int32_t)(view.selection_col * view.cell_width -
+                                  view.scroll_x);
+                    wayland_overlay_place(
+                        fd,
+                        &overlays[overlay_selection],
+                        selection_x,
+                        (int32_t)(view.selection_row * view.cell_height -
+                                  view.scroll_y),
+                        (int32_t)(view.selection_cols * view.cell_width),
+                        (int32_t)(view.selection_rows * view.cell_height),
+                        roll);
+                }
+                if (overlays_created && audio->meters) {
+                    // the latest readings, whatever blocks ran in between:
+                    // master peaks and loudness at the right edge, the
+                    // spectrum in the bottom quarter beside them
+                    MeterReading master;
+                    meter_read(audio->meters, audio_node_master, &master);
+                    float levels[3] = {
+                        meter_db(master.peak[0]),
+                        meter_db(master.peak[1]),
+                        meter_lufs(master.short_term),
+                    };
+                    int32_t meter_x =
+                        (int32_t)width - 2 * overlay_meter_width;
+                    // readings over 0 dB would reach above the window
+                    int32_t window[4] = {0, 0, (int32_t)width, (int32_t)height};
+                    for (uint32_t i = 0; i < 2; i++) {
+                        int32_t h = (int32_t)((1.0f - levels[i] /
+                                                          meter_floor_db) *
+                                              height);
+                        wayland_overlay_place(
+                            fd,
+                            &overlays[overlay_meter_left + i],
+                            meter_x + (int32_t)i * overlay_meter_width,
+                            (int32_t)height - h,
+                            overlay_meter_width - 1,
+                            h,
+                            window);
+                    }
+                    int32_t loudness_y = (int32_t)(levels[2] /
+                                                   meter_floor_db * height);
+                    wayland_overlay_place(
+                        fd,
+                        &overlays[overlay_loudness],
+                        meter_x,
+                        loudness_y,
+                        loudness_y < (int32_t)height - 2
+                            ? 2 * overlay_meter_width
+                            : 0,
+                        2,
+                        window);
+                    float bands[overlay_spectrum_bands];
+                    meter_bands(meter_read_spectrum(audio->meters),
+                                audio->sample_rate,
+                                overlay_band_low_hz,
+                                overlay_band_high_hz,
+                                bands,
+                                overlay_spectrum_bands);
+                    int32_t band_x =
+                        meter_x -
+                        overlay_spectrum_bands * overlay_band_width - 4;
+                    for (uint32_t i = 0; i < overlay_spectrum_bands; i++) {
+                        int32_t h = (int32_t)((1.0f - bands[i] /
+                                                          meter_floor_db) *
+                                              height / 4);
+                        wayland_overlay_place(
+                            fd,
+                            &overlays[overlay_spectrum + i],
+                            band_x + (int32_t)i * overlay_band_width,
+                            (int32_t)height - h,
+                            overlay_band_width - 1,
+                            h,
+                            window);
+                    }
+                }
+
+                // scrolling within the margin costs only this request
+                uint8_t set_source[24];
+                write_le32(set_source, wp_viewport_id);
+                write_le16(set_source + 4, 1);
+                write_le16(set_source + 6, 24);
+                write_le32(set_source + 8, float_to_fixed(canvas_src_x));
+                write_le32(set_source + 12, 0);
+                write_le32(set_source + 16, float_to_fixed(width));
+                write_le32(set_source + 20, float_to_fixed(height));
+                dump_bytes("wp_viewport::set_source request", set_source, 24);
+                ssize_t set_source_written = write(fd, set_source, 24);
+                assert(set_source_written == 24);
+
+                // the server already destroyed the old callback, reuse its id
+                uint8_t next_frame[12];
+                write_le32(next_frame, wl_surface_id);
+                write_le16(next_frame + 4, 3);
+                write_le16(next_frame + 6, 12);
+                write_le32(next_frame + 8, wl_callback_id);
+                dump_bytes("wl_surface::frame request", next_frame, 12);
+                ssize_t next_frame_written = write(fd, next_frame, 12);
+                assert(next_frame_written == 12);
+
+                uint8_t frame_commit[8];
+                write_le32(frame_commit, wl_surface_id);
+                write_le16(frame_commit + 4, 6);
+                write_le16(frame_commit + 6, 8);
+                dump_bytes("wl_surface_commit request", frame_commit, 8);
+                ssize_t frame_commit_written = write(fd, frame_commit, 8);
+                assert(frame_commit_written == 8);
+#endif
                 goto done;
             wl_display_error:
                 dump_bytes("wl_display::error event", buffer + offset, size);
@@ -556,6 +1115,12 @@ void wayland_init() {
                 ssize_t ack_configure_written = write(fd, ack_configure, 12);
                 assert(ack_configure_written == 12);
 
+                PianoRollView configure_view = view;
+                configure_view.width = canvas_width;
+                configure_view.scroll_x = canvas_scroll_x;
+                vulkan_render_frame(&vulkan_context, &configure_view);
+                canvas_dirty = 0;
+
                 uint8_t attach[20];
                 write_le32(attach, wl_surface_id);
                 write_le16(attach + 4, 1);
@@ -579,13 +1144,80 @@ void wayland_init() {
                 ssize_t damage_written = write(fd, damage, 24);
                 assert(damage_written == 24);
 
-                uint8_t commit[8];
-                write_le32(commit, wl_surface_id);
-                write_le16(commit + 4, 6);
-                write_le16(commit + 6, 8);
-                dump_bytes("wl_surface_commit request", commit, 8);
-                ssize_t commit_written = write(fd, commit, 8);
-                assert(commit_written == 8);
+                uint8_t viewport_source[24];
+                write_le32(viewport_source, wp_viewport_id);
+                write_le16(viewport_source + 4, 1);
+                write_le16(viewport_source + 6, 24);
+                write_le32(viewport_source + 8,
+                           float_to_fixed(view.scroll_x - canvas_scroll_x));
+                write_le32(viewport_source + 12, 0);
+                write_le32(viewport_source + 16, float_to_fixed(width));
+                write_le32(viewport_source + 20, float_to_fixed(height));
+                dump_bytes(
+                    "wp_viewport::set_source request", viewport_source, 24);
+                ssize_t viewport_source_written =
+                    write(fd, viewport_source, 24);
+                assert(viewport_source_written == 24);
+
+                uint8_t viewport_destination[16];
+                write_le32(viewport_destination, wp_viewport_id);
+                write_le16(viewport_destination + 4, 2);
+                write_le16(viewport_destination + 6, 16);
+                write_le32(viewport_destination + 8, width);
+                write_le32(viewport_destination + 12, height);
+                dump_bytes("wp_viewport::set_destination request",
+                           viewport_destination,
+                           16);
+                ssize_t viewport_destination_written =
+                    write(fd, viewport_destination, 16);
+                assert(viewport_destination_written == 16);
+
+                // same buffer, cropped to the sidebar at canvas x = 0
+                uint8_t sidebar_attach[20];
+                write_le32(sidebar_attach, sidebar_surface_id);
+                write_le16(sidebar_attach + 4, 1);
+                write_le16(sidebar_attach + 6, 20);
+                write_le32(sidebar_attach + 8, wl_buffer_id);
+                write_le32(sidebar_attach + 12, 0);
+                write_le32(sidebar_attach + 16, 0);
+                dump_bytes("wl_surface_attach request", sidebar_attach, 20);
+                ssize_t sidebar_attach_written = write(fd, sidebar_attach, 20);
+                assert(sidebar_attach_written == 20);
+
+                uint8_t sidebar_source[24];
+                write_le32(sidebar_source, sidebar_viewport_id);
+                write_le16(sidebar_source + 4, 1);
+                write_le16(sidebar_source + 6, 24);
+                write_le32(sidebar_source + 8, 0);
+                write_le32(sidebar_source + 12, 0);
+                write_le32(sidebar_source + 16,
+                           float_to_fixed(view.sidebar_width));
+                write_le32(sidebar_source + 20, float_to_fixed(height));
+                dump_bytes(
+                    "wp_viewport::set_source request", sidebar_source, 24);
+                ssize_t sidebar_source_written = write(fd, sidebar_source, 24);
+                assert(sidebar_source_written == 24);
+
+                uint8_t sidebar_destination[16];
+                write_le32(sidebar_destination, sidebar_viewport_id);
+                write_le16(sidebar_destination + 4, 2);
+                write_le16(sidebar_destination + 6, 16);
+                write_le32(sidebar_destination + 8, view.sidebar_width);
+                write_le32(sidebar_destination + 12, height);
+                dump_bytes("wp_viewport::set_destination request",
+                           sidebar_destination,
+                           16);
+                ssize_t sidebar_destination_written =
+                    write(fd, sidebar_destination, 16);
+                assert(sidebar_destination_written == 16);
+
+                uint8_t sidebar_commit[8];
+                write_le32(sidebar_commit, sidebar_surface_id);
+                write_le16(sidebar_commit + 4, 6);
+                write_le16(sidebar_commit + 6, 8);
+                dump_bytes("wl_surface_commit request", sidebar_commit, 8);
+                ssize_t sidebar_commit_written = write(fd, sidebar_commit, 8);
+                assert(sidebar_commit_written == 8);
 
                 uint8_t frame[12];
                 write_le32(frame, wl_surface_id);
@@ -598,6 +1230,14 @@ void wayland_init() {
                 wl_callback_id = new_id;
                 obj_op[obj_op_index(wl_callback_id, 0)] = &&wl_callback_done;
                 new_id++;
+
+                uint8_t commit[8];
+                write_le32(commit, wl_surface_id);
+                write_le16(commit + 4, 6);
+                write_le16(commit + 6, 8);
+                dump_bytes("wl_surface_commit request", commit, 8);
+                ssize_t commit_written = write(fd, commit, 8);
+                assert(commit_written == 8);
 #endif
 #if WL_SHM
                 uint8_t shm_ack_configure[12];
@@ -715,7 +1355,7 @@ void wayland_init() {
                 uint8_t tail[20];
                 write_le32(tail, 0);
                 write_le32(tail + 4, 0);
-                write_le32(tail + 8, stride);
+                write_le32(tail + 8, canvas_stride);
                 write_le32(tail + 12, 0);
                 write_le32(tail + 16, 0);
                 struct iovec iov[2] = {
@@ -757,7 +1397,7 @@ void wayland_init() {
                                // variables names
                 write_le16(create_immed + 6, 28);
                 write_le32(create_immed + 8, new_id);
-                write_le32(create_immed + 12, width);
+                write_le32(create_immed + 12, canvas_width);
                 write_le32(create_immed + 16, height);
                 write_le32(create_immed + 20, DRM_FORMAT_ARGB8888);
                 write_le32(create_immed + 24, 0);
@@ -818,6 +1458,10 @@ void wayland_init() {
                            buffer + offset,
                            size);
                 goto done;
+            wl_subcompositor_jump:
+                dump_bytes(
+                    "wl_subcompositor_jump event", buffer + offset, size);
+                goto done;
             wl_compositor_jump:
                 dump_bytes("wl_compositor_jump event", buffer + offset, size);
                 goto done;
@@ -1018,6 +1662,51 @@ void wayland_init() {
                 goto done;
             wl_keyboard_key:
                 dump_bytes("wl_keyboard_key event", buffer + offset, size);
+#if DMABUF
+                enum {
+                    key_space = 57,
+                    key_j = 36,
+                    key_k = 37,
+                    wl_keyboard_key_state_pressed = 1,
+                };
+                uint32_t key = read_le32(buffer + offset + 16);
+                uint8_t pressed = read_le32(buffer + offset + 20) ==
+                                  wl_keyboard_key_state_pressed;
+                // j and k move the cursor a semitone and sound the pitch
+                // it lands on; the note goes to the engine before the
+                // view changes, so it never waits on the frame
+                if ((key == key_j || key == key_k) && pressed) {
+                    uint32_t row = view.cursor_row;
+                    if (key == key_j && row < pitch_count - 1) row++;
+                    if (key == key_k && row > 0) row--;
+                    uint64_t ns = midi_now_ns();
+                    if (auditioning < pitch_count) {
+                        audio_audition(
+                            audio, audio_cmd_note_off, auditioning, 0.0f, ns);
+                    }
+                    auditioning = pitch_count - 1 - row;
+                    audio_audition(
+                        audio, audio_cmd_note_on, auditioning, 0.8f, ns);
+                    view.cursor_row = row;
+                } else if ((key == key_j || key == key_k) &&
+                           auditioning < pitch_count) {
+                    audio_audition(audio,
+                                   audio_cmd_note_off,
+                                   auditioning,
+                                   0.0f,
+                                   midi_now_ns());
+                    auditioning = pitch_count;
+                }
+                if (key == key_space && pressed) {
+                    playing = !playing;
+                    if (playing) audio_set_track(audio, &note_track);
+                    audio_send(audio,
+                               playing ? audio_cmd_play : audio_cmd_stop,
+                               0,
+                               0.0f,
+                               0);
+                }
+#endif
                 goto done;
             wl_keyboard_modifiers:
                 dump_bytes(
@@ -1041,6 +1730,28 @@ void wayland_init() {
                 goto done;
             wl_pointer_axis:
                 dump_bytes("wl_pointer_axis event", buffer + offset, size);
+#if DMABUF
+                enum {
+                    wl_pointer_axis_vertical_scroll = 0,
+                    wl_pointer_axis_horizontal_scroll = 1,
+                };
+                uint32_t axis = read_le32(buffer + offset + 12);
+                float axis_value =
+                    fixed_to_float((int32_t)read_le32(buffer + offset + 16));
+                if (axis == wl_pointer_axis_horizontal_scroll) {
+                    // picked up by the viewport on the next frame
+                    view.scroll_x += axis_value;
+                    if (view.scroll_x < 0) view.scroll_x = 0;
+                } else if (axis == wl_pointer_axis_vertical_scroll) {
+                    float max_scroll_y =
+                        pitch_count * view.cell_height - (float)height;
+                    view.scroll_y += axis_value;
+                    if (view.scroll_y > max_scroll_y)
+                        view.scroll_y = max_scroll_y;
+                    if (view.scroll_y < 0) view.scroll_y = 0;
+                    canvas_dirty = 1;
+                }
+#endif
                 goto done;
             wl_pointer_frame:
                 dump_bytes("wl_pointer_frame event", buffer + offset, size);
@@ -1147,6 +1858,90 @@ void wayland_registry_bind(
     end("reg_bind request");
 }
 
+// the overlay cut to clip (left, top, right, bottom), hidden when
+// nothing of it is left
+void wayland_overlay_place(int fd,
+                           OverlaySurface* overlay,
+                           int32_t x,
+                           int32_t y,
+                           int32_t w,
+                           int32_t h,
+                           const int32_t clip[4]) {
+    int32_t right = x + w < clip[2] ? x + w : clip[2];
+    int32_t bottom = y + h < clip[3] ? y + h : clip[3];
+    if (x < clip[0]) x = clip[0];
+    if (y < clip[1]) y = clip[1];
+    wayland_overlay_update(fd, overlay, x, y, right - x, bottom - y);
+}
+
+void wayland_overlay_update(int fd,
+                            OverlaySurface* overlay,
+                            int32_t x,
+                            int32_t y,
+                            int32_t w,
+                            int32_t h) {
+    if (w <= 0 || h <= 0) {
+        w = 0;
+        h = 0;
+    }
+    uint8_t visibility_changed = (w == 0) != (overlay->w == 0);
+    uint8_t size_changed = w != overlay->w || h != overlay->h;
+    uint8_t position_changed = x != overlay->x || y != overlay->y;
+    if (!size_changed && !position_changed) return;
+
+    if (w && position_changed) {
+        // parent state: applied by the next commit of the main surface
+        uint8_t set_position[16];
+        write_le32(set_position, overlay->subsurface_id);
+        write_le16(set_position + 4, 1);
+        write_le16(set_position + 6, 16);
+        write_le32(set_position + 8, x);
+        write_le32(set_position + 12, y);
+        dump_bytes("wl_subsurface::set_position request", set_position, 16);
+        ssize_t set_position_written = write(fd, set_position, 16);
+        assert(set_position_written == 16);
+        overlay->x = x;
+        overlay->y = y;
+    }
+    if (size_changed) {
+        if (visibility_changed) {
+            // attaching a null buffer unmaps the subsurface
+            uint8_t attach[20];
+            write_le32(attach, overlay->surface_id);
+            write_le16(attach + 4, 1);
+            write_le16(attach + 6, 20);
+            write_le32(attach + 8, w ? overlay->buffer_id : 0);
+            write_le32(attach + 12, 0);
+            write_le32(attach + 16, 0);
+            dump_bytes("wl_surface_attach request", attach, 20);
+            ssize_t attach_written = write(fd, attach, 20);
+            assert(attach_written == 20);
+        }
+        if (w) {
+            uint8_t set_destination[16];
+            write_le32(set_destination, overlay->viewport_id);
+            write_le16(set_destination + 4, 2);
+            write_le16(set_destination + 6, 16);
+            write_le32(set_destination + 8, w);
+            write_le32(set_destination + 12, h);
+            dump_bytes("wp_viewport::set_destination request",
+                       set_destination,
+                       16);
+            ssize_t set_destination_written = write(fd, set_destination, 16);
+            assert(set_destination_written == 16);
+        }
+        uint8_t commit[8];
+        write_le32(commit, overlay->surface_id);
+        write_le16(commit + 4, 6);
+        write_le16(commit + 6, 8);
+        dump_bytes("wl_surface_commit request", commit, 8);
+        ssize_t commit_written = write(fd, commit, 8);
+        assert(commit_written == 8);
+        overlay->w = w;
+        overlay->h = h;
+    }
+}
+
 int wayland_make_fd() {
     header("make fd");
 
@@ -0,0 +1,194 @@
+// WAR - make music with vim motions
+// Copyright (C) 2025 Nick Monaco
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+//=============================================================================
+// tools/war-top.c
+//=============================================================================
+
+// war-top [-1] [stats file]: per node and per block timings of a running
+// WAR, once a second. The file is mapped read-only and copied out, so the
+// engine never waits on it. Without a path it takes the newest
+// /dev/shm/war-stats.*; -1 prints one interval and exits
+
+#include "data.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    war_top_interval_ms = 1000,
+    war_top_retries = 100,
+};
+
+// a consistent copy: names and node count from one generation
+int war_top_snapshot(const StatsPage* page, StatsPage* copy) {
+    for (uint32_t i = 0; i < war_top_retries; i++) {
+        uint32_t generation =
+            __atomic_load_n(&page->generation, __ATOMIC_ACQUIRE);
+        if (generation & 1) continue;
+        memcpy(copy, page, sizeof(StatsPage));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->generation, __ATOMIC_RELAXED) == generation)
+            return 1;
+    }
+    return 0;
+}
+
+// upper bound of the bucket the 99th percentile falls in
+double war_top_p99_us(const uint64_t* now, const uint64_t* then) {
+    uint64_t total = 0;
+    for (uint32_t b = 0; b < stats_buckets; b++) total += now[b] - then[b];
+    if (!total) return 0.0;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < stats_buckets; b++) {
+        seen += now[b] - then[b];
+        if (seen * 100 >= total * 99) return (double)(2ull << b) / 1e3;
+    }
+    return 0.0;
+}
+
+void war_top_print(const StatsPage* now,
+                   const StatsPage* then,
+                   double wall_ns) {
+    uint64_t blocks = now->blocks - then->blocks;
+    uint64_t block_ns = now->block_ns_total - then->block_ns_total;
+    uint64_t budget_ns = now->budget_ns_total - then->budget_ns_total;
+    printf("pid %d, %u Hz: %" PRIu64 " blocks, %" PRIu64
+           " over budget (%" PRIu64 " total), load %.1f%%, block avg %.1f "
+           "us p99 %.1f us worst %.1f us\n",
+           now->pid,
+           now->sample_rate,
+           blocks,
+           now->misses - then->misses,
+           now->misses,
+           budget_ns ? 100.0 * block_ns / budget_ns : 0.0,
+           blocks ? block_ns / 1e3 / blocks : 0.0,
+           war_top_p99_us(now->block_histogram, then->block_histogram),
+           now->block_ns_max / 1e3);
+    printf("%-24s %8s %9s %9s %9s %8s %6s\n",
+           "node",
+           "calls",
+           "avg us",
+           "p99 us",
+           "max us",
+           "%budget",
+           "%cpu");
+    for (uint32_t i = 0; i < now->node_count && i < max_graph_nodes; i++) {
+        const StatsNode* node = &now->nodes[i];
+        const StatsNode* old = &then->nodes[i];
+        uint64_t calls = node->calls - old->calls;
+        uint64_t ns = node->ns_total - old->ns_total;
+        printf("%-24.24s %8" PRIu64 " %9.2f %9.2f %9.2f %7.2f%% %5.1f%%\n",
+               node->name,
+               calls,
+               calls ? ns / 1e3 / calls : 0.0,
+               war_top_p99_us(node->histogram, old->histogram),
+               node->ns_max / 1e3,
+               budget_ns ? 100.0 * ns / budget_ns : 0.0,
+               wall_ns > 0 ? 100.0 * ns / wall_ns : 0.0);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int once = 0;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-1")) {
+            once = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    glob_t found = {0};
+    if (!path) {
+        time_t newest = 0;
+        if (glob("/dev/shm/war-stats.*", 0, NULL, &found) == 0) {
+            for (size_t i = 0; i < found.gl_pathc; i++) {
+                struct stat st;
+                if (stat(found.gl_pathv[i], &st) || st.st_mtime < newest)
+                    continue;
+                newest = st.st_mtime;
+                path = found.gl_pathv[i];
+            }
+        }
+        if (!path) {
+            fprintf(stderr, "war-top: no WAR running with stats on\n");
+            return 1;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "war-top: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    const StatsPage* page =
+        mmap(NULL, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED ||
+        __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != stats_magic ||
+        page->version != stats_version) {
+        fprintf(stderr, "war-top: %s is not a WAR stats file\n", path);
+        return 1;
+    }
+    printf("war-top: %s\n", path);
+
+    StatsPage* then = malloc(sizeof(StatsPage));
+    StatsPage* now = malloc(sizeof(StatsPage));
+    if (!then || !now || !war_top_snapshot(page, then)) return 1;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (;;) {
+        struct timespec wait = {
+            .tv_sec = war_top_interval_ms / 1000,
+            .tv_nsec = (war_top_interval_ms % 1000) * 1000000L,
+        };
+        nanosleep(&wait, NULL);
+        if (kill(page->pid, 0) && errno == ESRCH) {
+            printf("war-top: pid %d is gone\n", page->pid);
+            break;
+        }
+        if (!war_top_snapshot(page, now)) continue;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double wall_ns = (t1.tv_sec - t0.tv_sec) * 1e9 +
+                         (double)(t1.tv_nsec - t0.tv_nsec);
+        // nodes were renumbered: this interval has no baseline
+        if (now->generation == then->generation)
+            war_top_print(now, then, wall_ns);
+        StatsPage* swap = then;
+        then = now;
+        now = swap;
+        t0 = t1;
+        if (once) break;
+    }
+    free(then);
+    free(now);
+    globfree(&found);
+    return 0;
+}